@@ -200,9 +200,9 @@ func set_history(messages: Array) -> void:
         })
         agent_node.add_message(role, content)
 
-func enqueue_action(name: String, params: Dictionary = {}):
+func enqueue_action(name: String, params: Dictionary = {}, options: Dictionary = {}):
     if _ensure_agent_node() and agent_node:
-        agent_node.enqueue_action(name, params)
+        agent_node.enqueue_action(name, params, options)
 
 func _ensure_agent_node() -> bool:
     if agent_node and is_instance_valid(agent_node):
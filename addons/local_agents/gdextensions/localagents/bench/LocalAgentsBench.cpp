@@ -0,0 +1,675 @@
+// localagents_bench: drives the same InferenceEngine AgentRuntime uses, without Godot, over a
+// fixed set of agent-shaped scenarios and a sweep of thread / batch / context settings, and
+// writes one JSON document per run so results can be diffed across commits.
+//
+//   localagents_bench --model bench/tiny-llama.gguf --threads 1,4 --batch 64,512 --ctx 1024,4096
+//                     --out bench_results.json
+//
+// Suites: cognition (short decision prompt), dialogue (long multi-turn history), embedding
+// (bulk embed_text), concurrent (N agent threads contending for one engine, as AgentNodes do
+// for AgentRuntime's lock), replay (re-issue a trace captured with AgentRuntime.start_trace).
+//
+//   localagents_bench --model npc.gguf --replay session.latrace --replay-speed 4 --agents 8
+
+#include "InferenceEngine.hpp"
+#include "ModelPrefetcher.hpp"
+#include "RuntimeMetrics.hpp"
+#include "TraceLog.hpp"
+
+#include <llama.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef LOCAL_AGENTS_BENCH_GIT_COMMIT
+#define LOCAL_AGENTS_BENCH_GIT_COMMIT "unknown"
+#endif
+
+using local_agents::runtime::ChatMessage;
+using local_agents::runtime::GenerationRequest;
+using local_agents::runtime::GenerationResult;
+using local_agents::runtime::InferenceEngine;
+using local_agents::runtime::ModelLoadOptions;
+using local_agents::runtime::ModelPrefetcher;
+using local_agents::runtime::PrefetchOptions;
+using local_agents::runtime::PrefetchState;
+using local_agents::runtime::RuntimeMetrics;
+using local_agents::runtime::ThreadingOptions;
+using local_agents::runtime::TraceKind;
+using local_agents::runtime::TraceRecord;
+
+namespace {
+
+struct BenchOptions {
+    std::string model_path;
+    std::vector<std::string> suites = {"cognition", "dialogue", "embedding", "concurrent"};
+    std::vector<int32_t> threads;
+    std::vector<int32_t> batch_sizes = {512};
+    std::vector<int32_t> context_sizes = {4096};
+    std::vector<int32_t> contexts = {1};
+    int32_t repeat = 5;
+    int32_t warmup = 1;
+    int32_t agents = 4;
+    int32_t embedding_count = 64;
+    int32_t n_gpu_layers = 0;
+    int32_t poll = 0;
+    bool prefetch = false;
+    std::string cpu_mask;
+    std::string label;
+    std::string out_path;
+    std::string replay_path;
+    double replay_speed = 1.0;        // 0 = issue every record as soon as a worker is free
+    std::vector<TraceRecord> trace;   // read once from replay_path, in start order
+};
+
+struct Sample {
+    double ttft_ms = 0.0;
+    double total_ms = 0.0;
+    int32_t prompt_tokens = 0;
+    int32_t completion_tokens = 0;
+};
+
+struct SuiteResult {
+    std::string suite;
+    int32_t threads = 0;
+    int32_t batch_size = 0;
+    int32_t context_size = 0;
+    int32_t contexts = 1;
+    double wall_ms = 0.0;
+    int32_t errors = 0;
+    std::string last_error;
+    std::vector<Sample> samples;
+    std::vector<RuntimeMetrics::Sample> metrics;
+    int32_t skipped = 0;                  // replay: hash-only records
+    int32_t deterministic_checked = 0;    // replay: greedy records whose output was compared
+    int32_t deterministic_mismatches = 0;
+};
+
+// ---- synthetic, deterministic prompt text ---------------------------------------------
+
+const char *const kWords[] = {
+    "the", "village", "river", "food", "water", "wood", "stone", "trade", "build", "walk",
+    "gather", "rest", "talk", "help", "night", "morning", "market", "house", "farm", "field",
+    "fish", "forest", "north", "south", "east", "west", "fire", "tool", "storm", "rain",
+    "winter", "summer", "plan", "move", "speak", "ask", "answer", "remember", "goal", "task",
+    "need", "find", "carry", "eat", "sleep", "guard", "scout", "people", "time", "work",
+};
+
+class WordStream {
+public:
+    explicit WordStream(uint32_t seed) : state_(seed ? seed : 1u) {}
+
+    std::string sentence(int words) {
+        std::string out;
+        for (int i = 0; i < words; ++i) {
+            state_ = state_ * 1664525u + 1013904223u;
+            if (!out.empty()) {
+                out += ' ';
+            }
+            out += kWords[(state_ >> 8) % (sizeof(kWords) / sizeof(kWords[0]))];
+        }
+        out += '.';
+        return out;
+    }
+
+private:
+    uint32_t state_;
+};
+
+const char *const kSystemPrompt =
+    "You are Local Agents, an offline assistant running inside a Godot game. Be concise and helpful.";
+
+std::string cognition_prompt(int variant) {
+    WordStream words(static_cast<uint32_t>(1000 + variant));
+    std::ostringstream prompt;
+    prompt << "Situation: " << words.sentence(24) << " Needs: " << words.sentence(8)
+           << " Choose your next action and answer with one short sentence.";
+    return InferenceEngine::render_prompt(kSystemPrompt, {}, prompt.str());
+}
+
+std::string dialogue_prompt(int variant, int32_t context_size) {
+    WordStream words(static_cast<uint32_t>(2000 + variant));
+    // ~40 tokens per turn on a word-level vocab; keep a quarter of the window free for output
+    // and tokenizer slack so every context size in the sweep gets a full-but-valid prompt.
+    const int turns = std::max(2, std::min(48, (context_size * 3 / 4) / 48));
+    std::vector<ChatMessage> history;
+    history.reserve(static_cast<size_t>(turns));
+    for (int i = 0; i < turns; ++i) {
+        history.push_back({i % 2 == 0 ? "user" : "assistant", words.sentence(32)});
+    }
+    return InferenceEngine::render_prompt(kSystemPrompt, history, "Summarize what we agreed to do next.");
+}
+
+// ---- stats / JSON -----------------------------------------------------------------------
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    const double rank = p / 100.0 * static_cast<double>(values.size() - 1);
+    const size_t lower = static_cast<size_t>(rank);
+    const size_t upper = std::min(lower + 1, values.size() - 1);
+    const double fraction = rank - static_cast<double>(lower);
+    return values[lower] + (values[upper] - values[lower]) * fraction;
+}
+
+std::string json_escape(const std::string &text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+void write_distribution(std::ostream &out, const char *name, const std::vector<double> &values) {
+    double sum = 0.0;
+    for (double value : values) {
+        sum += value;
+    }
+    out << "\"" << name << "\": {"
+        << "\"mean\": " << (values.empty() ? 0.0 : sum / static_cast<double>(values.size()))
+        << ", \"p50\": " << percentile(values, 50.0)
+        << ", \"p90\": " << percentile(values, 90.0)
+        << ", \"p99\": " << percentile(values, 99.0)
+        << ", \"min\": " << (values.empty() ? 0.0 : *std::min_element(values.begin(), values.end()))
+        << ", \"max\": " << (values.empty() ? 0.0 : *std::max_element(values.begin(), values.end()))
+        << "}";
+}
+
+void write_result(std::ostream &out, const SuiteResult &result) {
+    std::vector<double> ttft;
+    std::vector<double> latency;
+    int64_t prompt_tokens = 0;
+    int64_t completion_tokens = 0;
+    double busy_ms = 0.0;
+    for (const Sample &sample : result.samples) {
+        ttft.push_back(sample.ttft_ms);
+        latency.push_back(sample.total_ms);
+        prompt_tokens += sample.prompt_tokens;
+        completion_tokens += sample.completion_tokens;
+        busy_ms += sample.total_ms;
+    }
+    const double wall_s = result.wall_ms / 1000.0;
+
+    out << "    {\"suite\": \"" << result.suite << "\""
+        << ", \"threads\": " << result.threads
+        << ", \"batch_size\": " << result.batch_size
+        << ", \"context_size\": " << result.context_size
+        << ", \"contexts\": " << result.contexts
+        << ", \"runs\": " << result.samples.size()
+        << ", \"errors\": " << result.errors;
+    if (!result.last_error.empty()) {
+        out << ", \"last_error\": \"" << json_escape(result.last_error) << "\"";
+    }
+    out << ", \"wall_ms\": " << result.wall_ms
+        << ", \"prompt_tokens\": " << prompt_tokens
+        << ", \"completion_tokens\": " << completion_tokens
+        << ", \"requests_per_second\": " << (wall_s > 0.0 ? static_cast<double>(result.samples.size()) / wall_s : 0.0)
+        << ", \"completion_tokens_per_second\": " << (wall_s > 0.0 ? static_cast<double>(completion_tokens) / wall_s : 0.0)
+        << ", \"busy_ms\": " << busy_ms << ",\n      ";
+    write_distribution(out, "ttft_ms", ttft);
+    out << ",\n      ";
+    write_distribution(out, "latency_ms", latency);
+    if (result.suite == "replay") {
+        out << ",\n      \"replay\": {\"skipped\": " << result.skipped
+            << ", \"deterministic_checked\": " << result.deterministic_checked
+            << ", \"deterministic_mismatches\": " << result.deterministic_mismatches << "}";
+    }
+    out << ",\n      \"runtime_metrics\": {";
+    for (size_t i = 0; i < result.metrics.size(); ++i) {
+        out << (i ? ", " : "") << "\"" << result.metrics[i].name << "\": " << result.metrics[i].value;
+    }
+    out << "}}";
+}
+
+// ---- suites -----------------------------------------------------------------------------
+
+double ms_since(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+GenerationRequest make_request(const std::string &prompt, int32_t max_tokens, int32_t batch_size) {
+    GenerationRequest request;
+    request.prompt = prompt;
+    request.sampling.temperature = 0.0f;
+    request.sampling.seed = 42;
+    request.max_tokens = max_tokens;
+    request.batch_size = batch_size;
+    return request;
+}
+
+void record(SuiteResult &result, const GenerationResult &generated, double total_ms) {
+    if (!generated.ok) {
+        ++result.errors;
+        result.last_error = generated.error;
+        return;
+    }
+    result.samples.push_back({generated.ttft_ms, total_ms, generated.prompt_tokens, generated.completion_tokens});
+}
+
+void run_generation_suite(InferenceEngine &engine, const BenchOptions &options, SuiteResult &result,
+                          bool dialogue) {
+    const int32_t max_tokens = dialogue ? 64 : 16;
+    for (int32_t i = 0; i < options.warmup + options.repeat; ++i) {
+        const std::string prompt = dialogue ? dialogue_prompt(i, result.context_size) : cognition_prompt(i);
+        const GenerationRequest request = make_request(prompt, max_tokens, result.batch_size);
+        const auto started = std::chrono::steady_clock::now();
+        GenerationResult generated = engine.generate(request, started);
+        const double total_ms = ms_since(started);
+        if (i >= options.warmup) {
+            record(result, generated, total_ms);
+        }
+    }
+}
+
+void run_embedding_suite(InferenceEngine &engine, const BenchOptions &options, SuiteResult &result) {
+    WordStream words(3000);
+    std::vector<std::string> texts;
+    for (int32_t i = 0; i < options.embedding_count; ++i) {
+        texts.push_back(words.sentence(12 + (i % 5) * 4));
+    }
+    std::vector<float> embedding;
+    std::string error;
+    for (int32_t pass = 0; pass < options.warmup + options.repeat; ++pass) {
+        for (const std::string &text : texts) {
+            const auto started = std::chrono::steady_clock::now();
+            const bool ok = engine.embed(text, true, true, embedding, error);
+            const double total_ms = ms_since(started);
+            if (pass < options.warmup) {
+                continue;
+            }
+            if (!ok) {
+                ++result.errors;
+                result.last_error = error;
+                continue;
+            }
+            result.samples.push_back({total_ms, total_ms, 0, 0});
+        }
+    }
+}
+
+void run_concurrent_suite(InferenceEngine &engine, const BenchOptions &options, SuiteResult &result) {
+    // Agents call generate() directly, as AgentNodes do through AgentRuntime: with more agents
+    // than --contexts they queue for a free context, and latency includes that wait, like TTFT
+    // in the runtime metrics. Each agent keeps its own conversation id, so affinity holds.
+    std::mutex result_mutex;
+    std::vector<std::thread> agents;
+    for (int32_t agent = 0; agent < options.agents; ++agent) {
+        agents.emplace_back([&, agent]() {
+            for (int32_t i = 0; i < options.repeat; ++i) {
+                GenerationRequest request = make_request(cognition_prompt(agent * 1000 + i), 16, result.batch_size);
+                request.conversation_id = "agent-" + std::to_string(agent);
+                const auto started = std::chrono::steady_clock::now();
+                const GenerationResult generated = engine.generate(request, started);
+                const double total_ms = ms_since(started);
+                std::scoped_lock lock(result_mutex);
+                record(result, generated, total_ms);
+            }
+        });
+    }
+    for (std::thread &thread : agents) {
+        thread.join();
+    }
+}
+
+void run_replay_suite(InferenceEngine &engine, const BenchOptions &options, SuiteResult &result) {
+    // Open loop: each record is due at its captured offset (scaled by --replay-speed) and its
+    // latency runs from that due time, so a backlog behind --agents workers shows up as
+    // queueing rather than silently stretching the schedule.
+    std::mutex result_mutex;
+    std::atomic<size_t> next{0};
+    const auto origin = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int32_t worker = 0; worker < options.agents; ++worker) {
+        workers.emplace_back([&]() {
+            std::vector<float> embedding;
+            for (size_t index = next.fetch_add(1); index < options.trace.size(); index = next.fetch_add(1)) {
+                const TraceRecord &recorded = options.trace[index];
+                if (recorded.request.prompt.empty()) {
+                    std::scoped_lock lock(result_mutex);
+                    ++result.skipped;
+                    continue;
+                }
+                auto due = origin;
+                if (options.replay_speed > 0.0) {
+                    due += std::chrono::microseconds(
+                        static_cast<int64_t>(static_cast<double>(recorded.start_us) / options.replay_speed));
+                    std::this_thread::sleep_until(due);
+                } else {
+                    due = std::chrono::steady_clock::now();
+                }
+
+                GenerationResult generated;
+                uint64_t output_hash = 0;
+                if (recorded.kind == TraceKind::Embed) {
+                    generated.ok = engine.embed(recorded.request.prompt, recorded.add_bos, recorded.normalize,
+                                                embedding, generated.error);
+                    output_hash = local_agents::runtime::trace_hash(embedding.data(), embedding.size() * sizeof(float));
+                } else {
+                    GenerationRequest request = recorded.request;
+                    // Adapters are registered per process; the bench only has the base model.
+                    request.loras.clear();
+                    generated = engine.generate(request, due);
+                    output_hash = local_agents::runtime::trace_hash(generated.text);
+                }
+                const double total_ms = ms_since(due);
+
+                std::scoped_lock lock(result_mutex);
+                if (recorded.kind == TraceKind::Embed) {
+                    if (!generated.ok) {
+                        ++result.errors;
+                        result.last_error = generated.error;
+                    } else {
+                        result.samples.push_back({total_ms, total_ms, 0, 0});
+                    }
+                } else {
+                    record(result, generated, total_ms);
+                }
+                if (generated.ok && recorded.ok && local_agents::runtime::trace_is_deterministic(recorded) &&
+                    recorded.request.loras.empty()) {
+                    ++result.deterministic_checked;
+                    if (output_hash != recorded.output_hash) {
+                        ++result.deterministic_mismatches;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread &thread : workers) {
+        thread.join();
+    }
+}
+
+void run_suite(InferenceEngine &engine, const BenchOptions &options, SuiteResult &result) {
+    RuntimeMetrics::get().reset();
+    const auto started = std::chrono::steady_clock::now();
+    if (result.suite == "cognition") {
+        run_generation_suite(engine, options, result, false);
+    } else if (result.suite == "dialogue") {
+        run_generation_suite(engine, options, result, true);
+    } else if (result.suite == "embedding") {
+        run_embedding_suite(engine, options, result);
+    } else if (result.suite == "concurrent") {
+        run_concurrent_suite(engine, options, result);
+    } else if (result.suite == "replay") {
+        run_replay_suite(engine, options, result);
+    }
+    result.wall_ms = ms_since(started);
+    result.metrics = RuntimeMetrics::get().samples();
+}
+
+// ---- CLI ----------------------------------------------------------------------------------
+
+std::vector<std::string> split_list(const std::string &value) {
+    std::vector<std::string> items;
+    std::stringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+std::vector<int32_t> split_ints(const std::string &value) {
+    std::vector<int32_t> items;
+    for (const std::string &item : split_list(value)) {
+        items.push_back(static_cast<int32_t>(std::strtol(item.c_str(), nullptr, 10)));
+    }
+    return items;
+}
+
+void print_usage(const char *program) {
+    std::cerr << "Usage: " << program << " --model <path.gguf> [options]\n"
+              << "  --suite <list>       cognition,dialogue,embedding,concurrent (default: all)\n"
+              << "  --threads <list>     thread counts to sweep (default: hardware concurrency)\n"
+              << "  --batch <list>       n_batch values to sweep (default: 512)\n"
+              << "  --ctx <list>         n_ctx values to sweep (default: 4096)\n"
+              << "  --contexts <list>    context-pool sizes to sweep; threads are split between them (default: 1)\n"
+              << "  --repeat <n>         measured runs per suite (default: 5)\n"
+              << "  --warmup <n>         unmeasured runs per suite (default: 1)\n"
+              << "  --agents <n>         threads in the concurrent and replay suites (default: 4)\n"
+              << "  --embeddings <n>     texts per pass in the embedding suite (default: 64)\n"
+              << "  --n-gpu-layers <n>   layers to offload (default: 0)\n"
+              << "  --poll <0-100>       ggml threadpool busy-wait level (default: 0)\n"
+              << "  --cpu-mask <mask>    pin workers, \"0xF0\" or \"4-7\" (default: unpinned)\n"
+              << "  --prefetch           page the weights in alongside each load, as AgentRuntime does\n"
+              << "  --replay <path>      run only the replay suite over a trace from AgentRuntime.start_trace\n"
+              << "  --replay-speed <x>   1 = captured timing, 4 = four times faster, 0 = back to back (default: 1)\n"
+              << "  --label <text>       free-form tag stored in the results\n"
+              << "  --out <path>         write JSON here instead of stdout\n";
+}
+
+bool parse_args(int argc, char **argv, BenchOptions &options) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto next = [&](std::string &out) {
+            if (i + 1 >= argc) {
+                std::cerr << "error: " << arg << " expects a value\n";
+                return false;
+            }
+            out = argv[++i];
+            return true;
+        };
+        std::string value;
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "--model") {
+            if (!next(options.model_path)) return false;
+        } else if (arg == "--suite") {
+            if (!next(value)) return false;
+            options.suites = split_list(value);
+        } else if (arg == "--threads") {
+            if (!next(value)) return false;
+            options.threads = split_ints(value);
+        } else if (arg == "--batch") {
+            if (!next(value)) return false;
+            options.batch_sizes = split_ints(value);
+        } else if (arg == "--ctx") {
+            if (!next(value)) return false;
+            options.context_sizes = split_ints(value);
+        } else if (arg == "--contexts") {
+            if (!next(value)) return false;
+            options.contexts = split_ints(value);
+        } else if (arg == "--repeat") {
+            if (!next(value)) return false;
+            options.repeat = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--warmup") {
+            if (!next(value)) return false;
+            options.warmup = std::max(0, std::atoi(value.c_str()));
+        } else if (arg == "--agents") {
+            if (!next(value)) return false;
+            options.agents = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--embeddings") {
+            if (!next(value)) return false;
+            options.embedding_count = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--n-gpu-layers") {
+            if (!next(value)) return false;
+            options.n_gpu_layers = std::atoi(value.c_str());
+        } else if (arg == "--poll") {
+            if (!next(value)) return false;
+            options.poll = std::atoi(value.c_str());
+        } else if (arg == "--prefetch") {
+            options.prefetch = true;
+        } else if (arg == "--cpu-mask") {
+            if (!next(options.cpu_mask)) return false;
+        } else if (arg == "--replay") {
+            if (!next(options.replay_path)) return false;
+            options.suites = {"replay"};
+        } else if (arg == "--replay-speed") {
+            if (!next(value)) return false;
+            options.replay_speed = std::max(0.0, std::atof(value.c_str()));
+        } else if (arg == "--label") {
+            if (!next(options.label)) return false;
+        } else if (arg == "--out") {
+            if (!next(options.out_path)) return false;
+        } else {
+            std::cerr << "error: unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    if (options.model_path.empty()) {
+        std::cerr << "error: --model is required\n";
+        return false;
+    }
+    if (!options.replay_path.empty()) {
+        std::string error;
+        if (!local_agents::runtime::read_trace(options.replay_path, options.trace, error)) {
+            std::cerr << "error: " << error << "\n";
+            return false;
+        }
+        std::stable_sort(options.trace.begin(), options.trace.end(),
+                         [](const TraceRecord &a, const TraceRecord &b) { return a.start_us < b.start_us; });
+    }
+    if (options.threads.empty()) {
+        options.threads.push_back(static_cast<int32_t>(std::max(1u, std::thread::hardware_concurrency())));
+    }
+    return true;
+}
+
+void quiet_log(enum ggml_log_level level, const char *text, void *) {
+    if (level >= GGML_LOG_LEVEL_ERROR) {
+        std::fputs(text, stderr);
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    llama_log_set(quiet_log, nullptr);
+
+    std::vector<SuiteResult> results;
+    InferenceEngine engine;
+    ModelPrefetcher prefetcher;
+    double load_ms_total = 0.0;
+    double prefetch_ms_total = 0.0;
+    int32_t loads = 0;
+
+    for (int32_t contexts : options.contexts) {
+        for (int32_t context_size : options.context_sizes) {
+            for (int32_t batch_size : options.batch_sizes) {
+                ModelLoadOptions load;
+                load.n_gpu_layers = options.n_gpu_layers;
+                load.context_size = context_size;
+                load.batch_size = batch_size;
+                load.n_contexts = std::max(1, contexts);
+                std::string error;
+                const auto load_started = std::chrono::steady_clock::now();
+                if (options.prefetch) {
+                    prefetcher.start(options.model_path, PrefetchOptions());
+                }
+                if (!engine.load(options.model_path, load, error)) {
+                    std::cerr << "error: " << error << " (n_ctx=" << context_size << ", n_batch=" << batch_size
+                              << ", contexts=" << load.n_contexts << ")\n";
+                    return 1;
+                }
+                load_ms_total += ms_since(load_started);
+                ++loads;
+                if (options.prefetch) {
+                    // Suites measure the paged-in model; the wait is reported on its own.
+                    while (prefetcher.status().state == PrefetchState::Running) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    prefetch_ms_total += prefetcher.status().elapsed_ms;
+                    prefetcher.stop();
+                }
+
+                for (int32_t threads : options.threads) {
+                    ThreadingOptions threading;
+                    threading.n_threads = threads;
+                    threading.n_threads_batch = threads;
+                    threading.poll = options.poll;
+                    threading.cpu_mask = options.cpu_mask;
+                    // Measure steady-state throughput, not the wake-up after each parked request.
+                    threading.pause_when_idle = false;
+                    if (!engine.configure_threads(threading, error)) {
+                        std::cerr << "error: " << error << " (threads=" << threads << ")\n";
+                        return 1;
+                    }
+                    for (const std::string &suite : options.suites) {
+                        SuiteResult result;
+                        result.suite = suite;
+                        result.threads = threads;
+                        result.batch_size = engine.batch_size();
+                        result.context_size = engine.context_size();
+                        result.contexts = engine.n_contexts();
+                        run_suite(engine, options, result);
+                        std::cerr << suite << " threads=" << threads << " n_batch=" << result.batch_size
+                                  << " n_ctx=" << result.context_size << " contexts=" << result.contexts
+                                  << " runs=" << result.samples.size() << " wall_ms=" << result.wall_ms << "\n";
+                        results.push_back(std::move(result));
+                    }
+                }
+            }
+        }
+    }
+    engine.unload();
+
+    std::ofstream file;
+    if (!options.out_path.empty()) {
+        file.open(options.out_path, std::ios::out | std::ios::trunc);
+        if (!file) {
+            std::cerr << "error: cannot write " << options.out_path << "\n";
+            return 1;
+        }
+    }
+    std::ostream &out = options.out_path.empty() ? std::cout : file;
+
+    out << "{\n  \"schema\": 1"
+        << ",\n  \"commit\": \"" << LOCAL_AGENTS_BENCH_GIT_COMMIT << "\""
+        << ",\n  \"label\": \"" << json_escape(options.label) << "\""
+        << ",\n  \"timestamp\": " << static_cast<int64_t>(std::time(nullptr))
+        << ",\n  \"model\": \"" << json_escape(options.model_path) << "\""
+        << ",\n  \"hardware_concurrency\": " << std::thread::hardware_concurrency()
+        << ",\n  \"poll\": " << options.poll
+        << ",\n  \"cpu_mask\": \"" << json_escape(options.cpu_mask) << "\""
+        << ",\n  \"system_info\": \"" << json_escape(llama_print_system_info()) << "\""
+        << ",\n  \"load_ms_mean\": " << (loads > 0 ? load_ms_total / loads : 0.0)
+        << ",\n  \"prefetch\": " << (options.prefetch ? "true" : "false")
+        << ",\n  \"prefetch_ms_mean\": " << (options.prefetch && loads > 0 ? prefetch_ms_total / loads : 0.0);
+    if (!options.replay_path.empty()) {
+        out << ",\n  \"replay\": {\"path\": \"" << json_escape(options.replay_path) << "\""
+            << ", \"records\": " << options.trace.size() << ", \"speed\": " << options.replay_speed << "}";
+    }
+    out << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        write_result(out, results[i]);
+        out << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+    return 0;
+}
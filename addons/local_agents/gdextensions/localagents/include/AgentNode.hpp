@@ -6,11 +6,24 @@
 #include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/typed_array.hpp>
 #include <godot_cpp/variant/string.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "MpscRing.hpp"
+#include "SpeechListener.hpp"
+
+namespace local_agents::runtime {
+class Conversation;
+}
+
 namespace godot {
 
+class AgentRuntime;
+
 class AgentNode : public Node {
     GDCLASS(AgentNode, Node);
 
@@ -18,32 +31,67 @@ public:
     AgentNode();
     ~AgentNode() override;
 
-    void _process(double delta) override;
-
     // Lifecycle
     bool load_model(const String &model_path, const Dictionary &options);
+    bool load_model_async(const String &model_path, const Dictionary &options = Dictionary());
     void unload_model();
 
-    // Conversation helpers
+    // Conversation helpers. The history is a rolling window: once its messages (plus the
+    // summary) exceed max_history_tokens, the oldest are evicted and reported through
+    // history_evicted so the game can fold them into set_history_summary().
     void add_message(const String &role, const String &content);
     TypedArray<Dictionary> get_history() const;
     void clear_history();
+    int get_history_tokens() const;
+    // Id of the native conversation behind the history, usable as generate({"conversation": id}).
+    int64_t get_conversation_id() const;
+
+    void set_max_history_tokens(int tokens);
+    int get_max_history_tokens() const;
+
+    void set_history_summary(const String &summary);
+    String get_history_summary() const;
 
     Dictionary think(const String &prompt, const Dictionary &extra_options);
+    // Runs think() for several agents as one batched runtime call. `items` holds
+    // {node, prompt, options} Dictionaries; each node gets its reply in its history and
+    // message_emitted as think() would. Returns the responses in item order.
+    static Array think_many(const Array &items);
 
     bool say(const String &text, const Dictionary &options);
     String listen(const Dictionary &options);
-
-    // Action queue (placeholder for now, ensures API compatibility)
-    void enqueue_action(const String &name, const Dictionary &params);
-
-    // Properties
+    // Live counterpart of listen(): feed the returned listener microphone audio each frame.
+    // Every utterance it transcribes is added to the history and emitted as message_emitted
+    // and utterance_transcribed.
+    Ref<SpeechListener> start_listening(const Dictionary &options = Dictionary());
+
+    // Action queue. enqueue_action may be called from any thread (e.g. an inference worker);
+    // queued actions are emitted as action_requested on the main thread, at most
+    // max_actions_per_tick per scheduler tick (per frame while ticking is off), highest
+    // options.priority first. A newer action with the same options.coalesce_key replaces a
+    // still-queued one in place. Returns false when the queue is full. The pending count may
+    // also be read from any thread; clear_actions() is main thread only.
+    bool enqueue_action(const String &name, const Dictionary &params, const Dictionary &options = Dictionary());
+    int get_pending_action_count() const;
+    void clear_actions();
+
+    // Properties. Ticking is driven by AgentScheduler while the node is in the tree.
     void set_tick_enabled(bool enabled);
     bool is_tick_enabled() const;
 
     void set_tick_interval(double seconds);
     double get_tick_interval() const;
 
+    // Each period is tick_interval +/- up to this many seconds, so crowds spread out.
+    void set_tick_jitter(double seconds);
+    double get_tick_jitter() const;
+
+    // Called by AgentScheduler when this node comes due: emits the "tick" action (unless
+    // the scheduler batches signals) and drains up to max_actions_per_tick queued actions.
+    void scheduler_tick(bool emit_tick);
+    // Called by AgentScheduler each frame after request_drain(); returns true to stay queued.
+    bool scheduler_drain();
+
     void set_max_actions_per_tick(int actions);
     int get_max_actions_per_tick() const;
 
@@ -53,6 +101,10 @@ public:
     void set_voice(const String &voice_id);
     String get_voice() const;
 
+    // Adapter id registered with AgentRuntime::load_lora(); used when a request sets none.
+    void set_lora(const String &lora_id);
+    String get_lora() const;
+
     void set_default_model_path(const String &path);
     String get_default_model_path() const;
 
@@ -61,23 +113,52 @@ public:
 
 protected:
     static void _bind_methods();
+    void _notification(int what);
 
 private:
-    struct Message {
-        String role;
-        String content;
+    AgentRuntime *configured_runtime() const;
+    void update_tick_registration();
+
+    void sync_conversation();
+    void on_utterance_transcribed(const Dictionary &result);
+    // think() split around the runtime call, so think_many() can batch the middle.
+    Dictionary begin_think(AgentRuntime *runtime, const String &prompt, const Dictionary &extra_options);
+    void finish_think(const Dictionary &raw);
+
+    struct QueuedAction {
+        String name;
+        Dictionary payload; // params snapshot plus "name", as emitted
+        String coalesce_key;
+        int priority = 0;
+        uint64_t sequence = 0; // staging order, for FIFO among equal priorities
     };
 
+    void request_action_drain();
+    bool dispatch_actions();
+
     bool tick_enabled_ = false;
     double tick_interval_ = 0.0;
+    double tick_jitter_ = 0.0;
     int max_actions_per_tick_ = 4;
+    std::atomic<bool> ticking_{false};
     String db_path_;
     String voice_;
+    String lora_;
     String default_model_path_;
     String runtime_directory_;
 
-    std::vector<Message> history_;
-    double tick_accumulator_ = 0.0;
+    // Shared with AgentRuntime by id, so think() sends no history array at all.
+    std::shared_ptr<local_agents::runtime::Conversation> conversation_;
+
+    // Producers push into the ring lock-free; the main thread moves items into staged_,
+    // where priority ordering and coalescing happen without any shared state.
+    // Boxed so an idle ring is a few KB of null pointers, not hundreds of empty Dictionaries.
+    local_agents::runtime::MpscRing<std::unique_ptr<QueuedAction>> action_ring_;
+    std::atomic<bool> drain_requested_{false};
+    std::atomic<int> pending_actions_{0}; // ring + staged, minus coalesced duplicates
+    std::vector<QueuedAction> staged_actions_;
+    std::unordered_map<std::string, uint64_t> staged_keys_; // coalesce key -> sequence
+    uint64_t next_action_sequence_ = 0;
 };
 
 } // namespace godot
@@ -2,27 +2,53 @@
 #define LOCAL_AGENTS_AGENT_RUNTIME_HPP
 
 #include <godot_cpp/classes/node.hpp>
+#include <godot_cpp/classes/ref.hpp>
 #include <godot_cpp/templates/vector.hpp>
+#include <godot_cpp/variant/array.hpp>
 #include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
 #include <godot_cpp/variant/typed_array.hpp>
 #include <godot_cpp/variant/string.hpp>
 
 #include <llama.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <common/chat.h>
 
+#include "Conversation.hpp"
+#include "GenerationCache.hpp"
+#include "InferenceEngine.hpp"
+#include "ModelPrefetcher.hpp"
+#include "PiperVoice.hpp"
+#include "SpeechEngine.hpp"
+#include "SpeechListener.hpp"
+#include "SpeechStream.hpp"
+#include "ToolCallGrammar.hpp"
+#include "TraceLog.hpp"
+#include "TtsClipCache.hpp"
+
 struct llama_model;
 struct llama_context;
 struct llama_sampler;
 
 namespace godot {
 
+class GenerationHandle;
 class ModelDownloadManager;
 
 class AgentRuntime : public Node {
@@ -35,16 +61,79 @@ public:
     static AgentRuntime *get_singleton();
 
     bool load_model(const String &model_path, const Dictionary &options);
+    bool load_model_async(const String &model_path, const Dictionary &options = Dictionary());
     void unload_model();
     bool is_model_loaded() const;
+    bool is_model_loading() const;
+    double get_model_load_progress() const;
     Dictionary get_runtime_health();
 
     Dictionary generate(const Dictionary &request);
+    // One tool pick for a creature-style decision, on the local model with no HTTP or chat
+    // body round trip. `context` is the user turn (options.system_prompt adds a system one)
+    // or a messages array; `tool_specs` are OpenAI function specs. Under FunctionGemma's
+    // template the decode is held to its call syntax, declared names and argument shapes;
+    // other templates use their own tool-call grammar. Returns {ok, name, arguments, text,
+    // usage} or {ok: false, error, text}.
+    Dictionary resolve_tool_call(const Array &tool_specs, const Variant &context, const Dictionary &options = Dictionary());
+    // Local requests decode together as parallel sequences (see the `n_seq` load option);
+    // llama_server ones run in turn. Responses match generate()'s, in request order.
+    Array generate_many(const Array &requests);
+    // Resumable generate(): the returned handle decodes only inside its step(budget_usec),
+    // on the caller's thread. llama_server requests run to completion here instead.
+    Ref<GenerationHandle> begin_generation(const Dictionary &request);
+    // GenerationHandle::step() lands here to take the engine locks around the session.
+    void step_generation(GenerationHandle &handle, uint64_t budget_us);
     PackedFloat32Array embed_text(const String &text, const Dictionary &options = Dictionary());
+    // Token count under the loaded model's vocab, or a ~4 bytes/token estimate without one.
+    int64_t count_tokens(const String &text);
+
+    // Native conversations: `generate({"conversation": id, ...})` renders the prompt from the
+    // conversation's cached UTF-8 and tokens instead of a "history" array. AgentNode owns one
+    // each; scripts can create their own.
+    int64_t create_conversation();
+    bool append_conversation_message(int64_t id, const String &role, const String &content);
+    void release_conversation(int64_t id);
+    void register_conversation(const std::shared_ptr<local_agents::runtime::Conversation> &conversation);
+    std::shared_ptr<local_agents::runtime::Conversation> find_conversation(int64_t id) const;
+    // Tokenizes the conversation's new messages if a local model is ready; false otherwise.
+    bool tokenize_conversation(local_agents::runtime::Conversation &conversation);
 
+    // Text to speech through a resident `piper --output_raw` process per voice, started on
+    // first use. synthesize_speech() writes a WAV (a unique temp file unless output_path is
+    // given); synthesize_pcm() returns the samples; begin_speech() streams them from the
+    // synthesis thread as piper produces them.
     Dictionary synthesize_speech(const Dictionary &request);
+    Dictionary synthesize_pcm(const Dictionary &request);
+    Ref<SpeechStream> begin_speech(const Dictionary &request);
+    // Stops every resident piper process.
+    void release_voices();
+    // Lines already spoken come back from an on-disk clip cache (user://local_agents/tts_cache,
+    // 64 MiB by default; {"cache": false} per request skips it). prewarm_speech() queues the
+    // uncached lines for the synthesis thread, which serves begin_speech() first, and emits
+    // speech_prewarmed(id, result) when they are all in.
+    Dictionary configure_speech_cache(const Dictionary &options);
+    Dictionary get_speech_cache_info();
+    Dictionary prewarm_speech(const Array &lines, const Dictionary &request = Dictionary());
+    // WAV input runs on the resident speech model when whisper.cpp is linked; anything else
+    // (or {"in_process": false}) goes through the whisper binary in the runtime directory.
     Dictionary transcribe_audio(const Dictionary &request);
 
+    // Resident whisper.cpp model shared by transcribe_pcm() and transcribe_audio().
+    bool load_speech_model(const String &model_path, const Dictionary &options = Dictionary());
+    void unload_speech_model();
+    bool is_speech_model_loaded() const;
+    // Queues mono float PCM for the speech worker thread and returns its job id, or 0 when the
+    // input is rejected; transcription_finished(id, result) follows on the main thread.
+    int64_t transcribe_pcm(const PackedFloat32Array &pcm, int32_t sample_rate, const Dictionary &options = Dictionary());
+    // Voice activity detection on live input: `options` takes the VAD settings (sample_rate,
+    // threshold_db, hangover_ms, preroll_ms, ...) and any transcribe_pcm() options, which are
+    // applied to every utterance.
+    Ref<SpeechListener> create_speech_listener(const Dictionary &options = Dictionary());
+    // Called by SpeechListener; the result is emitted on the listener, not on the runtime.
+    int64_t queue_utterance(uint64_t listener_id, std::vector<float> &&samples, int32_t sample_rate,
+                            double start_seconds, double end_seconds, const Dictionary &options);
+
     Dictionary download_model(const Dictionary &request);
     Dictionary download_model_hf(const String &repo, const Dictionary &options = Dictionary());
     String get_model_cache_directory() const;
@@ -58,34 +147,245 @@ public:
     void set_system_prompt(const String &prompt);
     String get_system_prompt() const;
 
+    bool set_thread_options(const Dictionary &options);
+    Dictionary get_thread_info() const;
+    void pause_inference_threads();
+    void resume_inference_threads();
+
+    Dictionary get_memory_plan() const;
+    Dictionary get_prefetch_status() const;
+
+    bool load_lora(const String &path, const String &id);
+    bool unload_lora(const String &id);
+    PackedStringArray get_loras() const;
+    Dictionary plan_model_memory(const String &model_path, const Dictionary &options = Dictionary()) const;
+
+    Dictionary get_runtime_metrics() const;
+    double get_runtime_metric(const String &name) const;
+    void reset_runtime_metrics();
+
+    bool start_trace(const String &path, const Dictionary &options = Dictionary());
+    Dictionary stop_trace();
+    bool is_tracing() const;
+    void register_performance_monitors();
+    void unregister_performance_monitors();
+
 protected:
     static void _bind_methods();
     void _notification(int what);
 
 private:
-    Dictionary run_inference_locked(const Dictionary &request);
-    Dictionary run_llama_server_inference_locked(const Dictionary &request, const Dictionary &options);
-    bool ensure_sampler_locked(const Dictionary &options);
-    std::string build_prompt(const TypedArray<Dictionary> &history, const String &user_prompt) const;
-    std::string token_to_string(llama_token token) const;
+    friend class GenerationHandle;
+
+    // Settings readers need without waiting for a load or decode. A published snapshot is
+    // never modified: update_config() copies, edits and atomically swaps in a new one, so a
+    // reader keeps a consistent view for as long as it holds the pointer.
+    struct RuntimeConfig {
+        String default_model_path;
+        String runtime_directory;
+        String system_prompt;
+        Dictionary default_options;
+    };
+
+    // A local request turned into engine input, plus what its response needs afterwards.
+    struct PreparedGeneration {
+        local_agents::runtime::GenerationRequest generation;
+        bool require_json = false;
+        Dictionary json_schema;
+        bool use_cache = true;  // the "cache" option; deterministic requests only
+        bool cached = false;    // answered from the generation cache or a coalesced decode
+        // backend=inprocess: the chat-completions payload went through the model's chat
+        // template, and the output is parsed back into a chat-completions body.
+        bool chat = false;
+        Dictionary chat_payload;
+        common_chat_syntax chat_syntax;
+    };
+
+    // One transcribe_pcm() call, copied off the caller's thread.
+    struct SpeechJob {
+        int64_t id = 0;
+        std::vector<float> samples;
+        int32_t sample_rate = 0;
+        std::string model_path; // loaded first unless already resident
+        local_agents::runtime::SpeechModelOptions model_options;
+        local_agents::runtime::TranscribeOptions options;
+        uint64_t listener = 0; // SpeechListener instance id for utterances
+        double start_seconds = 0.0;
+        double end_seconds = 0.0;
+    };
+
+    // One prewarm_speech() call, finished when its last line is synthesized.
+    struct PrewarmBatch {
+        int64_t id = 0;
+        std::atomic<int64_t> remaining{0};
+        std::atomic<int64_t> failed{0};
+    };
+
+    // One begin_speech() call, or one prewarm_speech() line (no stream).
+    struct SynthesisJob {
+        local_agents::runtime::PiperVoiceOptions voice;
+        std::string text;
+        bool use_cache = true;
+        std::shared_ptr<SpeechStream::State> stream;
+        std::shared_ptr<PrewarmBatch> prewarm;
+    };
+
+    std::shared_ptr<const RuntimeConfig> config() const;
+    void update_config(const std::function<void(RuntimeConfig &)> &mutate);
+
+    // Both may release `lock` around the decode itself; it is held again on return.
+    Dictionary generate_locked(const Dictionary &request, std::chrono::steady_clock::time_point started,
+                               std::unique_lock<std::mutex> &lock);
+    Dictionary run_inference_locked(const Dictionary &request, const RuntimeConfig &config,
+                                    std::chrono::steady_clock::time_point started, std::unique_lock<std::mutex> &lock);
+    // The decode step of run_inference_locked: answered from the generation cache when it can
+    // be, otherwise decoded with `lock` released.
+    local_agents::runtime::GenerationResult decode_prepared_locked(PreparedGeneration &prepared,
+                                                                   std::chrono::steady_clock::time_point started,
+                                                                   std::unique_lock<std::mutex> &lock);
+    // Whether the chat_template option, or else the model's template, is FunctionGemma's, whose
+    // call syntax the native grammar covers; `escape_strings` tells which value spelling it uses.
+    bool function_call_template_locked(const Dictionary &options, bool &escape_strings) const;
+    void apply_function_call_grammar_locked(const std::vector<local_agents::runtime::ToolSpec> &tools,
+                                            bool escape_strings,
+                                            local_agents::runtime::GenerationRequest &generation) const;
+    bool ensure_model_loaded_locked();
+    void invalidate_adapter_results_locked();
+    // Fills `response` with the error when it returns false.
+    bool prepare_generation_locked(const Dictionary &request, const RuntimeConfig &config,
+                                   PreparedGeneration &prepared, Dictionary &response);
+    Dictionary finish_generation_locked(PreparedGeneration &prepared,
+                                        const local_agents::runtime::GenerationResult &result,
+                                        std::chrono::steady_clock::time_point started);
+    Dictionary run_llama_server_inference(const Dictionary &request, const Dictionary &options,
+                                          const RuntimeConfig &config);
+    // The OpenAI chat-completions payload both llama_server and inprocess requests send.
+    bool build_chat_payload(const Dictionary &request, const Dictionary &options, const RuntimeConfig &config,
+                            Dictionary &payload, Dictionary &response) const;
+    bool render_chat_request_locked(const Dictionary &request, const Dictionary &options, const RuntimeConfig &config,
+                                    PreparedGeneration &prepared, std::vector<std::string> &stop_sequences,
+                                    Dictionary &response);
+    Dictionary chat_completion_response(const PreparedGeneration &prepared,
+                                        const local_agents::runtime::GenerationResult &result,
+                                        int32_t max_tokens) const;
+    // Loads (or reuses) the model's chat templates; throws if `template_override` does not parse.
+    void ensure_chat_templates_locked(const std::string &template_override);
+    // How llama.cpp-backed prompts are laid out: the model's chat template unless the request
+    // asks for prompt_format "plain" or the model has none and no override is given.
+    local_agents::runtime::PromptFormat prompt_format_locked(const Dictionary &options);
+    bool apply_chat_template_locked(const std::vector<local_agents::runtime::ChatMessage> &messages,
+                                    bool add_generation_prompt, std::string &out) const;
+    void build_conversation_prompt_locked(local_agents::runtime::Conversation &conversation, const String &user_prompt,
+                                          const String &system_prompt,
+                                          const local_agents::runtime::PromptFormat &format,
+                                          local_agents::runtime::GenerationRequest &generation);
+    TypedArray<Dictionary> conversation_history(const local_agents::runtime::Conversation &conversation) const;
+    void build_prompt_locked(const TypedArray<Dictionary> &history, const String &user_prompt,
+                             const String &system_prompt, const local_agents::runtime::PromptFormat &format,
+                             local_agents::runtime::GenerationRequest &generation) const;
     bool load_model_locked(const String &path, const Dictionary &options, bool store_defaults);
+    void finish_model_load_locked(const Dictionary &options, bool store_defaults);
     void unload_model_locked();
+    void start_prefetch_locked(const String &path, const Dictionary &options);
+    void wait_for_model_load_locked(std::unique_lock<std::mutex> &lock);
+    void run_model_load_async(const String &path, const Dictionary &options);
+
+    Dictionary transcribe_samples(const std::string &model_path,
+                                  const local_agents::runtime::SpeechModelOptions &model_options,
+                                  const float *samples, size_t count, int32_t sample_rate,
+                                  const local_agents::runtime::TranscribeOptions &options);
+    int64_t enqueue_speech_job(SpeechJob &&job);
+    void run_speech_worker();
+    void stop_speech_worker();
+    void deliver_utterance(uint64_t listener_id, const Dictionary &result);
+    // Fills `voice` from the request's voice_path / voice_config / runtime_directory.
+    bool resolve_piper_voice(const Dictionary &request, local_agents::runtime::PiperVoiceOptions &voice,
+                             Dictionary &response) const;
+    // Runs `text` on the voice's resident process (restarted once if it had died), or
+    // replays it from the clip cache. `sample_rate` is set before the first sample reaches
+    // `sink`.
+    bool synthesize_with_voice(const local_agents::runtime::PiperVoiceOptions &options, const std::string &text,
+                               bool use_cache, const local_agents::runtime::PiperVoice::PcmSink &sink,
+                               std::atomic<int32_t> &sample_rate, std::string &error);
+    // Points the clip cache at its default directory unless configure_speech_cache() ran.
+    void ensure_speech_cache();
+    void run_synthesis_worker();
+    void run_prewarm_job(const SynthesisJob &job);
+    void stop_synthesis_worker();
+
+    bool lookup_cached_embedding(const std::string &key, PackedFloat32Array &out);
+    void store_cached_embedding(const std::string &key, const PackedFloat32Array &embedding);
+    void clear_embedding_cache();
 
     static AgentRuntime *singleton_;
 
+    // Model lifecycle only: load/unload sequencing, the loading_ handshake and adapter
+    // registration. Never held across a decode or an HTTP request.
     mutable std::mutex mutex_;
 
-    llama_model *model_ = nullptr;
-    llama_context *context_ = nullptr;
-    std::unique_ptr<llama_sampler, void(*)(llama_sampler*)> sampler_;
+    // Read with std::atomic_load; writers serialize on config_mutex_.
+    std::shared_ptr<const RuntimeConfig> config_;
+    std::mutex config_mutex_;
+
+    // While loading_ is set the load thread owns engine_ without holding mutex_; every other
+    // engine_ user waits on load_cv_ under mutex_ first.
+    local_agents::runtime::InferenceEngine engine_;
+    // Shared by generations decoding outside mutex_; taken exclusively (after mutex_) by
+    // anything that frees or rebuilds the model, its contexts, threadpools or adapters.
+    std::shared_mutex engine_lifetime_;
+    std::condition_variable load_cv_;
+    std::atomic<bool> loading_{false};    // written under mutex_
+    std::atomic<bool> model_ready_{false}; // loaded and not mid-load; written under mutex_
+    std::atomic<bool> load_cancelled_{false};
+    std::atomic<float> load_progress_{0.0f};
+    std::thread load_thread_;
+    local_agents::runtime::ModelPrefetcher prefetcher_;
+    local_agents::runtime::TraceWriter trace_; // local generate/embed records for bench --replay
+    std::map<std::string, std::string> lora_paths_; // id -> adapter path, survives reloads
+    uint64_t adapter_epoch_ = 0; // bumped by load_lora/unload_lora; part of every generation cache key
     std::unique_ptr<ModelDownloadManager> download_manager_;
 
-    String default_model_path_;
-    String runtime_directory_;
-    String system_prompt_;
-    Dictionary default_options_;
+    // Independent of the LLM's locks: transcription never waits on a decode or a load.
+    local_agents::runtime::SpeechEngine speech_;
+    std::thread speech_thread_; // started by the first transcribe_pcm()
+    std::deque<SpeechJob> speech_jobs_;
+    std::mutex speech_mutex_;
+    std::condition_variable speech_cv_;
+    bool speech_stopping_ = false;
+    int64_t next_speech_job_ = 1;
+
+    // Resident piper processes by voice model + config.
+    std::unordered_map<std::string, std::shared_ptr<local_agents::runtime::PiperVoice>> voices_;
+    std::mutex voices_mutex_;
+    std::thread synthesis_thread_; // started by the first begin_speech() or prewarm_speech()
+    std::deque<SynthesisJob> synthesis_jobs_;
+    std::deque<SynthesisJob> prewarm_jobs_; // run only when synthesis_jobs_ is empty
+    int64_t next_prewarm_id_ = 1;
+    std::mutex synthesis_mutex_;
+    std::condition_variable synthesis_cv_;
+    bool synthesis_stopping_ = false;
+    local_agents::runtime::TtsClipCache tts_cache_;
+    std::once_flag tts_cache_default_;
+
+    struct EmbeddingCacheEntry {
+        std::string key;
+        PackedFloat32Array embedding;
+    };
+    std::list<EmbeddingCacheEntry> embedding_cache_;
+    std::unordered_map<std::string, std::list<EmbeddingCacheEntry>::iterator> embedding_cache_index_;
+    size_t embedding_cache_capacity_ = 256;
+    std::mutex embedding_cache_mutex_;
+    local_agents::runtime::GenerationCache generation_cache_;
 
-    mutable std::mutex speech_mutex_;
+    std::unordered_map<int64_t, std::shared_ptr<local_agents::runtime::Conversation>> conversations_;
+    mutable std::mutex conversations_mutex_;
+    // The loaded model's chat templates, under mutex_. chat_templates_key_ changes on every
+    // (re)load and is the PromptFormat key conversations cache their rendering under.
+    common_chat_templates_ptr chat_templates_;
+    uint64_t chat_templates_epoch_ = 0;
+    uint64_t chat_templates_key_ = 0;
+    std::string chat_template_override_;
+    bool performance_monitors_registered_ = false;
 };
 
 } // namespace godot
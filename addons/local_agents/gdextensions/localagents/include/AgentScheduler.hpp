@@ -0,0 +1,78 @@
+#ifndef LOCAL_AGENTS_AGENT_SCHEDULER_HPP
+#define LOCAL_AGENTS_AGENT_SCHEDULER_HPP
+
+#include <godot_cpp/classes/object.hpp>
+#include <godot_cpp/variant/array.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "TimingWheel.hpp"
+
+namespace godot {
+
+// Engine singleton that ticks every registered agent from one per-frame hook instead of a
+// _process override per AgentNode. Agents register with a period and jitter; each frame the
+// timing wheel yields only the agents that came due (at most max_ticks_per_frame, the rest
+// carry to the next frame), AgentNodes among them emit their "tick" action, and the whole
+// set is reported once through agents_ticked. The same hook parks the runtime's inference
+// threads while the tree is paused or the window is in the background. Main thread only.
+class SceneTree;
+
+class AgentScheduler : public Object {
+    GDCLASS(AgentScheduler, Object);
+
+public:
+    AgentScheduler();
+    ~AgentScheduler() override;
+
+    static AgentScheduler *get_singleton();
+
+    void register_agent(Object *agent, double period, double jitter = 0.0);
+    void unregister_agent(Object *agent);
+    bool is_registered(Object *agent) const;
+    int get_agent_count() const;
+    int get_backlog() const;
+
+    void set_max_ticks_per_frame(int ticks);
+    int get_max_ticks_per_frame() const;
+
+    // When false only agents_ticked fires; AgentNodes skip their per-node "tick" signal but
+    // still drain their action queues.
+    void set_emit_agent_signals(bool enabled);
+    bool is_emitting_agent_signals() const;
+
+    // Asks for AgentNode::scheduler_drain() once per frame until it declines; used by nodes
+    // with queued actions but no tick of their own. Main thread only.
+    void request_drain(Object *agent);
+
+    // Advances the wheel by `delta` seconds and dispatches what came due, then runs the
+    // pending drains. Called by the SceneTree hook every unpaused frame; also usable
+    // directly for tests or custom loops.
+    void advance(double delta);
+    // Connects advance() to SceneTree::process_frame once the main loop exists.
+    void attach_to_tree();
+
+protected:
+    static void _bind_methods();
+
+private:
+    void on_process_frame();
+    void dispatch_due(uint64_t elapsed_ms);
+    void dispatch_drains();
+    void update_inference_hold(SceneTree *tree);
+
+    static AgentScheduler *singleton_;
+
+    local_agents::runtime::TimingWheel wheel_;
+    std::vector<uint64_t> drain_requests_;
+    double pending_ms_ = 0.0; // sub-millisecond remainder carried between frames
+    int max_ticks_per_frame_ = 256;
+    bool emit_agent_signals_ = true;
+    bool attached_ = false;
+    bool inference_held_ = false; // this hook parked the runtime's threads
+};
+
+} // namespace godot
+
+#endif // LOCAL_AGENTS_AGENT_SCHEDULER_HPP
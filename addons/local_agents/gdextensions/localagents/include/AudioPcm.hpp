@@ -0,0 +1,60 @@
+#ifndef LOCAL_AGENTS_AUDIO_PCM_HPP
+#define LOCAL_AGENTS_AUDIO_PCM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// Mono float PCM in [-1, 1] at a known rate: the one audio shape the speech paths pass
+// around, whatever the device or file produced.
+struct PcmBuffer {
+    std::vector<float> samples;
+    int32_t sample_rate = 0;
+};
+
+// Lock-free single-producer / single-consumer sample ring: a synthesis thread writes PCM
+// as it arrives while the main thread reads it into an audio buffer, neither waiting on
+// the other. Both sides move as many samples as fit and report the count.
+class PcmRing {
+public:
+    explicit PcmRing(size_t capacity);
+
+    PcmRing(const PcmRing &) = delete;
+    PcmRing &operator=(const PcmRing &) = delete;
+
+    size_t capacity() const { return capacity_; }
+    size_t size() const;
+
+    size_t write(const float *samples, size_t count); // producer only
+    size_t read(float *out, size_t count);            // consumer only
+
+private:
+    std::unique_ptr<float[]> samples_;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> write_{0};
+    alignas(64) std::atomic<size_t> read_{0};
+};
+
+// Reads a RIFF/WAVE file (PCM 8/16/24/32-bit or IEEE float, plain or extensible header)
+// and averages its channels down to mono.
+bool read_wav_file(const std::string &path, PcmBuffer &out, std::string &error);
+
+// Writes mono 16-bit PCM, clamping to [-1, 1].
+bool write_wav_file(const std::string &path, const float *samples, size_t count, int32_t sample_rate,
+                    std::string &error);
+
+// Linear-interpolation resample. Speech models take 16 kHz, and microphones and TTS voices
+// hand over 22.05-48 kHz; for narrowing to speech bandwidth this is close enough and costs
+// one pass with no allocation beyond `out`.
+void resample_linear(const float *samples, size_t count, int32_t from_rate, int32_t to_rate,
+                     std::vector<float> &out);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_AUDIO_PCM_HPP
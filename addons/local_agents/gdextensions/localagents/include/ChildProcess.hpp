@@ -0,0 +1,59 @@
+#ifndef LOCAL_AGENTS_CHILD_PROCESS_HPP
+#define LOCAL_AGENTS_CHILD_PROCESS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// A helper process with all three standard streams piped to us, for long-lived tools the
+// runtime talks to line by line (popen only gives one direction). stdin is a socket on
+// POSIX so a write to a child that died reports an error instead of raising SIGPIPE in
+// the host. One thread may read stdout while another reads stderr and a third writes.
+class ChildProcess {
+public:
+    ChildProcess() = default;
+    ~ChildProcess();
+
+    ChildProcess(const ChildProcess &) = delete;
+    ChildProcess &operator=(const ChildProcess &) = delete;
+
+    // argv[0] is the executable path; no shell is involved, so nothing needs quoting.
+    bool start(const std::vector<std::string> &argv, std::string &error);
+    bool running() const { return started_; }
+
+    bool write_all(const char *data, size_t size);
+    void close_stdin();
+
+    // Waits up to `timeout_ms` (0 = just check) for stdout. Returns the bytes read, 0 when
+    // nothing arrived in time, -1 at end of stream or on error.
+    int64_t read_stdout(char *buffer, size_t size, int32_t timeout_ms);
+    // Blocks until stderr has data; -1 at end of stream.
+    int64_t read_stderr(char *buffer, size_t size);
+
+    // Kills the child if it is still running and reaps it; returns its exit code (-1 if it
+    // was killed or never started).
+    int terminate();
+
+private:
+    void close_handles();
+
+    bool started_ = false;
+#ifdef _WIN32
+    void *process_ = nullptr;
+    void *stdin_ = nullptr;
+    void *stdout_ = nullptr;
+    void *stderr_ = nullptr;
+#else
+    int pid_ = -1;
+    int stdin_ = -1;
+    int stdout_ = -1;
+    int stderr_ = -1;
+#endif
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_CHILD_PROCESS_HPP
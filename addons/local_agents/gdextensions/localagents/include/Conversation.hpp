@@ -0,0 +1,109 @@
+#ifndef LOCAL_AGENTS_CONVERSATION_HPP
+#define LOCAL_AGENTS_CONVERSATION_HPP
+
+#include "InferenceEngine.hpp"
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// How a prompt lays messages out. Without `render` it is the plain "role: content" lines of
+// InferenceEngine::render_prompt. A chat template supplies `render`, which writes a whole
+// message list (with the assistant cue when asked) or returns false; its output is then
+// tokenized with special tokens parsed. `key` must change whenever `render`'s output could,
+// e.g. on a model or template switch; 0 is the plain format.
+struct PromptFormat {
+    uint64_t key = 0;
+    std::function<bool(const std::vector<ChatMessage> &messages, bool add_generation_prompt, std::string &out)> render;
+};
+
+// A chat history held natively and shared by AgentNode and AgentRuntime. Each message is
+// kept as UTF-8 in its rendered prompt form together with its tokens under the model that
+// last tokenized it, so a turn only renders and tokenizes the messages that are new since the
+// previous one. Under a chat template a message's rendered form is the text it adds after
+// the messages before it, so the pieces concatenate to the template's own output and the
+// prompt keeps a stable token prefix from turn to turn. The oldest messages are evicted once
+// the window exceeds max_tokens; an optional summary stands in for them.
+//
+// Self-synchronized: AgentNode appends on the main thread while a generate() on another
+// thread takes a snapshot.
+class Conversation {
+public:
+    Conversation();
+
+    Conversation(const Conversation &) = delete;
+    Conversation &operator=(const Conversation &) = delete;
+
+    // Process-unique, never reused; what AgentRuntime's registry and requests refer to.
+    int64_t id() const { return id_; }
+
+    void append(const std::string &role, const std::string &content);
+    void clear();
+    std::vector<ChatMessage> messages() const;
+
+    // Rendered as a leading "system" message and budgeted with the window.
+    void set_summary(const std::string &summary);
+    std::string summary() const;
+
+    void set_max_tokens(int32_t max_tokens); // 0 = unbounded
+    int32_t max_tokens() const;
+    // Messages plus summary; exact once tokenized, a ~4 bytes/token estimate before that.
+    int64_t token_total() const;
+
+    // Tokenizes every message (and the summary) already rendered in the current format but not
+    // yet tokenized under `engine`'s current model; messages a chat template has not rendered
+    // yet keep their estimate. Callers keep the model alive for the duration (AgentRuntime's
+    // lifetime lock).
+    void tokenize_pending(const InferenceEngine &engine);
+    // Drops the oldest messages until the window fits max_tokens, always keeping the newest.
+    // Returns them oldest first.
+    std::vector<ChatMessage> trim();
+
+    // Writes the prompt for the next reply into `text` and `tokens`: the system prompt and
+    // summary, the messages, `user_prompt` when not empty and the assistant cue, in `format`.
+    // Switching format re-renders every message; otherwise only new ones are rendered and
+    // tokenized, plus the short tail. Returns false when `format` cannot render the history
+    // (the caller renders it some other way). `tokens` is left empty unless every piece is
+    // tokenized under `engine`'s current model; callers keep it alive as for tokenize_pending.
+    bool render_prompt(const InferenceEngine &engine, const PromptFormat &format, const std::string &system_prompt,
+                       const std::string &user_prompt, std::string &text, std::vector<llama_token> &tokens);
+
+private:
+    struct Entry {
+        std::string role;
+        std::string content;
+        std::string rendered;  // in the conversation's format once `formatted`, else a plain line
+        bool formatted = false;
+        std::vector<llama_token> tokens;
+        uint64_t epoch = 0; // InferenceEngine::model_epoch() of `tokens`; 0 = estimated
+        int32_t token_count = 0;
+    };
+
+    static Entry make_entry(const std::string &role, const std::string &content);
+    void tokenize_entry(Entry &entry, const InferenceEngine &engine, bool add_bos, bool parse_special);
+    void restyle_entry(Entry &entry, std::string rendered);
+    // The system prompt and summary as a template sees them: one leading system message.
+    std::vector<ChatMessage> header_messages_locked() const;
+
+    const int64_t id_;
+    mutable std::mutex mutex_;
+    std::deque<Entry> entries_;
+    Entry summary_;
+    int64_t entries_tokens_ = 0;
+    int32_t max_tokens_ = 0;
+    // Prompt format state, written by render_prompt: the format `rendered` texts are in, and
+    // the system prompt and summary rendered as the prompt's head.
+    uint64_t format_key_ = 0;
+    std::string system_prompt_;
+    Entry header_;
+    bool header_valid_ = false;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_CONVERSATION_HPP
@@ -0,0 +1,85 @@
+#ifndef LOCAL_AGENTS_GENERATION_CACHE_HPP
+#define LOCAL_AGENTS_GENERATION_CACHE_HPP
+
+#include "InferenceEngine.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace local_agents::runtime {
+
+// Canonical key for a request whose output is a pure function of its inputs: greedy
+// (temperature <= 0) or seeded sampling on a fresh or prefix-cached context. Covers the model
+// epoch, prompt tokens (or text), sampling, adapters, stops, max_tokens and any grammar
+// constraint. Adapters enter by id and scale only, so `adapter_epoch` must change whenever
+// an id is loaded, replaced or removed. Empty when the request is not deterministic and
+// must not be shared.
+std::string canonical_generation_key(const GenerationRequest &request, uint64_t model_epoch,
+                                     uint64_t adapter_epoch);
+
+// Memoizes deterministic generations and folds identical concurrent ones into a single
+// decode. acquire() either returns a fresh cached result, makes the caller the leader that
+// decodes and later complete()s, or attaches it as a follower that wait()s for the
+// leader's result. Completed successes stay for `ttl` in a size-bounded LRU. Thread-safe.
+class GenerationCache {
+public:
+    enum class Role {
+        Hit,
+        Leader,
+        Follower,
+    };
+
+    struct Flight;
+    struct Ticket {
+        Role role = Role::Leader;
+        std::string key;
+        GenerationResult result; // Hit only
+        std::shared_ptr<Flight> flight;
+    };
+
+    // capacity 0 disables caching and coalescing; ttl_ms 0 keeps entries until evicted.
+    void configure(size_t capacity, uint64_t ttl_ms);
+    bool enabled() const;
+
+    Ticket acquire(const std::string &key);
+    // Leader only: publishes the result to followers and, if ok without a warning (a
+    // truncated decode), to the cache. store() applies the same rule.
+    void complete(Ticket &ticket, const GenerationResult &result);
+    // Follower only: blocks until the leader completes.
+    static GenerationResult wait(const Ticket &ticket);
+
+    // Non-blocking pair for callers that decode many requests themselves (generate_many).
+    bool lookup(const std::string &key, GenerationResult &out);
+    void store(const std::string &key, const GenerationResult &result);
+
+    void clear();
+    size_t size() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Entry {
+        std::string key;
+        GenerationResult result;
+        Clock::time_point expires;
+    };
+
+    bool lookup_locked(const std::string &key, GenerationResult &out);
+    void store_locked(const std::string &key, const GenerationResult &result);
+
+    mutable std::mutex mutex_;
+    std::list<Entry> entries_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    size_t capacity_ = 128;
+    uint64_t ttl_ms_ = 60000;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_GENERATION_CACHE_HPP
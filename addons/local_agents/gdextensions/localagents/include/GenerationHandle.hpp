@@ -0,0 +1,49 @@
+#ifndef LOCAL_AGENTS_GENERATION_HANDLE_HPP
+#define LOCAL_AGENTS_GENERATION_HANDLE_HPP
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+#include "AgentRuntime.hpp"
+
+namespace godot {
+
+// A generate() call the game advances itself, returned by AgentRuntime::begin_generation().
+// Each step(budget_usec) decodes prompt chunks and reply tokens on the calling thread until
+// the budget is spent, so builds without worker threads can cap inference cost per frame.
+// poll() reports the partial text; once done, get_response() has what generate() would
+// have returned.
+class GenerationHandle : public RefCounted {
+    GDCLASS(GenerationHandle, RefCounted);
+
+public:
+    GenerationHandle();
+    ~GenerationHandle() override;
+
+    // Returns true once the generation has finished (successfully or not).
+    bool step(int64_t budget_usec);
+    Dictionary poll() const;
+    bool is_done() const;
+    void cancel();
+    Dictionary get_response() const;
+
+protected:
+    static void _bind_methods();
+
+private:
+    friend class AgentRuntime;
+
+    std::unique_ptr<local_agents::runtime::GenerationSession> session_;
+    std::unique_ptr<AgentRuntime::PreparedGeneration> prepared_;
+    std::chrono::steady_clock::time_point started_;
+    Dictionary response_;
+    bool finished_ = false;
+};
+
+} // namespace godot
+
+#endif // LOCAL_AGENTS_GENERATION_HANDLE_HPP
@@ -0,0 +1,330 @@
+#ifndef LOCAL_AGENTS_INFERENCE_ENGINE_HPP
+#define LOCAL_AGENTS_INFERENCE_ENGINE_HPP
+
+#include "MemoryPlanner.hpp"
+#include "ModelMetadata.hpp"
+#include "SharedThreadPool.hpp"
+
+#include <llama.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// Plain-data mirrors of the Dictionary options AgentRuntime accepts. AgentRuntime converts
+// Variants into these; the native bench fills them directly. Zero/absent means "not set",
+// matching the `options.has(...)` checks the Dictionary path always used.
+struct SamplingOptions {
+    int32_t top_k = 0;
+    float top_p = 0.0f;
+    float min_p = 0.0f;
+    float typical_p = 0.0f;
+    float temperature = 1.0f;
+    int64_t seed = -1;
+    float repeat_penalty = 1.0f;
+    float frequency_penalty = 0.0f;
+    float presence_penalty = 0.0f;
+    int32_t repeat_last_n = 0;
+    int32_t mirostat = 0;
+    int32_t mirostat_m = 100;
+    float mirostat_tau = 5.0f;
+    float mirostat_eta = 0.1f;
+};
+
+struct ModelLoadOptions {
+    std::optional<int32_t> n_gpu_layers;
+    std::optional<bool> use_mmap;
+    std::optional<bool> use_mlock;
+    int32_t context_size = 0; // 0 = the model's training context
+    int32_t batch_size = 0;   // 0 = context_size
+    int32_t ubatch_size = 0;  // 0 = planner / llama.cpp default
+    std::optional<int32_t> pooling;
+    bool embeddings = true;
+    ThreadingOptions threading;
+    // When set, context/batch/KV precision not pinned above are chosen by plan_memory()
+    // from the GGUF header before anything is allocated, and loads that would swap fail.
+    bool plan_memory = true;
+    uint64_t memory_budget_bytes = 0;
+    int32_t min_context_size = 2048;
+    int32_t max_context_size = 8192;
+    std::string cache_type;   // "", "auto", "f16", "q8_0", "q4_0"
+    int32_t flash_attn = -1;  // -1 auto, 0 off, 1 on
+    // Sequences per context (llama n_seq_max). generate_batch() decodes up to this many
+    // requests together in one context; 1 disables batching.
+    int32_t n_seq = 1;
+    // Independent llama_contexts over the one set of weights. Each has its own KV cache,
+    // sampler state and threadpool (the thread counts above are split between them), so
+    // that many requests decode truly in parallel instead of queueing on one context.
+    int32_t n_contexts = 1;
+    // Decode a BOS/EOS pair after the context is created so the first real request does not
+    // pay for graph building, buffer allocation or faulting in mmap'd weights.
+    bool warmup = false;
+    // Called on the loading thread with 0..1; returning false aborts the load.
+    std::function<bool(float)> progress;
+};
+
+struct ChatMessage {
+    std::string role;
+    std::string content;
+};
+
+struct LoraSelection {
+    std::string id;
+    float scale = 1.0f;
+};
+
+struct GenerationRequest {
+    std::string prompt;
+    // Optional pre-tokenized `prompt` (BOS included) from the model with this model_epoch();
+    // generate() decodes it as-is instead of tokenizing `prompt`. Stale epochs are ignored.
+    std::vector<llama_token> prompt_tokens;
+    uint64_t prompt_epoch = 0;
+    SamplingOptions sampling;
+    std::vector<LoraSelection> loras; // adapters from load_lora(); empty = base model
+    // Requests with the same id prefer the context that served the last one, so its KV
+    // cache (and with cache_prompt, the shared prompt prefix) is still there.
+    std::string conversation_id;
+    std::vector<std::string> stop;
+    int32_t max_tokens = 256;
+    int32_t batch_size = 512;
+    bool reset_context = true;
+    bool cache_prompt = false;
+    // Chat-template renders spell control tokens (<start_of_turn>, ...) as text; tokenize
+    // those as the tokens they name instead of as plain characters.
+    bool parse_special = false;
+    // Optional GBNF constraint on the output. A lazy grammar only engages once a trigger
+    // pattern matches the text or a trigger token is sampled (a tool call after free text).
+    std::string grammar;
+    bool grammar_lazy = false;
+    std::vector<std::string> grammar_trigger_patterns;
+    std::vector<llama_token> grammar_trigger_tokens;
+    // Control tokens kept in the output text instead of dropped (tool-call markers).
+    std::vector<llama_token> preserved_tokens;
+};
+
+struct GenerationResult {
+    bool ok = false;
+    std::string error;
+    std::string warning;
+    std::string text;
+    int32_t prompt_tokens = 0;
+    int32_t completion_tokens = 0;
+    int32_t cached_tokens = 0; // prompt tokens reused from the context's KV cache
+    double ttft_ms = 0.0;
+    double tokens_per_second = 0.0;
+};
+
+class GenerationSession;
+
+struct ThreadPoolInfo {
+    bool configured = false;
+    int32_t n_threads = 0;       // per context
+    int32_t n_threads_batch = 0; // per context
+    int32_t n_pools = 0;
+    int32_t n_contexts = 0;
+    bool paused = false;
+    ThreadingOptions options;
+};
+
+// The llama.cpp model and its pool of contexts behind AgentRuntime, with no godot-cpp
+// dependency so localagents_bench can drive exactly the same load/decode path outside
+// the engine. generate() and embed() lease a free context and may run concurrently from
+// any number of threads, waiting only when every context is busy. load(), unload(),
+// warm_up(), configure_threads() and the LoRA registry need exclusive access: callers
+// make sure no generate()/embed() is in flight (AgentRuntime's lifetime lock).
+class InferenceEngine {
+public:
+    InferenceEngine() = default;
+    ~InferenceEngine();
+
+    InferenceEngine(const InferenceEngine &) = delete;
+    InferenceEngine &operator=(const InferenceEngine &) = delete;
+
+    bool load(const std::string &path, const ModelLoadOptions &options, std::string &error);
+    void unload();
+    bool warm_up(std::string &error);
+    bool is_loaded() const { return model_ != nullptr && !slots_.empty(); }
+
+    const std::string &model_path() const { return model_path_; }
+    int32_t context_size() const { return context_size_; }
+    int32_t batch_size() const { return batch_size_; }
+    int32_t n_contexts() const { return static_cast<int32_t>(slots_.size()); }
+    int32_t n_seq() const { return n_seq_; }
+    bool embeddings_enabled() const { return embeddings_; }
+    const ModelMetadata &metadata() const { return metadata_; }
+    const MemoryPlan &memory_plan() const { return memory_plan_; }
+    // Process RSS growth across load(); mmap'd weights only count once their pages fault in.
+    uint64_t memory_actual_bytes() const { return memory_actual_bytes_; }
+
+    // Reads the GGUF header and runs plan_memory() with the same defaults load() applies.
+    static MemoryPlan plan(const std::string &path, const ModelLoadOptions &options, ModelMetadata &metadata,
+                           std::string &error);
+
+    GenerationResult generate(const GenerationRequest &request,
+                              std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now());
+    // generate() in resumable form: tokenizes now, decodes only inside GenerationSession::step().
+    // Errors found here come back as an already finished session. Same exclusivity rules as
+    // generate() for every step; the session must not outlive the engine.
+    std::unique_ptr<GenerationSession> begin_generation(
+        const GenerationRequest &request, std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now());
+    // Decodes the requests as parallel sequences of one context: a shared prefill, then one
+    // llama_decode per step for every sequence still generating. Results are in request order.
+    // Requests whose adapter sets differ, or beyond n_seq(), form further groups; a group's
+    // prompt tokens plus max_tokens stay within context_size(), and a request that does not
+    // fit one decodes alone. A sequence cut off by a failed decode comes back as an error.
+    std::vector<GenerationResult> generate_batch(const std::vector<GenerationRequest> &requests,
+                                                 std::chrono::steady_clock::time_point started =
+                                                     std::chrono::steady_clock::now());
+    bool embed(const std::string &text, bool add_bos, bool normalize, std::vector<float> &out, std::string &error);
+    // Tokenizer access; only reads the vocab, so it is safe alongside generate()/embed().
+    // `add_bos` adds the BOS token only when the vocab asks for one; `parse_special` reads
+    // control-token text (a chat template's markers) as the tokens themselves.
+    bool tokenize(const std::string &text, bool add_bos, std::vector<llama_token> &out,
+                  bool parse_special = false) const;
+    // Tokens `text` costs inside a prompt (no BOS); -1 when no model is loaded.
+    int32_t count_tokens(const std::string &text) const;
+    // Changes on every successful load() (0 while unloaded), so cached tokens can tell which
+    // vocab produced them.
+    uint64_t model_epoch() const { return model_epoch_; }
+
+    void update_kv_metrics() const;
+
+    // Adapters stay resident next to the base weights until unload_lora() or unload();
+    // switching the active set per request only costs a KV reset.
+    bool load_lora(const std::string &id, const std::string &path, std::string &error);
+    bool unload_lora(const std::string &id);
+    std::vector<std::string> lora_ids() const;
+
+    // Rebuilds every context's threadpool and re-attaches it without reloading the model.
+    bool configure_threads(const ThreadingOptions &options, std::string &error);
+    // Safe from any thread, loaded or not, including while requests decode. A pause also
+    // holds pools created by a later load.
+    void pause_threads();
+    void resume_threads();
+    ThreadPoolInfo thread_info() const;
+
+    llama_model *model() const { return model_; }
+
+    static std::string render_prompt(const std::string &system_prompt,
+                                     const std::vector<ChatMessage> &history,
+                                     const std::string &user_prompt);
+
+private:
+    friend class GenerationSession;
+
+    struct ContextSlot {
+        llama_context *context = nullptr;
+        SharedThreadPool threads;
+        std::vector<LoraSelection> active_loras;
+        std::vector<llama_token> tokens; // what the KV cache currently holds, in order
+        std::string affinity;            // conversation whose KV this is
+        uint64_t last_used = 0;
+        bool busy = false;
+        std::atomic<int64_t> kv_used{0};
+    };
+    class SlotLease;
+
+    ContextSlot *acquire_slot(const std::string &affinity);
+    void release_slot(ContextSlot *slot);
+    static void reset_slot(ContextSlot &slot);
+    bool warm_up_slot(ContextSlot &slot, std::string &error);
+    void generate_group(const std::vector<GenerationRequest> &requests, const std::vector<size_t> &group,
+                        std::chrono::steady_clock::time_point started, std::vector<GenerationResult> &results);
+    std::string token_to_string(llama_token token, bool special = false) const;
+    bool apply_loras(ContextSlot &slot, const std::vector<LoraSelection> &loras, bool &changed, std::string &error);
+
+    llama_model *model_ = nullptr;
+    // The vector only changes in load()/unload(); slots_mutex_ guards it against the
+    // thread controls and every slot's busy/affinity/last_used bookkeeping.
+    std::vector<std::unique_ptr<ContextSlot>> slots_;
+    mutable std::mutex slots_mutex_;
+    std::condition_variable slot_cv_;
+    uint64_t slot_clock_ = 0;
+    ThreadingOptions threading_;
+    bool threads_held_ = false;
+    std::map<std::string, llama_adapter_lora *> loras_;
+    std::string model_path_;
+    uint64_t model_epoch_ = 0;
+    ModelMetadata metadata_;
+    MemoryPlan memory_plan_;
+    uint64_t memory_actual_bytes_ = 0;
+    int32_t context_size_ = 0;
+    int32_t batch_size_ = 0;
+    int32_t n_seq_ = 1;
+    bool embeddings_ = false;
+};
+
+// One generate() spread over as many step() calls as the caller likes, each bounded by a time
+// budget, for builds that must not block a frame on a whole reply. Between steps the session
+// holds no context: each step leases one again (preferring the one with its KV) and re-decodes
+// whatever another request evicted. A reload in between fails the session.
+class GenerationSession {
+public:
+    // Decodes prompt chunks (request.batch_size tokens each), then one token at a time, until
+    // the reply ends or `budget_us` has passed (0 = to the end). At least one unit runs per
+    // call, so a budget below one chunk's cost still makes progress.
+    void step(uint64_t budget_us);
+    void cancel();
+
+    bool done() const { return done_; }
+    bool prefilling() const { return !done_ && decoded_ < prompt_size_; }
+    float prefill_progress() const;
+    // Text so far; may end inside a UTF-8 sequence or a stop string until done().
+    const std::string &text() const { return text_; }
+    int32_t completion_tokens() const { return result_.completion_tokens; }
+    const GenerationResult &result() const { return result_; }
+
+private:
+    friend class InferenceEngine;
+    GenerationSession() = default;
+
+    void fail(const char *error);
+    void finish(InferenceEngine::ContextSlot &slot);
+
+    InferenceEngine *engine_ = nullptr;
+    GenerationRequest request_;
+    GenerationResult result_;
+    std::chrono::steady_clock::time_point started_;
+    std::unique_ptr<llama_sampler, void (*)(llama_sampler *)> sampler_{nullptr, llama_sampler_free};
+    std::vector<llama_token> tokens_; // context carried over + prompt + sampled tokens
+    size_t prompt_base_ = 0;          // tokens of tokens_ that predate this request
+    size_t prompt_size_ = 0;
+    size_t decoded_ = 0;              // prefix of tokens_ this session has put in the KV
+    int32_t sampled_ = 0;
+    uint64_t epoch_ = 0;
+    std::string affinity_;
+    std::string text_;
+    uint64_t decode_us_ = 0;
+    uint64_t ttft_us_ = 0;
+    bool started_stepping_ = false;
+    bool done_ = false;
+};
+
+// `constraint` (e.g. a grammar sampler), when given, runs first in the chain and is owned by it.
+llama_sampler *create_sampler(const SamplingOptions &options, const llama_model *model,
+                              llama_sampler *constraint = nullptr);
+// The request's grammar sampler, or nullptr when it has none. Sets `error` if the grammar
+// does not parse.
+llama_sampler *create_grammar_sampler(const GenerationRequest &request, const llama_model *model, std::string &error);
+
+bool tokenize_text(const llama_vocab *vocab,
+                   const std::string &text,
+                   bool add_bos,
+                   bool parse_special,
+                   std::vector<llama_token> &out_tokens);
+
+bool apply_stop_sequences(std::string &text, const std::vector<std::string> &stops);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_INFERENCE_ENGINE_HPP
@@ -0,0 +1,85 @@
+#ifndef LOCAL_AGENTS_MEMORY_PLANNER_HPP
+#define LOCAL_AGENTS_MEMORY_PLANNER_HPP
+
+#include "ModelMetadata.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+enum class KvCacheType {
+    F16,
+    Q8_0,
+    Q4_0,
+};
+
+const char *kv_cache_type_name(KvCacheType type);
+bool parse_kv_cache_type(const std::string &name, KvCacheType &out);
+double kv_cache_type_bytes(KvCacheType type);
+
+struct MemoryPlanRequest {
+    uint64_t budget_bytes = 0;     // 0 = whatever is available minus the safety margin
+    int32_t context_size = 0;      // pinned n_ctx; 0 lets the planner choose
+    int32_t min_context_size = 2048;
+    int32_t max_context_size = 8192;
+    int32_t batch_size = 0;        // pinned n_batch; 0 = min(n_ctx, 2048)
+    int32_t ubatch_size = 0;       // pinned n_ubatch; 0 lets the planner choose
+    std::string cache_type;        // "", "auto", "f16", "q8_0", "q4_0"
+    int32_t flash_attn = -1;       // -1 auto, 0 off, 1 on
+    int32_t n_seq = 1;             // parallel sequences sharing the KV cache
+    int32_t n_contexts = 1;        // independent contexts, each with its own KV + compute buffers
+    int32_t n_gpu_layers = 0;
+    bool use_mmap = true;
+};
+
+struct MemoryEstimate {
+    uint64_t weights = 0;
+    uint64_t kv_cache = 0;
+    uint64_t compute = 0;
+    uint64_t total = 0;      // resident: weights + kv_cache + compute
+    uint64_t anonymous = 0;  // swappable part (weights only when not mmap'd)
+};
+
+struct MemoryPlan {
+    bool ok = false;
+    std::string reason;
+    std::vector<std::string> warnings;
+    int32_t context_size = 0;
+    int32_t batch_size = 0;
+    int32_t ubatch_size = 0;
+    KvCacheType type_k = KvCacheType::F16;
+    KvCacheType type_v = KvCacheType::F16;
+    int32_t flash_attn = -1;
+    MemoryEstimate predicted;
+    uint64_t limit_bytes = 0;
+    uint64_t available_bytes = 0;
+    uint64_t total_system_bytes = 0;
+};
+
+struct SystemMemory {
+    uint64_t total = 0;
+    uint64_t available = 0;
+};
+
+// Physical RAM as the OS reports it (0 when unknown) and this process's resident set.
+SystemMemory query_system_memory();
+uint64_t process_resident_bytes();
+
+// KV + weights + a compute-buffer estimate for one configuration, host side only: layers
+// offloaded with n_gpu_layers are excluded proportionally.
+MemoryEstimate estimate_memory(const ModelMetadata &model, int32_t context_size, int32_t ubatch_size,
+                               KvCacheType type_k, KvCacheType type_v, bool flash_attn, int32_t n_seq,
+                               int32_t n_gpu_layers, bool use_mmap);
+
+// Picks the largest context (up to max_context_size / n_ctx_train) whose KV cache, compute
+// buffers and weights fit the budget, trading KV precision (f16 -> q8_0 -> q4_0, the
+// quantized V cache with flash attention) and micro-batch size before shrinking the
+// window below min_context_size. Refuses any plan whose swappable memory exceeds what the
+// machine has free.
+MemoryPlan plan_memory(const ModelMetadata &model, const MemoryPlanRequest &request, const SystemMemory &system);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_MEMORY_PLANNER_HPP
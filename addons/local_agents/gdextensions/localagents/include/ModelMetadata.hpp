@@ -0,0 +1,40 @@
+#ifndef LOCAL_AGENTS_MODEL_METADATA_HPP
+#define LOCAL_AGENTS_MODEL_METADATA_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+struct TensorExtent {
+    std::string name;
+    uint64_t offset = 0; // absolute file offset of the tensor data
+    uint64_t size = 0;
+    int32_t layer = -1;  // blk.<n>. index, -1 for embeddings / output / norms
+};
+
+// Shape and layout of a GGUF model read from its header alone (no tensor data is mapped),
+// so the runtime can size a context or plan I/O before committing to a full load.
+struct ModelMetadata {
+    std::string architecture;
+    int32_t n_layer = 0;
+    int32_t n_embd = 0;
+    int32_t n_ff = 0;
+    int32_t n_head = 0;
+    int32_t n_head_kv = 0;
+    int32_t n_embd_head_k = 0;
+    int32_t n_embd_head_v = 0;
+    int32_t n_ctx_train = 0;
+    int32_t n_vocab = 0;
+    uint64_t file_size = 0;
+    uint64_t data_offset = 0;
+    uint64_t weights_bytes = 0;
+    std::vector<TensorExtent> tensors;
+};
+
+bool read_model_metadata(const std::string &path, ModelMetadata &out, std::string &error);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_MODEL_METADATA_HPP
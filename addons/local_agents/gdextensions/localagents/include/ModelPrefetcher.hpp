@@ -0,0 +1,104 @@
+#ifndef LOCAL_AGENTS_MODEL_PREFETCHER_HPP
+#define LOCAL_AGENTS_MODEL_PREFETCHER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace local_agents::runtime {
+
+struct PrefetchOptions {
+    uint64_t mlock_budget_bytes = 0; // pin the hottest tensors up to this many bytes; 0 = none
+    uint64_t max_bytes = 0;          // stop reading after this much; 0 = free RAM minus a margin
+};
+
+enum class PrefetchState {
+    Idle,
+    Running,
+    Done,
+    Cancelled,
+    Failed,
+};
+
+const char *prefetch_state_name(PrefetchState state);
+
+struct PrefetchStatus {
+    PrefetchState state = PrefetchState::Idle;
+    std::string path;
+    std::string error;   // fatal for Failed, otherwise a warning (e.g. mlock refused)
+    uint64_t bytes_total = 0;
+    uint64_t bytes_done = 0;
+    uint64_t locked_bytes = 0;
+    int32_t layers_total = 0;
+    int32_t layers_done = 0;
+    double elapsed_ms = 0.0;
+};
+
+// Pulls a GGUF's tensor data into the OS page cache on a background thread, in the order a
+// forward pass touches it (token embeddings, blk.0 … blk.N, output), so the mmap'd model
+// llama.cpp maps in parallel stops page-faulting on the first requests. Optionally mlocks
+// the hottest tensors (output head, then blocks from the first layer up) within a budget;
+// the lock holds until stop(). Self-synchronized.
+class ModelPrefetcher {
+public:
+    ModelPrefetcher() = default;
+    ~ModelPrefetcher();
+
+    ModelPrefetcher(const ModelPrefetcher &) = delete;
+    ModelPrefetcher &operator=(const ModelPrefetcher &) = delete;
+
+    // Stops any previous prefetch first.
+    void start(const std::string &path, const PrefetchOptions &options);
+    // Cancels a running prefetch, joins it and releases any locked pages.
+    void stop();
+    PrefetchStatus status() const;
+
+private:
+    struct Range {
+        uint64_t offset = 0;
+        uint64_t size = 0;
+    };
+    struct Group {
+        int32_t order = 0; // -1 token embeddings, block index, n_layer for output/norms
+        std::vector<Range> ranges;
+        uint64_t bytes = 0;
+    };
+
+    void run(std::string path, PrefetchOptions options);
+    bool map_file_locked(const std::string &path, std::string &error);
+    void unmap_file_locked();
+    void set_state(PrefetchState state, const std::string &error = std::string());
+
+    mutable std::mutex mutex_;
+    std::thread thread_;
+    std::atomic<bool> cancel_{false};
+    std::atomic<int> state_{static_cast<int>(PrefetchState::Idle)};
+    std::atomic<uint64_t> bytes_total_{0};
+    std::atomic<uint64_t> bytes_done_{0};
+    std::atomic<uint64_t> locked_bytes_{0};
+    std::atomic<int32_t> layers_total_{0};
+    std::atomic<int32_t> layers_done_{0};
+    std::atomic<int64_t> started_us_{0};
+    std::atomic<int64_t> finished_us_{0};
+    std::string path_;
+    std::string error_;
+
+    // Our own read-only view of the file; it shares page-cache pages with llama.cpp's map.
+    const uint8_t *mapping_ = nullptr;
+    uint64_t mapping_size_ = 0;
+    std::vector<std::pair<const uint8_t *, uint64_t>> locked_;
+#if defined(_WIN32)
+    void *file_handle_ = nullptr;
+    void *mapping_handle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_MODEL_PREFETCHER_HPP
@@ -0,0 +1,92 @@
+#ifndef LOCAL_AGENTS_MPSC_RING_HPP
+#define LOCAL_AGENTS_MPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace local_agents::runtime {
+
+// Bounded lock-free multi-producer / single-consumer ring. Every cell carries a sequence
+// number: producers claim a position with one CAS and publish by bumping the cell's
+// sequence, so a push never blocks on the consumer or on another producer and a full
+// ring is reported instead of waited on. Only one thread may call try_pop.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(size_t capacity) {
+        capacity_ = 2;
+        while (capacity_ < capacity) {
+            capacity_ <<= 1;
+        }
+        mask_ = capacity_ - 1;
+        cells_ = std::make_unique<Cell[]>(capacity_);
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscRing(const MpscRing &) = delete;
+    MpscRing &operator=(const MpscRing &) = delete;
+
+    size_t capacity() const { return capacity_; }
+
+    // Approximate while producers are active; exact from the consumer once they stop.
+    size_t size() const {
+        const size_t tail = tail_.load(std::memory_order_acquire);
+        const size_t head = head_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool try_push(T value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell &cell = cells_[pos & mask_];
+            const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // full: the consumer has not freed this cell yet
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T &out) {
+        const size_t pos = head_.load(std::memory_order_relaxed);
+        Cell &cell = cells_[pos & mask_];
+        const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1) < 0) {
+            return false; // empty, or the producer that claimed it has not published yet
+        }
+        out = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(pos + capacity_, std::memory_order_release);
+        head_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t capacity_ = 0;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<size_t> head_{0};
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_MPSC_RING_HPP
@@ -0,0 +1,73 @@
+#ifndef LOCAL_AGENTS_PIPER_VOICE_HPP
+#define LOCAL_AGENTS_PIPER_VOICE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ChildProcess.hpp"
+
+namespace local_agents::runtime {
+
+struct PiperVoiceOptions {
+    std::string binary;
+    std::string model;
+    std::string config;         // empty: piper's own default, <model>.json
+    std::string espeak_data;
+    std::string tashkeel_model;
+    int32_t speaker = -1;        // multi-speaker voices; -1 = piper's default
+    float length_scale = 0.0f;   // 0 = the voice config's value
+    float noise_scale = 0.0f;
+    float noise_w = 0.0f;
+    int32_t timeout_ms = 30000; // longest silence from piper before a line is abandoned
+};
+
+// One long-lived `piper --output_raw` process per voice. Piper loads the ONNX model once,
+// then synthesizes each stdin line to 16-bit mono PCM on stdout, so a line costs its
+// inference instead of a process start and a model load. Raw output carries no framing:
+// the end of an utterance is the "Real-time factor" line piper logs to stderr after it has
+// flushed that utterance's audio, which a reader thread counts.
+//
+// synthesize() serializes callers; a piper that dies or stalls is killed and the call
+// fails, and the next call starts a fresh one.
+class PiperVoice {
+public:
+    // Receives float samples as they arrive; returning false drops the rest of the line.
+    using PcmSink = std::function<bool(const float *samples, size_t count)>;
+
+    PiperVoice() = default;
+    ~PiperVoice();
+
+    PiperVoice(const PiperVoice &) = delete;
+    PiperVoice &operator=(const PiperVoice &) = delete;
+
+    bool start(const PiperVoiceOptions &options, std::string &error);
+    void stop();
+    bool running() const;
+    int32_t sample_rate() const { return sample_rate_; }
+    const PiperVoiceOptions &options() const { return options_; }
+
+    bool synthesize(const std::string &text, const PcmSink &sink, std::string &error);
+
+private:
+    void read_stderr();
+    void stop_locked();
+
+    mutable std::mutex mutex_; // one utterance at a time
+    ChildProcess process_;
+    std::thread stderr_thread_;
+    PiperVoiceOptions options_;
+    int32_t sample_rate_ = 22050;
+
+    mutable std::mutex status_mutex_; // written by the stderr reader
+    uint64_t utterances_done_ = 0;    // "Real-time factor" lines seen
+    bool exited_ = true;
+    std::string last_log_;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_PIPER_VOICE_HPP
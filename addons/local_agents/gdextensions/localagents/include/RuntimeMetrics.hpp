@@ -0,0 +1,160 @@
+#ifndef LOCAL_AGENTS_RUNTIME_METRICS_HPP
+#define LOCAL_AGENTS_RUNTIME_METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// Process-wide runtime metrics. Every instrument is a fixed member backed by relaxed
+// atomics, so recording from inference worker threads never takes a lock and readers
+// (Performance monitors, get_runtime_metrics(), the bench) only ever see slightly
+// stale values, never torn ones. Kept free of godot-cpp types so the native bench can
+// link it without the engine.
+
+class Counter {
+public:
+    void add(uint64_t amount = 1) { value_.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t get() const { return value_.load(std::memory_order_relaxed); }
+    void reset() { value_.store(0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+class Gauge {
+public:
+    void set(int64_t value) { value_.store(value, std::memory_order_relaxed); }
+    void add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    int64_t get() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+class RateGauge {
+public:
+    void set(double value) { value_.store(value, std::memory_order_relaxed); }
+    double get() const { return value_.load(std::memory_order_relaxed); }
+    void reset() { value_.store(0.0, std::memory_order_relaxed); }
+
+private:
+    std::atomic<double> value_{0.0};
+};
+
+// HDR-style log-linear histogram over microseconds: values below 32us are exact, above
+// that every power-of-two range is split into 16 linear sub-buckets (~6% worst-case
+// relative error) up to ~12 days. Recording is a single relaxed fetch_add.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBucketBits = 4;
+    static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+    static constexpr int kMaxExponent = 36;
+    static constexpr int kBucketCount = (kMaxExponent + 2) * kSubBucketCount;
+
+    void record(uint64_t micros);
+    void reset();
+
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    double mean() const;
+    // p in [0, 100]; returns the bucket midpoint in microseconds, 0 when empty.
+    double percentile(double p) const;
+
+    static int bucket_index(uint64_t micros);
+    static uint64_t bucket_lower_bound(int index);
+    static uint64_t bucket_upper_bound(int index);
+
+private:
+    std::array<std::atomic<uint64_t>, kBucketCount> buckets_{};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> sum_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// Records elapsed wall time into a histogram when it leaves scope.
+class ScopedLatency {
+public:
+    explicit ScopedLatency(LatencyHistogram &histogram)
+        : histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+    ~ScopedLatency();
+
+    ScopedLatency(const ScopedLatency &) = delete;
+    ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+private:
+    LatencyHistogram &histogram_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Increments a gauge for the lifetime of the scope (queue depth, in-flight requests).
+class ScopedGauge {
+public:
+    explicit ScopedGauge(Gauge &gauge) : gauge_(&gauge) { gauge_->add(1); }
+    ~ScopedGauge() { release(); }
+
+    void release() {
+        if (gauge_) {
+            gauge_->add(-1);
+            gauge_ = nullptr;
+        }
+    }
+
+    ScopedGauge(const ScopedGauge &) = delete;
+    ScopedGauge &operator=(const ScopedGauge &) = delete;
+
+private:
+    Gauge *gauge_;
+};
+
+uint64_t elapsed_micros(std::chrono::steady_clock::time_point since);
+
+class RuntimeMetrics {
+public:
+    struct Sample {
+        const char *name;
+        double value;
+    };
+
+    static RuntimeMetrics &get();
+
+    // Flattened, monitor-friendly view; names are stable and double as the
+    // Performance monitor suffix ("LocalAgents/<name>").
+    std::vector<Sample> samples() const;
+    bool sample(const std::string &name, double &out) const;
+    static std::vector<const char *> sample_names();
+
+    void reset();
+
+    Gauge queue_depth;
+    Gauge in_flight;
+    Counter requests_total;
+    Counter request_errors;
+    Counter prompt_tokens;
+    Counter completion_tokens;
+    LatencyHistogram ttft_us;
+    LatencyHistogram request_us;
+    RateGauge decode_tokens_per_second;
+    Gauge kv_cells_used;
+    Gauge kv_cells_total;
+    Counter embedding_requests;
+    Counter embedding_cache_hits;
+    Counter embedding_cache_misses;
+    Counter generation_cache_hits;
+    Counter generation_cache_misses;
+    Counter generation_requests_coalesced;
+    LatencyHistogram graph_query_us;
+    Counter transcriptions;
+    LatencyHistogram transcribe_us;
+    Counter tts_cache_hits;
+    Counter tts_cache_misses;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_RUNTIME_METRICS_HPP
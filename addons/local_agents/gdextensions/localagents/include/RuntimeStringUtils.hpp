@@ -15,6 +15,22 @@ inline godot::String from_utf8(const std::string &value) {
     return godot::String::utf8(value.c_str());
 }
 
+// Length of `value` without a trailing, still incomplete UTF-8 sequence, for showing text
+// that is being generated token by token.
+inline size_t complete_utf8_length(const std::string &value) {
+    size_t start = value.size();
+    // Walk back over at most three continuation bytes to the sequence's lead byte.
+    while (start > 0 && value.size() - start < 4 && (static_cast<unsigned char>(value[start - 1]) & 0xC0) == 0x80) {
+        --start;
+    }
+    if (start == 0) {
+        return value.size();
+    }
+    const unsigned char lead = static_cast<unsigned char>(value[start - 1]);
+    const size_t needed = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+    return value.size() - (start - 1) < needed ? start - 1 : value.size();
+}
+
 } // namespace local_agents::runtime
 
 #endif // LOCAL_AGENTS_RUNTIME_STRING_UTILS_HPP
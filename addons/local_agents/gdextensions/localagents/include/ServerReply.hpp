@@ -0,0 +1,34 @@
+#ifndef LOCAL_AGENTS_SERVER_REPLY_HPP
+#define LOCAL_AGENTS_SERVER_REPLY_HPP
+
+// llama.cpp vendors nlohmann/json; its location moved from common/ to vendor/nlohmann/.
+#if __has_include(<nlohmann/json.hpp>)
+#include <nlohmann/json.hpp>
+#elif __has_include(<vendor/nlohmann/json.hpp>)
+#include <vendor/nlohmann/json.hpp>
+#else
+#include <json.hpp>
+#endif
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace local_agents::runtime {
+
+using ServerJson = nlohmann::ordered_json;
+
+// Parses a llama-server chat-completions reply, keeping only what the runtime reads: id,
+// object, created, model, choices (minus logprobs), usage, error and the legacy content /
+// output_text fields. timings, logprobs, prompt_progress and anything else are skipped
+// while parsing and never built. `keep_all` keeps the whole document instead.
+bool parse_chat_reply(std::string_view body, bool keep_all, ServerJson &out, std::string &error);
+
+// Streams the first embedding vector out of an embeddings reply (`data[0].embedding` or a
+// top-level `embedding`) straight into floats, without building the document. On a reply
+// without one, `error` holds the server's error message or "invalid_embedding_response".
+bool parse_embedding_reply(std::string_view body, std::vector<float> &out, std::string &error);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_SERVER_REPLY_HPP
@@ -0,0 +1,89 @@
+#ifndef LOCAL_AGENTS_SHARED_THREAD_POOL_HPP
+#define LOCAL_AGENTS_SHARED_THREAD_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct llama_context;
+struct ggml_threadpool;
+
+namespace local_agents::runtime {
+
+struct ThreadingOptions {
+    // 0 = auto: hardware threads minus reserved_threads, so Godot's main, render and
+    // physics threads keep a core each instead of competing with ggml workers.
+    int32_t n_threads = 0;
+    int32_t n_threads_batch = 0;
+    int32_t reserved_threads = 2;
+    // "0xF0" hex bitmask or "4-7,12" CPU list; empty = no pinning.
+    std::string cpu_mask;
+    std::string cpu_mask_batch;
+    bool strict_cpu = false;
+    // ggml busy-wait level 0..100: higher wakes faster between graphs and burns more CPU.
+    int32_t poll = 0;
+    // ggml_sched_priority (0 normal, 1 medium, 2 high, 3 realtime).
+    int32_t priority = 0;
+    // Park workers after every request; the next decode resumes them automatically.
+    bool pause_when_idle = true;
+};
+
+// Owns the ggml threadpools a llama_context computes on: one for decode (n_threads) and one
+// for prompt prefill (n_threads_batch), shared when both resolve to the same size and mask.
+// A ggml pool runs one graph at a time, so each context of a pool gets its own instance.
+// Attaching explicit pools replaces llama.cpp's per-call thread spawn, pins workers when
+// masks are given, and lets the runtime park them while the scene is inactive. Pool pointers
+// are guarded by a mutex so pause/resume may come from the main thread while another thread
+// is decoding.
+class SharedThreadPool {
+public:
+    SharedThreadPool() = default;
+    ~SharedThreadPool();
+
+    SharedThreadPool(const SharedThreadPool &) = delete;
+    SharedThreadPool &operator=(const SharedThreadPool &) = delete;
+
+    bool configure(const ThreadingOptions &options, std::string &error);
+    void release();
+    bool is_configured() const;
+
+    void attach(llama_context *context) const;
+    static void detach(llama_context *context);
+
+    // Park workers until resume(), e.g. while the scene is paused or unfocused. A decode
+    // in the meantime still runs (ggml wakes the pool) and is parked again on_idle().
+    void pause();
+    void resume();
+    // Called after each request: parks the pool when pause_when_idle or a pause() hold is set.
+    void on_idle();
+    bool is_paused() const;
+
+    int32_t n_threads() const;
+    int32_t n_threads_batch() const;
+    ThreadingOptions options() const;
+
+    static int32_t resolve_thread_count(int32_t requested, int32_t reserved);
+    // Share `index` of `parts` pools computing side by side: thread counts are divided and
+    // CPU masks split into disjoint runs so the pools do not fight over the same cores.
+    static ThreadingOptions partition(const ThreadingOptions &options, int32_t parts, int32_t index);
+    // Accepts "0x..." hex masks and comma-separated CPU ids / ranges ("0-3,8").
+    static bool parse_cpu_mask(const std::string &spec, bool *mask, size_t size, std::string &error);
+
+private:
+    void release_locked();
+    void pause_locked();
+
+    mutable std::mutex mutex_;
+    ggml_threadpool *pool_ = nullptr;
+    ggml_threadpool *pool_batch_ = nullptr;
+    ThreadingOptions options_;
+    int32_t n_threads_ = 0;
+    int32_t n_threads_batch_ = 0;
+    bool paused_ = false;
+    bool held_ = false;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_SHARED_THREAD_POOL_HPP
@@ -0,0 +1,88 @@
+#ifndef LOCAL_AGENTS_SPEECH_ENGINE_HPP
+#define LOCAL_AGENTS_SPEECH_ENGINE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct whisper_context;
+
+namespace local_agents::runtime {
+
+struct SpeechModelOptions {
+    bool use_gpu = true;
+    bool flash_attn = false;
+    int32_t gpu_device = 0;
+};
+
+struct TranscribeOptions {
+    std::string language = "en"; // "auto" detects
+    bool translate = false;
+    int32_t n_threads = 0;        // 0 = hardware threads minus the runtime's reserved two
+    int32_t beam_size = 0;        // 0 = greedy
+    float temperature = 0.0f;
+    bool timestamps = true;       // per-segment start/end; off skips the timestamp tokens
+    bool single_segment = false;  // one utterance in, one segment out (voice commands)
+    std::string initial_prompt;   // vocabulary hint: names, jargon
+};
+
+struct TranscriptSegment {
+    int64_t start_ms = 0;
+    int64_t end_ms = 0;
+    std::string text;
+};
+
+struct TranscribeResult {
+    std::string text;
+    std::string language;
+    std::vector<TranscriptSegment> segments;
+    double audio_ms = 0.0;
+    double encode_ms = 0.0;
+};
+
+// A resident whisper.cpp model. The old path spawned whisper-cli per utterance, so every
+// call paid process start, a full model load and a JSON round trip through the disk; this
+// keeps one whisper_context alive and runs whisper_full on PCM already in memory. It links
+// against the same ggml build as llama.cpp.
+//
+// whisper_full works on the context's single decoder state, so transcriptions serialize on
+// an internal mutex; cancel() aborts the one in flight at its next ggml callback. Without
+// LOCAL_AGENTS_WITH_WHISPER every entry point fails with "whisper_not_linked".
+class SpeechEngine {
+public:
+    static constexpr int32_t kSampleRate = 16000;
+
+    SpeechEngine() = default;
+    ~SpeechEngine();
+
+    SpeechEngine(const SpeechEngine &) = delete;
+    SpeechEngine &operator=(const SpeechEngine &) = delete;
+
+    static bool available();
+
+    // Replaces the resident model; a no-op when `path` is already loaded.
+    bool load(const std::string &path, const SpeechModelOptions &options, std::string &error);
+    void unload();
+    bool is_loaded() const;
+    std::string model_path() const;
+
+    // `samples` is mono float PCM at `sample_rate`; anything but 16 kHz is resampled first.
+    bool transcribe(const float *samples, size_t count, int32_t sample_rate, const TranscribeOptions &options,
+                    TranscribeResult &result, std::string &error);
+    void cancel();
+
+private:
+    void unload_locked();
+
+    mutable std::mutex mutex_;
+    whisper_context *context_ = nullptr;
+    std::string path_;
+    std::atomic<bool> cancelled_{false};
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_SPEECH_ENGINE_HPP
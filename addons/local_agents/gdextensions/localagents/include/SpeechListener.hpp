@@ -0,0 +1,61 @@
+#ifndef LOCAL_AGENTS_SPEECH_LISTENER_HPP
+#define LOCAL_AGENTS_SPEECH_LISTENER_HPP
+
+#include <godot_cpp/classes/audio_effect_capture.hpp>
+#include <godot_cpp/classes/ref.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/packed_vector2_array.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "VoiceActivity.hpp"
+
+namespace godot {
+
+// Live microphone input cut into utterances, returned by AgentRuntime::create_speech_listener().
+// Feed it every frame (capture() drains an AudioEffectCapture; push_frames()/push_pcm() take
+// audio you already have). Voice activity detection runs on the calling thread; each finished
+// utterance goes to the speech worker and comes back as utterance_transcribed(result), so
+// silence never reaches whisper and a reply can start one hangover after the speaker stops.
+class SpeechListener : public RefCounted {
+    GDCLASS(SpeechListener, RefCounted);
+
+public:
+    // Each returns how many utterances it queued for transcription.
+    int64_t push_pcm(const PackedFloat32Array &pcm);
+    int64_t push_frames(const PackedVector2Array &frames);
+    int64_t capture(const Ref<AudioEffectCapture> &effect);
+    // Ends an utterance in progress, e.g. on push-to-talk release.
+    int64_t flush();
+    // Drops buffered audio and an utterance in progress.
+    void reset();
+
+    bool is_speaking() const;
+    int32_t get_sample_rate() const;
+    double get_noise_floor_db() const;
+    // seconds_heard, seconds_voiced, voiced_ratio, utterances.
+    Dictionary get_stats() const;
+
+protected:
+    static void _bind_methods();
+
+private:
+    friend class AgentRuntime;
+
+    int64_t process(const float *samples, size_t count);
+    int64_t dispatch();
+
+    local_agents::runtime::VoiceActivityDetector vad_;
+    local_agents::runtime::VadOptions vad_options_;
+    Dictionary transcribe_options_;
+    std::vector<local_agents::runtime::VoicedSegment> finished_;
+    std::vector<float> mono_;
+    int64_t utterances_ = 0;
+};
+
+} // namespace godot
+
+#endif // LOCAL_AGENTS_SPEECH_LISTENER_HPP
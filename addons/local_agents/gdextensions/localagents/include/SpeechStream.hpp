@@ -0,0 +1,67 @@
+#ifndef LOCAL_AGENTS_SPEECH_STREAM_HPP
+#define LOCAL_AGENTS_SPEECH_STREAM_HPP
+
+#include <godot_cpp/classes/audio_stream_generator_playback.hpp>
+#include <godot_cpp/classes/ref.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "AudioPcm.hpp"
+
+namespace godot {
+
+// Text being spoken by a resident Piper voice, returned by AgentRuntime::begin_speech().
+// The synthesis thread writes PCM into a ring as piper produces it, so playback can start
+// on the first chunk: call fill(playback) each frame with an AudioStreamGenerator whose
+// mix_rate is get_sample_rate(), or read() the samples yourself.
+class SpeechStream : public RefCounted {
+    GDCLASS(SpeechStream, RefCounted);
+
+public:
+    // Shared with the synthesis thread, which may outlive the script's reference.
+    struct State {
+        explicit State(size_t capacity) : ring(capacity) {}
+
+        local_agents::runtime::PcmRing ring;
+        std::atomic<int32_t> sample_rate{0}; // set before the first sample is written
+        std::atomic<bool> producing{true};
+        std::atomic<bool> cancelled{false};
+        std::mutex error_mutex;
+        std::string error;
+
+        void finish(const std::string &failure);
+    };
+
+    SpeechStream();
+    ~SpeechStream() override;
+
+    int32_t get_sample_rate() const;
+    int64_t get_frames_available() const;
+    // Up to `max_frames` mono samples (-1 = everything buffered).
+    PackedFloat32Array read(int64_t max_frames = -1);
+    // Pushes as many buffered frames as the playback has room for; returns how many.
+    int64_t fill(const Ref<AudioStreamGeneratorPlayback> &playback);
+    bool is_synthesizing() const;
+    // Synthesis ended and every sample has been read.
+    bool is_finished() const;
+    String get_error() const;
+    void cancel();
+
+protected:
+    static void _bind_methods();
+
+private:
+    friend class AgentRuntime;
+
+    std::shared_ptr<State> state_;
+};
+
+} // namespace godot
+
+#endif // LOCAL_AGENTS_SPEECH_STREAM_HPP
@@ -0,0 +1,71 @@
+#ifndef LOCAL_AGENTS_TIMING_WHEEL_HPP
+#define LOCAL_AGENTS_TIMING_WHEEL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// Hierarchical timing wheel for periodic agent ticks: four levels of 256 one-millisecond
+// slots (~49 days of range). Advancing touches only the slots that come due plus an
+// occasional cascade, so a frame costs O(elapsed ms + due timers) however many timers are
+// registered. Periods carry a uniform +/- jitter, and the first fire lands at a random
+// phase so agents registered together do not all tick on the same frame.
+//
+// Not synchronized; AgentScheduler owns one on the main thread.
+class TimingWheel {
+public:
+    explicit TimingWheel(uint64_t seed = 0x9E3779B97F4A7C15ull);
+
+    // Registers `id` (or re-times it if already registered).
+    void schedule(uint64_t id, uint64_t period_ms, uint64_t jitter_ms);
+    void cancel(uint64_t id);
+    bool contains(uint64_t id) const { return timers_.count(id) != 0; }
+    size_t size() const { return timers_.size(); }
+    // Due ids held back by a previous advance()'s cap.
+    size_t backlog() const { return backlog_.size(); }
+    uint64_t now_ms() const { return now_; }
+
+    // Moves time forward and appends up to `max_due` due ids (0 = no cap) to `out`, each at
+    // most once. Ids over the cap are delivered first on the next call.
+    void advance(uint64_t elapsed_ms, size_t max_due, std::vector<uint64_t> &out);
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kBits = 8;
+    static constexpr uint64_t kSlots = 1ull << kBits;
+    static constexpr uint64_t kMask = kSlots - 1;
+
+    struct Timer {
+        uint64_t period = 1;
+        uint64_t jitter = 0;
+        uint64_t due = 0;
+        bool backlogged = false;
+        uint64_t delivered_at = UINT64_MAX; // target_ of the advance() that last delivered it
+    };
+    struct Slotted {
+        uint64_t id;
+        uint64_t due; // stale when it no longer matches the timer's due
+    };
+
+    uint64_t next_random();
+    uint64_t next_interval(const Timer &timer);
+    void place(uint64_t id, uint64_t due);
+    void step(size_t max_due, size_t base, std::vector<uint64_t> &out);
+    void deliver(uint64_t id, Timer &timer, size_t max_due, size_t base, std::vector<uint64_t> &out);
+
+    std::array<std::array<std::vector<Slotted>, kSlots>, kLevels> wheel_;
+    std::unordered_map<uint64_t, Timer> timers_;
+    std::deque<uint64_t> backlog_;
+    uint64_t now_ = 0;
+    uint64_t target_ = 0; // where the current advance() stops
+    uint64_t rng_;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_TIMING_WHEEL_HPP
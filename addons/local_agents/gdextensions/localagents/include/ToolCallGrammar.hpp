@@ -0,0 +1,47 @@
+#ifndef LOCAL_AGENTS_TOOL_CALL_GRAMMAR_HPP
+#define LOCAL_AGENTS_TOOL_CALL_GRAMMAR_HPP
+
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+struct ToolParameter {
+    std::string name;
+    std::string type;                 // JSON-schema type; anything but integer/number/boolean is text
+    std::vector<std::string> choices; // the schema's enum, if any
+    bool required = false;
+};
+
+struct ToolSpec {
+    std::string name;
+    std::vector<ToolParameter> parameters; // in declaration order
+};
+
+struct ToolArgument {
+    std::string name;
+    std::string value; // unescaped
+    std::string type;  // the declared parameter's type
+};
+
+struct ToolCall {
+    std::string name;
+    std::vector<ToolArgument> arguments;
+};
+
+// FunctionGemma's call syntax, <start_function_call>call:NAME{key:VALUE,...}<end_function_call>.
+// Text values are wrapped in <escape> markers when `escape_strings` (the released template),
+// or JSON-quoted with quoted keys for templates that spell calls as JSON.
+//
+// GBNF admitting exactly one call to one of `tools`: declared names only, required arguments
+// in order, optional ones after, enum values verbatim and numbers/booleans in their own shape.
+std::string function_call_grammar(const std::vector<ToolSpec> &tools, bool escape_strings);
+
+// Reads the first call in `text` (markers optional, either value spelling) and checks it
+// against `tools`. On failure `error` is unknown_tool, missing_argument or no_tool_call.
+bool parse_function_call(const std::string &text, const std::vector<ToolSpec> &tools, ToolCall &call,
+                         std::string &error);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_TOOL_CALL_GRAMMAR_HPP
@@ -0,0 +1,78 @@
+#ifndef LOCAL_AGENTS_TRACE_LOG_HPP
+#define LOCAL_AGENTS_TRACE_LOG_HPP
+
+#include "InferenceEngine.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace local_agents::runtime {
+
+enum class TraceKind : uint8_t {
+    Generate = 1,
+    Embed = 2,
+};
+
+// One engine-level request and what came back. `request.prompt` is the rendered prompt
+// (or the embedded text); it is left empty when the trace only keeps hashes.
+struct TraceRecord {
+    TraceKind kind = TraceKind::Generate;
+    uint64_t start_us = 0;    // since the trace was opened
+    uint64_t duration_us = 0; // request latency, including queueing
+    GenerationRequest request;
+    uint64_t prompt_hash = 0;
+    bool add_bos = true;      // embed only
+    bool normalize = true;    // embed only
+    bool ok = false;
+    int32_t prompt_tokens = 0;
+    int32_t completion_tokens = 0;
+    uint64_t ttft_us = 0;
+    uint64_t output_hash = 0; // text for generate, vector bytes for embed
+};
+
+uint64_t trace_hash(const void *data, size_t size);
+uint64_t trace_hash(const std::string &text);
+// Greedy sampling; the only requests whose replayed output must match bit for bit.
+bool trace_is_deterministic(const TraceRecord &record);
+
+// Appends TraceRecords to a compact little-endian binary file: an 8-byte magic and a
+// version, then length-prefixed records. Self-synchronized, so every generate/embed thread
+// can append; a request pays one short lock and a buffered write.
+class TraceWriter {
+public:
+    TraceWriter() = default;
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    bool open(const std::string &path, bool record_prompts, std::string &error);
+    // Flushes and closes; returns the number of records written.
+    uint64_t close();
+    bool is_open() const;
+    std::string path() const;
+
+    // Offset of `at` from open(), for TraceRecord::start_us.
+    uint64_t offset_us(std::chrono::steady_clock::time_point at) const;
+    void append(TraceRecord record);
+
+private:
+    mutable std::mutex mutex_;
+    std::atomic<bool> open_{false}; // lets callers skip building a record when not tracing
+    std::ofstream file_;
+    std::string path_;
+    std::chrono::steady_clock::time_point opened_;
+    bool record_prompts_ = true;
+    uint64_t records_ = 0;
+};
+
+bool read_trace(const std::string &path, std::vector<TraceRecord> &out, std::string &error);
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_TRACE_LOG_HPP
@@ -0,0 +1,80 @@
+#ifndef LOCAL_AGENTS_TTS_CLIP_CACHE_HPP
+#define LOCAL_AGENTS_TTS_CLIP_CACHE_HPP
+
+#include "PiperVoice.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace local_agents::runtime {
+
+// Collapses whitespace runs (newlines included) to one space and trims the ends, so lines
+// that piper would speak identically share a cache entry.
+std::string normalize_tts_text(const std::string &text);
+
+// Canonical key for one synthesized line: the voice model (path, size and mtime, so a
+// replaced model misses), its config, the speaker parameters and the normalized text.
+std::string tts_clip_key(const PiperVoiceOptions &voice, const std::string &normalized_text);
+
+// IMA ADPCM (4 bits per sample, a predictor/step header every block): speech compresses
+// 4:1 against 16-bit PCM and decodes at memory speed, the same trade games make for
+// shipped voice lines.
+std::vector<uint8_t> encode_adpcm(const float *samples, size_t count);
+bool decode_adpcm(const uint8_t *bytes, size_t size, size_t sample_count, std::vector<float> &out);
+
+// Content-addressed clip store on disk. Each entry is one file named by the hash of its
+// key, holding the full key (checked on read against hash collisions), the sample rate and
+// ADPCM samples. Writes go to a temp file that is renamed into place, so readers and other
+// processes never see a partial clip. An in-memory LRU index, rebuilt from the directory
+// (by mtime) on first use, keeps the total under `max_bytes`; a miss never touches disk.
+// Thread-safe.
+class TtsClipCache {
+public:
+    // max_bytes 0 disables the cache. Takes effect on the next call; a new directory is
+    // indexed lazily.
+    void configure(const std::filesystem::path &directory, uint64_t max_bytes);
+    bool enabled() const;
+
+    bool lookup(const std::string &key, std::vector<float> &samples, int32_t &sample_rate);
+    bool contains(const std::string &key);
+    bool store(const std::string &key, const float *samples, size_t count, int32_t sample_rate,
+               std::string &error);
+
+    // Deletes every clip in the directory.
+    void clear();
+    size_t entry_count();
+    uint64_t total_bytes();
+    uint64_t max_bytes() const;
+    std::filesystem::path directory() const;
+
+private:
+    struct Entry {
+        std::string name;
+        uint64_t bytes = 0;
+    };
+
+    bool ensure_index_locked();
+    void touch_locked(std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found);
+    void erase_locked(std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found);
+    void evict_locked();
+    std::filesystem::path path_for(const std::string &name) const;
+
+    mutable std::mutex mutex_;
+    std::filesystem::path directory_;
+    uint64_t max_bytes_ = 0;
+    bool indexed_ = false;
+    std::list<Entry> entries_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+    uint64_t total_bytes_ = 0;
+    uint64_t temp_counter_ = 0;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_TTS_CLIP_CACHE_HPP
@@ -0,0 +1,81 @@
+#ifndef LOCAL_AGENTS_VOICE_ACTIVITY_HPP
+#define LOCAL_AGENTS_VOICE_ACTIVITY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace local_agents::runtime {
+
+struct VadOptions {
+    int32_t frame_ms = 20;
+    float threshold_db = 9.0f;      // frame energy above the tracked noise floor
+    float min_energy_db = -50.0f;   // dBFS; quieter frames are never speech
+    float max_zcr = 0.35f;          // zero crossings per sample; noisier frames need twice the threshold
+    int32_t onset_ms = 60;          // voiced run that opens an utterance
+    int32_t hangover_ms = 400;      // silence that closes it
+    int32_t preroll_ms = 250;       // audio kept from before the onset
+    int32_t min_utterance_ms = 200; // less voiced audio than this (clicks, bumps) is dropped
+    int32_t max_utterance_ms = 20000; // longer speech is cut and carries on in a new utterance
+};
+
+struct VoicedSegment {
+    std::vector<float> samples;
+    int64_t start_sample = 0; // position in the stream, pre-roll included
+    int64_t end_sample = 0;
+};
+
+// Energy / zero-crossing voice activity detector for a mono stream at a fixed rate. Frames
+// louder than an adaptive noise floor by `threshold_db` count as voiced; a high zero-crossing
+// rate (hiss, fans, fricative-only noise) raises the bar. An utterance opens after `onset_ms`
+// of voiced frames, starting `preroll_ms` earlier so soft word onsets survive, and closes
+// after `hangover_ms` of silence, of which only a short tail is kept. Costs a few operations
+// per sample; not thread-safe.
+class VoiceActivityDetector {
+public:
+    void reset(int32_t sample_rate, const VadOptions &options = VadOptions());
+
+    // Appends every utterance that ended inside this block to `finished`.
+    void push(const float *samples, size_t count, std::vector<VoicedSegment> &finished);
+    // Closes an open utterance (end of recording, push-to-talk release).
+    void flush(std::vector<VoicedSegment> &finished);
+
+    bool in_speech() const { return in_speech_; }
+    float noise_floor_db() const { return noise_floor_db_; }
+    int32_t sample_rate() const { return sample_rate_; }
+    int64_t samples_seen() const { return position_; }
+    // Samples handed out in segments, the share of the stream transcription will see.
+    int64_t samples_voiced() const { return samples_voiced_; }
+
+private:
+    void process_frame(const float *frame, std::vector<VoicedSegment> &finished);
+    void close_utterance(size_t keep, std::vector<VoicedSegment> &finished);
+
+    VadOptions options_;
+    int32_t sample_rate_ = 16000;
+    size_t frame_samples_ = 320;
+    size_t onset_frames_ = 3;
+    size_t hangover_frames_ = 20;
+    size_t preroll_samples_ = 4000;
+    size_t tail_samples_ = 1600;
+    size_t min_samples_ = 3200;
+    size_t max_samples_ = 320000;
+
+    std::vector<float> partial_;   // samples short of a whole frame
+    std::vector<float> history_;   // recent audio while idle, for the pre-roll
+    VoicedSegment current_;
+    bool in_speech_ = false;
+    bool floor_ready_ = false;
+    float noise_floor_db_ = -90.0f;
+    size_t voiced_run_ = 0;
+    size_t silent_run_ = 0;
+    size_t utterance_voiced_frames_ = 0; // measured against min_utterance_ms
+    bool continued_ = false;             // current_ follows a max_utterance_ms cut
+    int64_t position_ = 0; // samples pushed, partial frame included
+    int64_t frame_end_ = 0; // samples processed as whole frames
+    int64_t samples_voiced_ = 0;
+};
+
+} // namespace local_agents::runtime
+
+#endif // LOCAL_AGENTS_VOICE_ACTIVITY_HPP
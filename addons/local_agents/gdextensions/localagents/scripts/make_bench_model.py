@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Write a tiny random-weight llama GGUF for localagents_bench.
+
+The bench needs a model that loads through the real llama.cpp path but is small enough to
+generate offline, commit-independent, and run in CI in seconds. This writes one with the
+standard library only (no numpy / gguf-py): a few transformer blocks of seeded random f32
+weights and a SentencePiece-style vocab (byte fallback + common English words), so prompts
+tokenize to realistic lengths. The output is deterministic for a given set of arguments, which
+keeps bench results comparable across commits.
+
+Usage:
+    python3 scripts/make_bench_model.py [--out bench/tiny-llama.gguf] [--n-embd 64] [--n-layer 2]
+"""
+
+import argparse
+import array
+import os
+import random
+import struct
+import sys
+
+GGUF_MAGIC = b"GGUF"
+GGUF_VERSION = 3
+GGUF_ALIGNMENT = 32
+
+# gguf_type
+T_UINT32 = 4
+T_INT32 = 5
+T_FLOAT32 = 6
+T_BOOL = 7
+T_STRING = 8
+T_ARRAY = 9
+
+# ggml_type
+GGML_TYPE_F32 = 0
+
+# llama_token_type
+TOKEN_NORMAL = 1
+TOKEN_UNKNOWN = 2
+TOKEN_CONTROL = 3
+TOKEN_BYTE = 6
+
+SPIECE_SPACE = "▁"
+
+WORDS = """
+the be to of and a in that have i it for not on with he as you do at this but his by from they
+we say her she or an will my one all would there their what so up out if about who get which go
+me when make can like time no just him know take people into year your good some could them see
+other than then now look only come its over think also back after use two how our work first
+well way even new want because any these give day most us agent agents village villager food water
+wood stone tree river hungry tired trade build walk gather rest talk help night morning market
+house farm field fish forest north south east west fire tool tools storm rain winter summer plan
+action move speak ask answer remember memory goal task need find carry eat sleep guard scout
+""".split()
+
+
+def parse_args():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--out", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "bench", "tiny-llama.gguf"))
+    parser.add_argument("--n-embd", type=int, default=64)
+    parser.add_argument("--n-layer", type=int, default=2)
+    parser.add_argument("--n-head", type=int, default=4)
+    parser.add_argument("--n-head-kv", type=int, default=2)
+    parser.add_argument("--n-ff", type=int, default=172)
+    parser.add_argument("--n-ctx-train", type=int, default=8192)
+    parser.add_argument("--seed", type=int, default=1234)
+    return parser.parse_args()
+
+
+def build_vocab():
+    tokens = ["<unk>", "<s>", "</s>"]
+    types = [TOKEN_UNKNOWN, TOKEN_CONTROL, TOKEN_CONTROL]
+    for byte in range(256):
+        tokens.append("<0x%02X>" % byte)
+        types.append(TOKEN_BYTE)
+    for control in ("<|im_start|>", "<|im_end|>"):
+        tokens.append(control)
+        types.append(TOKEN_CONTROL)
+
+    seen = set(tokens)
+
+    def add(piece):
+        if piece not in seen:
+            seen.add(piece)
+            tokens.append(piece)
+            types.append(TOKEN_NORMAL)
+
+    add(SPIECE_SPACE)
+    for code in range(33, 127):
+        add(chr(code))
+    # SPM merges pairwise, so every prefix of a word must itself be a token for the
+    # merge chain to reach the whole word.
+    for word in WORDS:
+        piece = SPIECE_SPACE + word
+        for end in range(2, len(piece) + 1):
+            add(piece[:end])
+
+    # Longer pieces score higher so the bigram merge prefers them.
+    scores = []
+    for index, (piece, kind) in enumerate(zip(tokens, types)):
+        scores.append(float(len(piece)) - index * 1e-4 if kind == TOKEN_NORMAL else 0.0)
+    return tokens, scores, types
+
+
+class GGUFWriter:
+    def __init__(self):
+        self.kv = []
+        self.tensors = []
+
+    @staticmethod
+    def _string(value):
+        data = value.encode("utf-8")
+        return struct.pack("<Q", len(data)) + data
+
+    def add_u32(self, key, value):
+        self.kv.append(self._string(key) + struct.pack("<II", T_UINT32, value))
+
+    def add_f32(self, key, value):
+        self.kv.append(self._string(key) + struct.pack("<If", T_FLOAT32, value))
+
+    def add_bool(self, key, value):
+        self.kv.append(self._string(key) + struct.pack("<IB", T_BOOL, 1 if value else 0))
+
+    def add_str(self, key, value):
+        self.kv.append(self._string(key) + struct.pack("<I", T_STRING) + self._string(value))
+
+    def add_array(self, key, elem_type, values):
+        body = bytearray(self._string(key) + struct.pack("<IIQ", T_ARRAY, elem_type, len(values)))
+        for value in values:
+            if elem_type == T_STRING:
+                body += self._string(value)
+            elif elem_type == T_FLOAT32:
+                body += struct.pack("<f", value)
+            elif elem_type == T_INT32:
+                body += struct.pack("<i", value)
+            else:
+                raise ValueError("unsupported array type %d" % elem_type)
+        self.kv.append(bytes(body))
+
+    def add_tensor(self, name, shape, values):
+        # shape is in ggml order (ne0 first, the contiguous dimension).
+        data = array.array("f", values)
+        if sys.byteorder != "little":
+            data.byteswap()
+        self.tensors.append((name, shape, data.tobytes()))
+
+    def write(self, path):
+        header = bytearray()
+        header += GGUF_MAGIC
+        header += struct.pack("<IQQ", GGUF_VERSION, len(self.tensors), len(self.kv))
+        for entry in self.kv:
+            header += entry
+
+        offset = 0
+        for name, shape, data in self.tensors:
+            header += self._string(name)
+            header += struct.pack("<I", len(shape))
+            for dim in shape:
+                header += struct.pack("<Q", dim)
+            header += struct.pack("<IQ", GGML_TYPE_F32, offset)
+            offset += len(data)
+            offset += (-offset) % GGUF_ALIGNMENT
+
+        header += b"\0" * ((-len(header)) % GGUF_ALIGNMENT)
+
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        tmp_path = path + ".tmp"
+        with open(tmp_path, "wb") as handle:
+            handle.write(header)
+            for _, _, data in self.tensors:
+                handle.write(data)
+                handle.write(b"\0" * ((-len(data)) % GGUF_ALIGNMENT))
+        os.replace(tmp_path, path)
+
+
+def main():
+    args = parse_args()
+    if args.n_embd % args.n_head != 0 or args.n_head % args.n_head_kv != 0:
+        sys.exit("n_embd must divide by n_head and n_head by n_head_kv")
+
+    rng = random.Random(args.seed)
+    tokens, scores, types = build_vocab()
+    n_vocab = len(tokens)
+    head_dim = args.n_embd // args.n_head
+    n_embd_kv = head_dim * args.n_head_kv
+
+    def weights(count, scale=0.02):
+        return [rng.gauss(0.0, scale) for _ in range(count)]
+
+    writer = GGUFWriter()
+    writer.add_str("general.architecture", "llama")
+    writer.add_str("general.name", "localagents-bench-tiny")
+    writer.add_u32("general.file_type", 0)
+    writer.add_u32("llama.vocab_size", n_vocab)
+    writer.add_u32("llama.context_length", args.n_ctx_train)
+    writer.add_u32("llama.embedding_length", args.n_embd)
+    writer.add_u32("llama.block_count", args.n_layer)
+    writer.add_u32("llama.feed_forward_length", args.n_ff)
+    writer.add_u32("llama.attention.head_count", args.n_head)
+    writer.add_u32("llama.attention.head_count_kv", args.n_head_kv)
+    writer.add_u32("llama.rope.dimension_count", head_dim)
+    writer.add_f32("llama.rope.freq_base", 10000.0)
+    writer.add_f32("llama.attention.layer_norm_rms_epsilon", 1e-5)
+    writer.add_str("tokenizer.ggml.model", "llama")
+    writer.add_array("tokenizer.ggml.tokens", T_STRING, tokens)
+    writer.add_array("tokenizer.ggml.scores", T_FLOAT32, scores)
+    writer.add_array("tokenizer.ggml.token_type", T_INT32, types)
+    writer.add_u32("tokenizer.ggml.unknown_token_id", 0)
+    writer.add_u32("tokenizer.ggml.bos_token_id", 1)
+    writer.add_u32("tokenizer.ggml.eos_token_id", 2)
+    writer.add_bool("tokenizer.ggml.add_bos_token", True)
+    writer.add_bool("tokenizer.ggml.add_eos_token", False)
+    writer.add_str(
+        "tokenizer.chat_template",
+        "{% for message in messages %}<|im_start|>{{ message['role'] }}\n{{ message['content'] }}<|im_end|>\n"
+        "{% endfor %}{% if add_generation_prompt %}<|im_start|>assistant\n{% endif %}",
+    )
+
+    writer.add_tensor("token_embd.weight", [args.n_embd, n_vocab], weights(args.n_embd * n_vocab))
+    for layer in range(args.n_layer):
+        prefix = "blk.%d." % layer
+        writer.add_tensor(prefix + "attn_norm.weight", [args.n_embd], [1.0] * args.n_embd)
+        writer.add_tensor(prefix + "attn_q.weight", [args.n_embd, args.n_embd], weights(args.n_embd * args.n_embd))
+        writer.add_tensor(prefix + "attn_k.weight", [args.n_embd, n_embd_kv], weights(args.n_embd * n_embd_kv))
+        writer.add_tensor(prefix + "attn_v.weight", [args.n_embd, n_embd_kv], weights(args.n_embd * n_embd_kv))
+        writer.add_tensor(prefix + "attn_output.weight", [args.n_embd, args.n_embd], weights(args.n_embd * args.n_embd))
+        writer.add_tensor(prefix + "ffn_norm.weight", [args.n_embd], [1.0] * args.n_embd)
+        writer.add_tensor(prefix + "ffn_gate.weight", [args.n_embd, args.n_ff], weights(args.n_embd * args.n_ff))
+        writer.add_tensor(prefix + "ffn_up.weight", [args.n_embd, args.n_ff], weights(args.n_embd * args.n_ff))
+        writer.add_tensor(prefix + "ffn_down.weight", [args.n_ff, args.n_embd], weights(args.n_ff * args.n_embd))
+    writer.add_tensor("output_norm.weight", [args.n_embd], [1.0] * args.n_embd)
+    writer.add_tensor("output.weight", [args.n_embd, n_vocab], weights(args.n_embd * n_vocab))
+
+    writer.write(args.out)
+    print("wrote %s (%d tokens, %d layers, n_embd=%d)" % (args.out, n_vocab, args.n_layer, args.n_embd))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+#!/usr/bin/env bash
+set -euo pipefail
+
+SCRIPT_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+EXT_DIR=$(cd "${SCRIPT_DIR}/.." && pwd)
+BUILD_DIR="${EXT_DIR}/build"
+MODEL_PATH="${EXT_DIR}/bench/tiny-llama.gguf"
+RESULTS_DIR="${EXT_DIR}/bench/results"
+BENCH_ARGS=()
+
+usage() {
+    cat <<USAGE
+Usage: $(basename "$0") [options] [-- localagents_bench args]
+
+Builds localagents_bench, generates the tiny offline bench model if needed, and writes
+bench/results/<commit>.json.
+
+Options:
+  --build-dir <path>   CMake build directory (default: ./build).
+  --model <path>       GGUF to benchmark (default: bench/tiny-llama.gguf, generated).
+  --out-dir <path>     Results directory (default: bench/results).
+  -h, --help           Show this help.
+USAGE
+}
+
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --build-dir)
+            [[ $# -lt 2 ]] && { echo "Error: --build-dir expects a value" >&2; exit 1; }
+            BUILD_DIR="$2"
+            shift 2
+            ;;
+        --model)
+            [[ $# -lt 2 ]] && { echo "Error: --model expects a value" >&2; exit 1; }
+            MODEL_PATH="$2"
+            shift 2
+            ;;
+        --out-dir)
+            [[ $# -lt 2 ]] && { echo "Error: --out-dir expects a value" >&2; exit 1; }
+            RESULTS_DIR="$2"
+            shift 2
+            ;;
+        --)
+            shift
+            BENCH_ARGS=("$@")
+            break
+            ;;
+        -h|--help)
+            usage
+            exit 0
+            ;;
+        *)
+            echo "Error: unknown option '$1'" >&2
+            usage
+            exit 1
+            ;;
+    esac
+done
+
+cmake -S "${EXT_DIR}" -B "${BUILD_DIR}" -DCMAKE_BUILD_TYPE=Release -DLOCAL_AGENTS_BUILD_BENCH=ON
+cmake --build "${BUILD_DIR}" --target localagents_bench --config Release
+
+if [[ ! -f "${MODEL_PATH}" ]]; then
+    python3 "${SCRIPT_DIR}/make_bench_model.py" --out "${MODEL_PATH}"
+fi
+
+BENCH_BIN="${BUILD_DIR}/localagents_bench"
+if [[ ! -x "${BENCH_BIN}" ]]; then
+    BENCH_BIN=$(find "${BUILD_DIR}" -type f \( -name localagents_bench -o -name localagents_bench.exe \) | head -n 1)
+fi
+
+COMMIT=$(git -C "${EXT_DIR}" rev-parse --short HEAD 2>/dev/null || echo "unknown")
+mkdir -p "${RESULTS_DIR}"
+OUT_FILE="${RESULTS_DIR}/${COMMIT}.json"
+
+"${BENCH_BIN}" --model "${MODEL_PATH}" --out "${OUT_FILE}" ${BENCH_ARGS[@]+"${BENCH_ARGS[@]}"}
+echo "Bench results written to ${OUT_FILE}."
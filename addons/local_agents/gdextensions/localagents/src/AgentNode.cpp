@@ -1,36 +1,72 @@
 #include "AgentNode.hpp"
 #include "AgentRuntime.hpp"
+#include "AgentScheduler.hpp"
+#include "Conversation.hpp"
+#include "RuntimeStringUtils.hpp"
 
 #include <godot_cpp/classes/engine.hpp>
 #include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
 
+#include <algorithm>
+
 using namespace godot;
+using local_agents::runtime::ChatMessage;
+using local_agents::runtime::Conversation;
+using local_agents::runtime::from_utf8;
+using local_agents::runtime::to_utf8;
+
+namespace {
+constexpr size_t kActionQueueCapacity = 256;
+}
 
-AgentNode::AgentNode() = default;
-AgentNode::~AgentNode() = default;
+AgentNode::AgentNode() : conversation_(std::make_shared<Conversation>()), action_ring_(kActionQueueCapacity) {
+    conversation_->set_max_tokens(2048);
+}
+
+AgentNode::~AgentNode() {
+    if (AgentRuntime *runtime = AgentRuntime::get_singleton()) {
+        runtime->release_conversation(conversation_->id());
+    }
+}
 
 void AgentNode::_bind_methods() {
     ClassDB::bind_method(D_METHOD("load_model", "model_path", "options"), &AgentNode::load_model);
+    ClassDB::bind_method(D_METHOD("load_model_async", "model_path", "options"), &AgentNode::load_model_async, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("unload_model"), &AgentNode::unload_model);
     ClassDB::bind_method(D_METHOD("add_message", "role", "content"), &AgentNode::add_message);
     ClassDB::bind_method(D_METHOD("get_history"), &AgentNode::get_history);
     ClassDB::bind_method(D_METHOD("clear_history"), &AgentNode::clear_history);
+    ClassDB::bind_method(D_METHOD("get_history_tokens"), &AgentNode::get_history_tokens);
+    ClassDB::bind_method(D_METHOD("get_conversation_id"), &AgentNode::get_conversation_id);
+    ClassDB::bind_method(D_METHOD("set_max_history_tokens", "tokens"), &AgentNode::set_max_history_tokens);
+    ClassDB::bind_method(D_METHOD("get_max_history_tokens"), &AgentNode::get_max_history_tokens);
+    ClassDB::bind_method(D_METHOD("set_history_summary", "summary"), &AgentNode::set_history_summary);
+    ClassDB::bind_method(D_METHOD("get_history_summary"), &AgentNode::get_history_summary);
     ClassDB::bind_method(D_METHOD("think", "prompt", "extra_options"), &AgentNode::think);
+    ClassDB::bind_static_method("AgentNode", D_METHOD("think_many", "items"), &AgentNode::think_many);
     ClassDB::bind_method(D_METHOD("say", "text", "options"), &AgentNode::say);
     ClassDB::bind_method(D_METHOD("listen", "options"), &AgentNode::listen);
-    ClassDB::bind_method(D_METHOD("enqueue_action", "name", "params"), &AgentNode::enqueue_action);
+    ClassDB::bind_method(D_METHOD("start_listening", "options"), &AgentNode::start_listening, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("enqueue_action", "name", "params", "options"), &AgentNode::enqueue_action, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("get_pending_action_count"), &AgentNode::get_pending_action_count);
+    ClassDB::bind_method(D_METHOD("clear_actions"), &AgentNode::clear_actions);
 
     ClassDB::bind_method(D_METHOD("set_tick_enabled", "enabled"), &AgentNode::set_tick_enabled);
     ClassDB::bind_method(D_METHOD("is_tick_enabled"), &AgentNode::is_tick_enabled);
     ClassDB::bind_method(D_METHOD("set_tick_interval", "seconds"), &AgentNode::set_tick_interval);
     ClassDB::bind_method(D_METHOD("get_tick_interval"), &AgentNode::get_tick_interval);
+    ClassDB::bind_method(D_METHOD("set_tick_jitter", "seconds"), &AgentNode::set_tick_jitter);
+    ClassDB::bind_method(D_METHOD("get_tick_jitter"), &AgentNode::get_tick_jitter);
     ClassDB::bind_method(D_METHOD("set_max_actions_per_tick", "actions"), &AgentNode::set_max_actions_per_tick);
     ClassDB::bind_method(D_METHOD("get_max_actions_per_tick"), &AgentNode::get_max_actions_per_tick);
     ClassDB::bind_method(D_METHOD("set_db_path", "path"), &AgentNode::set_db_path);
     ClassDB::bind_method(D_METHOD("get_db_path"), &AgentNode::get_db_path);
     ClassDB::bind_method(D_METHOD("set_voice", "voice"), &AgentNode::set_voice);
     ClassDB::bind_method(D_METHOD("get_voice"), &AgentNode::get_voice);
+    ClassDB::bind_method(D_METHOD("set_lora", "lora_id"), &AgentNode::set_lora);
+    ClassDB::bind_method(D_METHOD("get_lora"), &AgentNode::get_lora);
     ClassDB::bind_method(D_METHOD("set_default_model_path", "path"), &AgentNode::set_default_model_path);
     ClassDB::bind_method(D_METHOD("get_default_model_path"), &AgentNode::get_default_model_path);
     ClassDB::bind_method(D_METHOD("set_runtime_directory", "path"), &AgentNode::set_runtime_directory);
@@ -38,35 +74,139 @@ void AgentNode::_bind_methods() {
 
     ADD_PROPERTY(PropertyInfo(Variant::BOOL, "tick_enabled"), "set_tick_enabled", "is_tick_enabled");
     ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "tick_interval"), "set_tick_interval", "get_tick_interval");
+    ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "tick_jitter"), "set_tick_jitter", "get_tick_jitter");
     ADD_PROPERTY(PropertyInfo(Variant::INT, "max_actions_per_tick"), "set_max_actions_per_tick", "get_max_actions_per_tick");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "db_path"), "set_db_path", "get_db_path");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "voice"), "set_voice", "get_voice");
+    ADD_PROPERTY(PropertyInfo(Variant::STRING, "lora"), "set_lora", "get_lora");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_history_tokens"), "set_max_history_tokens", "get_max_history_tokens");
+    ADD_PROPERTY(PropertyInfo(Variant::STRING, "history_summary"), "set_history_summary", "get_history_summary");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "default_model_path"), "set_default_model_path", "get_default_model_path");
     ADD_PROPERTY(PropertyInfo(Variant::STRING, "runtime_directory"), "set_runtime_directory", "get_runtime_directory");
 
     ADD_SIGNAL(MethodInfo("message_emitted", PropertyInfo(Variant::STRING, "role"), PropertyInfo(Variant::STRING, "content")));
     ADD_SIGNAL(MethodInfo("action_requested", PropertyInfo(Variant::STRING, "action"), PropertyInfo(Variant::DICTIONARY, "params")));
+    ADD_SIGNAL(MethodInfo("history_evicted", PropertyInfo(Variant::ARRAY, "messages")));
+    ADD_SIGNAL(MethodInfo("utterance_transcribed", PropertyInfo(Variant::STRING, "text"), PropertyInfo(Variant::DICTIONARY, "result")));
 }
 
-void AgentNode::_process(double delta) {
-    if (!tick_enabled_) {
+void AgentNode::_notification(int what) {
+    if (what == NOTIFICATION_ENTER_TREE) {
+        update_tick_registration();
         return;
     }
-    tick_accumulator_ += delta;
-    if (tick_accumulator_ < tick_interval_ || tick_interval_ <= 0.0) {
+    if (what == NOTIFICATION_EXIT_TREE) {
+        // Still inside the tree while this is delivered, so unregister directly.
+        if (AgentScheduler *scheduler = AgentScheduler::get_singleton()) {
+            scheduler->unregister_agent(this);
+        }
         return;
     }
-    tick_accumulator_ = 0.0;
-    if (!Engine::get_singleton()->is_editor_hint()) {
+}
+
+void AgentNode::update_tick_registration() {
+    AgentScheduler *scheduler = AgentScheduler::get_singleton();
+    if (!scheduler) {
+        return;
+    }
+    const bool wanted =
+        tick_enabled_ && tick_interval_ > 0.0 && is_inside_tree() && !Engine::get_singleton()->is_editor_hint();
+    ticking_.store(wanted);
+    if (wanted) {
+        scheduler->register_agent(this, tick_interval_, tick_jitter_);
+    } else {
+        scheduler->unregister_agent(this);
+        // Whatever was waiting for the next tick now drains per frame instead.
+        if (get_pending_action_count() > 0 && !drain_requested_.exchange(true)) {
+            scheduler->request_drain(this);
+        }
+    }
+}
+
+void AgentNode::scheduler_tick(bool emit_tick) {
+    if (emit_tick) {
         emit_signal("action_requested", String("tick"), Dictionary());
     }
+    dispatch_actions();
 }
 
-bool AgentNode::load_model(const String &model_path, const Dictionary &options) {
+bool AgentNode::scheduler_drain() {
+    // Clear first: an enqueue racing with this dispatch then arms its own drain.
+    drain_requested_.store(false);
+    const bool more = dispatch_actions();
+    return more && !ticking_.load() && !drain_requested_.exchange(true);
+}
+
+void AgentNode::request_action_drain() {
+    if (AgentScheduler *scheduler = AgentScheduler::get_singleton()) {
+        scheduler->request_drain(this);
+    } else {
+        drain_requested_.store(false);
+        dispatch_actions();
+    }
+}
+
+bool AgentNode::dispatch_actions() {
+    std::unique_ptr<QueuedAction> popped;
+    bool resort = false;
+    while (action_ring_.try_pop(popped)) {
+        QueuedAction &incoming = *popped;
+        if (!incoming.coalesce_key.is_empty()) {
+            const std::string key = to_utf8(incoming.coalesce_key);
+            auto found = staged_keys_.find(key);
+            if (found != staged_keys_.end()) {
+                // Latest content wins but keeps the older slot, so a key that is
+                // re-sent every frame still reaches the front.
+                for (QueuedAction &staged : staged_actions_) {
+                    if (staged.sequence == found->second) {
+                        incoming.sequence = staged.sequence;
+                        staged = std::move(incoming);
+                        break;
+                    }
+                }
+                pending_actions_.fetch_sub(1);
+                resort = true;
+                continue;
+            }
+            staged_keys_[key] = next_action_sequence_;
+        }
+        incoming.sequence = next_action_sequence_++;
+        staged_actions_.push_back(std::move(incoming));
+        resort = true;
+    }
+    if (staged_actions_.empty()) {
+        return false;
+    }
+    if (resort) {
+        std::sort(staged_actions_.begin(), staged_actions_.end(), [](const QueuedAction &a, const QueuedAction &b) {
+            return a.priority != b.priority ? a.priority > b.priority : a.sequence < b.sequence;
+        });
+    }
+
+    const size_t count = max_actions_per_tick_ > 0
+                             ? std::min(staged_actions_.size(), static_cast<size_t>(max_actions_per_tick_))
+                             : staged_actions_.size();
+    std::vector<QueuedAction> batch(std::make_move_iterator(staged_actions_.begin()),
+                                    std::make_move_iterator(staged_actions_.begin() + count));
+    staged_actions_.erase(staged_actions_.begin(), staged_actions_.begin() + count);
+    pending_actions_.fetch_sub(static_cast<int>(count));
+    for (const QueuedAction &action : batch) {
+        if (!action.coalesce_key.is_empty()) {
+            staged_keys_.erase(to_utf8(action.coalesce_key));
+        }
+    }
+    // Handlers may enqueue more; those land in the ring and wait for the next dispatch.
+    for (const QueuedAction &action : batch) {
+        emit_signal("action_requested", action.name, action.payload);
+    }
+    return !staged_actions_.empty() || action_ring_.size() > 0;
+}
+
+AgentRuntime *AgentNode::configured_runtime() const {
     AgentRuntime *runtime = AgentRuntime::get_singleton();
     if (!runtime) {
         UtilityFunctions::push_error("AgentRuntime singleton not available");
-        return false;
+        return nullptr;
     }
     if (!runtime_directory_.is_empty()) {
         runtime->set_runtime_directory(runtime_directory_);
@@ -74,7 +214,18 @@ bool AgentNode::load_model(const String &model_path, const Dictionary &options)
     if (!default_model_path_.is_empty()) {
         runtime->set_default_model_path(default_model_path_);
     }
-    return runtime->load_model(model_path, options);
+    return runtime;
+}
+
+bool AgentNode::load_model(const String &model_path, const Dictionary &options) {
+    AgentRuntime *runtime = configured_runtime();
+    return runtime && runtime->load_model(model_path, options);
+}
+
+bool AgentNode::load_model_async(const String &model_path, const Dictionary &options) {
+    // Progress and completion arrive as AgentRuntime's model_load_progress / model_loaded.
+    AgentRuntime *runtime = configured_runtime();
+    return runtime && runtime->load_model_async(model_path, options);
 }
 
 void AgentNode::unload_model() {
@@ -84,24 +235,73 @@ void AgentNode::unload_model() {
     }
 }
 
+void AgentNode::sync_conversation() {
+    // Tokenizes only what was added since the last sync (or everything after a model change);
+    // without a local model the window runs on estimates.
+    AgentRuntime *runtime = AgentRuntime::get_singleton();
+    if (runtime) {
+        runtime->tokenize_conversation(*conversation_);
+    }
+    const std::vector<ChatMessage> evicted = conversation_->trim();
+    if (evicted.empty()) {
+        return;
+    }
+    Array messages;
+    for (const ChatMessage &message : evicted) {
+        Dictionary entry;
+        entry["role"] = from_utf8(message.role);
+        entry["content"] = from_utf8(message.content);
+        messages.append(entry);
+    }
+    emit_signal("history_evicted", messages);
+}
+
 void AgentNode::add_message(const String &role, const String &content) {
-    history_.push_back({role, content});
+    conversation_->append(to_utf8(role), to_utf8(content));
+    sync_conversation();
 }
 
 TypedArray<Dictionary> AgentNode::get_history() const {
+    const std::vector<ChatMessage> messages = conversation_->messages();
     TypedArray<Dictionary> result;
-    result.resize(history_.size());
-    for (size_t i = 0; i < history_.size(); ++i) {
+    result.resize(static_cast<int64_t>(messages.size()));
+    for (size_t i = 0; i < messages.size(); ++i) {
         Dictionary entry;
-        entry["role"] = history_[i].role;
-        entry["content"] = history_[i].content;
-        result[i] = entry;
+        entry["role"] = from_utf8(messages[i].role);
+        entry["content"] = from_utf8(messages[i].content);
+        result[static_cast<int64_t>(i)] = entry;
     }
     return result;
 }
 
 void AgentNode::clear_history() {
-    history_.clear();
+    conversation_->clear();
+}
+
+int AgentNode::get_history_tokens() const {
+    return static_cast<int>(conversation_->token_total());
+}
+
+int64_t AgentNode::get_conversation_id() const {
+    return conversation_->id();
+}
+
+void AgentNode::set_max_history_tokens(int tokens) {
+    conversation_->set_max_tokens(tokens);
+    sync_conversation();
+}
+
+int AgentNode::get_max_history_tokens() const {
+    return conversation_->max_tokens();
+}
+
+void AgentNode::set_history_summary(const String &summary) {
+    conversation_->set_summary(to_utf8(summary));
+    sync_conversation();
+}
+
+String AgentNode::get_history_summary() const {
+    return from_utf8(conversation_->summary());
 }
 
 Dictionary AgentNode::think(const String &prompt, const Dictionary &extra_options) {
@@ -113,6 +313,54 @@ Dictionary AgentNode::think(const String &prompt, const Dictionary &extra_option
         return response;
     }
 
+    Dictionary raw = runtime->generate(begin_think(runtime, prompt, extra_options));
+    finish_think(raw);
+    return raw;
+}
+
+Array AgentNode::think_many(const Array &items) {
+    Array responses;
+    responses.resize(items.size());
+    AgentRuntime *runtime = AgentRuntime::get_singleton();
+    if (!runtime) {
+        Dictionary error;
+        error["ok"] = false;
+        error["error"] = "runtime_unavailable";
+        for (int i = 0; i < items.size(); ++i) {
+            responses[i] = error.duplicate();
+        }
+        return responses;
+    }
+
+    std::vector<AgentNode *> nodes;
+    std::vector<int> positions;
+    Array requests;
+    for (int i = 0; i < items.size(); ++i) {
+        const Dictionary item = items[i];
+        AgentNode *node = Object::cast_to<AgentNode>(item.get("node", Variant()));
+        if (!node) {
+            Dictionary error;
+            error["ok"] = false;
+            error["error"] = "invalid_agent";
+            responses[i] = error;
+            continue;
+        }
+        requests.append(node->begin_think(runtime, item.get("prompt", String()), item.get("options", Dictionary())));
+        nodes.push_back(node);
+        positions.push_back(i);
+    }
+
+    // One call, so the runtime can prefill and decode every agent's turn in the same batches.
+    const Array raw = runtime->generate_many(requests);
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        const Dictionary response = raw[static_cast<int>(k)];
+        nodes[k]->finish_think(response);
+        responses[positions[k]] = response;
+    }
+    return responses;
+}
+
+Dictionary AgentNode::begin_think(AgentRuntime *runtime, const String &prompt, const Dictionary &extra_options) {
     if (!default_model_path_.is_empty()) {
         runtime->set_default_model_path(default_model_path_);
     }
@@ -120,14 +368,26 @@ Dictionary AgentNode::think(const String &prompt, const Dictionary &extra_option
         runtime->set_runtime_directory(runtime_directory_);
     }
 
+    // The prompt joins the conversation first (tokenized once, here), and the runtime renders
+    // the whole turn from the conversation's cached text and tokens.
+    runtime->register_conversation(conversation_);
     add_message("user", prompt);
 
     Dictionary request;
-    request["prompt"] = prompt;
-    request["history"] = get_history();
-    request["options"] = extra_options;
+    request["conversation"] = conversation_->id();
+    Dictionary options = extra_options.duplicate();
+    if (!lora_.is_empty() && !options.has("lora")) {
+        options["lora"] = lora_;
+    }
+    // Keeps this node on the pooled context that already holds its conversation.
+    if (!options.has("conversation_id")) {
+        options["conversation_id"] = String::num_uint64(get_instance_id());
+    }
+    request["options"] = options;
+    return request;
+}
 
-    Dictionary raw = runtime->generate(request);
+void AgentNode::finish_think(const Dictionary &raw) {
     if ((bool)raw.get("ok", false)) {
         String text = raw.get("text", String());
         if (!text.is_empty()) {
@@ -135,7 +395,6 @@ Dictionary AgentNode::think(const String &prompt, const Dictionary &extra_option
             emit_signal("message_emitted", String("assistant"), text);
         }
     }
-    return raw;
 }
 
 bool AgentNode::say(const String &text, const Dictionary &options) {
@@ -190,14 +449,74 @@ String AgentNode::listen(const Dictionary &options) {
     return transcript;
 }
 
-void AgentNode::enqueue_action(const String &name, const Dictionary &params) {
-    Dictionary payload = params.duplicate();
-    payload["name"] = name;
-    emit_signal("action_requested", name, payload);
+Ref<SpeechListener> AgentNode::start_listening(const Dictionary &options) {
+    AgentRuntime *runtime = AgentRuntime::get_singleton();
+    if (!runtime) {
+        UtilityFunctions::push_error("AgentRuntime singleton unavailable");
+        return Ref<SpeechListener>();
+    }
+    Ref<SpeechListener> listener = runtime->create_speech_listener(options);
+    listener->connect("utterance_transcribed", callable_mp(this, &AgentNode::on_utterance_transcribed));
+    return listener;
+}
+
+void AgentNode::on_utterance_transcribed(const Dictionary &result) {
+    if (!result.get("ok", false)) {
+        String error = result.get("error", String("whisper_failed"));
+        UtilityFunctions::push_error(String("Whisper transcription failed: ") + error);
+        return;
+    }
+    String transcript = result.get("text", String());
+    if (transcript.is_empty()) {
+        return; // a cough or a breath the VAD let through
+    }
+    add_message("user", transcript);
+    emit_signal("message_emitted", String("user"), transcript);
+    emit_signal("utterance_transcribed", transcript, result);
+}
+
+bool AgentNode::enqueue_action(const String &name, const Dictionary &params, const Dictionary &options) {
+    auto queued = std::make_unique<QueuedAction>();
+    QueuedAction &action = *queued;
+    action.name = name;
+    // Snapshot now: the caller may keep mutating `params` on its own thread.
+    action.payload = params.duplicate(true);
+    action.payload["name"] = name;
+    action.coalesce_key = String(options.get("coalesce_key", String()));
+    action.priority = int(options.get("priority", 0));
+    // Counted before the push so a dispatch that pops it first never sees the count go negative.
+    pending_actions_.fetch_add(1);
+    if (!action_ring_.try_push(std::move(queued))) {
+        pending_actions_.fetch_sub(1);
+        UtilityFunctions::push_warning("AgentNode::enqueue_action - action queue full, dropping " + name);
+        return false;
+    }
+    // Ticking nodes drain on their next tick; otherwise ask for a per-frame drain. The
+    // deferred hop makes this safe from worker threads.
+    if (!ticking_.load() && !drain_requested_.exchange(true)) {
+        callable_mp(this, &AgentNode::request_action_drain).call_deferred();
+    }
+    return true;
+}
+
+int AgentNode::get_pending_action_count() const {
+    return pending_actions_.load();
+}
+
+void AgentNode::clear_actions() {
+    std::unique_ptr<QueuedAction> discarded;
+    int dropped = static_cast<int>(staged_actions_.size());
+    while (action_ring_.try_pop(discarded)) {
+        ++dropped;
+    }
+    pending_actions_.fetch_sub(dropped);
+    staged_actions_.clear();
+    staged_keys_.clear();
 }
 
 void AgentNode::set_tick_enabled(bool enabled) {
     tick_enabled_ = enabled;
+    update_tick_registration();
 }
 
 bool AgentNode::is_tick_enabled() const {
@@ -206,12 +525,22 @@ bool AgentNode::is_tick_enabled() const {
 
 void AgentNode::set_tick_interval(double seconds) {
     tick_interval_ = seconds;
+    update_tick_registration();
 }
 
 double AgentNode::get_tick_interval() const {
     return tick_interval_;
 }
 
+void AgentNode::set_tick_jitter(double seconds) {
+    tick_jitter_ = seconds > 0.0 ? seconds : 0.0;
+    update_tick_registration();
+}
+
+double AgentNode::get_tick_jitter() const {
+    return tick_jitter_;
+}
+
 void AgentNode::set_max_actions_per_tick(int actions) {
     max_actions_per_tick_ = actions;
 }
@@ -236,6 +565,14 @@ String AgentNode::get_voice() const {
     return voice_;
 }
 
+void AgentNode::set_lora(const String &lora_id) {
+    lora_ = lora_id;
+}
+
+String AgentNode::get_lora() const {
+    return lora_;
+}
+
 void AgentNode::set_default_model_path(const String &path) {
     default_model_path_ = path;
     if (AgentRuntime::get_singleton()) {
@@ -1,13 +1,20 @@
 #include "AgentRuntime.hpp"
+#include "AudioPcm.hpp"
+#include "GenerationHandle.hpp"
 
 #include "ModelDownloadManager.hpp"
+#include "RuntimeMetrics.hpp"
 #include "RuntimeStringUtils.hpp"
+#include "ServerReply.hpp"
 
+#include <godot_cpp/classes/audio_server.hpp>
 #include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/performance.hpp>
 #include <godot_cpp/classes/project_settings.hpp>
 #include <godot_cpp/classes/os.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
 #include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/packed_string_array.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
@@ -16,6 +23,7 @@
 #include <llama.h>
 #include <curl/curl.h>
 
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <sstream>
@@ -25,11 +33,15 @@
 #include <fstream>
 #include <limits>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <mutex>
+#include <thread>
 #include <climits>
 #include <filesystem>
 #include <cstdio>
 #include <cstdlib>
+#include <ctime>
 #include <optional>
 #include <iomanip>
 #include <cerrno>
@@ -40,8 +52,52 @@
 using namespace godot;
 using local_agents::runtime::to_utf8;
 using local_agents::runtime::from_utf8;
+using local_agents::runtime::RuntimeMetrics;
+using local_agents::runtime::ScopedGauge;
+using local_agents::runtime::ScopedLatency;
+using local_agents::runtime::canonical_generation_key;
+using local_agents::runtime::ChatMessage;
+using local_agents::runtime::Conversation;
+using local_agents::runtime::GenerationCache;
+using local_agents::runtime::GenerationRequest;
+using local_agents::runtime::GenerationResult;
+using local_agents::runtime::InferenceEngine;
+using local_agents::runtime::LoraSelection;
+using local_agents::runtime::MemoryPlan;
+using local_agents::runtime::ModelLoadOptions;
+using local_agents::runtime::ModelMetadata;
+using local_agents::runtime::PcmBuffer;
+using local_agents::runtime::PiperVoice;
+using local_agents::runtime::PiperVoiceOptions;
+using local_agents::runtime::PrefetchOptions;
+using local_agents::runtime::PrefetchStatus;
+using local_agents::runtime::PromptFormat;
+using local_agents::runtime::SamplingOptions;
+using local_agents::runtime::SpeechEngine;
+using local_agents::runtime::SpeechModelOptions;
+using local_agents::runtime::ServerJson;
+using local_agents::runtime::parse_chat_reply;
+using local_agents::runtime::parse_embedding_reply;
+using local_agents::runtime::parse_function_call;
+using local_agents::runtime::function_call_grammar;
+using local_agents::runtime::ThreadPoolInfo;
+using local_agents::runtime::ToolArgument;
+using local_agents::runtime::ToolCall;
+using local_agents::runtime::ToolParameter;
+using local_agents::runtime::ToolSpec;
+using local_agents::runtime::ThreadingOptions;
+using local_agents::runtime::tokenize_text;
+using local_agents::runtime::TranscribeOptions;
+using local_agents::runtime::TranscribeResult;
+using local_agents::runtime::VadOptions;
+using local_agents::runtime::VoiceActivityDetector;
+using local_agents::runtime::VoicedSegment;
+using local_agents::runtime::normalize_tts_text;
+using local_agents::runtime::tts_clip_key;
 
 namespace {
+constexpr const char *kPerformanceMonitorPrefix = "LocalAgents/";
+
 String make_completion_id() {
     static std::atomic<uint64_t> counter{0};
     uint64_t value = counter.fetch_add(1, std::memory_order_relaxed) + 1;
@@ -50,115 +106,274 @@ String make_completion_id() {
     return String::utf8(oss.str().c_str());
 }
 
-llama_sampler *create_sampler(const Dictionary &options, const llama_model *model) {
-    llama_sampler_chain_params chain_params = llama_sampler_chain_default_params();
-    chain_params.no_perf = true;
-
-    llama_sampler *chain = llama_sampler_chain_init(chain_params);
-    if (!chain) {
-        return nullptr;
-    }
-
-    auto append_sampler = [chain](llama_sampler *sampler) {
-        if (sampler) {
-            llama_sampler_chain_add(chain, sampler);
-        }
-    };
+SamplingOptions sampling_options_from_dictionary(const Dictionary &options) {
+    SamplingOptions sampling;
+    sampling.top_k = options.get("top_k", 0);
+    sampling.top_p = options.get("top_p", 0.0f);
+    sampling.min_p = options.get("min_p", 0.0f);
+    sampling.typical_p = options.get("typical_p", 0.0f);
+    sampling.temperature = options.get("temperature", 1.0f);
+    sampling.seed = options.get("seed", -1);
+    sampling.repeat_penalty = options.get("repeat_penalty", 1.0f);
+    sampling.frequency_penalty = options.get("frequency_penalty", 0.0f);
+    sampling.presence_penalty = options.get("presence_penalty", 0.0f);
+    sampling.repeat_last_n = options.get("repeat_last_n", 0);
+    sampling.mirostat = options.get("mirostat", 0);
+    sampling.mirostat_m = options.get("mirostat_m", 100);
+    sampling.mirostat_tau = options.get("mirostat_tau", 5.0f);
+    sampling.mirostat_eta = options.get("mirostat_eta", 0.1f);
+    return sampling;
+}
 
-    bool use_distribution = false;
-    bool use_mirostat = false;
+ThreadingOptions threading_options_from_dictionary(const Dictionary &options) {
+    ThreadingOptions threading;
+    threading.n_threads = options.get("n_threads", 0);
+    threading.n_threads_batch = options.get("n_threads_batch", 0);
+    threading.reserved_threads = options.get("reserved_threads", 2);
+    threading.cpu_mask = to_utf8(options.get("cpu_mask", String()));
+    threading.cpu_mask_batch = to_utf8(options.get("cpu_mask_batch", String()));
+    threading.strict_cpu = options.get("cpu_strict", false);
+    threading.poll = options.get("poll", 0);
+    threading.priority = options.get("thread_priority", 0);
+    threading.pause_when_idle = options.get("pause_threads_when_idle", true);
+    return threading;
+}
 
-    if (options.has("top_k")) {
-        int32_t top_k = (int32_t)options["top_k"];
-        if (top_k > 0) {
-            append_sampler(llama_sampler_init_top_k(top_k));
-            use_distribution = true;
-        }
+ModelLoadOptions load_options_from_dictionary(const Dictionary &options) {
+    ModelLoadOptions load;
+    if (options.has("n_gpu_layers")) {
+        load.n_gpu_layers = (int32_t)options["n_gpu_layers"];
     }
-
-    if (options.has("top_p")) {
-        float top_p = (float)options["top_p"];
-        if (top_p > 0.0f) {
-            append_sampler(llama_sampler_init_top_p(top_p, 1));
-            use_distribution = true;
-        }
+    if (options.has("use_mmap")) {
+        load.use_mmap = (bool)options["use_mmap"];
     }
-
-    if (options.has("min_p")) {
-        float min_p = (float)options["min_p"];
-        if (min_p > 0.0f) {
-            append_sampler(llama_sampler_init_min_p(min_p, 1));
-            use_distribution = true;
-        }
+    if (options.has("use_mlock")) {
+        load.use_mlock = (bool)options["use_mlock"];
     }
-
-    if (options.has("typical_p")) {
-        float typical_p = (float)options["typical_p"];
-        if (typical_p > 0.0f && typical_p < 1.0f) {
-            append_sampler(llama_sampler_init_typical(typical_p, 1));
-            use_distribution = true;
-        }
+    if (options.has("context_size")) {
+        load.context_size = (int32_t)options["context_size"];
     }
-
-    float temperature = 1.0f;
-    if (options.has("temperature")) {
-        temperature = (float)options["temperature"];
+    if (options.has("batch_size")) {
+        int32_t batch_size = (int32_t)options["batch_size"];
+        load.batch_size = batch_size > 0 ? batch_size : 512;
     }
-
-    if (temperature <= 0.0f) {
-        use_distribution = false;
-    } else if (temperature != 1.0f) {
-        append_sampler(llama_sampler_init_temp(temperature));
-        use_distribution = true;
-    } else {
-        use_distribution = true;
+    if (options.has("pooling")) {
+        load.pooling = (int32_t)options["pooling"];
+    }
+    if (options.has("embedding")) {
+        load.embeddings = (bool)options["embedding"];
+    } else if (options.has("embeddings")) {
+        load.embeddings = (bool)options["embeddings"];
+    }
+    if (options.has("warmup")) {
+        load.warmup = (bool)options["warmup"];
+    }
+    if (options.has("ubatch_size")) {
+        load.ubatch_size = (int32_t)options["ubatch_size"];
+    }
+    if (options.has("memory_plan")) {
+        load.plan_memory = (bool)options["memory_plan"];
+    }
+    if (options.has("memory_budget_mb")) {
+        int64_t budget_mb = options["memory_budget_mb"];
+        load.memory_budget_bytes = budget_mb > 0 ? static_cast<uint64_t>(budget_mb) * 1024ull * 1024ull : 0;
+    }
+    if (options.has("min_context_size")) {
+        load.min_context_size = (int32_t)options["min_context_size"];
     }
+    if (options.has("max_context_size")) {
+        load.max_context_size = (int32_t)options["max_context_size"];
+    }
+    if (options.has("cache_type")) {
+        load.cache_type = to_utf8(String(options["cache_type"]));
+    }
+    if (options.has("flash_attn")) {
+        Variant flash = options["flash_attn"];
+        load.flash_attn = flash.get_type() == Variant::BOOL ? ((bool)flash ? 1 : 0) : (int32_t)flash;
+    }
+    if (options.has("n_contexts")) {
+        load.n_contexts = std::max(1, (int32_t)options["n_contexts"]);
+    }
+    if (options.has("n_seq")) {
+        load.n_seq = std::max(1, (int32_t)options["n_seq"]);
+    }
+    load.threading = threading_options_from_dictionary(options);
+    return load;
+}
+
+SpeechModelOptions speech_model_options_from_dictionary(const Dictionary &options) {
+    SpeechModelOptions model;
+    model.use_gpu = options.get("use_gpu", true);
+    model.flash_attn = options.get("flash_attn", false);
+    model.gpu_device = options.get("gpu_device", 0);
+    return model;
+}
+
+TranscribeOptions transcribe_options_from_dictionary(const Dictionary &options) {
+    TranscribeOptions transcribe;
+    transcribe.language = to_utf8(String(options.get("language", String("en"))));
+    transcribe.translate = options.get("translate", false);
+    transcribe.n_threads = options.get("n_threads", 0);
+    transcribe.beam_size = options.get("beam_size", 0);
+    transcribe.temperature = options.get("temperature", 0.0f);
+    transcribe.timestamps = options.get("timestamps", true);
+    transcribe.single_segment = options.get("single_segment", false);
+    transcribe.initial_prompt = to_utf8(String(options.get("initial_prompt", String())));
+    return transcribe;
+}
+
+VadOptions vad_options_from_dictionary(const Dictionary &options) {
+    VadOptions vad;
+    vad.frame_ms = options.get("frame_ms", vad.frame_ms);
+    vad.threshold_db = options.get("threshold_db", vad.threshold_db);
+    vad.min_energy_db = options.get("min_energy_db", vad.min_energy_db);
+    vad.max_zcr = options.get("max_zcr", vad.max_zcr);
+    vad.onset_ms = options.get("onset_ms", vad.onset_ms);
+    vad.hangover_ms = options.get("hangover_ms", vad.hangover_ms);
+    vad.preroll_ms = options.get("preroll_ms", vad.preroll_ms);
+    vad.min_utterance_ms = options.get("min_utterance_ms", vad.min_utterance_ms);
+    vad.max_utterance_ms = options.get("max_utterance_ms", vad.max_utterance_ms);
+    return vad;
+}
+
+// Voiced stretches of a whole recording, joined by short gaps so whisper still hears the
+// pauses between them. Empty when nothing was voiced.
+std::vector<float> voiced_audio(const std::vector<float> &samples, int32_t sample_rate, const VadOptions &options) {
+    VoiceActivityDetector detector;
+    detector.reset(sample_rate, options);
+    std::vector<VoicedSegment> segments;
+    detector.push(samples.data(), samples.size(), segments);
+    detector.flush(segments);
+    const size_t gap = static_cast<size_t>(sample_rate / 5);
+    std::vector<float> voiced;
+    for (const VoicedSegment &segment : segments) {
+        if (!voiced.empty()) {
+            voiced.insert(voiced.end(), gap, 0.0f);
+        }
+        voiced.insert(voiced.end(), segment.samples.begin(), segment.samples.end());
+    }
+    return voiced;
+}
+
+Dictionary transcription_response(const TranscribeResult &result) {
+    Dictionary response;
+    response["ok"] = true;
+    response["text"] = String::utf8(result.text.c_str()).strip_edges();
+    response["language"] = String::utf8(result.language.c_str());
+    Array segments;
+    for (const auto &segment : result.segments) {
+        Dictionary entry;
+        entry["start"] = static_cast<double>(segment.start_ms) / 1000.0;
+        entry["end"] = static_cast<double>(segment.end_ms) / 1000.0;
+        entry["text"] = String::utf8(segment.text.c_str()).strip_edges();
+        segments.append(entry);
+    }
+    response["segments"] = segments;
+    response["audio_ms"] = result.audio_ms;
+    response["encode_ms"] = result.encode_ms;
+    return response;
+}
 
-    uint32_t seed = LLAMA_DEFAULT_SEED;
-    if (options.has("seed")) {
-        int64_t raw_seed = (int64_t)options["seed"];
-        if (raw_seed >= 0) {
-            seed = static_cast<uint32_t>(raw_seed);
+// `lora` accepts an adapter id, {"id": ..., "scale": ...}, or an Array of either.
+std::vector<LoraSelection> lora_selections_from_options(const Dictionary &options) {
+    std::vector<LoraSelection> selections;
+    if (!options.has("lora")) {
+        return selections;
+    }
+    const float default_scale = static_cast<float>((double)options.get("lora_scale", 1.0));
+    auto append = [&selections, default_scale](const Variant &value) {
+        LoraSelection selection;
+        selection.scale = default_scale;
+        if (value.get_type() == Variant::STRING || value.get_type() == Variant::STRING_NAME) {
+            selection.id = to_utf8(String(value));
+        } else if (value.get_type() == Variant::DICTIONARY) {
+            Dictionary entry = value;
+            selection.id = to_utf8(String(entry.get("id", String())));
+            selection.scale = static_cast<float>((double)entry.get("scale", default_scale));
+        }
+        if (!selection.id.empty() && selection.scale != 0.0f) {
+            selections.push_back(std::move(selection));
+        }
+    };
+    Variant value = options["lora"];
+    if (value.get_type() == Variant::ARRAY) {
+        Array entries = value;
+        for (int i = 0; i < entries.size(); ++i) {
+            append(entries[i]);
         }
+    } else {
+        append(value);
     }
+    return selections;
+}
 
-    float repeat_penalty = options.get("repeat_penalty", 1.0f);
-    float frequency_penalty = options.get("frequency_penalty", 0.0f);
-    float presence_penalty = options.get("presence_penalty", 0.0f);
-    int32_t repeat_last_n = options.get("repeat_last_n", 0);
-    if (repeat_penalty != 1.0f || frequency_penalty != 0.0f || presence_penalty != 0.0f || repeat_last_n != 0) {
-        append_sampler(llama_sampler_init_penalties(repeat_last_n, repeat_penalty, frequency_penalty, presence_penalty));
+// Page-cache prefetch only helps mmap'd weights, and use_mlock already faults everything in.
+bool prefetch_enabled(const Dictionary &options) {
+    if (options.has("prefetch")) {
+        return (bool)options["prefetch"];
     }
+    const bool use_mmap = options.has("use_mmap") ? (bool)options["use_mmap"] : true;
+    const bool use_mlock = options.has("use_mlock") ? (bool)options["use_mlock"] : false;
+    return use_mmap && !use_mlock;
+}
 
-    int32_t mirostat_mode = options.get("mirostat", 0);
-    if (mirostat_mode == 1 && model != nullptr) {
-        const llama_vocab *model_vocab = llama_model_get_vocab(model);
-        int32_t vocab_tokens = model_vocab ? llama_vocab_n_tokens(model_vocab) : 0;
-        int32_t mirostat_last_n = options.get("mirostat_m", 100);
-        float tau = options.get("mirostat_tau", 5.0f);
-        float eta = options.get("mirostat_eta", 0.1f);
-        append_sampler(llama_sampler_init_mirostat(vocab_tokens, seed, tau, eta, mirostat_last_n));
-        use_mirostat = true;
-    } else if (mirostat_mode == 2) {
-        float tau = options.get("mirostat_tau", 5.0f);
-        float eta = options.get("mirostat_eta", 0.1f);
-        append_sampler(llama_sampler_init_mirostat_v2(seed, tau, eta));
-        use_mirostat = true;
+PrefetchOptions prefetch_options_from_dictionary(const Dictionary &options) {
+    PrefetchOptions prefetch;
+    if (options.has("mlock_budget_mb")) {
+        int64_t budget_mb = options["mlock_budget_mb"];
+        prefetch.mlock_budget_bytes = budget_mb > 0 ? static_cast<uint64_t>(budget_mb) * 1024ull * 1024ull : 0;
     }
-
-    if (!use_mirostat) {
-        if (use_distribution) {
-            append_sampler(llama_sampler_init_dist(seed));
-        } else {
-            append_sampler(llama_sampler_init_greedy());
-        }
+    if (options.has("prefetch_max_mb")) {
+        int64_t max_mb = options["prefetch_max_mb"];
+        prefetch.max_bytes = max_mb > 0 ? static_cast<uint64_t>(max_mb) * 1024ull * 1024ull : 0;
     }
+    return prefetch;
+}
 
-    if (llama_sampler_chain_n(chain) == 0) {
-        append_sampler(llama_sampler_init_greedy());
-    }
+double to_mib(uint64_t bytes) {
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
 
-    return chain;
+Dictionary memory_plan_to_dictionary(const MemoryPlan &plan, const ModelMetadata &metadata, uint64_t actual_bytes) {
+    Dictionary result;
+    result["ok"] = plan.ok;
+    if (!plan.reason.empty()) {
+        result["error"] = String::utf8(plan.reason.c_str());
+    }
+    PackedStringArray warnings;
+    for (const std::string &warning : plan.warnings) {
+        warnings.push_back(String::utf8(warning.c_str()));
+    }
+    result["warnings"] = warnings;
+    result["context_size"] = plan.context_size;
+    result["batch_size"] = plan.batch_size;
+    result["ubatch_size"] = plan.ubatch_size;
+    result["cache_type_k"] = String(local_agents::runtime::kv_cache_type_name(plan.type_k));
+    result["cache_type_v"] = String(local_agents::runtime::kv_cache_type_name(plan.type_v));
+    result["flash_attn"] = plan.flash_attn;
+
+    Dictionary predicted;
+    predicted["weights_mb"] = to_mib(plan.predicted.weights);
+    predicted["kv_cache_mb"] = to_mib(plan.predicted.kv_cache);
+    predicted["compute_mb"] = to_mib(plan.predicted.compute);
+    predicted["total_mb"] = to_mib(plan.predicted.total);
+    predicted["anonymous_mb"] = to_mib(plan.predicted.anonymous);
+    result["predicted"] = predicted;
+    result["actual_mb"] = to_mib(actual_bytes);
+    result["limit_mb"] = to_mib(plan.limit_bytes);
+    result["available_mb"] = to_mib(plan.available_bytes);
+    result["system_total_mb"] = to_mib(plan.total_system_bytes);
+
+    Dictionary model;
+    model["architecture"] = String::utf8(metadata.architecture.c_str());
+    model["n_layer"] = metadata.n_layer;
+    model["n_embd"] = metadata.n_embd;
+    model["n_head"] = metadata.n_head;
+    model["n_head_kv"] = metadata.n_head_kv;
+    model["n_ctx_train"] = metadata.n_ctx_train;
+    model["weights_mb"] = to_mib(metadata.weights_bytes);
+    result["model"] = model;
+    return result;
 }
 
 String normalize_project_path(const String &path) {
@@ -288,75 +503,6 @@ void ensure_parent_directory(const std::filesystem::path &file_path) {
     std::filesystem::create_directories(parent, ec);
 }
 
-bool tokenize_text(
-    const llama_vocab *vocab,
-    const std::string &text,
-    bool add_bos,
-    bool parse_special,
-    std::vector<llama_token> &out_tokens
-) {
-    out_tokens.clear();
-    if (!vocab) {
-        return false;
-    }
-
-    // Recent llama.cpp versions can return a negative required size when the output
-    // buffer is too small, including probing calls with a null buffer.
-    int32_t capacity = std::max<int32_t>(32, static_cast<int32_t>(text.size()) + (add_bos ? 2 : 1));
-    out_tokens.resize(static_cast<size_t>(capacity));
-
-    for (int attempt = 0; attempt < 4; ++attempt) {
-        int32_t token_count = llama_tokenize(
-            vocab,
-            text.c_str(),
-            static_cast<int32_t>(text.length()),
-            out_tokens.data(),
-            capacity,
-            add_bos,
-            parse_special
-        );
-
-        if (token_count > 0) {
-            out_tokens.resize(static_cast<size_t>(token_count));
-            return true;
-        }
-
-        if (token_count < 0) {
-            capacity = -token_count;
-            if (capacity <= 0) {
-                return false;
-            }
-            out_tokens.resize(static_cast<size_t>(capacity));
-            continue;
-        }
-
-        return false;
-    }
-
-    return false;
-}
-
-bool apply_stop_sequences(std::string &text, const std::vector<std::string> &stops) {
-    if (stops.empty()) {
-        return false;
-    }
-    size_t earliest = std::string::npos;
-    for (const std::string &stop : stops) {
-        if (stop.empty()) {
-            continue;
-        }
-        size_t pos = text.find(stop);
-        if (pos != std::string::npos && (earliest == std::string::npos || pos < earliest)) {
-            earliest = pos;
-        }
-    }
-    if (earliest != std::string::npos) {
-        text.resize(earliest);
-        return true;
-    }
-    return false;
-}
-
 Variant parse_json_response(const String &text) {
     auto try_parse = [](const String &candidate) -> Variant {
         Ref<JSON> parser;
@@ -420,8 +566,10 @@ bool validate_json_schema_basic(const Variant &parsed, const Dictionary &schema,
 struct HttpJsonResponse {
     bool ok = false;
     long status_code = 0;
-    String body;
+    std::string body; // raw bytes; decoded natively, turned into a String only when reported
     String error;
+
+    String body_text() const { return String::utf8(body.data(), static_cast<int>(body.size())); }
 };
 
 size_t curl_write_string(void *contents, size_t size, size_t nmemb, void *userdata) {
@@ -441,8 +589,6 @@ HttpJsonResponse http_post_json(
     int timeout_seconds
 ) {
     HttpJsonResponse result;
-    result.body = String();
-    result.error = String();
 
     CURL *curl = curl_easy_init();
     if (!curl) {
@@ -459,7 +605,6 @@ HttpJsonResponse http_post_json(
         header_list = curl_slist_append(header_list, "Content-Type: application/json");
     }
 
-    std::string response_buffer;
     std::string payload_text = to_utf8(JSON::stringify(payload));
     std::string url_utf8 = to_utf8(url);
 
@@ -469,7 +614,7 @@ HttpJsonResponse http_post_json(
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload_text.c_str());
     curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, static_cast<long>(payload_text.size()));
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_string);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_buffer);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result.body);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_seconds > 0 ? timeout_seconds : 120);
     curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
 
@@ -483,7 +628,6 @@ HttpJsonResponse http_post_json(
     long status_code = 0;
     curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status_code);
     result.status_code = status_code;
-    result.body = String::utf8(response_buffer.c_str());
 
     curl_slist_free_all(header_list);
     curl_easy_cleanup(curl);
@@ -511,6 +655,14 @@ bool is_llama_server_backend(const Dictionary &options) {
            backend == String("llama_http");
 }
 
+bool is_inprocess_backend(const Dictionary &options) {
+    if (!options.has("backend")) {
+        return false;
+    }
+    String backend = String(options["backend"]).to_lower().strip_edges();
+    return backend == String("inprocess") || backend == String("in_process") || backend == String("in-process");
+}
+
 void merge_dictionary(Dictionary &target, const Dictionary &source) {
     Array keys = source.keys();
     for (int i = 0; i < keys.size(); ++i) {
@@ -519,6 +671,28 @@ void merge_dictionary(Dictionary &target, const Dictionary &source) {
     }
 }
 
+// Runtime defaults overlaid with a request's own "options".
+Dictionary request_options(const Dictionary &defaults, const Dictionary &request) {
+    Dictionary options = defaults.duplicate();
+    if (request.has("messages")) {
+        // A bare chat-completions body ({model, messages, tools, temperature, ...}): its
+        // fields are options, exactly as if they had been nested under "options".
+        Array keys = request.keys();
+        for (int i = 0; i < keys.size(); ++i) {
+            const String key = keys[i];
+            if (key != String("options") && key != String("history") && key != String("prompt") &&
+                key != String("conversation")) {
+                options[key] = request[key];
+            }
+        }
+    }
+    if (request.has("options")) {
+        Dictionary overrides = request["options"];
+        merge_dictionary(options, overrides);
+    }
+    return options;
+}
+
 void append_message(Array &messages, const String &role, const Variant &content) {
     if (role.is_empty()) {
         return;
@@ -597,62 +771,117 @@ String extract_chat_completion_text(const Dictionary &response, Dictionary &firs
     return String();
 }
 
-PackedFloat32Array embedding_from_json(const Dictionary &response, bool normalize, String &error_out) {
-    PackedFloat32Array empty;
+// The runtime's response envelope around a chat-completions body, the same for the
+// llama_server and inprocess backends. False when the body reports an error.
+bool fill_chat_completion_response(const Dictionary &parsed_dict, const Dictionary &payload, Dictionary &response) {
+    response["response"] = parsed_dict;
 
-    Array values;
-    if (response.has("data") && response["data"].get_type() == Variant::ARRAY) {
-        Array data = response["data"];
-        if (!data.is_empty() && data[0].get_type() == Variant::DICTIONARY) {
-            Dictionary first = data[0];
-            if (first.has("embedding") && first["embedding"].get_type() == Variant::ARRAY) {
-                values = first["embedding"];
-            }
-        }
-    } else if (response.has("embedding") && response["embedding"].get_type() == Variant::ARRAY) {
-        values = response["embedding"];
-    }
+    Dictionary first_choice;
+    Variant tool_calls;
+    String text = extract_chat_completion_text(parsed_dict, first_choice, tool_calls).strip_edges();
 
-    if (values.is_empty()) {
-        if (response.has("error")) {
-            Variant err = response["error"];
-            if (err.get_type() == Variant::DICTIONARY) {
-                Dictionary err_dict = err;
-                error_out = err_dict.get("message", String("invalid_embedding_response"));
-            } else {
-                error_out = String("invalid_embedding_response");
-            }
+    if (text.is_empty() && parsed_dict.has("output_text")) {
+        text = parsed_dict["output_text"];
+    }
+    if (text.is_empty() && parsed_dict.has("error")) {
+        Variant error_variant = parsed_dict["error"];
+        if (error_variant.get_type() == Variant::DICTIONARY) {
+            Dictionary error_dict = error_variant;
+            response["error"] = error_dict.get("message", String("server_error"));
         } else {
-            error_out = String("invalid_embedding_response");
+            response["error"] = String("server_error");
         }
-        return empty;
+        return false;
     }
 
-    empty.resize(values.size());
-    float *out = empty.ptrw();
-    for (int i = 0; i < values.size(); ++i) {
-        Variant v = values[i];
-        if (v.get_type() == Variant::FLOAT || v.get_type() == Variant::INT) {
-            out[i] = static_cast<float>(v);
-        } else {
-            out[i] = 0.0f;
+    response["ok"] = true;
+    response["text"] = text;
+    if (parsed_dict.has("id")) {
+        response["id"] = parsed_dict["id"];
+    }
+    if (tool_calls.get_type() != Variant::NIL) {
+        response["tool_calls"] = tool_calls;
+    }
+    if (parsed_dict.has("usage")) {
+        response["usage"] = parsed_dict["usage"];
+    }
+
+    if (payload.has("response_format")) {
+        Variant rf_variant = payload["response_format"];
+        String rf_type;
+        if (rf_variant.get_type() == Variant::DICTIONARY) {
+            Dictionary rf = rf_variant;
+            rf_type = rf.get("type", String());
+        } else if (rf_variant.get_type() == Variant::STRING) {
+            rf_type = rf_variant;
+        }
+        if (rf_type == String("json_object") || rf_type == String("json_schema")) {
+            Variant parsed_json = parse_json_response(text);
+            if (parsed_json.get_type() != Variant::NIL) {
+                response["json"] = parsed_json;
+            }
         }
     }
 
+    return true;
+}
+
+PackedFloat32Array embedding_from_values(const std::vector<float> &values, bool normalize) {
+    PackedFloat32Array embedding;
+    embedding.resize(static_cast<int64_t>(values.size()));
+    float *out = embedding.ptrw();
+    std::copy(values.begin(), values.end(), out);
+
     if (normalize) {
         double norm = 0.0;
-        for (int i = 0; i < empty.size(); ++i) {
+        for (int i = 0; i < embedding.size(); ++i) {
             norm += static_cast<double>(out[i]) * static_cast<double>(out[i]);
         }
         norm = std::sqrt(std::max(norm, 1e-12));
         if (norm > 0.0) {
-            for (int i = 0; i < empty.size(); ++i) {
+            for (int i = 0; i < embedding.size(); ++i) {
                 out[i] = static_cast<float>(out[i] / norm);
             }
         }
     }
 
-    return empty;
+    return embedding;
+}
+
+// Godot containers for a parsed server reply. Integers stay integers (JSON::parse_string
+// would make every number a float), matching the local backend's usage counts.
+Variant server_json_to_variant(const ServerJson &value) {
+    switch (value.type()) {
+    case ServerJson::value_t::object: {
+        Dictionary dict;
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            dict[String::utf8(it.key().c_str())] = server_json_to_variant(it.value());
+        }
+        return dict;
+    }
+    case ServerJson::value_t::array: {
+        Array array;
+        array.resize(static_cast<int64_t>(value.size()));
+        for (size_t i = 0; i < value.size(); ++i) {
+            array[static_cast<int64_t>(i)] = server_json_to_variant(value[i]);
+        }
+        return array;
+    }
+    case ServerJson::value_t::string: {
+        const std::string &text = value.get_ref<const std::string &>();
+        return String::utf8(text.data(), static_cast<int>(text.size()));
+    }
+    case ServerJson::value_t::boolean:
+        return value.get<bool>();
+    case ServerJson::value_t::number_integer:
+        return value.get<int64_t>();
+    case ServerJson::value_t::number_unsigned:
+        return static_cast<int64_t>(value.get<uint64_t>());
+    case ServerJson::value_t::number_float:
+        return value.get<double>();
+    default:
+        return Variant();
+    }
 }
 
 #ifdef _WIN32
@@ -673,6 +902,183 @@ int close_pipe(FILE *pipe) {
 }
 #endif
 
+// backend=inprocess: chat-completions payloads rendered through the model's own chat template.
+std::string json_text(const Variant &value) {
+    if (value.get_type() == Variant::STRING) {
+        return to_utf8(static_cast<String>(value));
+    }
+    return to_utf8(JSON::stringify(value));
+}
+
+std::vector<common_chat_msg> chat_messages_from_array(const Array &messages) {
+    std::vector<common_chat_msg> out;
+    out.reserve(static_cast<size_t>(messages.size()));
+    for (int i = 0; i < messages.size(); ++i) {
+        if (messages[i].get_type() != Variant::DICTIONARY) {
+            continue;
+        }
+        const Dictionary entry = messages[i];
+        common_chat_msg message;
+        message.role = to_utf8(String(entry.get("role", String())));
+        message.content = to_utf8(content_variant_to_text(entry.get("content", Variant())));
+        message.reasoning_content = to_utf8(String(entry.get("reasoning_content", String())));
+        message.tool_name = to_utf8(String(entry.get("name", String())));
+        message.tool_call_id = to_utf8(String(entry.get("tool_call_id", String())));
+        const Variant calls_variant = entry.get("tool_calls", Variant());
+        if (calls_variant.get_type() == Variant::ARRAY) {
+            const Array calls = calls_variant;
+            for (int c = 0; c < calls.size(); ++c) {
+                if (calls[c].get_type() != Variant::DICTIONARY) {
+                    continue;
+                }
+                const Dictionary call = calls[c];
+                const Dictionary function = call.get("function", Dictionary());
+                common_chat_tool_call tool_call;
+                tool_call.name = to_utf8(String(function.get("name", String())));
+                tool_call.arguments = json_text(function.get("arguments", Dictionary()));
+                tool_call.id = to_utf8(String(call.get("id", String())));
+                message.tool_calls.push_back(std::move(tool_call));
+            }
+        }
+        out.push_back(std::move(message));
+    }
+    return out;
+}
+
+std::vector<common_chat_tool> chat_tools_from_array(const Array &tools) {
+    std::vector<common_chat_tool> out;
+    for (int i = 0; i < tools.size(); ++i) {
+        if (tools[i].get_type() != Variant::DICTIONARY) {
+            continue;
+        }
+        const Dictionary entry = tools[i];
+        const Dictionary function = entry.get("function", entry);
+        common_chat_tool tool;
+        tool.name = to_utf8(String(function.get("name", String())));
+        tool.description = to_utf8(String(function.get("description", String())));
+        tool.parameters = json_text(function.get("parameters", Dictionary()));
+        if (!tool.name.empty()) {
+            out.push_back(std::move(tool));
+        }
+    }
+    return out;
+}
+
+// The same OpenAI function specs, reduced to what the native FunctionGemma grammar checks.
+std::vector<ToolSpec> tool_specs_from_array(const Array &tools) {
+    std::vector<ToolSpec> out;
+    for (int i = 0; i < tools.size(); ++i) {
+        if (tools[i].get_type() != Variant::DICTIONARY) {
+            continue;
+        }
+        const Dictionary entry = tools[i];
+        const Dictionary function = entry.get("function", entry);
+        ToolSpec tool;
+        tool.name = to_utf8(String(function.get("name", String())));
+        if (tool.name.empty()) {
+            continue;
+        }
+        const Dictionary parameters = function.get("parameters", Dictionary());
+        const Dictionary properties = parameters.get("properties", Dictionary());
+        const Array required = parameters.get("required", Array());
+        const Array names = properties.keys();
+        for (int p = 0; p < names.size(); ++p) {
+            const Dictionary schema = properties[names[p]];
+            ToolParameter parameter;
+            parameter.name = to_utf8(String(names[p]));
+            Variant type = schema.get("type", String("string"));
+            if (type.get_type() == Variant::ARRAY && !Array(type).is_empty()) {
+                type = Array(type)[0];
+            }
+            parameter.type = to_utf8(String(type));
+            const Array choices = schema.get("enum", Array());
+            for (int c = 0; c < choices.size(); ++c) {
+                parameter.choices.push_back(to_utf8(choices[c].get_type() == Variant::STRING ? String(choices[c])
+                                                                                              : JSON::stringify(choices[c])));
+            }
+            parameter.required = required.has(names[p]);
+            tool.parameters.push_back(std::move(parameter));
+        }
+        out.push_back(std::move(tool));
+    }
+    return out;
+}
+
+Variant tool_argument_variant(const ToolArgument &argument) {
+    const String value = from_utf8(argument.value);
+    if (argument.type == "integer" && value.is_valid_int()) {
+        return value.to_int();
+    }
+    if (argument.type == "number" && value.is_valid_float()) {
+        return value.to_float();
+    }
+    if (argument.type == "boolean") {
+        return value == String("true");
+    }
+    return value;
+}
+
+common_chat_tool_choice chat_tool_choice(const Variant &choice) {
+    if (choice.get_type() == Variant::DICTIONARY) {
+        return COMMON_CHAT_TOOL_CHOICE_REQUIRED; // {"type": "function", "function": {...}}
+    }
+    const String name = String(choice).to_lower().strip_edges();
+    if (name == String("required")) {
+        return COMMON_CHAT_TOOL_CHOICE_REQUIRED;
+    }
+    if (name == String("none")) {
+        return COMMON_CHAT_TOOL_CHOICE_NONE;
+    }
+    return COMMON_CHAT_TOOL_CHOICE_AUTO;
+}
+
+// JSON schema text for a payload's response_format, or "" when it asks for none.
+std::string chat_json_schema(const Dictionary &payload) {
+    const Variant format_variant = payload.get("response_format", Variant());
+    if (format_variant.get_type() != Variant::DICTIONARY) {
+        return std::string();
+    }
+    const Dictionary format = format_variant;
+    const String type = format.get("type", String());
+    if (type == String("json_schema")) {
+        Variant schema = format.get("schema", Variant());
+        if (schema.get_type() == Variant::NIL && format.get("json_schema", Variant()).get_type() == Variant::DICTIONARY) {
+            schema = Dictionary(format["json_schema"]).get("schema", Variant());
+        }
+        return schema.get_type() == Variant::DICTIONARY ? json_text(schema) : std::string("{\"type\":\"object\"}");
+    }
+    if (type == String("json_object")) {
+        return format.has("schema") ? json_text(format["schema"]) : std::string("{\"type\":\"object\"}");
+    }
+    return std::string();
+}
+
+std::string escape_regex(const std::string &text) {
+    static const std::string special = "\\^$.|?*+()[]{}";
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (char c : text) {
+        if (special.find(c) != std::string::npos) {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+// Newer llama.cpp ships PEG-based parsers for some formats inside the chat params; older
+// builds have neither field and parse by format alone.
+template <typename Syntax, typename Params>
+auto load_chat_parser(Syntax &syntax, const Params &params, int) -> decltype(syntax.parser.load(params.parser), void()) {
+    if (!params.parser.empty()) {
+        syntax.parser.load(params.parser);
+    }
+}
+
+template <typename Syntax, typename Params>
+void load_chat_parser(Syntax &, const Params &, long) {}
+
+
 int extract_exit_code(int status) {
 #ifdef _WIN32
     return status;
@@ -691,23 +1097,28 @@ int extract_exit_code(int status) {
 
 AgentRuntime *AgentRuntime::singleton_ = nullptr;
 
-AgentRuntime::AgentRuntime()
-    : sampler_(nullptr, [](llama_sampler *sampler) {
-          if (sampler) {
-              llama_sampler_free(sampler);
-          }
-      }) {
+AgentRuntime::AgentRuntime() {
     if (!singleton_) {
         singleton_ = this;
     }
     download_manager_ = std::make_unique<ModelDownloadManager>();
-    system_prompt_ = String("You are Local Agents, an offline assistant running inside a Godot game. Be concise and helpful.");
+    auto initial = std::make_shared<RuntimeConfig>();
+    initial->system_prompt = String("You are Local Agents, an offline assistant running inside a Godot game. Be concise and helpful.");
+    config_ = std::move(initial);
 }
 
 AgentRuntime::~AgentRuntime() {
     if (singleton_ == this) {
         singleton_ = nullptr;
     }
+    // Aborts an in-flight async load at its next progress callback.
+    load_cancelled_.store(true);
+    if (load_thread_.joinable()) {
+        load_thread_.join();
+    }
+    stop_speech_worker();
+    stop_synthesis_worker();
+    release_voices();
     unload_model();
 }
 
@@ -717,13 +1128,34 @@ AgentRuntime *AgentRuntime::get_singleton() {
 
 void AgentRuntime::_bind_methods() {
     ClassDB::bind_method(D_METHOD("load_model", "model_path", "options"), &AgentRuntime::load_model);
+    ClassDB::bind_method(D_METHOD("load_model_async", "model_path", "options"), &AgentRuntime::load_model_async, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("unload_model"), &AgentRuntime::unload_model);
     ClassDB::bind_method(D_METHOD("is_model_loaded"), &AgentRuntime::is_model_loaded);
+    ClassDB::bind_method(D_METHOD("is_model_loading"), &AgentRuntime::is_model_loading);
+    ClassDB::bind_method(D_METHOD("get_model_load_progress"), &AgentRuntime::get_model_load_progress);
     ClassDB::bind_method(D_METHOD("get_runtime_health"), &AgentRuntime::get_runtime_health);
     ClassDB::bind_method(D_METHOD("generate", "request"), &AgentRuntime::generate);
+    ClassDB::bind_method(D_METHOD("resolve_tool_call", "tool_specs", "context", "options"), &AgentRuntime::resolve_tool_call, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("generate_many", "requests"), &AgentRuntime::generate_many);
+    ClassDB::bind_method(D_METHOD("begin_generation", "request"), &AgentRuntime::begin_generation);
     ClassDB::bind_method(D_METHOD("synthesize_speech", "request"), &AgentRuntime::synthesize_speech);
+    ClassDB::bind_method(D_METHOD("synthesize_pcm", "request"), &AgentRuntime::synthesize_pcm);
+    ClassDB::bind_method(D_METHOD("begin_speech", "request"), &AgentRuntime::begin_speech);
+    ClassDB::bind_method(D_METHOD("release_voices"), &AgentRuntime::release_voices);
+    ClassDB::bind_method(D_METHOD("configure_speech_cache", "options"), &AgentRuntime::configure_speech_cache);
+    ClassDB::bind_method(D_METHOD("get_speech_cache_info"), &AgentRuntime::get_speech_cache_info);
+    ClassDB::bind_method(D_METHOD("prewarm_speech", "lines", "request"), &AgentRuntime::prewarm_speech, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("transcribe_audio", "request"), &AgentRuntime::transcribe_audio);
+    ClassDB::bind_method(D_METHOD("load_speech_model", "model_path", "options"), &AgentRuntime::load_speech_model, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("unload_speech_model"), &AgentRuntime::unload_speech_model);
+    ClassDB::bind_method(D_METHOD("create_speech_listener", "options"), &AgentRuntime::create_speech_listener, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("is_speech_model_loaded"), &AgentRuntime::is_speech_model_loaded);
+    ClassDB::bind_method(D_METHOD("transcribe_pcm", "pcm", "sample_rate", "options"), &AgentRuntime::transcribe_pcm, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("embed_text", "text", "options"), &AgentRuntime::embed_text, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("count_tokens", "text"), &AgentRuntime::count_tokens);
+    ClassDB::bind_method(D_METHOD("create_conversation"), &AgentRuntime::create_conversation);
+    ClassDB::bind_method(D_METHOD("append_conversation_message", "id", "role", "content"), &AgentRuntime::append_conversation_message);
+    ClassDB::bind_method(D_METHOD("release_conversation", "id"), &AgentRuntime::release_conversation);
     ClassDB::bind_method(D_METHOD("download_model", "request"), &AgentRuntime::download_model);
     ClassDB::bind_method(D_METHOD("download_model_hf", "repo", "options"), &AgentRuntime::download_model_hf, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("get_model_cache_directory"), &AgentRuntime::get_model_cache_directory);
@@ -734,7 +1166,38 @@ void AgentRuntime::_bind_methods() {
     ClassDB::bind_method(D_METHOD("get_runtime_directory"), &AgentRuntime::get_runtime_directory);
     ClassDB::bind_method(D_METHOD("set_system_prompt", "prompt"), &AgentRuntime::set_system_prompt);
     ClassDB::bind_method(D_METHOD("get_system_prompt"), &AgentRuntime::get_system_prompt);
-
+    ClassDB::bind_method(D_METHOD("set_thread_options", "options"), &AgentRuntime::set_thread_options);
+    ClassDB::bind_method(D_METHOD("get_thread_info"), &AgentRuntime::get_thread_info);
+    ClassDB::bind_method(D_METHOD("pause_inference_threads"), &AgentRuntime::pause_inference_threads);
+    ClassDB::bind_method(D_METHOD("resume_inference_threads"), &AgentRuntime::resume_inference_threads);
+    ClassDB::bind_method(D_METHOD("get_memory_plan"), &AgentRuntime::get_memory_plan);
+    ClassDB::bind_method(D_METHOD("get_prefetch_status"), &AgentRuntime::get_prefetch_status);
+    ClassDB::bind_method(D_METHOD("load_lora", "path", "id"), &AgentRuntime::load_lora);
+    ClassDB::bind_method(D_METHOD("unload_lora", "id"), &AgentRuntime::unload_lora);
+    ClassDB::bind_method(D_METHOD("get_loras"), &AgentRuntime::get_loras);
+    ClassDB::bind_method(D_METHOD("plan_model_memory", "model_path", "options"), &AgentRuntime::plan_model_memory, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("get_runtime_metrics"), &AgentRuntime::get_runtime_metrics);
+    ClassDB::bind_method(D_METHOD("get_runtime_metric", "name"), &AgentRuntime::get_runtime_metric);
+    ClassDB::bind_method(D_METHOD("reset_runtime_metrics"), &AgentRuntime::reset_runtime_metrics);
+    ClassDB::bind_method(D_METHOD("start_trace", "path", "options"), &AgentRuntime::start_trace, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("stop_trace"), &AgentRuntime::stop_trace);
+    ClassDB::bind_method(D_METHOD("is_tracing"), &AgentRuntime::is_tracing);
+    ClassDB::bind_method(D_METHOD("register_performance_monitors"), &AgentRuntime::register_performance_monitors);
+    ClassDB::bind_method(D_METHOD("unregister_performance_monitors"), &AgentRuntime::unregister_performance_monitors);
+
+    ADD_SIGNAL(MethodInfo("model_load_progress",
+        PropertyInfo(Variant::FLOAT, "progress"),
+        PropertyInfo(Variant::STRING, "path")));
+    ADD_SIGNAL(MethodInfo("model_loaded",
+        PropertyInfo(Variant::BOOL, "ok"),
+        PropertyInfo(Variant::STRING, "error"),
+        PropertyInfo(Variant::STRING, "path")));
+    ADD_SIGNAL(MethodInfo("transcription_finished",
+        PropertyInfo(Variant::INT, "id"),
+        PropertyInfo(Variant::DICTIONARY, "result")));
+    ADD_SIGNAL(MethodInfo("speech_prewarmed",
+        PropertyInfo(Variant::INT, "id"),
+        PropertyInfo(Variant::DICTIONARY, "result")));
     ADD_SIGNAL(MethodInfo("download_started",
         PropertyInfo(Variant::STRING, "label"),
         PropertyInfo(Variant::STRING, "path")));
@@ -766,44 +1229,117 @@ void AgentRuntime::_notification(int what) {
 }
 
 bool AgentRuntime::load_model(const String &model_path, const Dictionary &options) {
-    std::scoped_lock lock(mutex_);
-    String resolved = model_path.is_empty() ? default_model_path_ : model_path;
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    String resolved = model_path.is_empty() ? config()->default_model_path : model_path;
     if (resolved.is_empty()) {
         UtilityFunctions::push_error("AgentRuntime::load_model - model path empty");
         return false;
     }
     if (!model_path.is_empty()) {
-        default_model_path_ = resolved;
+        update_config([&resolved](RuntimeConfig &config) { config.default_model_path = resolved; });
     }
     return load_model_locked(resolved, options, true);
 }
 
-void AgentRuntime::unload_model() {
+bool AgentRuntime::load_model_async(const String &model_path, const Dictionary &options) {
     std::scoped_lock lock(mutex_);
+    if (loading_) {
+        UtilityFunctions::push_error("AgentRuntime::load_model_async - a model load is already in progress");
+        return false;
+    }
+    String resolved = model_path.is_empty() ? config()->default_model_path : model_path;
+    if (resolved.is_empty()) {
+        UtilityFunctions::push_error("AgentRuntime::load_model_async - model path empty");
+        return false;
+    }
+    if (!model_path.is_empty()) {
+        update_config([&resolved](RuntimeConfig &config) { config.default_model_path = resolved; });
+    }
+    // The previous loader already released mutex_ and is only unwinding.
+    if (load_thread_.joinable()) {
+        load_thread_.join();
+    }
+
+    // Free the old model first so the new one is planned against the memory it will get.
     unload_model_locked();
+    start_prefetch_locked(resolved, options);
+    loading_ = true;
+    load_cancelled_.store(false);
+    load_progress_.store(0.0f);
+    load_thread_ = std::thread(&AgentRuntime::run_model_load_async, this, resolved, options);
+    return true;
 }
 
-bool AgentRuntime::is_model_loaded() const {
-    std::scoped_lock lock(mutex_);
-    return model_ != nullptr && context_ != nullptr;
-}
+void AgentRuntime::run_model_load_async(const String &path, const Dictionary &options) {
+    ModelLoadOptions load = load_options_from_dictionary(options);
+    if (!options.has("warmup")) {
+        load.warmup = true;
+    }
+    float last_emitted = -1.0f;
+    load.progress = [this, &path, &last_emitted](float progress) {
+        load_progress_.store(progress);
+        // llama.cpp reports per tensor; one signal per percent is plenty for a loading bar.
+        if (progress >= 1.0f || progress - last_emitted >= 0.01f) {
+            last_emitted = progress;
+            call_deferred("emit_signal", "model_load_progress", progress, path);
+        }
+        return !load_cancelled_.load();
+    };
+
+    std::string error;
+    const bool ok = engine_.load(to_utf8(path), load, error);
 
-Dictionary AgentRuntime::get_runtime_health() {
-    Dictionary health;
-    String runtime_property;
-    String model_path;
-    bool model_loaded = false;
     {
         std::scoped_lock lock(mutex_);
-        runtime_property = runtime_directory_;
-        model_path = default_model_path_;
-        model_loaded = model_ != nullptr && context_ != nullptr;
+        if (ok) {
+            finish_model_load_locked(options, true);
+        } else {
+            UtilityFunctions::push_error(String("AgentRuntime::load_model_async - ") + String::utf8(error.c_str()));
+        }
+        loading_ = false;
+        model_ready_ = ok;
     }
+    load_cv_.notify_all();
+    load_progress_.store(ok ? 1.0f : 0.0f);
+    call_deferred("emit_signal", "model_loaded", ok, ok ? String() : String::utf8(error.c_str()), path);
+}
 
-    std::filesystem::path runtime_dir = resolve_runtime_directory_path(String(), runtime_property);
-    bool runtime_dir_exists = !runtime_dir.empty() && std::filesystem::exists(runtime_dir);
-    std::filesystem::path model_path_fs = to_path(model_path);
-    bool model_path_exists = !model_path_fs.empty() && std::filesystem::exists(model_path_fs);
+void AgentRuntime::wait_for_model_load_locked(std::unique_lock<std::mutex> &lock) {
+    load_cv_.wait(lock, [this]() { return !loading_; });
+}
+
+void AgentRuntime::unload_model() {
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    unload_model_locked();
+}
+
+bool AgentRuntime::is_model_loaded() const {
+    return model_ready_.load();
+}
+
+bool AgentRuntime::is_model_loading() const {
+    return loading_.load();
+}
+
+double AgentRuntime::get_model_load_progress() const {
+    return load_progress_.load();
+}
+
+Dictionary AgentRuntime::get_runtime_health() {
+    // Lock-free: HUDs poll this every frame, including while a load or decode is running.
+    Dictionary health;
+    const std::shared_ptr<const RuntimeConfig> snapshot = config();
+    const String runtime_property = snapshot->runtime_directory;
+    const String model_path = snapshot->default_model_path;
+    const bool model_loading = loading_.load();
+    const bool model_loaded = model_ready_.load();
+
+    std::filesystem::path runtime_dir = resolve_runtime_directory_path(String(), runtime_property);
+    bool runtime_dir_exists = !runtime_dir.empty() && std::filesystem::exists(runtime_dir);
+    std::filesystem::path model_path_fs = to_path(model_path);
+    bool model_path_exists = !model_path_fs.empty() && std::filesystem::exists(model_path_fs);
 
     std::filesystem::path llama_cli = find_binary(runtime_dir, {"llama-cli", "llama-cli.exe"});
     std::filesystem::path llama_server = find_binary(runtime_dir, {"llama-server", "llama-server.exe"});
@@ -829,6 +1365,7 @@ Dictionary AgentRuntime::get_runtime_health() {
 
     health["ok"] = runtime_dir_exists && missing.is_empty();
     health["model_loaded"] = model_loaded;
+    health["model_loading"] = model_loading;
     health["default_model_path"] = model_path;
     health["default_model_exists"] = model_path_exists;
     health["runtime_directory"] = runtime_property;
@@ -836,64 +1373,408 @@ Dictionary AgentRuntime::get_runtime_health() {
     health["runtime_directory_exists"] = runtime_dir_exists;
     health["binaries"] = binaries;
     health["missing_binaries"] = missing;
+    health["threads"] = get_thread_info();
+    health["prefetch"] = get_prefetch_status();
     return health;
 }
 
 Dictionary AgentRuntime::generate(const Dictionary &request) {
-    std::scoped_lock lock(mutex_);
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    const auto started = std::chrono::steady_clock::now();
+    metrics.requests_total.add();
 
-    Dictionary options = default_options_.duplicate();
-    if (request.has("options")) {
-        Dictionary overrides = request["options"];
-        Array keys = overrides.keys();
-        for (int i = 0; i < keys.size(); ++i) {
-            Variant key = keys[i];
-            options[key] = overrides[key];
+    const std::shared_ptr<const RuntimeConfig> snapshot = config();
+    const Dictionary options = request_options(snapshot->default_options, request);
+    Dictionary response;
+    if (is_llama_server_backend(options)) {
+        // Remote requests never touch the local model, so they skip mutex_ entirely.
+        ScopedGauge in_flight(metrics.in_flight);
+        ScopedLatency request_timer(metrics.request_us);
+        response = run_llama_server_inference(request, options, *snapshot);
+    } else {
+        ScopedGauge queued(metrics.queue_depth);
+        std::unique_lock lock(mutex_);
+        // Requests issued during load_model_async queue here until the model is ready.
+        wait_for_model_load_locked(lock);
+        queued.release();
+
+        ScopedGauge in_flight(metrics.in_flight);
+        ScopedLatency request_timer(metrics.request_us);
+        response = generate_locked(request, started, lock);
+    }
+    if (!(bool)response.get("ok", false)) {
+        metrics.request_errors.add();
+    }
+    return response;
+}
+
+Dictionary AgentRuntime::generate_locked(const Dictionary &request, std::chrono::steady_clock::time_point started,
+                                         std::unique_lock<std::mutex> &lock) {
+    if (!ensure_model_loaded_locked()) {
+        Dictionary error;
+        error["ok"] = false;
+        error["error"] = "model_not_loaded";
+        return error;
+    }
+
+    return run_inference_locked(request, *config(), started, lock);
+}
+
+Dictionary AgentRuntime::resolve_tool_call(const Array &tool_specs, const Variant &context, const Dictionary &options) {
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    const auto started = std::chrono::steady_clock::now();
+    metrics.requests_total.add();
+
+    Dictionary response;
+    response["ok"] = false;
+    const std::vector<ToolSpec> tools = tool_specs_from_array(tool_specs);
+    if (tools.empty()) {
+        response["error"] = String("missing_tools");
+        metrics.request_errors.add();
+        return response;
+    }
+
+    ScopedGauge queued(metrics.queue_depth);
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    queued.release();
+    ScopedGauge in_flight(metrics.in_flight);
+    ScopedLatency request_timer(metrics.request_us);
+    if (!ensure_model_loaded_locked()) {
+        response["error"] = String("model_not_loaded");
+        metrics.request_errors.add();
+        return response;
+    }
+
+    // An in-process chat request, so the prompt goes through the model's own template with
+    // the tools declared and every generate() option applies. FunctionGemma's calls are
+    // constrained here instead: "none" keeps common's generic tool handler from adding its
+    // JSON-call instructions, while the template still renders the declarations.
+    bool escape_strings = true;
+    const bool native = function_call_template_locked(options, escape_strings);
+    Dictionary request_options = options.duplicate();
+    Array messages;
+    if (context.get_type() == Variant::ARRAY) {
+        messages = context;
+    } else {
+        append_message(messages, String("system"), options.get("system_prompt", String()));
+        append_message(messages, String("user"), String(context));
+    }
+    request_options["backend"] = String("inprocess");
+    request_options["messages"] = messages;
+    request_options["tools"] = tool_specs;
+    request_options["tool_choice"] = native ? String("none") : String("required");
+    if (native) {
+        request_options["parse_tool_calls"] = false;
+    }
+    if (!request_options.has("max_tokens")) {
+        request_options["max_tokens"] = 64;
+    }
+    Dictionary request;
+    request["options"] = request_options;
+
+    PreparedGeneration prepared;
+    if (prepare_generation_locked(request, *config(), prepared, response)) {
+        if (native) {
+            apply_function_call_grammar_locked(tools, escape_strings, prepared.generation);
+        }
+        const GenerationResult result = decode_prepared_locked(prepared, started, lock);
+        const Dictionary completion = finish_generation_locked(prepared, result, started);
+        response = Dictionary();
+        response["ok"] = false;
+        response["text"] = from_utf8(result.text);
+        response["usage"] = completion.get("usage", Dictionary());
+        response["cached"] = prepared.cached;
+        if (!(bool)completion.get("ok", false)) {
+            response["error"] = completion.get("error", String("generation_failed"));
+        } else if (native) {
+            ToolCall call;
+            std::string error;
+            if (parse_function_call(result.text, tools, call, error)) {
+                Dictionary arguments;
+                for (const ToolArgument &argument : call.arguments) {
+                    arguments[from_utf8(argument.name)] = tool_argument_variant(argument);
+                }
+                response["ok"] = true;
+                response["name"] = from_utf8(call.name);
+                response["arguments"] = arguments;
+            } else {
+                response["error"] = String::utf8(error.c_str());
+            }
+        } else {
+            // The template's own parser already split the call out; only its name is checked.
+            const Array tool_calls = completion.get("tool_calls", Array());
+            Dictionary function;
+            if (!tool_calls.is_empty() && tool_calls[0].get_type() == Variant::DICTIONARY) {
+                const Dictionary call = tool_calls[0];
+                function = call.get("function", Dictionary());
+            }
+            const std::string name = to_utf8(String(function.get("name", String())));
+            const Variant arguments = JSON::parse_string(String(function.get("arguments", String("{}"))));
+            if (name.empty()) {
+                response["error"] = String("no_tool_call");
+            } else if (std::none_of(tools.begin(), tools.end(), [&](const ToolSpec &tool) { return tool.name == name; })) {
+                response["error"] = String("unknown_tool");
+            } else {
+                response["ok"] = true;
+                response["name"] = from_utf8(name);
+                response["arguments"] = arguments.get_type() == Variant::DICTIONARY ? arguments : Variant(Dictionary());
+            }
         }
     }
+    if (!(bool)response.get("ok", false)) {
+        metrics.request_errors.add();
+    }
+    return response;
+}
 
-    if (is_llama_server_backend(options)) {
-        return run_llama_server_inference_locked(request, options);
+bool AgentRuntime::ensure_model_loaded_locked() {
+    if (engine_.is_loaded()) {
+        return true;
     }
+    const std::shared_ptr<const RuntimeConfig> snapshot = config();
+    return !snapshot->default_model_path.is_empty() &&
+           load_model_locked(snapshot->default_model_path, snapshot->default_options, false);
+}
 
-    if (!model_ || !context_) {
-        if (default_model_path_.is_empty()) {
+Array AgentRuntime::generate_many(const Array &requests) {
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    const auto started = std::chrono::steady_clock::now();
+    metrics.requests_total.add(static_cast<uint64_t>(requests.size()));
+
+    const std::shared_ptr<const RuntimeConfig> snapshot = config();
+    Array responses;
+    responses.resize(requests.size());
+    std::vector<int> local;
+    for (int i = 0; i < requests.size(); ++i) {
+        if (requests[i].get_type() != Variant::DICTIONARY) {
             Dictionary error;
             error["ok"] = false;
-            error["error"] = "model_not_loaded";
-            return error;
+            error["error"] = "invalid_request";
+            responses[i] = error;
+            continue;
         }
-        if (!load_model_locked(default_model_path_, default_options_, false)) {
-            Dictionary error;
-            error["ok"] = false;
-            error["error"] = "model_not_loaded";
-            return error;
+        const Dictionary request = requests[i];
+        const Dictionary options = request_options(snapshot->default_options, request);
+        if (is_llama_server_backend(options)) {
+            // The server batches concurrent slots itself; nothing to gain from grouping here.
+            ScopedGauge in_flight(metrics.in_flight);
+            ScopedLatency request_timer(metrics.request_us);
+            responses[i] = run_llama_server_inference(request, options, *snapshot);
+        } else {
+            local.push_back(i);
+        }
+    }
+
+    if (!local.empty()) {
+        ScopedGauge queued(metrics.queue_depth);
+        std::unique_lock lock(mutex_);
+        wait_for_model_load_locked(lock);
+        queued.release();
+
+        ScopedGauge in_flight(metrics.in_flight);
+        ScopedLatency request_timer(metrics.request_us);
+        if (!ensure_model_loaded_locked()) {
+            for (int index : local) {
+                Dictionary error;
+                error["ok"] = false;
+                error["error"] = "model_not_loaded";
+                responses[index] = error;
+            }
+        } else {
+            const std::shared_ptr<const RuntimeConfig> current = config();
+            std::vector<PreparedGeneration> prepared(local.size());
+            std::vector<GenerationRequest> batch;
+            std::vector<size_t> batched;
+            std::vector<std::string> batch_keys;
+            // Identical deterministic entries decode once: duplicates[k] -> index into batch.
+            // Only the cache and this batch are consulted; waiting on another thread's
+            // in-flight decode here could stall the whole batch behind it.
+            std::vector<std::pair<size_t, size_t>> duplicates;
+            std::unordered_map<std::string, size_t> batch_index;
+            const bool cache_enabled = generation_cache_.enabled();
+            for (size_t k = 0; k < local.size(); ++k) {
+                Dictionary error;
+                if (!prepare_generation_locked(requests[local[k]], *current, prepared[k], error)) {
+                    responses[local[k]] = error;
+                    continue;
+                }
+                const std::string key =
+                    cache_enabled && prepared[k].use_cache
+                        ? canonical_generation_key(prepared[k].generation, engine_.model_epoch(), adapter_epoch_)
+                        : std::string();
+                if (!key.empty()) {
+                    auto pending = batch_index.find(key);
+                    if (pending != batch_index.end()) {
+                        metrics.generation_requests_coalesced.add();
+                        prepared[k].cached = true;
+                        duplicates.emplace_back(k, pending->second);
+                        continue;
+                    }
+                    GenerationResult hit;
+                    if (generation_cache_.lookup(key, hit)) {
+                        prepared[k].cached = true;
+                        responses[local[k]] = finish_generation_locked(prepared[k], hit, started);
+                        continue;
+                    }
+                    batch_index.emplace(key, batch.size());
+                }
+                batch.push_back(std::move(prepared[k].generation));
+                batched.push_back(k);
+                batch_keys.push_back(key);
+            }
+
+            std::vector<GenerationResult> results;
+            {
+                // Same lock dance as run_inference_locked, once for the whole batch.
+                std::shared_lock lifetime(engine_lifetime_);
+                lock.unlock();
+                results = engine_.generate_batch(batch, started);
+                lifetime.unlock();
+                lock.lock();
+            }
+            for (size_t j = 0; j < batched.size(); ++j) {
+                PreparedGeneration &entry = prepared[batched[j]];
+                if (!batch_keys[j].empty()) {
+                    generation_cache_.store(batch_keys[j], results[j]);
+                }
+                entry.generation = std::move(batch[j]);
+                responses[local[batched[j]]] = finish_generation_locked(entry, results[j], started);
+            }
+            for (const auto &[k, j] : duplicates) {
+                responses[local[k]] = finish_generation_locked(prepared[k], results[j], started);
+            }
         }
     }
 
-    return run_inference_locked(request);
+    for (int i = 0; i < responses.size(); ++i) {
+        const Dictionary response = responses[i];
+        if (!(bool)response.get("ok", false)) {
+            metrics.request_errors.add();
+        }
+    }
+    return responses;
 }
 
-PackedFloat32Array AgentRuntime::embed_text(const String &text, const Dictionary &options) {
+Ref<GenerationHandle> AgentRuntime::begin_generation(const Dictionary &request) {
+    Ref<GenerationHandle> handle;
+    handle.instantiate();
+    handle->started_ = std::chrono::steady_clock::now();
+
+    const std::shared_ptr<const RuntimeConfig> snapshot = config();
+    if (is_llama_server_backend(request_options(snapshot->default_options, request))) {
+        handle->response_ = generate(request);
+        handle->finished_ = true;
+        return handle;
+    }
+
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    metrics.requests_total.add();
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    Dictionary error;
+    error["ok"] = false;
+    if (!ensure_model_loaded_locked()) {
+        error["error"] = "model_not_loaded";
+        handle->response_ = error;
+        handle->finished_ = true;
+        metrics.request_errors.add();
+        return handle;
+    }
+    handle->prepared_ = std::make_unique<PreparedGeneration>();
+    if (!prepare_generation_locked(request, *config(), *handle->prepared_, error)) {
+        handle->response_ = error;
+        handle->finished_ = true;
+        metrics.request_errors.add();
+        return handle;
+    }
+    {
+        std::shared_lock lifetime(engine_lifetime_);
+        handle->session_ = engine_.begin_generation(handle->prepared_->generation, handle->started_);
+    }
+    if (handle->session_->done()) {
+        handle->response_ = finish_generation_locked(*handle->prepared_, handle->session_->result(), handle->started_);
+        handle->finished_ = true;
+        metrics.request_us.record(local_agents::runtime::elapsed_micros(handle->started_));
+        if (!(bool)handle->response_.get("ok", false)) {
+            metrics.request_errors.add();
+        }
+    }
+    return handle;
+}
+
+void AgentRuntime::step_generation(GenerationHandle &handle, uint64_t budget_us) {
+    if (handle.finished_) {
+        return;
+    }
+    {
+        // Same rule as every lock-free engine reader: lifetime first, then readiness. While
+        // an async load owns the engine the step simply waits for a later frame.
+        std::shared_lock lifetime(engine_lifetime_);
+        if (!model_ready_.load() && loading_.load()) {
+            return;
+        }
+        handle.session_->step(budget_us);
+    }
+    if (!handle.session_->done()) {
+        return;
+    }
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
     std::scoped_lock lock(mutex_);
+    handle.response_ = finish_generation_locked(*handle.prepared_, handle.session_->result(), handle.started_);
+    handle.finished_ = true;
+    metrics.request_us.record(local_agents::runtime::elapsed_micros(handle.started_));
+    if (!(bool)handle.response_.get("ok", false)) {
+        metrics.request_errors.add();
+    }
+}
 
+PackedFloat32Array AgentRuntime::embed_text(const String &text, const Dictionary &options) {
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
     PackedFloat32Array empty;
     if (text.is_empty()) {
         UtilityFunctions::push_warning("AgentRuntime::embed_text - empty text");
         return empty;
     }
 
-    Dictionary resolved = default_options_.duplicate();
-    if (!options.is_empty()) {
-        Array keys = options.keys();
-        for (int i = 0; i < keys.size(); ++i) {
-            Variant key = keys[i];
-            resolved[key] = options[key];
+    const std::shared_ptr<const RuntimeConfig> snapshot = config();
+    Dictionary resolved = snapshot->default_options.duplicate();
+    merge_dictionary(resolved, options);
+
+    bool normalize = resolved.get("normalize", true);
+    bool add_bos = resolved.get("add_bos", true);
+    bool use_cache = resolved.get("cache", true);
+    {
+        std::scoped_lock cache_lock(embedding_cache_mutex_);
+        use_cache = use_cache && embedding_cache_capacity_ > 0;
+    }
+    metrics.embedding_requests.add();
+
+    // Embeddings are deterministic per (backend, model, flags, text), so repeated memory
+    // lookups of the same line skip the decode entirely.
+    std::string cache_key;
+    if (use_cache) {
+        std::ostringstream key;
+        if (is_llama_server_backend(resolved)) {
+            key << "server|" << to_utf8(resolved.get("server_base_url", resolved.get("base_url", String())))
+                << "|" << to_utf8(resolved.get("server_model", resolved.get("model", String())));
+        } else {
+            key << "local|" << to_utf8(snapshot->default_model_path);
+        }
+        key << "|" << (normalize ? 1 : 0) << (add_bos ? 1 : 0) << "|" << to_utf8(text);
+        cache_key = key.str();
+
+        PackedFloat32Array cached;
+        if (lookup_cached_embedding(cache_key, cached)) {
+            metrics.embedding_cache_hits.add();
+            return cached;
         }
+        metrics.embedding_cache_misses.add();
     }
 
-    bool normalize = resolved.get("normalize", true);
     if (is_llama_server_backend(resolved)) {
+        // No mutex_: the HTTP round trip must not queue behind local loads or decodes.
+        ScopedGauge in_flight(metrics.in_flight);
         String base_url = resolved.get("server_base_url", resolved.get("base_url", String("http://127.0.0.1:8080")));
         base_url = normalize_server_base_url(base_url);
         if (base_url.is_empty()) {
@@ -937,96 +1818,138 @@ PackedFloat32Array AgentRuntime::embed_text(const String &text, const Dictionary
             return empty;
         }
 
-        Variant parsed = JSON::parse_string(http.body);
-        if (parsed.get_type() != Variant::DICTIONARY) {
-            UtilityFunctions::push_error("AgentRuntime::embed_text - invalid_json_response");
+        std::vector<float> values;
+        std::string parse_error;
+        if (!parse_embedding_reply(http.body, values, parse_error)) {
+            UtilityFunctions::push_error(String("AgentRuntime::embed_text - ") + String::utf8(parse_error.c_str()));
             return empty;
         }
-
-        String parse_error;
-        PackedFloat32Array server_embedding = embedding_from_json(parsed, normalize, parse_error);
-        if (server_embedding.is_empty()) {
-            UtilityFunctions::push_error(String("AgentRuntime::embed_text - ") + parse_error);
-            return empty;
+        PackedFloat32Array server_embedding = embedding_from_values(values, normalize);
+        if (!cache_key.empty()) {
+            store_cached_embedding(cache_key, server_embedding);
         }
         return server_embedding;
     }
 
-    if (!model_ || !context_) {
-        if (default_model_path_.is_empty()) {
+    const auto embed_started = std::chrono::steady_clock::now();
+    ScopedGauge queued(metrics.queue_depth);
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    queued.release();
+    ScopedGauge in_flight(metrics.in_flight);
+
+    if (!engine_.is_loaded()) {
+        const std::shared_ptr<const RuntimeConfig> current = config();
+        if (current->default_model_path.is_empty()) {
             UtilityFunctions::push_error("AgentRuntime::embed_text - model not loaded");
             return empty;
         }
-        Dictionary reload_options = default_options_.duplicate();
+        Dictionary reload_options = current->default_options.duplicate();
         reload_options["embedding"] = true;
-        if (!load_model_locked(default_model_path_, reload_options, false)) {
+        if (!load_model_locked(current->default_model_path, reload_options, false)) {
             UtilityFunctions::push_error("AgentRuntime::embed_text - failed to reload model with embedding support");
             return empty;
         }
     }
 
-    bool add_bos = resolved.get("add_bos", true);
-
-    std::string input = to_utf8(text);
-    const llama_vocab *vocab = llama_model_get_vocab(model_);
-    if (!vocab) {
-        UtilityFunctions::push_error("AgentRuntime::embed_text - vocab unavailable");
-        return empty;
-    }
-
-    std::vector<llama_token> tokens;
-    if (!tokenize_text(vocab, input, add_bos, false, tokens)) {
-        UtilityFunctions::push_error("AgentRuntime::embed_text - tokenization failed");
+    std::vector<float> values;
+    std::string embed_error;
+    bool embedded = false;
+    {
+        // Same hand-off as run_inference_locked: decode on a pooled context without mutex_.
+        std::shared_lock lifetime(engine_lifetime_);
+        lock.unlock();
+        embedded = engine_.embed(to_utf8(text), add_bos, normalize, values, embed_error);
+    }
+    if (trace_.is_open()) {
+        local_agents::runtime::TraceRecord record;
+        record.kind = local_agents::runtime::TraceKind::Embed;
+        record.start_us = trace_.offset_us(embed_started);
+        record.duration_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                       std::chrono::steady_clock::now() - embed_started)
+                                                       .count());
+        record.request.prompt = to_utf8(text);
+        record.add_bos = add_bos;
+        record.normalize = normalize;
+        record.ok = embedded;
+        record.output_hash = local_agents::runtime::trace_hash(values.data(), values.size() * sizeof(float));
+        trace_.append(std::move(record));
+    }
+    if (!embedded) {
+        UtilityFunctions::push_error(String("AgentRuntime::embed_text - ") + String::utf8(embed_error.c_str()));
         return empty;
     }
 
-    llama_memory_clear(llama_get_memory(context_), true);
-
-    llama_batch batch = llama_batch_get_one(tokens.data(), static_cast<int32_t>(tokens.size()));
+    PackedFloat32Array embedding;
+    embedding.resize(static_cast<int64_t>(values.size()));
+    std::memcpy(embedding.ptrw(), values.data(), values.size() * sizeof(float));
 
-    if (llama_decode(context_, batch) != 0) {
-        UtilityFunctions::push_error("AgentRuntime::embed_text - llama_decode failed");
-        return empty;
+    if (!cache_key.empty()) {
+        store_cached_embedding(cache_key, embedding);
     }
+    return embedding;
+}
 
-    const float *embedding_ptr = nullptr;
-    switch (llama_pooling_type(context_)) {
-        case LLAMA_POOLING_TYPE_NONE:
-            embedding_ptr = llama_get_embeddings(context_);
-            if (!embedding_ptr) {
-                embedding_ptr = llama_get_embeddings_ith(context_, static_cast<int32_t>(tokens.size()) - 1);
+int64_t AgentRuntime::count_tokens(const String &text) {
+    const std::string utf8 = to_utf8(text);
+    {
+        // The lifetime lock comes first: once held, a ready model cannot be unloaded under us,
+        // and an async load (which never sets model_ready_ early) is never read mid-build.
+        std::shared_lock lifetime(engine_lifetime_);
+        if (model_ready_.load()) {
+            const int32_t count = engine_.count_tokens(utf8);
+            if (count >= 0) {
+                return count;
             }
-            break;
-        default:
-            embedding_ptr = llama_get_embeddings_seq(context_, 0);
-            break;
+        }
     }
+    return static_cast<int64_t>((utf8.size() + 3) / 4);
+}
 
-    if (!embedding_ptr) {
-        UtilityFunctions::push_error("AgentRuntime::embed_text - no embedding data");
-        return empty;
+int64_t AgentRuntime::create_conversation() {
+    auto conversation = std::make_shared<Conversation>();
+    register_conversation(conversation);
+    return conversation->id();
+}
+
+bool AgentRuntime::append_conversation_message(int64_t id, const String &role, const String &content) {
+    std::shared_ptr<Conversation> conversation = find_conversation(id);
+    if (!conversation) {
+        UtilityFunctions::push_error(String("AgentRuntime::append_conversation_message - unknown conversation ") + String::num_int64(id));
+        return false;
     }
+    conversation->append(to_utf8(role), to_utf8(content));
+    tokenize_conversation(*conversation);
+    conversation->trim();
+    return true;
+}
 
-    int dim = llama_model_n_embd(model_);
-    PackedFloat32Array embedding;
-    embedding.resize(dim);
-    float *out = embedding.ptrw();
-    std::memcpy(out, embedding_ptr, dim * sizeof(float));
+void AgentRuntime::release_conversation(int64_t id) {
+    std::scoped_lock lock(conversations_mutex_);
+    conversations_.erase(id);
+}
 
-    if (normalize) {
-        double norm = 0.0;
-        for (int i = 0; i < dim; ++i) {
-            norm += static_cast<double>(out[i]) * static_cast<double>(out[i]);
-        }
-        norm = std::sqrt(std::max(norm, 1e-12));
-        if (norm > 0.0) {
-            for (int i = 0; i < dim; ++i) {
-                out[i] = static_cast<float>(out[i] / norm);
-            }
-        }
+void AgentRuntime::register_conversation(const std::shared_ptr<Conversation> &conversation) {
+    if (!conversation) {
+        return;
     }
+    std::scoped_lock lock(conversations_mutex_);
+    conversations_.emplace(conversation->id(), conversation);
+}
 
-    return embedding;
+std::shared_ptr<Conversation> AgentRuntime::find_conversation(int64_t id) const {
+    std::scoped_lock lock(conversations_mutex_);
+    auto found = conversations_.find(id);
+    return found == conversations_.end() ? nullptr : found->second;
+}
+
+bool AgentRuntime::tokenize_conversation(Conversation &conversation) {
+    std::shared_lock lifetime(engine_lifetime_);
+    if (!model_ready_.load()) {
+        return false;
+    }
+    conversation.tokenize_pending(engine_);
+    return true;
 }
 
 Dictionary AgentRuntime::download_model(const Dictionary &request) {
@@ -1048,13 +1971,7 @@ Dictionary AgentRuntime::download_model(const Dictionary &request) {
         emit_signal("download_finished", ok, error, path);
     };
 
-    String runtime_dir_copy;
-    {
-        std::scoped_lock lock(mutex_);
-        runtime_dir_copy = runtime_directory_;
-    }
-
-    return download_manager_->download(request, callbacks, runtime_dir_copy);
+    return download_manager_->download(request, callbacks, config()->runtime_directory);
 }
 
 String AgentRuntime::get_model_cache_directory() const {
@@ -1171,73 +2088,50 @@ Dictionary AgentRuntime::download_model_hf(const String &repo, const Dictionary
     return download_model(request);
 }
 
-Dictionary AgentRuntime::synthesize_speech(const Dictionary &request) {
-    Dictionary response;
-    response["ok"] = false;
-
-    String text = request.get("text", String());
-    if (text.is_empty()) {
-        response["error"] = String("missing_text");
-        return response;
-    }
-
+bool AgentRuntime::resolve_piper_voice(const Dictionary &request, PiperVoiceOptions &voice, Dictionary &response) const {
     String voice_path = request.get("voice_path", String());
     if (voice_path.is_empty()) {
         response["error"] = String("missing_voice_path");
-        return response;
-    }
-
-    String output_path = request.get("output_path", String());
-    if (output_path.is_empty()) {
-        std::filesystem::path temp_path = std::filesystem::temp_directory_path() / "local_agents_tts.wav";
-        output_path = String::utf8(temp_path.string().c_str());
+        return false;
     }
 
     String runtime_override = request.get("runtime_directory", String());
     String voice_config = request.get("voice_config", String());
 
-    String runtime_property;
-    {
-        std::scoped_lock lock(speech_mutex_);
-        runtime_property = runtime_directory_;
-    }
+    const String runtime_property = config()->runtime_directory;
 
     std::filesystem::path runtime_dir_path = resolve_runtime_directory_path(runtime_override, runtime_property);
     if (runtime_dir_path.empty()) {
         response["error"] = String("runtime_directory_missing");
-        return response;
+        return false;
     }
+    response["runtime_directory"] = path_to_string(runtime_dir_path);
 
     std::filesystem::path piper_bin = find_binary(runtime_dir_path, {"piper", "piper.exe"});
     if (piper_bin.empty()) {
         response["error"] = String("piper_binary_missing");
-        response["runtime_directory"] = path_to_string(runtime_dir_path);
-        return response;
+        return false;
     }
 
     std::filesystem::path voice_model_path = to_path(voice_path);
     if (voice_model_path.empty() || !std::filesystem::exists(voice_model_path)) {
         response["error"] = String("voice_missing");
         response["voice_path"] = voice_path;
-        return response;
+        return false;
     }
 
-    std::optional<std::filesystem::path> voice_config_path;
+    voice = PiperVoiceOptions();
+    voice.binary = piper_bin.string();
+    voice.model = voice_model_path.string();
     if (!voice_config.is_empty()) {
         std::filesystem::path config_candidate = to_path(voice_config);
         if (!config_candidate.empty() && std::filesystem::exists(config_candidate)) {
-            voice_config_path = config_candidate;
+            voice.config = config_candidate.string();
         } else {
             response["voice_config_missing"] = voice_config;
         }
     }
 
-    std::filesystem::path output_file_path = to_path(output_path);
-    if (output_file_path.empty()) {
-        output_file_path = std::filesystem::path(to_utf8(output_path));
-    }
-    ensure_parent_directory(output_file_path);
-
     std::filesystem::path espeak_dir = runtime_dir_path / "espeak-ng-data";
     if (!std::filesystem::exists(espeak_dir)) {
         std::filesystem::path alt = runtime_dir_path / "espeak-ng" / "data";
@@ -1245,20 +2139,152 @@ Dictionary AgentRuntime::synthesize_speech(const Dictionary &request) {
             espeak_dir = alt;
         }
     }
+    if (std::filesystem::exists(espeak_dir)) {
+        voice.espeak_data = espeak_dir.string();
+    }
     std::filesystem::path tashkeel_model = runtime_dir_path / "libtashkeel_model.ort";
+    if (std::filesystem::exists(tashkeel_model)) {
+        voice.tashkeel_model = tashkeel_model.string();
+    }
+    if (request.has("timeout_ms")) {
+        voice.timeout_ms = std::max(1, int32_t(request["timeout_ms"]));
+    }
+    voice.speaker = request.get("speaker", -1);
+    voice.length_scale = request.get("length_scale", 0.0);
+    voice.noise_scale = request.get("noise_scale", 0.0);
+    voice.noise_w = request.get("noise_w", 0.0);
+    return true;
+}
+
+bool AgentRuntime::synthesize_with_voice(const PiperVoiceOptions &options, const std::string &text, bool use_cache,
+                                         const PiperVoice::PcmSink &sink, std::atomic<int32_t> &sample_rate,
+                                         std::string &error) {
+    const std::string line = normalize_tts_text(text);
+    std::string clip_key;
+    std::vector<float> clip;
+    bool clip_complete = true;
+    if (use_cache && !line.empty() && tts_cache_.enabled()) {
+        clip_key = tts_clip_key(options, line);
+        int32_t cached_rate = 0;
+        if (tts_cache_.lookup(clip_key, clip, cached_rate)) {
+            RuntimeMetrics::get().tts_cache_hits.add();
+            sample_rate.store(cached_rate);
+            sink(clip.data(), clip.size());
+            return true;
+        }
+        RuntimeMetrics::get().tts_cache_misses.add();
+    }
+    // On a miss the clip is kept on its way to `sink` and stored once piper finishes the line;
+    // a line the sink cut short is not.
+    const PiperVoice::PcmSink recording_sink = [&](const float *samples, size_t count) {
+        clip.insert(clip.end(), samples, samples + count);
+        clip_complete = clip_complete && sink(samples, count);
+        return clip_complete;
+    };
+
+    // Speaker parameters are process arguments, so each set gets its own process.
+    std::ostringstream voice_key;
+    voice_key << options.model << '\n' << options.config << '\n' << options.speaker << ' ' << options.length_scale
+              << ' ' << options.noise_scale << ' ' << options.noise_w;
+    const std::string key = voice_key.str();
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::shared_ptr<PiperVoice> voice;
+        {
+            std::scoped_lock lock(voices_mutex_);
+            std::shared_ptr<PiperVoice> &slot = voices_[key];
+            if (!slot || !slot->running()) {
+                slot = std::make_shared<PiperVoice>();
+                if (!slot->start(options, error)) {
+                    voices_.erase(key);
+                    return false;
+                }
+            }
+            voice = slot;
+        }
+        sample_rate.store(voice->sample_rate());
+        error.clear();
+        clip.clear();
+        clip_complete = true;
+        if (voice->synthesize(line, clip_key.empty() ? sink : recording_sink, error)) {
+            if (!clip_key.empty() && clip_complete && !clip.empty()) {
+                std::string cache_error;
+                tts_cache_.store(clip_key, clip.data(), clip.size(), voice->sample_rate(), cache_error);
+            }
+            return true;
+        }
+        // A process that had already exited (killed, crashed between lines) gets one restart;
+        // one that fails on this line does not.
+        if (error.rfind("piper_not_running", 0) != 0 && error.rfind("piper_write_failed", 0) != 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+Dictionary AgentRuntime::synthesize_speech(const Dictionary &request) {
+    Dictionary response;
+    response["ok"] = false;
+
+    String text = request.get("text", String());
+    if (text.is_empty()) {
+        response["error"] = String("missing_text");
+        return response;
+    }
+
+    PiperVoiceOptions voice;
+    if (!resolve_piper_voice(request, voice, response)) {
+        return response;
+    }
+
+    // Unique per call: concurrent syntheses used to share one temp file and overwrite each
+    // other's audio.
+    String output_path = request.get("output_path", String());
+    std::filesystem::path output_file_path = to_path(output_path);
+    if (output_path.is_empty()) {
+        static std::atomic<uint64_t> counter{0};
+        std::ostringstream name;
+        name << "local_agents_tts_" << OS::get_singleton()->get_process_id() << '_'
+             << counter.fetch_add(1, std::memory_order_relaxed) + 1 << ".wav";
+        output_file_path = std::filesystem::temp_directory_path() / name.str();
+    } else if (output_file_path.empty()) {
+        output_file_path = std::filesystem::path(to_utf8(output_path));
+    }
+    ensure_parent_directory(output_file_path);
+
+    std::string text_utf8 = to_utf8(text);
+    if (bool(request.get("persistent", true))) {
+        ensure_speech_cache();
+        std::vector<float> pcm;
+        std::atomic<int32_t> sample_rate{0};
+        std::string error;
+        const bool use_cache = request.get("cache", true);
+        const bool ok = synthesize_with_voice(voice, text_utf8, use_cache, [&pcm](const float *samples, size_t count) {
+            pcm.insert(pcm.end(), samples, samples + count);
+            return true;
+        }, sample_rate, error);
+        if (ok && local_agents::runtime::write_wav_file(output_file_path.string(), pcm.data(), pcm.size(),
+                                                        sample_rate.load(), error)) {
+            response["ok"] = true;
+            response["output_path"] = path_to_string(output_file_path);
+            response["sample_rate"] = sample_rate.load();
+            return response;
+        }
+        // Fall back to a one-shot run, e.g. for a piper build without --output_raw.
+        response["persistent_error"] = String::utf8(error.c_str());
+    }
 
     std::ostringstream command;
-    command << '\"' << piper_bin.string() << '\"';
-    command << " --model " << std::quoted(voice_model_path.string());
+    command << '\"' << voice.binary << '\"';
+    command << " --model " << std::quoted(voice.model);
     command << " --output_file " << std::quoted(output_file_path.string());
-    if (voice_config_path.has_value()) {
-        command << " --config " << std::quoted(voice_config_path->string());
+    if (!voice.config.empty()) {
+        command << " --config " << std::quoted(voice.config);
     }
-    if (std::filesystem::exists(espeak_dir)) {
-        command << " --espeak_data " << std::quoted(espeak_dir.string());
+    if (!voice.espeak_data.empty()) {
+        command << " --espeak_data " << std::quoted(voice.espeak_data);
     }
-    if (std::filesystem::exists(tashkeel_model)) {
-        command << " --tashkeel_model " << std::quoted(tashkeel_model.string());
+    if (!voice.tashkeel_model.empty()) {
+        command << " --tashkeel_model " << std::quoted(voice.tashkeel_model);
     }
 
     std::string command_line = command.str();
@@ -1269,7 +2295,6 @@ Dictionary AgentRuntime::synthesize_speech(const Dictionary &request) {
         return response;
     }
 
-    std::string text_utf8 = to_utf8(text);
     int write_error = 0;
     if (std::fputs(text_utf8.c_str(), pipe) == EOF) {
         write_error = errno;
@@ -1303,47 +2328,296 @@ Dictionary AgentRuntime::synthesize_speech(const Dictionary &request) {
 
     response["ok"] = true;
     response["output_path"] = path_to_string(output_file_path);
-    response["runtime_directory"] = path_to_string(runtime_dir_path);
     return response;
 }
 
-Dictionary AgentRuntime::transcribe_audio(const Dictionary &request) {
+Dictionary AgentRuntime::synthesize_pcm(const Dictionary &request) {
     Dictionary response;
     response["ok"] = false;
-
-    String input_path = request.get("input_path", String());
-    if (input_path.is_empty()) {
-        response["error"] = String("missing_input_path");
+    String text = request.get("text", String());
+    if (text.is_empty()) {
+        response["error"] = String("missing_text");
         return response;
     }
-    String model_path = request.get("model_path", String());
-    if (model_path.is_empty()) {
-        response["error"] = String("missing_model_path");
+    PiperVoiceOptions voice;
+    if (!resolve_piper_voice(request, voice, response)) {
         return response;
     }
 
-    String runtime_override = request.get("runtime_directory", String());
-    String output_override = request.get("output_path", String());
+    ensure_speech_cache();
+    std::vector<float> pcm;
+    std::atomic<int32_t> sample_rate{0};
+    std::string error;
+    const bool use_cache = request.get("cache", true);
+    if (!synthesize_with_voice(voice, to_utf8(text), use_cache, [&pcm](const float *samples, size_t count) {
+            pcm.insert(pcm.end(), samples, samples + count);
+            return true;
+        }, sample_rate, error)) {
+        response["error"] = String::utf8(error.c_str());
+        return response;
+    }
+    PackedFloat32Array samples;
+    samples.resize(static_cast<int64_t>(pcm.size()));
+    std::copy(pcm.begin(), pcm.end(), samples.ptrw());
+    response["ok"] = true;
+    response["pcm"] = samples;
+    response["sample_rate"] = sample_rate.load();
+    return response;
+}
 
-    String runtime_property;
+Ref<SpeechStream> AgentRuntime::begin_speech(const Dictionary &request) {
+    Ref<SpeechStream> stream;
+    stream.instantiate();
+    String text = request.get("text", String());
+    Dictionary response;
+    SynthesisJob job;
+    if (text.is_empty()) {
+        stream->state_->finish("missing_text");
+        return stream;
+    }
+    if (!resolve_piper_voice(request, job.voice, response)) {
+        stream->state_->finish(to_utf8(String(response.get("error", String("piper_failed")))));
+        return stream;
+    }
+    job.text = to_utf8(text);
+    job.use_cache = request.get("cache", true);
+    job.stream = stream->state_;
+
+    // A cached line that fits the ring is there before this returns; no thread hop.
+    ensure_speech_cache();
+    if (job.use_cache && tts_cache_.enabled()) {
+        std::vector<float> clip;
+        int32_t cached_rate = 0;
+        if (tts_cache_.lookup(tts_clip_key(job.voice, normalize_tts_text(job.text)), clip, cached_rate) &&
+            clip.size() <= job.stream->ring.capacity()) {
+            RuntimeMetrics::get().tts_cache_hits.add();
+            job.stream->sample_rate.store(cached_rate);
+            job.stream->ring.write(clip.data(), clip.size());
+            job.stream->finish(std::string());
+            return stream;
+        }
+    }
+
+    std::scoped_lock lock(synthesis_mutex_);
+    if (synthesis_stopping_) {
+        stream->state_->finish("cancelled");
+        return stream;
+    }
+    synthesis_jobs_.push_back(std::move(job));
+    if (!synthesis_thread_.joinable()) {
+        synthesis_thread_ = std::thread(&AgentRuntime::run_synthesis_worker, this);
+    }
+    synthesis_cv_.notify_one();
+    return stream;
+}
+
+void AgentRuntime::run_synthesis_worker() {
+    for (;;) {
+        SynthesisJob job;
+        {
+            std::unique_lock lock(synthesis_mutex_);
+            synthesis_cv_.wait(lock, [this]() {
+                return synthesis_stopping_ || !synthesis_jobs_.empty() || !prewarm_jobs_.empty();
+            });
+            if (synthesis_stopping_) {
+                return;
+            }
+            std::deque<SynthesisJob> &queue = synthesis_jobs_.empty() ? prewarm_jobs_ : synthesis_jobs_;
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        if (job.prewarm) {
+            run_prewarm_job(job);
+            continue;
+        }
+        SpeechStream::State &stream = *job.stream;
+        if (stream.cancelled.load()) {
+            stream.finish("cancelled");
+            continue;
+        }
+        // A full ring (nobody reading yet) holds piper back rather than dropping audio; piper
+        // then blocks on its own stdout until playback catches up.
+        std::string error;
+        const bool ok = synthesize_with_voice(job.voice, job.text, job.use_cache, [&stream](const float *samples, size_t count) {
+            while (count > 0) {
+                if (stream.cancelled.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                const size_t written = stream.ring.write(samples, count);
+                samples += written;
+                count -= written;
+                if (count > 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+            }
+            return true;
+        }, stream.sample_rate, error);
+        stream.finish(ok ? (stream.cancelled.load() ? std::string("cancelled") : std::string()) : error);
+    }
+}
+
+void AgentRuntime::run_prewarm_job(const SynthesisJob &job) {
+    PrewarmBatch &batch = *job.prewarm;
+    std::atomic<int32_t> sample_rate{0};
+    std::string error;
+    // The sink discards: synthesize_with_voice() stores the clip on the way through.
+    if (!synthesize_with_voice(job.voice, job.text, true, [](const float *, size_t) { return true; }, sample_rate,
+                               error)) {
+        batch.failed.fetch_add(1);
+    }
+    if (batch.remaining.fetch_sub(1) == 1) {
+        Dictionary result;
+        result["id"] = batch.id;
+        result["failed"] = batch.failed.load();
+        result["ok"] = batch.failed.load() == 0;
+        call_deferred("emit_signal", "speech_prewarmed", batch.id, result);
+    }
+}
+
+void AgentRuntime::stop_synthesis_worker() {
+    std::deque<SynthesisJob> pending;
     {
-        std::scoped_lock lock(speech_mutex_);
-        runtime_property = runtime_directory_;
+        std::scoped_lock lock(synthesis_mutex_);
+        synthesis_stopping_ = true;
+        pending.swap(synthesis_jobs_);
+        prewarm_jobs_.clear();
+    }
+    for (SynthesisJob &job : pending) {
+        job.stream->finish("cancelled");
     }
+    synthesis_cv_.notify_all();
+    if (synthesis_thread_.joinable()) {
+        synthesis_thread_.join();
+    }
+}
 
-    std::filesystem::path runtime_dir_path = resolve_runtime_directory_path(runtime_override, runtime_property);
-    if (runtime_dir_path.empty()) {
-        response["error"] = String("runtime_directory_missing");
+void AgentRuntime::ensure_speech_cache() {
+    std::call_once(tts_cache_default_, [this]() {
+        if (tts_cache_.directory().empty()) {
+            const String directory = normalize_project_path("user://local_agents/tts_cache");
+            tts_cache_.configure(std::filesystem::path(to_utf8(directory)), 64ull << 20);
+        }
+    });
+}
+
+Dictionary AgentRuntime::configure_speech_cache(const Dictionary &options) {
+    ensure_speech_cache();
+    std::filesystem::path directory = tts_cache_.directory();
+    if (options.has("directory")) {
+        directory = std::filesystem::path(to_utf8(normalize_project_path(options["directory"])));
+    }
+    uint64_t max_bytes = tts_cache_.max_bytes();
+    if (options.has("max_bytes")) {
+        max_bytes = static_cast<uint64_t>(std::max<int64_t>(0, int64_t(options["max_bytes"])));
+    }
+    tts_cache_.configure(directory, max_bytes);
+    if (bool(options.get("clear", false))) {
+        tts_cache_.clear();
+    }
+    return get_speech_cache_info();
+}
+
+Dictionary AgentRuntime::get_speech_cache_info() {
+    ensure_speech_cache();
+    Dictionary info;
+    info["enabled"] = tts_cache_.enabled();
+    info["directory"] = path_to_string(tts_cache_.directory());
+    info["max_bytes"] = static_cast<int64_t>(tts_cache_.max_bytes());
+    info["bytes"] = static_cast<int64_t>(tts_cache_.total_bytes());
+    info["entries"] = static_cast<int64_t>(tts_cache_.entry_count());
+    return info;
+}
+
+Dictionary AgentRuntime::prewarm_speech(const Array &lines, const Dictionary &request) {
+    Dictionary response;
+    response["ok"] = false;
+    PiperVoiceOptions voice;
+    if (!resolve_piper_voice(request, voice, response)) {
+        return response;
+    }
+    ensure_speech_cache();
+    if (!tts_cache_.enabled()) {
+        response["error"] = String("tts_cache_disabled");
         return response;
     }
 
-    std::filesystem::path whisper_bin = find_binary(runtime_dir_path, {"whisper", "whisper-cli", "whisper.exe", "whisper-cli.exe"});
-    if (whisper_bin.empty()) {
-        response["error"] = String("whisper_binary_missing");
-        response["runtime_directory"] = path_to_string(runtime_dir_path);
+    // Duplicates and lines already on disk are skipped here, so the batch is only real work.
+    std::vector<std::string> pending;
+    std::unordered_set<std::string> seen;
+    int64_t cached = 0;
+    for (int64_t i = 0; i < lines.size(); ++i) {
+        const std::string line = normalize_tts_text(to_utf8(String(lines[i])));
+        if (line.empty() || !seen.insert(line).second) {
+            continue;
+        }
+        if (tts_cache_.contains(tts_clip_key(voice, line))) {
+            ++cached;
+            continue;
+        }
+        pending.push_back(line);
+    }
+
+    response["ok"] = true;
+    response["cached"] = cached;
+    response["queued"] = static_cast<int64_t>(pending.size());
+    response["id"] = 0;
+    if (pending.empty()) {
+        return response;
+    }
+
+    std::scoped_lock lock(synthesis_mutex_);
+    if (synthesis_stopping_) {
+        response["ok"] = false;
+        response["error"] = String("cancelled");
+        return response;
+    }
+    auto batch = std::make_shared<PrewarmBatch>();
+    batch->id = next_prewarm_id_++;
+    batch->remaining.store(static_cast<int64_t>(pending.size()));
+    for (std::string &line : pending) {
+        SynthesisJob job;
+        job.voice = voice;
+        job.text = std::move(line);
+        job.prewarm = batch;
+        prewarm_jobs_.push_back(std::move(job));
+    }
+    if (!synthesis_thread_.joinable()) {
+        synthesis_thread_ = std::thread(&AgentRuntime::run_synthesis_worker, this);
+    }
+    synthesis_cv_.notify_one();
+    response["id"] = batch->id;
+    return response;
+}
+
+void AgentRuntime::release_voices() {
+    std::unordered_map<std::string, std::shared_ptr<PiperVoice>> voices;
+    {
+        std::scoped_lock lock(voices_mutex_);
+        voices.swap(voices_);
+    }
+    for (auto &entry : voices) {
+        entry.second->stop();
+    }
+}
+
+Dictionary AgentRuntime::transcribe_audio(const Dictionary &request) {
+    Dictionary response;
+    response["ok"] = false;
+
+    String input_path = request.get("input_path", String());
+    if (input_path.is_empty()) {
+        response["error"] = String("missing_input_path");
+        return response;
+    }
+    String model_path = request.get("model_path", String());
+    if (model_path.is_empty()) {
+        response["error"] = String("missing_model_path");
         return response;
     }
 
+    String runtime_override = request.get("runtime_directory", String());
+    String output_override = request.get("output_path", String());
+
     std::filesystem::path input_file = to_path(input_path);
     if (input_file.empty() || !std::filesystem::exists(input_file)) {
         response["error"] = String("input_missing");
@@ -1358,6 +2632,53 @@ Dictionary AgentRuntime::transcribe_audio(const Dictionary &request) {
         return response;
     }
 
+    PcmBuffer pcm;
+    std::string wav_error;
+    if (SpeechEngine::available() && bool(request.get("in_process", true)) &&
+        local_agents::runtime::read_wav_file(input_file.string(), pcm, wav_error)) {
+        const size_t heard = pcm.samples.size();
+        if (bool(request.get("vad", false))) {
+            pcm.samples = voiced_audio(pcm.samples, pcm.sample_rate, vad_options_from_dictionary(request));
+            if (pcm.samples.empty()) {
+                Dictionary silent;
+                silent["ok"] = true;
+                silent["text"] = String();
+                silent["segments"] = Array();
+                silent["voiced_ratio"] = 0.0;
+                return silent;
+            }
+        }
+        Dictionary result = transcribe_samples(model_file.string(), speech_model_options_from_dictionary(request),
+                                               pcm.samples.data(), pcm.samples.size(), pcm.sample_rate,
+                                               transcribe_options_from_dictionary(request));
+        if (bool(request.get("vad", false))) {
+            result["voiced_ratio"] = static_cast<double>(pcm.samples.size()) / static_cast<double>(std::max<size_t>(1, heard));
+        }
+        if (bool(result.get("ok", false)) && !output_override.is_empty()) {
+            std::filesystem::path output_file = to_path(output_override);
+            ensure_parent_directory(output_file);
+            std::ofstream output(output_file, std::ios::binary | std::ios::trunc);
+            output << to_utf8(JSON::stringify(result));
+            result["output_path"] = path_to_string(output_file);
+        }
+        return result;
+    }
+
+    const String runtime_property = config()->runtime_directory;
+
+    std::filesystem::path runtime_dir_path = resolve_runtime_directory_path(runtime_override, runtime_property);
+    if (runtime_dir_path.empty()) {
+        response["error"] = String("runtime_directory_missing");
+        return response;
+    }
+
+    std::filesystem::path whisper_bin = find_binary(runtime_dir_path, {"whisper", "whisper-cli", "whisper.exe", "whisper-cli.exe"});
+    if (whisper_bin.empty()) {
+        response["error"] = String("whisper_binary_missing");
+        response["runtime_directory"] = path_to_string(runtime_dir_path);
+        return response;
+    }
+
     std::filesystem::path desired_output = to_path(output_override);
     if (desired_output.empty()) {
         desired_output = input_file;
@@ -1426,25 +2747,174 @@ Dictionary AgentRuntime::transcribe_audio(const Dictionary &request) {
     return response;
 }
 
-Dictionary AgentRuntime::run_inference_locked(const Dictionary &request) {
+bool AgentRuntime::load_speech_model(const String &model_path, const Dictionary &options) {
+    std::filesystem::path model_file = to_path(model_path);
+    if (model_file.empty() || !std::filesystem::exists(model_file)) {
+        UtilityFunctions::push_error(String("AgentRuntime::load_speech_model - model missing: ") + model_path);
+        return false;
+    }
+    std::string error;
+    if (!speech_.load(model_file.string(), speech_model_options_from_dictionary(options), error)) {
+        UtilityFunctions::push_error(String("AgentRuntime::load_speech_model - ") + String::utf8(error.c_str()));
+        return false;
+    }
+    return true;
+}
+
+void AgentRuntime::unload_speech_model() {
+    speech_.unload();
+}
+
+bool AgentRuntime::is_speech_model_loaded() const {
+    return speech_.is_loaded();
+}
+
+int64_t AgentRuntime::transcribe_pcm(const PackedFloat32Array &pcm, int32_t sample_rate, const Dictionary &options) {
+    if (pcm.is_empty() || sample_rate <= 0) {
+        UtilityFunctions::push_error("AgentRuntime::transcribe_pcm - empty audio or invalid sample rate");
+        return 0;
+    }
+    SpeechJob job;
+    job.samples.assign(pcm.ptr(), pcm.ptr() + pcm.size());
+    job.sample_rate = sample_rate;
+    String model_path = options.get("model_path", String());
+    if (!model_path.is_empty()) {
+        job.model_path = to_path(model_path).string();
+    }
+    job.model_options = speech_model_options_from_dictionary(options);
+    job.options = transcribe_options_from_dictionary(options);
+    return enqueue_speech_job(std::move(job));
+}
+
+Ref<SpeechListener> AgentRuntime::create_speech_listener(const Dictionary &options) {
+    Ref<SpeechListener> listener;
+    listener.instantiate();
+    int32_t sample_rate = options.get("sample_rate", 0);
+    if (sample_rate <= 0) {
+        // AudioEffectCapture hands back frames at the mix rate.
+        AudioServer *audio = AudioServer::get_singleton();
+        sample_rate = audio ? static_cast<int32_t>(audio->get_mix_rate()) : 44100;
+    }
+    listener->vad_options_ = vad_options_from_dictionary(options);
+    listener->vad_.reset(sample_rate, listener->vad_options_);
+    listener->transcribe_options_ = options.duplicate();
+    return listener;
+}
+
+int64_t AgentRuntime::queue_utterance(uint64_t listener_id, std::vector<float> &&samples, int32_t sample_rate,
+                                      double start_seconds, double end_seconds, const Dictionary &options) {
+    if (samples.empty() || sample_rate <= 0) {
+        return 0;
+    }
+    SpeechJob job;
+    job.samples = std::move(samples);
+    job.sample_rate = sample_rate;
+    String model_path = options.get("model_path", String());
+    if (!model_path.is_empty()) {
+        job.model_path = to_path(model_path).string();
+    }
+    job.model_options = speech_model_options_from_dictionary(options);
+    job.options = transcribe_options_from_dictionary(options);
+    job.listener = listener_id;
+    job.start_seconds = start_seconds;
+    job.end_seconds = end_seconds;
+    return enqueue_speech_job(std::move(job));
+}
+
+int64_t AgentRuntime::enqueue_speech_job(SpeechJob &&job) {
+    std::scoped_lock lock(speech_mutex_);
+    if (speech_stopping_) {
+        return 0;
+    }
+    job.id = next_speech_job_++;
+    const int64_t id = job.id;
+    speech_jobs_.push_back(std::move(job));
+    if (!speech_thread_.joinable()) {
+        speech_thread_ = std::thread(&AgentRuntime::run_speech_worker, this);
+    }
+    speech_cv_.notify_one();
+    return id;
+}
+
+Dictionary AgentRuntime::transcribe_samples(const std::string &model_path, const SpeechModelOptions &model_options,
+                                            const float *samples, size_t count, int32_t sample_rate,
+                                            const TranscribeOptions &options) {
     Dictionary response;
-    if (!model_ || !context_) {
+    response["ok"] = false;
+    std::string error;
+    if (!model_path.empty() && !speech_.load(model_path, model_options, error)) {
+        response["error"] = String::utf8(error.c_str());
+        response["model_path"] = String::utf8(model_path.c_str());
+        return response;
+    }
+
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    ScopedLatency latency(metrics.transcribe_us);
+    TranscribeResult result;
+    if (!speech_.transcribe(samples, count, sample_rate, options, result, error)) {
+        response["error"] = String::utf8(error.c_str());
+        return response;
+    }
+    metrics.transcriptions.add();
+    return transcription_response(result);
+}
+
+void AgentRuntime::run_speech_worker() {
+    for (;;) {
+        SpeechJob job;
+        {
+            std::unique_lock lock(speech_mutex_);
+            speech_cv_.wait(lock, [this]() { return speech_stopping_ || !speech_jobs_.empty(); });
+            if (speech_stopping_) {
+                return;
+            }
+            job = std::move(speech_jobs_.front());
+            speech_jobs_.pop_front();
+        }
+        Dictionary result = transcribe_samples(job.model_path, job.model_options, job.samples.data(),
+                                               job.samples.size(), job.sample_rate, job.options);
+        result["id"] = job.id;
+        if (job.listener != 0) {
+            result["start"] = job.start_seconds;
+            result["end"] = job.end_seconds;
+            callable_mp(this, &AgentRuntime::deliver_utterance).call_deferred(job.listener, result);
+            continue;
+        }
+        call_deferred("emit_signal", "transcription_finished", job.id, result);
+    }
+}
+
+void AgentRuntime::deliver_utterance(uint64_t listener_id, const Dictionary &result) {
+    // The listener may have been dropped while its last utterance was transcribed.
+    if (SpeechListener *listener = Object::cast_to<SpeechListener>(ObjectDB::get_instance(ObjectID(listener_id)))) {
+        listener->emit_signal("utterance_transcribed", result);
+    }
+}
+
+void AgentRuntime::stop_speech_worker() {
+    {
+        std::scoped_lock lock(speech_mutex_);
+        speech_stopping_ = true;
+        speech_jobs_.clear();
+    }
+    speech_cv_.notify_all();
+    speech_.cancel();
+    if (speech_thread_.joinable()) {
+        speech_thread_.join();
+    }
+}
+
+bool AgentRuntime::prepare_generation_locked(const Dictionary &request, const RuntimeConfig &config,
+                                             PreparedGeneration &prepared, Dictionary &response) {
+    if (!engine_.is_loaded()) {
         response["ok"] = false;
         response["error"] = "model_not_loaded";
-        return response;
+        return false;
     }
 
     TypedArray<Dictionary> history = request.get("history", TypedArray<Dictionary>());
     String prompt = request.get("prompt", String());
-    Dictionary options = default_options_.duplicate();
-    if (request.has("options")) {
-        Dictionary overrides = request["options"];
-        Array keys = overrides.keys();
-        for (int i = 0; i < keys.size(); ++i) {
-            Variant key = keys[i];
-            options[key] = overrides[key];
-        }
-    }
+    Dictionary options = request_options(config.default_options, request);
 
     std::vector<std::string> stop_sequences;
     if (options.has("stop")) {
@@ -1480,7 +2950,7 @@ Dictionary AgentRuntime::run_inference_locked(const Dictionary &request) {
         }
     }
 
-    bool require_json = false;
+    bool &require_json = prepared.require_json;
     if (options.has("response_format")) {
         Variant response_format_variant = options["response_format"];
         if (response_format_variant.get_type() == Variant::DICTIONARY) {
@@ -1492,7 +2962,7 @@ Dictionary AgentRuntime::run_inference_locked(const Dictionary &request) {
             require_json = response_type == String("json_object");
         }
     }
-    Dictionary json_schema;
+    Dictionary &json_schema = prepared.json_schema;
     if (options.has("json_schema")) {
         Variant schema_variant = options["json_schema"];
         if (schema_variant.get_type() == Variant::DICTIONARY) {
@@ -1501,86 +2971,145 @@ Dictionary AgentRuntime::run_inference_locked(const Dictionary &request) {
         }
     }
 
-    sampler_.reset();
-    if (!ensure_sampler_locked(options)) {
-        response["ok"] = false;
-        response["error"] = "sampler_init_failed";
-        return response;
-    }
+    GenerationRequest &generation = prepared.generation;
+    if (is_inprocess_backend(options)) {
+        if (!render_chat_request_locked(request, options, config, prepared, stop_sequences, response)) {
+            return false;
+        }
+    } else if (request.has("conversation")) {
+        std::shared_ptr<Conversation> conversation = find_conversation(request["conversation"]);
+        if (!conversation) {
+            response["ok"] = false;
+            response["error"] = "unknown_conversation";
+            return false;
+        }
+        build_conversation_prompt_locked(*conversation, prompt, config.system_prompt, prompt_format_locked(options),
+                                         generation);
+    } else {
+        build_prompt_locked(history, prompt, config.system_prompt, prompt_format_locked(options), generation);
+    }
+    generation.sampling = sampling_options_from_dictionary(options);
+    generation.loras = lora_selections_from_options(options);
+    generation.stop = std::move(stop_sequences);
+    generation.max_tokens = options.get("max_tokens", 256);
+    generation.batch_size = options.get("batch_size", 512);
+    generation.reset_context = options.get("reset_context", true);
+    generation.cache_prompt = options.get("cache_prompt", false);
+    generation.conversation_id = to_utf8(String(options.get("conversation_id", String())));
+    prepared.use_cache = options.get("cache", true);
+
+    return true;
+}
 
-    if (sampler_) {
-        llama_sampler_reset(sampler_.get());
+Dictionary AgentRuntime::run_inference_locked(const Dictionary &request, const RuntimeConfig &config,
+                                              std::chrono::steady_clock::time_point started,
+                                              std::unique_lock<std::mutex> &lock) {
+    Dictionary response;
+    PreparedGeneration prepared;
+    if (!prepare_generation_locked(request, config, prepared, response)) {
+        return response;
     }
 
-    std::string prompt_text = build_prompt(history, prompt);
+    const GenerationResult result = decode_prepared_locked(prepared, started, lock);
+    return finish_generation_locked(prepared, result, started);
+}
 
-    const bool add_bos = true;
-    const llama_vocab *vocab = llama_model_get_vocab(model_);
-    if (!vocab) {
-        response["ok"] = false;
-        response["error"] = "vocab_unavailable";
-        return response;
+GenerationResult AgentRuntime::decode_prepared_locked(PreparedGeneration &prepared,
+                                                      std::chrono::steady_clock::time_point started,
+                                                      std::unique_lock<std::mutex> &lock) {
+    // Deterministic requests share results: a recent identical one answers from the cache,
+    // and one already decoding on another thread is waited on instead of decoded twice.
+    GenerationCache::Ticket ticket;
+    const std::string cache_key =
+        prepared.use_cache && generation_cache_.enabled()
+            ? canonical_generation_key(prepared.generation, engine_.model_epoch(), adapter_epoch_)
+            : std::string();
+    if (!cache_key.empty()) {
+        ticket = generation_cache_.acquire(cache_key);
+        if (ticket.role == GenerationCache::Role::Hit) {
+            prepared.cached = true;
+            return ticket.result;
+        }
+        if (ticket.role == GenerationCache::Role::Follower) {
+            lock.unlock();
+            GenerationResult result = GenerationCache::wait(ticket);
+            lock.lock();
+            prepared.cached = true;
+            return result;
+        }
+    }
+
+    GenerationResult result;
+    {
+        // Decode without mutex_ so other agents reach the context pool in parallel. The shared
+        // lifetime lock keeps the model and contexts alive; drop it before re-taking mutex_,
+        // which exclusive holders acquire first.
+        std::shared_lock lifetime(engine_lifetime_);
+        lock.unlock();
+        result = engine_.generate(prepared.generation, started);
+        lifetime.unlock();
+        lock.lock();
+    }
+    if (ticket.flight) {
+        generation_cache_.complete(ticket, result);
     }
+    return result;
+}
 
-    std::vector<llama_token> tokens_prompt;
-    if (!tokenize_text(vocab, prompt_text, add_bos, false, tokens_prompt)) {
+Dictionary AgentRuntime::finish_generation_locked(PreparedGeneration &prepared, const GenerationResult &result,
+                                                  std::chrono::steady_clock::time_point started) {
+    Dictionary response;
+    const int32_t max_tokens = prepared.generation.max_tokens;
+    // Cache hits decoded nothing, so replaying them as decodes would overstate the load.
+    if (trace_.is_open() && !prepared.cached) {
+        local_agents::runtime::TraceRecord record;
+        record.kind = local_agents::runtime::TraceKind::Generate;
+        record.start_us = trace_.offset_us(started);
+        record.duration_us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                                       std::chrono::steady_clock::now() - started)
+                                                       .count());
+        record.ok = result.ok;
+        record.prompt_tokens = result.prompt_tokens;
+        record.completion_tokens = result.completion_tokens;
+        record.ttft_us = static_cast<uint64_t>(result.ttft_ms * 1000.0);
+        record.output_hash = local_agents::runtime::trace_hash(result.text);
+        record.request = std::move(prepared.generation);
+        trace_.append(std::move(record));
+    }
+    if (!result.ok) {
         response["ok"] = false;
-        response["error"] = "tokenization_failed";
+        response["error"] = String::utf8(result.error.c_str());
         return response;
     }
-
-    // Avoid cross-request KV contamination unless explicitly opted into prompt caching.
-    bool reset_context = options.get("reset_context", true);
-    bool cache_prompt = options.get("cache_prompt", false);
-    if (reset_context && !cache_prompt) {
-        llama_memory_clear(llama_get_memory(context_), true);
-    }
-
-    int32_t decode_batch_size = options.get("batch_size", 512);
-    if (decode_batch_size <= 0) {
-        decode_batch_size = 512;
+    if (!result.warning.empty()) {
+        UtilityFunctions::push_warning(String::utf8(result.warning.c_str()));
     }
-    for (size_t offset = 0; offset < tokens_prompt.size(); offset += static_cast<size_t>(decode_batch_size)) {
-        int32_t chunk = static_cast<int32_t>(std::min<size_t>(
-            static_cast<size_t>(decode_batch_size),
-            tokens_prompt.size() - offset
-        ));
-        llama_batch batch = llama_batch_get_one(tokens_prompt.data() + offset, chunk);
-        if (llama_decode(context_, batch)) {
-            response["ok"] = false;
-            response["error"] = "llama_decode_failed";
-            return response;
+    if (prepared.chat) {
+        response = chat_completion_response(prepared, result, max_tokens);
+        if (prepared.cached) {
+            response["cached"] = true;
         }
+        return response;
     }
 
-    int max_tokens = options.get("max_tokens", 256);
+    Dictionary usage;
+    usage["prompt_tokens"] = result.prompt_tokens;
+    usage["completion_tokens"] = result.completion_tokens;
+    usage["total_tokens"] = result.prompt_tokens + result.completion_tokens;
+    usage["cached_tokens"] = result.cached_tokens;
+    Dictionary timings;
+    timings["ttft_ms"] = result.ttft_ms;
+    timings["predicted_per_second"] = result.tokens_per_second;
 
-    std::ostringstream generated;
-    for (int i = 0; i < max_tokens; ++i) {
-        llama_token token = llama_sampler_sample(sampler_.get(), context_, -1);
-        if (llama_vocab_is_eog(vocab, token)) {
-            break;
-        }
-        generated << token_to_string(token);
-        std::string generated_snapshot = generated.str();
-        if (apply_stop_sequences(generated_snapshot, stop_sequences)) {
-            generated.str(std::string());
-            generated.clear();
-            generated << generated_snapshot;
-            break;
-        }
-
-        llama_batch cont = llama_batch_get_one(&token, 1);
-        if (llama_decode(context_, cont)) {
-            UtilityFunctions::push_warning("llama_decode failed during continuation");
-            break;
-        }
-    }
-
-    String text = String::utf8(generated.str().c_str()).strip_edges();
+    String text = String::utf8(result.text.c_str()).strip_edges();
     response["ok"] = true;
     response["text"] = text;
-    if (require_json) {
+    response["usage"] = usage;
+    response["timings"] = timings;
+    if (prepared.cached) {
+        response["cached"] = true;
+    }
+    if (prepared.require_json) {
         Variant parsed_json = parse_json_response(text);
         if (parsed_json.get_type() == Variant::NIL) {
             response["ok"] = false;
@@ -1588,7 +3117,7 @@ Dictionary AgentRuntime::run_inference_locked(const Dictionary &request) {
             return response;
         }
         String schema_reason;
-        if (!validate_json_schema_basic(parsed_json, json_schema, schema_reason)) {
+        if (!validate_json_schema_basic(parsed_json, prepared.json_schema, schema_reason)) {
             response["ok"] = false;
             response["error"] = "json_schema_validation_failed";
             response["schema_reason"] = schema_reason;
@@ -1600,32 +3129,21 @@ Dictionary AgentRuntime::run_inference_locked(const Dictionary &request) {
     return response;
 }
 
-Dictionary AgentRuntime::run_llama_server_inference_locked(const Dictionary &request, const Dictionary &options) {
-    Dictionary response;
-    response["ok"] = false;
-    response["provider"] = String("llama_server");
-
-    String base_url = options.get("server_base_url", options.get("base_url", String("http://127.0.0.1:8080")));
-    base_url = normalize_server_base_url(base_url);
-    if (base_url.is_empty()) {
-        response["error"] = String("missing_server_base_url");
-        return response;
-    }
-
-    String chat_endpoint = options.get("server_chat_endpoint", String());
-    if (chat_endpoint.is_empty()) {
-        chat_endpoint = base_url.ends_with("/v1") ? String("/chat/completions") : String("/v1/chat/completions");
-    }
-    if (!chat_endpoint.begins_with("/")) {
-        chat_endpoint = String("/") + chat_endpoint;
-    }
-    String url = base_url + chat_endpoint;
-
+bool AgentRuntime::build_chat_payload(const Dictionary &request, const Dictionary &options,
+                                      const RuntimeConfig &config, Dictionary &payload, Dictionary &response) const {
     Array messages;
     if (options.has("messages") && options["messages"].get_type() == Variant::ARRAY) {
         messages = options["messages"];
     } else {
         TypedArray<Dictionary> history = request.get("history", TypedArray<Dictionary>());
+        if (request.has("conversation")) {
+            std::shared_ptr<Conversation> conversation = find_conversation(request["conversation"]);
+            if (!conversation) {
+                response["error"] = String("unknown_conversation");
+                return false;
+            }
+            history = conversation_history(*conversation);
+        }
         bool has_system = false;
         for (int i = 0; i < history.size(); ++i) {
             Dictionary entry = history[i];
@@ -1640,10 +3158,10 @@ Dictionary AgentRuntime::run_llama_server_inference_locked(const Dictionary &req
             append_message(messages, role, content);
         }
 
-        if (!has_system && !system_prompt_.is_empty()) {
+        if (!has_system && !config.system_prompt.is_empty()) {
             Dictionary system_message;
             system_message["role"] = String("system");
-            system_message["content"] = system_prompt_;
+            system_message["content"] = config.system_prompt;
             messages.insert(0, system_message);
         }
 
@@ -1655,10 +3173,9 @@ Dictionary AgentRuntime::run_llama_server_inference_locked(const Dictionary &req
 
     if (messages.is_empty()) {
         response["error"] = String("missing_messages");
-        return response;
+        return false;
     }
 
-    Dictionary payload;
     payload["messages"] = messages;
     payload["model"] = options.get("server_model", options.get("model", String("local-agents")));
 
@@ -1713,6 +3230,258 @@ Dictionary AgentRuntime::run_llama_server_inference_locked(const Dictionary &req
     if (options.has("server_extra_body") && options["server_extra_body"].get_type() == Variant::DICTIONARY) {
         merge_dictionary(payload, options["server_extra_body"]);
     }
+    return true;
+}
+
+bool AgentRuntime::render_chat_request_locked(const Dictionary &request, const Dictionary &options,
+                                              const RuntimeConfig &config, PreparedGeneration &prepared,
+                                              std::vector<std::string> &stop_sequences, Dictionary &response) {
+    Dictionary &payload = prepared.chat_payload;
+    response["provider"] = String("inprocess");
+    if (!build_chat_payload(request, options, config, payload, response)) {
+        response["ok"] = false;
+        return false;
+    }
+
+    GenerationRequest &generation = prepared.generation;
+    const std::string template_override = to_utf8(String(options.get("chat_template", String())));
+    try {
+        ensure_chat_templates_locked(template_override);
+
+        common_chat_templates_inputs inputs;
+        inputs.messages = chat_messages_from_array(payload["messages"]);
+        if (payload.get("tools", Variant()).get_type() == Variant::ARRAY) {
+            inputs.tools = chat_tools_from_array(payload["tools"]);
+        }
+        inputs.tool_choice = chat_tool_choice(payload.get("tool_choice", Variant()));
+        inputs.parallel_tool_calls = payload.get("parallel_tool_calls", false);
+        inputs.use_jinja = true;
+        inputs.add_generation_prompt = true;
+        // As in apply_chat_template_locked: the tokenizer adds BOS/EOS itself, so the
+        // template's copies are stripped rather than doubled.
+        const llama_vocab *template_vocab = llama_model_get_vocab(engine_.model());
+        inputs.add_bos = llama_vocab_get_add_bos(template_vocab);
+        inputs.add_eos = llama_vocab_get_add_eos(template_vocab);
+        inputs.json_schema = chat_json_schema(payload);
+        inputs.grammar = to_utf8(String(options.get("grammar", String())));
+        const String reasoning = payload.get("reasoning_format", String("deepseek"));
+        inputs.reasoning_format = reasoning == String("none") ? COMMON_REASONING_FORMAT_NONE
+                                                              : COMMON_REASONING_FORMAT_DEEPSEEK;
+        if (payload.get("chat_template_kwargs", Variant()).get_type() == Variant::DICTIONARY) {
+            const Dictionary kwargs = payload["chat_template_kwargs"];
+            const Array keys = kwargs.keys();
+            for (int i = 0; i < keys.size(); ++i) {
+                // The template engine takes every value as JSON text.
+                inputs.chat_template_kwargs[to_utf8(String(keys[i]))] = to_utf8(JSON::stringify(kwargs[keys[i]]));
+            }
+        }
+        const common_chat_params params = common_chat_templates_apply(chat_templates_.get(), inputs);
+
+        generation.prompt = params.prompt;
+        generation.parse_special = true;
+        generation.grammar = params.grammar;
+        generation.grammar_lazy = params.grammar_lazy;
+        const llama_vocab *vocab = llama_model_get_vocab(engine_.model());
+        std::vector<llama_token> ids;
+        for (const std::string &piece : params.preserved_tokens) {
+            if (tokenize_text(vocab, piece, false, true, ids) && ids.size() == 1) {
+                generation.preserved_tokens.push_back(ids[0]);
+            }
+        }
+        // Same trigger translation llama-server applies: single preserved tokens trigger as
+        // tokens, words anywhere in the output as one alternation, full patterns anchored.
+        std::vector<std::string> anywhere;
+        for (const common_grammar_trigger &trigger : params.grammar_triggers) {
+            switch (trigger.type) {
+            case COMMON_GRAMMAR_TRIGGER_TYPE_TOKEN:
+                generation.grammar_trigger_tokens.push_back(trigger.token);
+                break;
+            case COMMON_GRAMMAR_TRIGGER_TYPE_WORD:
+                if (tokenize_text(vocab, trigger.value, false, true, ids) && ids.size() == 1 &&
+                    std::find(generation.preserved_tokens.begin(), generation.preserved_tokens.end(), ids[0]) !=
+                        generation.preserved_tokens.end()) {
+                    generation.grammar_trigger_tokens.push_back(ids[0]);
+                } else {
+                    anywhere.push_back(escape_regex(trigger.value));
+                }
+                break;
+            case COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN:
+                anywhere.push_back(trigger.value);
+                break;
+            case COMMON_GRAMMAR_TRIGGER_TYPE_PATTERN_FULL: {
+                std::string anchored = trigger.value;
+                if (anchored.empty() || anchored.front() != '^') {
+                    anchored.insert(anchored.begin(), '^');
+                }
+                if (anchored.back() != '$') {
+                    anchored += '$';
+                }
+                generation.grammar_trigger_patterns.push_back(std::move(anchored));
+                break;
+            }
+            }
+        }
+        if (!anywhere.empty()) {
+            std::string alternation;
+            for (const std::string &pattern : anywhere) {
+                alternation += (alternation.empty() ? "" : "|") + pattern;
+            }
+            generation.grammar_trigger_patterns.push_back("^[\\s\\S]*?(" + alternation + ")[\\s\\S]*");
+        }
+        stop_sequences.insert(stop_sequences.end(), params.additional_stops.begin(), params.additional_stops.end());
+
+        prepared.chat = true;
+        // The body's "json" comes from response_format, as on the server path; no hard failure.
+        prepared.require_json = false;
+        prepared.chat_syntax.format = params.format;
+        prepared.chat_syntax.reasoning_format = inputs.reasoning_format;
+        prepared.chat_syntax.thinking_forced_open = params.thinking_forced_open;
+        prepared.chat_syntax.parse_tool_calls = payload.get("parse_tool_calls", true);
+        load_chat_parser(prepared.chat_syntax, params, 0);
+    } catch (const std::exception &e) {
+        response["ok"] = false;
+        response["error"] = String("chat_template_failed");
+        response["detail"] = String::utf8(e.what());
+        return false;
+    }
+    return true;
+}
+
+bool AgentRuntime::function_call_template_locked(const Dictionary &options, bool &escape_strings) const {
+    std::string source = to_utf8(String(options.get("chat_template", String())));
+    if (source.empty()) {
+        const char *builtin = llama_model_chat_template(engine_.model(), nullptr);
+        source = builtin ? builtin : "";
+    }
+    escape_strings = source.find("<escape>") != std::string::npos;
+    return source.find("<start_function_call>") != std::string::npos;
+}
+
+void AgentRuntime::apply_function_call_grammar_locked(const std::vector<ToolSpec> &tools, bool escape_strings,
+                                                      GenerationRequest &generation) const {
+    // Held to one call from the first token: no free text or lazy trigger to wait for.
+    generation.grammar = function_call_grammar(tools, escape_strings);
+    generation.grammar_lazy = false;
+    generation.grammar_trigger_patterns.clear();
+    generation.grammar_trigger_tokens.clear();
+    const llama_vocab *vocab = llama_model_get_vocab(engine_.model());
+    std::vector<llama_token> ids;
+    for (const char *marker : {"<start_function_call>", "<end_function_call>", "<escape>"}) {
+        if (tokenize_text(vocab, marker, false, true, ids) && ids.size() == 1 &&
+            std::find(generation.preserved_tokens.begin(), generation.preserved_tokens.end(), ids[0]) ==
+                generation.preserved_tokens.end()) {
+            generation.preserved_tokens.push_back(ids[0]);
+        }
+    }
+}
+
+Dictionary AgentRuntime::chat_completion_response(const PreparedGeneration &prepared, const GenerationResult &result,
+                                                  int32_t max_tokens) const {
+    static std::atomic<uint64_t> next_completion{1};
+    const uint64_t completion = next_completion.fetch_add(1);
+
+    common_chat_msg parsed;
+    try {
+        parsed = common_chat_parse(result.text, false, prepared.chat_syntax);
+    } catch (const std::exception &) {
+        // Output the format's parser rejects (e.g. cut off by max_tokens) stays plain content.
+        parsed = common_chat_msg();
+        parsed.content = result.text;
+    }
+
+    Dictionary message;
+    message["role"] = String("assistant");
+    message["content"] = parsed.content.empty() && !parsed.tool_calls.empty()
+                             ? Variant()
+                             : Variant(String::utf8(parsed.content.c_str()));
+    if (!parsed.reasoning_content.empty()) {
+        message["reasoning_content"] = String::utf8(parsed.reasoning_content.c_str());
+    }
+    if (!parsed.tool_calls.empty()) {
+        Array tool_calls;
+        for (size_t i = 0; i < parsed.tool_calls.size(); ++i) {
+            const common_chat_tool_call &call = parsed.tool_calls[i];
+            Dictionary function;
+            function["name"] = String::utf8(call.name.c_str());
+            function["arguments"] = String::utf8(call.arguments.c_str());
+            Dictionary entry;
+            entry["id"] = call.id.empty() ? String("call_") + String::num_uint64(completion) + "_" + String::num_int64(i)
+                                          : String::utf8(call.id.c_str());
+            entry["type"] = String("function");
+            entry["function"] = function;
+            tool_calls.append(entry);
+        }
+        message["tool_calls"] = tool_calls;
+    }
+
+    Dictionary choice;
+    choice["index"] = 0;
+    choice["message"] = message;
+    String finish_reason = String("stop");
+    if (!parsed.tool_calls.empty()) {
+        finish_reason = String("tool_calls");
+    } else if (result.completion_tokens >= max_tokens) {
+        finish_reason = String("length");
+    }
+    choice["finish_reason"] = finish_reason;
+    Array choices;
+    choices.append(choice);
+
+    Dictionary cached_details;
+    cached_details["cached_tokens"] = result.cached_tokens;
+    Dictionary usage;
+    usage["prompt_tokens"] = result.prompt_tokens;
+    usage["completion_tokens"] = result.completion_tokens;
+    usage["total_tokens"] = result.prompt_tokens + result.completion_tokens;
+    usage["prompt_tokens_details"] = cached_details;
+    Dictionary timings;
+    timings["prompt_n"] = result.prompt_tokens;
+    timings["predicted_n"] = result.completion_tokens;
+    timings["ttft_ms"] = result.ttft_ms;
+    timings["predicted_per_second"] = result.tokens_per_second;
+
+    Dictionary body;
+    body["id"] = String("chatcmpl-local-") + String::num_uint64(completion);
+    body["object"] = String("chat.completion");
+    body["created"] = static_cast<int64_t>(std::time(nullptr));
+    body["model"] = prepared.chat_payload.get("model", String("local-agents"));
+    body["choices"] = choices;
+    body["usage"] = usage;
+    body["timings"] = timings;
+
+    Dictionary response;
+    response["ok"] = false;
+    response["provider"] = String("inprocess");
+    fill_chat_completion_response(body, prepared.chat_payload, response);
+    return response;
+}
+
+Dictionary AgentRuntime::run_llama_server_inference(const Dictionary &request, const Dictionary &options,
+                                                    const RuntimeConfig &config) {
+    Dictionary response;
+    response["ok"] = false;
+    response["provider"] = String("llama_server");
+
+    String base_url = options.get("server_base_url", options.get("base_url", String("http://127.0.0.1:8080")));
+    base_url = normalize_server_base_url(base_url);
+    if (base_url.is_empty()) {
+        response["error"] = String("missing_server_base_url");
+        return response;
+    }
+
+    String chat_endpoint = options.get("server_chat_endpoint", String());
+    if (chat_endpoint.is_empty()) {
+        chat_endpoint = base_url.ends_with("/v1") ? String("/chat/completions") : String("/v1/chat/completions");
+    }
+    if (!chat_endpoint.begins_with("/")) {
+        chat_endpoint = String("/") + chat_endpoint;
+    }
+    String url = base_url + chat_endpoint;
+
+    Dictionary payload;
+    if (!build_chat_payload(request, options, config, payload, response)) {
+        return response;
+    }
 
     int timeout_seconds = options.get("server_timeout_seconds", options.get("server_timeout_sec", 120));
     PackedStringArray headers;
@@ -1729,244 +3498,522 @@ Dictionary AgentRuntime::run_llama_server_inference_locked(const Dictionary &req
     if (!http.ok) {
         response["error"] = String("http_request_failed");
         response["detail"] = http.error;
-        response["raw"] = http.body;
+        response["raw"] = http.body_text();
         return response;
     }
     if (http.status_code < 200 || http.status_code >= 300) {
         response["error"] = String("http_status_error");
-        response["raw"] = http.body;
+        response["raw"] = http.body_text();
         return response;
     }
 
-    Variant parsed = JSON::parse_string(http.body);
-    if (parsed.get_type() != Variant::DICTIONARY) {
-        response["error"] = String("invalid_json_response");
-        response["raw"] = http.body;
+    // Only the fields the envelope reads are built unless the caller asked for the raw reply.
+    const bool keep_raw = options.get("raw", false);
+    ServerJson parsed;
+    std::string parse_error;
+    if (!parse_chat_reply(http.body, keep_raw, parsed, parse_error)) {
+        response["error"] = String::utf8(parse_error.c_str());
+        response["raw"] = http.body_text();
         return response;
     }
 
-    Dictionary parsed_dict = parsed;
-    response["response"] = parsed_dict;
+    if (!fill_chat_completion_response(server_json_to_variant(parsed), payload, response) || keep_raw) {
+        response["raw"] = http.body_text();
+    }
+    return response;
+}
 
-    Dictionary first_choice;
-    Variant tool_calls;
-    String text = extract_chat_completion_text(parsed_dict, first_choice, tool_calls).strip_edges();
+void AgentRuntime::ensure_chat_templates_locked(const std::string &template_override) {
+    if (chat_templates_ && chat_templates_epoch_ == engine_.model_epoch() &&
+        chat_template_override_ == template_override) {
+        return;
+    }
+    chat_templates_ = common_chat_templates_init(engine_.model(), template_override);
+    chat_templates_epoch_ = engine_.model_epoch();
+    chat_template_override_ = template_override;
+    ++chat_templates_key_;
+}
 
-    if (text.is_empty() && parsed_dict.has("output_text")) {
-        text = parsed_dict["output_text"];
+PromptFormat AgentRuntime::prompt_format_locked(const Dictionary &options) {
+    PromptFormat format;
+    const std::string template_override = to_utf8(String(options.get("chat_template", String())));
+    // Without a template of its own a model gets plain lines, not common's ChatML fallback,
+    // whose markers it was never trained on.
+    if (String(options.get("prompt_format", String("template"))) == String("plain") || !engine_.model() ||
+        (template_override.empty() && !llama_model_chat_template(engine_.model(), nullptr))) {
+        return format;
+    }
+    try {
+        ensure_chat_templates_locked(template_override);
+    } catch (const std::exception &e) {
+        UtilityFunctions::push_warning(String("AgentRuntime::generate - chat template unusable, using plain prompts: ") +
+                                       String::utf8(e.what()));
+        return format;
+    }
+    format.key = chat_templates_key_;
+    format.render = [this](const std::vector<ChatMessage> &messages, bool add_generation_prompt, std::string &out) {
+        return apply_chat_template_locked(messages, add_generation_prompt, out);
+    };
+    return format;
+}
+
+bool AgentRuntime::apply_chat_template_locked(const std::vector<ChatMessage> &messages, bool add_generation_prompt,
+                                              std::string &out) const {
+    common_chat_templates_inputs inputs;
+    inputs.messages.reserve(messages.size());
+    for (const ChatMessage &message : messages) {
+        common_chat_msg msg;
+        msg.role = message.role;
+        msg.content = message.content;
+        inputs.messages.push_back(std::move(msg));
+    }
+    inputs.use_jinja = true;
+    inputs.add_generation_prompt = add_generation_prompt;
+    // The tokenizer adds BOS/EOS itself; the template's copies are stripped so they are not doubled.
+    const llama_vocab *vocab = llama_model_get_vocab(engine_.model());
+    inputs.add_bos = llama_vocab_get_add_bos(vocab);
+    inputs.add_eos = llama_vocab_get_add_eos(vocab);
+    try {
+        out = common_chat_templates_apply(chat_templates_.get(), inputs).prompt;
+    } catch (const std::exception &) {
+        return false;
     }
-    if (text.is_empty() && parsed_dict.has("error")) {
-        Variant error_variant = parsed_dict["error"];
-        if (error_variant.get_type() == Variant::DICTIONARY) {
-            Dictionary error_dict = error_variant;
-            response["error"] = error_dict.get("message", String("server_error"));
-        } else {
-            response["error"] = String("server_error");
+    return true;
+}
+
+void AgentRuntime::build_conversation_prompt_locked(Conversation &conversation, const String &user_prompt,
+                                                    const String &system_prompt, const PromptFormat &format,
+                                                    GenerationRequest &generation) {
+    // The conversation keeps each message rendered and tokenized, so only messages added
+    // since the last turn and the short tail before the reply get rendered and tokenized.
+    std::string text;
+    std::vector<llama_token> tokens;
+    if (!conversation.render_prompt(engine_, format, to_utf8(system_prompt), to_utf8(user_prompt), text, tokens)) {
+        build_prompt_locked(conversation_history(conversation), user_prompt, system_prompt, format, generation);
+        return;
+    }
+    generation.prompt = std::move(text);
+    generation.parse_special = static_cast<bool>(format.render);
+    if (!tokens.empty()) {
+        generation.prompt_tokens = std::move(tokens);
+        generation.prompt_epoch = engine_.model_epoch();
+    }
+}
+
+TypedArray<Dictionary> AgentRuntime::conversation_history(const Conversation &conversation) const {
+    TypedArray<Dictionary> history;
+    const std::string summary = conversation.summary();
+    if (!summary.empty()) {
+        Dictionary entry;
+        entry["role"] = String("system");
+        entry["content"] = from_utf8(summary);
+        history.append(entry);
+    }
+    for (const ChatMessage &message : conversation.messages()) {
+        Dictionary entry;
+        entry["role"] = from_utf8(message.role);
+        entry["content"] = from_utf8(message.content);
+        history.append(entry);
+    }
+    return history;
+}
+
+void AgentRuntime::build_prompt_locked(const TypedArray<Dictionary> &history, const String &user_prompt,
+                                      const String &system_prompt, const PromptFormat &format,
+                                      GenerationRequest &generation) const {
+    std::vector<ChatMessage> messages;
+    messages.reserve(static_cast<size_t>(history.size()) + 2);
+    const std::string system = to_utf8(system_prompt);
+    if (format.render && !system.empty()) {
+        messages.push_back({"system", system});
+    }
+    for (int i = 0; i < history.size(); ++i) {
+        Dictionary entry = history[i];
+        messages.push_back({to_utf8(entry.get("role", String())), to_utf8(entry.get("content", String()))});
+    }
+    const std::string user = to_utf8(user_prompt);
+    if (format.render) {
+        if (!user.empty()) {
+            messages.push_back({"user", user});
+        }
+        if (apply_chat_template_locked(messages, true, generation.prompt)) {
+            generation.parse_special = true;
+            return;
+        }
+        // Templates that reject the history (e.g. a second system message) get plain lines.
+        messages.erase(messages.begin(), messages.begin() + (system.empty() ? 0 : 1));
+        if (!user.empty()) {
+            messages.pop_back();
         }
-        response["raw"] = http.body;
-        return response;
     }
+    generation.prompt = InferenceEngine::render_prompt(system, messages, user);
+}
 
-    response["ok"] = true;
-    response["text"] = text;
-    if (parsed_dict.has("id")) {
-        response["id"] = parsed_dict["id"];
+bool AgentRuntime::load_model_locked(const String &path, const Dictionary &options, bool store_defaults) {
+    unload_model_locked();
+    start_prefetch_locked(path, options);
+
+    std::string error;
+    if (!engine_.load(to_utf8(path), load_options_from_dictionary(options), error)) {
+        UtilityFunctions::push_error(String("AgentRuntime::load_model - ") + String::utf8(error.c_str()));
+        return false;
     }
-    if (tool_calls.get_type() != Variant::NIL) {
-        response["tool_calls"] = tool_calls;
+    finish_model_load_locked(options, store_defaults);
+    model_ready_ = true;
+    return true;
+}
+
+void AgentRuntime::finish_model_load_locked(const Dictionary &options, bool store_defaults) {
+    for (const std::string &warning : engine_.memory_plan().warnings) {
+        UtilityFunctions::push_warning(String("AgentRuntime::load_model - ") + String::utf8(warning.c_str()));
     }
-    if (parsed_dict.has("usage")) {
-        response["usage"] = parsed_dict["usage"];
+    // Adapters are bound to the base model, so registered ones are re-created on every load.
+    for (const auto &[id, lora_path] : lora_paths_) {
+        std::string error;
+        if (!engine_.load_lora(id, lora_path, error)) {
+            UtilityFunctions::push_warning(String("AgentRuntime::load_model - ") + String::utf8(error.c_str()));
+        }
+    }
+    if (options.has("embedding_cache_size")) {
+        int64_t capacity = options["embedding_cache_size"];
+        std::scoped_lock cache_lock(embedding_cache_mutex_);
+        embedding_cache_capacity_ = capacity > 0 ? static_cast<size_t>(capacity) : 0;
+    }
+    if (options.has("generation_cache_size") || options.has("generation_cache_ttl_ms")) {
+        const int64_t capacity = options.get("generation_cache_size", 128);
+        const int64_t ttl_ms = options.get("generation_cache_ttl_ms", 60000);
+        generation_cache_.configure(capacity > 0 ? static_cast<size_t>(capacity) : 0,
+                                    ttl_ms > 0 ? static_cast<uint64_t>(ttl_ms) : 0);
     }
 
-    if (payload.has("response_format")) {
-        Variant rf_variant = payload["response_format"];
-        String rf_type;
-        if (rf_variant.get_type() == Variant::DICTIONARY) {
-            Dictionary rf = rf_variant;
-            rf_type = rf.get("type", String());
-        } else if (rf_variant.get_type() == Variant::STRING) {
-            rf_type = rf_variant;
+    if (store_defaults) {
+        Dictionary defaults = options.duplicate(true);
+        if (!defaults.has("embedding")) {
+            defaults["embedding"] = engine_.embeddings_enabled();
         }
-        if (rf_type == String("json_object") || rf_type == String("json_schema")) {
-            Variant parsed_json = parse_json_response(text);
-            if (parsed_json.get_type() != Variant::NIL) {
-                response["json"] = parsed_json;
-            }
+        if (!defaults.has("context_size")) {
+            defaults["context_size"] = engine_.context_size();
+        }
+        if (!defaults.has("batch_size")) {
+            defaults["batch_size"] = engine_.batch_size();
         }
+        update_config([&defaults](RuntimeConfig &config) { config.default_options = defaults; });
     }
+}
 
-    return response;
+void AgentRuntime::start_prefetch_locked(const String &path, const Dictionary &options) {
+    if (prefetch_enabled(options)) {
+        // Runs alongside llama.cpp's own load; the pages it reads are the ones llama maps.
+        prefetcher_.start(to_utf8(path), prefetch_options_from_dictionary(options));
+    }
+}
+
+void AgentRuntime::unload_model_locked() {
+    model_ready_ = false;
+    prefetcher_.stop();
+    // Waits for generations decoding outside mutex_ to leave the context pool.
+    std::unique_lock lifetime(engine_lifetime_);
+    engine_.unload();
+    clear_embedding_cache();
+    generation_cache_.clear();
+    chat_templates_.reset();
 }
 
-bool AgentRuntime::ensure_sampler_locked(const Dictionary &options) {
-    llama_sampler *sampler = create_sampler(options, model_);
-    if (!sampler) {
-        UtilityFunctions::push_error("AgentRuntime::ensure_sampler - failed to create sampler");
+bool AgentRuntime::lookup_cached_embedding(const std::string &key, PackedFloat32Array &out) {
+    std::scoped_lock lock(embedding_cache_mutex_);
+    auto found = embedding_cache_index_.find(key);
+    if (found == embedding_cache_index_.end()) {
         return false;
     }
-    sampler_.reset(sampler);
-    llama_sampler_reset(sampler_.get());
+    embedding_cache_.splice(embedding_cache_.begin(), embedding_cache_, found->second);
+    out = found->second->embedding;
     return true;
 }
 
-std::string AgentRuntime::build_prompt(const TypedArray<Dictionary> &history, const String &user_prompt) const {
-    std::ostringstream oss;
-    oss << to_utf8(system_prompt_) << "\n";
-    for (int i = 0; i < history.size(); ++i) {
-        Dictionary entry = history[i];
-        String role = entry.get("role", String());
-        String content = entry.get("content", String());
-        oss << role.utf8().get_data() << ": " << content.utf8().get_data() << "\n";
+void AgentRuntime::store_cached_embedding(const std::string &key, const PackedFloat32Array &embedding) {
+    std::scoped_lock lock(embedding_cache_mutex_);
+    if (embedding_cache_capacity_ == 0) {
+        return;
     }
-    if (!user_prompt.is_empty()) {
-        oss << "user: " << user_prompt.utf8().get_data() << "\n";
+    auto found = embedding_cache_index_.find(key);
+    if (found != embedding_cache_index_.end()) {
+        found->second->embedding = embedding;
+        embedding_cache_.splice(embedding_cache_.begin(), embedding_cache_, found->second);
+        return;
+    }
+    embedding_cache_.push_front({key, embedding});
+    embedding_cache_index_[key] = embedding_cache_.begin();
+    while (embedding_cache_.size() > embedding_cache_capacity_) {
+        embedding_cache_index_.erase(embedding_cache_.back().key);
+        embedding_cache_.pop_back();
     }
-    oss << "assistant:";
-    return oss.str();
 }
 
-std::string AgentRuntime::token_to_string(llama_token token) const {
-    std::string buffer;
-    buffer.resize(4096);
-    const llama_vocab *vocab = llama_model_get_vocab(model_);
-    if (!vocab) {
-        return std::string();
+void AgentRuntime::clear_embedding_cache() {
+    std::scoped_lock lock(embedding_cache_mutex_);
+    embedding_cache_.clear();
+    embedding_cache_index_.clear();
+}
+
+bool AgentRuntime::set_thread_options(const Dictionary &options) {
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    update_config([&options](RuntimeConfig &config) { merge_dictionary(config.default_options, options); });
+    if (!engine_.is_loaded()) {
+        // Picked up by the next load.
+        return true;
     }
-    int written = llama_token_to_piece(vocab, token, buffer.data(), buffer.size(), 0, false);
-    if (written < 0) {
-        return std::string();
+    std::string error;
+    std::unique_lock lifetime(engine_lifetime_);
+    if (!engine_.configure_threads(threading_options_from_dictionary(config()->default_options), error)) {
+        UtilityFunctions::push_error(String("AgentRuntime::set_thread_options - ") + String::utf8(error.c_str()));
+        return false;
     }
-    buffer.resize(written);
-    return buffer;
+    return true;
 }
 
-bool AgentRuntime::load_model_locked(const String &path, const Dictionary &options, bool store_defaults) {
-    unload_model_locked();
+Dictionary AgentRuntime::get_thread_info() const {
+    // No mutex_: the pools are self-synchronized and this must not wait behind a generation.
+    const ThreadPoolInfo threads = engine_.thread_info();
+    const ThreadingOptions &options = threads.options;
+    Dictionary info;
+    info["configured"] = threads.configured;
+    info["contexts"] = threads.n_contexts;
+    info["n_threads"] = threads.n_threads;
+    info["n_threads_batch"] = threads.n_threads_batch;
+    info["cpu_mask"] = String::utf8(options.cpu_mask.c_str());
+    info["cpu_mask_batch"] = String::utf8(options.cpu_mask_batch.c_str());
+    info["poll"] = options.poll;
+    info["paused"] = threads.paused;
+    info["hardware_threads"] = static_cast<int64_t>(std::thread::hardware_concurrency());
+    return info;
+}
 
-    llama_backend_init();
+void AgentRuntime::pause_inference_threads() {
+    engine_.pause_threads();
+}
 
-    llama_model_params model_params = llama_model_default_params();
-    if (options.has("n_gpu_layers")) {
-        model_params.n_gpu_layers = (int32_t)options["n_gpu_layers"];
-    }
-    if (options.has("use_mmap")) {
-        model_params.use_mmap = (bool)options["use_mmap"];
-    }
-    if (options.has("use_mlock")) {
-        model_params.use_mlock = (bool)options["use_mlock"];
+void AgentRuntime::resume_inference_threads() {
+    engine_.resume_threads();
+}
+
+Dictionary AgentRuntime::get_memory_plan() const {
+    std::scoped_lock lock(mutex_);
+    if (loading_) {
+        Dictionary pending;
+        pending["ok"] = false;
+        pending["error"] = "model_loading";
+        return pending;
     }
+    return memory_plan_to_dictionary(engine_.memory_plan(), engine_.metadata(), engine_.memory_actual_bytes());
+}
 
-    model_ = llama_model_load_from_file(path.utf8().get_data(), model_params);
-    if (!model_) {
-        UtilityFunctions::push_error("AgentRuntime::load_model - failed to load: " + path);
+Dictionary AgentRuntime::plan_model_memory(const String &model_path, const Dictionary &options) const {
+    String resolved = model_path.is_empty() ? get_default_model_path() : model_path;
+    ModelMetadata metadata;
+    std::string error;
+    const MemoryPlan plan = InferenceEngine::plan(to_utf8(resolved), load_options_from_dictionary(options), metadata, error);
+    return memory_plan_to_dictionary(plan, metadata, 0);
+}
+
+bool AgentRuntime::load_lora(const String &path, const String &id) {
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    if (path.is_empty() || id.is_empty()) {
+        UtilityFunctions::push_error("AgentRuntime::load_lora - path and id are required");
         return false;
     }
-
-    llama_context_params ctx_params = llama_context_default_params();
-    int32_t model_ctx_train = llama_model_n_ctx_train(model_);
-    if (model_ctx_train > 0) {
-        ctx_params.n_ctx = model_ctx_train;
+    const std::string lora_id = to_utf8(id);
+    const std::string lora_path = to_utf8(normalize_project_path(path));
+    if (engine_.is_loaded()) {
+        std::string error;
+        std::unique_lock lifetime(engine_lifetime_);
+        if (!engine_.load_lora(lora_id, lora_path, error)) {
+            UtilityFunctions::push_error(String("AgentRuntime::load_lora - ") + String::utf8(error.c_str()));
+            return false;
+        }
     }
-    if (options.has("context_size")) {
-        ctx_params.n_ctx = (int32_t)options["context_size"];
+    lora_paths_[lora_id] = lora_path;
+    invalidate_adapter_results_locked();
+    return true;
+}
+
+bool AgentRuntime::unload_lora(const String &id) {
+    std::unique_lock lock(mutex_);
+    wait_for_model_load_locked(lock);
+    const std::string lora_id = to_utf8(id);
+    {
+        std::unique_lock lifetime(engine_lifetime_);
+        engine_.unload_lora(lora_id);
     }
-    if (ctx_params.n_ctx <= 0) {
-        ctx_params.n_ctx = 4096;
+    invalidate_adapter_results_locked();
+    return lora_paths_.erase(lora_id) > 0;
+}
+
+void AgentRuntime::invalidate_adapter_results_locked() {
+    // Cache keys name adapters by id, so a replaced or removed one would keep answering from
+    // old entries. The new epoch also orphans results still decoding with the old adapter,
+    // which complete() after this and would otherwise be stored under a live key.
+    ++adapter_epoch_;
+    generation_cache_.clear();
+}
+
+PackedStringArray AgentRuntime::get_loras() const {
+    std::scoped_lock lock(mutex_);
+    PackedStringArray ids;
+    for (const auto &[id, lora_path] : lora_paths_) {
+        ids.push_back(String::utf8(id.c_str()));
     }
-    if (options.has("batch_size")) {
-        ctx_params.n_batch = (int32_t)options["batch_size"];
-    } else {
-        ctx_params.n_batch = ctx_params.n_ctx;
+    return ids;
+}
+
+Dictionary AgentRuntime::get_prefetch_status() const {
+    // No mutex_: the prefetcher is self-synchronized and is polled while a load holds the lock.
+    const PrefetchStatus status = prefetcher_.status();
+    Dictionary result;
+    result["state"] = String(local_agents::runtime::prefetch_state_name(status.state));
+    result["path"] = String::utf8(status.path.c_str());
+    if (!status.error.empty()) {
+        result["error"] = String::utf8(status.error.c_str());
+    }
+    result["progress"] = status.bytes_total > 0 ? static_cast<double>(status.bytes_done) / static_cast<double>(status.bytes_total) : 0.0;
+    result["bytes_done"] = static_cast<int64_t>(status.bytes_done);
+    result["bytes_total"] = static_cast<int64_t>(status.bytes_total);
+    result["layers_done"] = status.layers_done;
+    result["layers_total"] = status.layers_total;
+    result["locked_mb"] = to_mib(status.locked_bytes);
+    result["elapsed_ms"] = status.elapsed_ms;
+    return result;
+}
+
+Dictionary AgentRuntime::get_runtime_metrics() const {
+    Dictionary result;
+    for (const RuntimeMetrics::Sample &sample : RuntimeMetrics::get().samples()) {
+        result[String(sample.name)] = sample.value;
     }
-    if (ctx_params.n_batch <= 0) {
-        ctx_params.n_batch = 512;
+    return result;
+}
+
+double AgentRuntime::get_runtime_metric(const String &name) const {
+    double value = 0.0;
+    RuntimeMetrics::get().sample(to_utf8(name), value);
+    return value;
+}
+
+void AgentRuntime::reset_runtime_metrics() {
+    RuntimeMetrics::get().reset();
+}
+
+bool AgentRuntime::start_trace(const String &path, const Dictionary &options) {
+    if (path.is_empty()) {
+        UtilityFunctions::push_error("AgentRuntime::start_trace - empty path");
+        return false;
     }
-    if (ctx_params.n_batch > ctx_params.n_ctx) {
-        ctx_params.n_batch = ctx_params.n_ctx;
+    String resolved = path;
+    if (path.begins_with("res://") || path.begins_with("user://")) {
+        ProjectSettings *settings = ProjectSettings::get_singleton();
+        if (settings) {
+            resolved = settings->globalize_path(path);
+        }
     }
-    if (options.has("pooling")) {
-        ctx_params.pooling_type = static_cast<enum llama_pooling_type>((int)options["pooling"]);
+    // Hash-only traces keep player text out of the file; they still replay timing and
+    // options but the bench cannot re-issue their prompts.
+    const bool record_prompts = options.get("record_prompts", true);
+    std::string error;
+    if (!trace_.open(to_utf8(resolved), record_prompts, error)) {
+        UtilityFunctions::push_error(String("AgentRuntime::start_trace - ") + String::utf8(error.c_str()));
+        return false;
     }
+    return true;
+}
 
-    if (options.has("embedding")) {
-        ctx_params.embeddings = (bool)options["embedding"];
-    } else if (options.has("embeddings")) {
-        ctx_params.embeddings = (bool)options["embeddings"];
-    } else {
-        ctx_params.embeddings = true;
-    }
+Dictionary AgentRuntime::stop_trace() {
+    Dictionary summary;
+    summary["path"] = String::utf8(trace_.path().c_str());
+    summary["records"] = static_cast<int64_t>(trace_.close());
+    return summary;
+}
 
-    context_ = llama_init_from_model(model_, ctx_params);
-    if (!context_) {
-        UtilityFunctions::push_error("AgentRuntime::load_model - failed to create context");
-        unload_model_locked();
-        return false;
-    }
+bool AgentRuntime::is_tracing() const {
+    return trace_.is_open();
+}
 
-    if (store_defaults) {
-        default_options_.clear();
-        Array keys = options.keys();
-        for (int i = 0; i < keys.size(); ++i) {
-            Variant key = keys[i];
-            default_options_[key] = options[key];
-        }
-        if (!default_options_.has("embedding")) {
-            default_options_["embedding"] = ctx_params.embeddings;
-        }
-        if (!default_options_.has("context_size")) {
-            default_options_["context_size"] = ctx_params.n_ctx;
-        }
-        if (!default_options_.has("batch_size")) {
-            default_options_["batch_size"] = ctx_params.n_batch;
+void AgentRuntime::register_performance_monitors() {
+    Performance *performance = Performance::get_singleton();
+    if (!performance || performance_monitors_registered_) {
+        return;
+    }
+    for (const char *name : RuntimeMetrics::sample_names()) {
+        StringName id(String(kPerformanceMonitorPrefix) + String(name));
+        if (performance->has_custom_monitor(id)) {
+            continue;
         }
+        Array arguments;
+        arguments.append(String(name));
+        performance->add_custom_monitor(id, callable_mp(this, &AgentRuntime::get_runtime_metric), arguments);
     }
-
-    Dictionary sampler_opts = store_defaults ? default_options_ : options;
-    sampler_.reset();
-    ensure_sampler_locked(sampler_opts);
-    return true;
+    performance_monitors_registered_ = true;
 }
 
-void AgentRuntime::unload_model_locked() {
-    if (context_) {
-        llama_free(context_);
-        context_ = nullptr;
+void AgentRuntime::unregister_performance_monitors() {
+    Performance *performance = Performance::get_singleton();
+    if (!performance || !performance_monitors_registered_) {
+        return;
     }
-    if (model_) {
-        llama_model_free(model_);
-        model_ = nullptr;
+    for (const char *name : RuntimeMetrics::sample_names()) {
+        StringName id(String(kPerformanceMonitorPrefix) + String(name));
+        if (performance->has_custom_monitor(id)) {
+            performance->remove_custom_monitor(id);
+        }
     }
-    sampler_.reset();
-    llama_backend_free();
+    performance_monitors_registered_ = false;
+}
+
+std::shared_ptr<const AgentRuntime::RuntimeConfig> AgentRuntime::config() const {
+    return std::atomic_load(&config_);
+}
+
+void AgentRuntime::update_config(const std::function<void(RuntimeConfig &)> &mutate) {
+    std::scoped_lock lock(config_mutex_);
+    auto next = std::make_shared<RuntimeConfig>(*std::atomic_load(&config_));
+    // Dictionary copies share storage, nested stop/loras arrays included; detach all of it so
+    // the published snapshot stays untouched by the caller and by later updates.
+    next->default_options = next->default_options.duplicate(true);
+    mutate(*next);
+    std::atomic_store(&config_, std::shared_ptr<const RuntimeConfig>(std::move(next)));
 }
 
 void AgentRuntime::set_default_model_path(const String &path) {
-    std::scoped_lock lock(mutex_);
-    default_model_path_ = path;
+    // AgentNode re-applies its settings on every think(); skip publishing a no-op.
+    if (config()->default_model_path == path) {
+        return;
+    }
+    update_config([&path](RuntimeConfig &config) { config.default_model_path = path; });
 }
 
 String AgentRuntime::get_default_model_path() const {
-    std::scoped_lock lock(mutex_);
-    return default_model_path_;
+    return config()->default_model_path;
 }
 
 void AgentRuntime::set_runtime_directory(const String &path) {
-    std::scoped_lock lock(mutex_);
-    runtime_directory_ = path;
+    // AgentNode re-applies its settings on every think(); skip publishing a no-op.
+    if (config()->runtime_directory == path) {
+        return;
+    }
+    update_config([&path](RuntimeConfig &config) { config.runtime_directory = path; });
 }
 
 String AgentRuntime::get_runtime_directory() const {
-    std::scoped_lock lock(mutex_);
-    return runtime_directory_;
+    return config()->runtime_directory;
 }
 
 void AgentRuntime::set_system_prompt(const String &prompt) {
-    std::scoped_lock lock(mutex_);
-    system_prompt_ = prompt;
+    if (config()->system_prompt == prompt) {
+        return;
+    }
+    update_config([&prompt](RuntimeConfig &config) { config.system_prompt = prompt; });
 }
 
 String AgentRuntime::get_system_prompt() const {
-    std::scoped_lock lock(mutex_);
-    return system_prompt_;
+    return config()->system_prompt;
 }
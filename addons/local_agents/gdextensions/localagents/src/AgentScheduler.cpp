@@ -0,0 +1,206 @@
+#include "AgentScheduler.hpp"
+#include "AgentNode.hpp"
+#include "AgentRuntime.hpp"
+
+#include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/scene_tree.hpp>
+#include <godot_cpp/classes/window.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/core/object.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace godot;
+
+AgentScheduler *AgentScheduler::singleton_ = nullptr;
+
+AgentScheduler::AgentScheduler() {
+    if (!singleton_) {
+        singleton_ = this;
+    }
+}
+
+AgentScheduler::~AgentScheduler() {
+    if (singleton_ == this) {
+        singleton_ = nullptr;
+    }
+}
+
+AgentScheduler *AgentScheduler::get_singleton() {
+    return singleton_;
+}
+
+void AgentScheduler::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("register_agent", "agent", "period", "jitter"), &AgentScheduler::register_agent, DEFVAL(0.0));
+    ClassDB::bind_method(D_METHOD("unregister_agent", "agent"), &AgentScheduler::unregister_agent);
+    ClassDB::bind_method(D_METHOD("is_registered", "agent"), &AgentScheduler::is_registered);
+    ClassDB::bind_method(D_METHOD("get_agent_count"), &AgentScheduler::get_agent_count);
+    ClassDB::bind_method(D_METHOD("get_backlog"), &AgentScheduler::get_backlog);
+    ClassDB::bind_method(D_METHOD("set_max_ticks_per_frame", "ticks"), &AgentScheduler::set_max_ticks_per_frame);
+    ClassDB::bind_method(D_METHOD("get_max_ticks_per_frame"), &AgentScheduler::get_max_ticks_per_frame);
+    ClassDB::bind_method(D_METHOD("set_emit_agent_signals", "enabled"), &AgentScheduler::set_emit_agent_signals);
+    ClassDB::bind_method(D_METHOD("is_emitting_agent_signals"), &AgentScheduler::is_emitting_agent_signals);
+    ClassDB::bind_method(D_METHOD("advance", "delta"), &AgentScheduler::advance);
+
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_ticks_per_frame"), "set_max_ticks_per_frame", "get_max_ticks_per_frame");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "emit_agent_signals"), "set_emit_agent_signals", "is_emitting_agent_signals");
+
+    ADD_SIGNAL(MethodInfo("agents_ticked", PropertyInfo(Variant::ARRAY, "agents")));
+}
+
+void AgentScheduler::register_agent(Object *agent, double period, double jitter) {
+    if (!agent) {
+        UtilityFunctions::push_error("AgentScheduler::register_agent - null agent");
+        return;
+    }
+    if (!(period > 0.0)) {
+        UtilityFunctions::push_error("AgentScheduler::register_agent - period must be positive");
+        return;
+    }
+    const uint64_t period_ms = static_cast<uint64_t>(std::max(1.0, std::round(period * 1000.0)));
+    const uint64_t jitter_ms = static_cast<uint64_t>(std::max(0.0, std::round(jitter * 1000.0)));
+    wheel_.schedule(agent->get_instance_id(), period_ms, jitter_ms);
+}
+
+void AgentScheduler::unregister_agent(Object *agent) {
+    if (agent) {
+        wheel_.cancel(agent->get_instance_id());
+    }
+}
+
+bool AgentScheduler::is_registered(Object *agent) const {
+    return agent && wheel_.contains(agent->get_instance_id());
+}
+
+int AgentScheduler::get_agent_count() const {
+    return static_cast<int>(wheel_.size());
+}
+
+int AgentScheduler::get_backlog() const {
+    return static_cast<int>(wheel_.backlog());
+}
+
+void AgentScheduler::set_max_ticks_per_frame(int ticks) {
+    max_ticks_per_frame_ = std::max(0, ticks);
+}
+
+int AgentScheduler::get_max_ticks_per_frame() const {
+    return max_ticks_per_frame_;
+}
+
+void AgentScheduler::set_emit_agent_signals(bool enabled) {
+    emit_agent_signals_ = enabled;
+}
+
+bool AgentScheduler::is_emitting_agent_signals() const {
+    return emit_agent_signals_;
+}
+
+void AgentScheduler::request_drain(Object *agent) {
+    if (agent) {
+        drain_requests_.push_back(agent->get_instance_id());
+    }
+}
+
+void AgentScheduler::advance(double delta) {
+    if (delta > 0.0) {
+        pending_ms_ += delta * 1000.0;
+        const double whole_ms = std::floor(pending_ms_);
+        pending_ms_ -= whole_ms;
+        dispatch_due(static_cast<uint64_t>(whole_ms));
+    }
+    dispatch_drains();
+}
+
+void AgentScheduler::dispatch_drains() {
+    if (drain_requests_.empty()) {
+        return;
+    }
+    std::vector<uint64_t> requests;
+    requests.swap(drain_requests_);
+    for (uint64_t id : requests) {
+        AgentNode *node = Object::cast_to<AgentNode>(ObjectDB::get_instance(ObjectID(id)));
+        if (node && node->scheduler_drain()) {
+            drain_requests_.push_back(id);
+        }
+    }
+}
+
+void AgentScheduler::dispatch_due(uint64_t elapsed_ms) {
+    // Local: a tick handler may register agents or even call advance() itself.
+    std::vector<uint64_t> due;
+    wheel_.advance(elapsed_ms, static_cast<size_t>(max_ticks_per_frame_), due);
+    if (due.empty()) {
+        return;
+    }
+
+    Array agents;
+    for (uint64_t id : due) {
+        Object *object = ObjectDB::get_instance(ObjectID(id));
+        if (!object) {
+            // Freed without unregistering (e.g. a script-registered object).
+            wheel_.cancel(id);
+            continue;
+        }
+        agents.append(object);
+        if (AgentNode *node = Object::cast_to<AgentNode>(object)) {
+            node->scheduler_tick(emit_agent_signals_);
+        }
+    }
+    if (!agents.is_empty()) {
+        emit_signal("agents_ticked", agents);
+    }
+}
+
+void AgentScheduler::attach_to_tree() {
+    if (attached_) {
+        return;
+    }
+    SceneTree *tree = Object::cast_to<SceneTree>(Engine::get_singleton()->get_main_loop());
+    if (!tree) {
+        return;
+    }
+    tree->connect("process_frame", callable_mp(this, &AgentScheduler::on_process_frame));
+    attached_ = true;
+}
+
+void AgentScheduler::on_process_frame() {
+    SceneTree *tree = Object::cast_to<SceneTree>(Engine::get_singleton()->get_main_loop());
+    if (!tree || Engine::get_singleton()->is_editor_hint()) {
+        return;
+    }
+    update_inference_hold(tree);
+    // Agents stop ticking while the tree is paused, as their _process used to.
+    if (tree->is_paused()) {
+        return;
+    }
+    Window *root = tree->get_root();
+    if (root) {
+        advance(root->get_process_delta_time());
+    }
+}
+
+void AgentScheduler::update_inference_hold(SceneTree *tree) {
+    // One decision per tree, acted on only when it changes: a single paused or disabled node
+    // no longer parks the pool for everyone, and game code's own pause/resume calls stand
+    // until the tree's state next flips. A request issued while parked still runs.
+    AgentRuntime *runtime = AgentRuntime::get_singleton();
+    if (!runtime) {
+        return;
+    }
+    Window *root = tree->get_root();
+    const bool hold = tree->is_paused() || (root && !root->has_focus());
+    if (hold == inference_held_) {
+        return;
+    }
+    inference_held_ = hold;
+    if (hold) {
+        runtime->pause_inference_threads();
+    } else {
+        runtime->resume_inference_threads();
+    }
+}
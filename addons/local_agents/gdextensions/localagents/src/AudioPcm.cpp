@@ -0,0 +1,216 @@
+#include "AudioPcm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr uint16_t kFormatPcm = 1;
+constexpr uint16_t kFormatFloat = 3;
+constexpr uint16_t kFormatExtensible = 0xFFFE;
+
+void put_u16(std::vector<unsigned char> &bytes, uint16_t value) {
+    bytes.push_back(static_cast<unsigned char>(value & 0xFF));
+    bytes.push_back(static_cast<unsigned char>(value >> 8));
+}
+
+void put_u32(std::vector<unsigned char> &bytes, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        bytes.push_back(static_cast<unsigned char>((value >> shift) & 0xFF));
+    }
+}
+
+uint16_t read_u16(const unsigned char *bytes) {
+    return static_cast<uint16_t>(bytes[0] | (bytes[1] << 8));
+}
+
+uint32_t read_u32(const unsigned char *bytes) {
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+float decode_sample(const unsigned char *bytes, uint16_t format, uint16_t bits) {
+    if (format == kFormatFloat) {
+        const uint32_t raw = read_u32(bytes);
+        float value = 0.0f;
+        std::memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+    switch (bits) {
+    case 8:
+        return (static_cast<float>(bytes[0]) - 128.0f) / 128.0f;
+    case 16:
+        return static_cast<float>(static_cast<int16_t>(read_u16(bytes))) / 32768.0f;
+    case 24: {
+        int32_t value = static_cast<int32_t>(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16));
+        if (value & 0x800000) {
+            value |= ~0xFFFFFF;
+        }
+        return static_cast<float>(value) / 8388608.0f;
+    }
+    default:
+        return static_cast<float>(static_cast<int32_t>(read_u32(bytes))) / 2147483648.0f;
+    }
+}
+} // namespace
+
+PcmRing::PcmRing(size_t capacity) {
+    capacity_ = 2;
+    while (capacity_ < capacity) {
+        capacity_ <<= 1;
+    }
+    mask_ = capacity_ - 1;
+    samples_ = std::make_unique<float[]>(capacity_);
+}
+
+size_t PcmRing::size() const {
+    return write_.load(std::memory_order_acquire) - read_.load(std::memory_order_acquire);
+}
+
+size_t PcmRing::write(const float *samples, size_t count) {
+    const size_t head = write_.load(std::memory_order_relaxed);
+    const size_t tail = read_.load(std::memory_order_acquire);
+    count = std::min(count, capacity_ - (head - tail));
+    const size_t start = head & mask_;
+    const size_t first = std::min(count, capacity_ - start);
+    std::copy(samples, samples + first, samples_.get() + start);
+    std::copy(samples + first, samples + count, samples_.get());
+    write_.store(head + count, std::memory_order_release);
+    return count;
+}
+
+size_t PcmRing::read(float *out, size_t count) {
+    const size_t tail = read_.load(std::memory_order_relaxed);
+    const size_t head = write_.load(std::memory_order_acquire);
+    count = std::min(count, head - tail);
+    const size_t start = tail & mask_;
+    const size_t first = std::min(count, capacity_ - start);
+    std::copy(samples_.get() + start, samples_.get() + start + first, out);
+    std::copy(samples_.get(), samples_.get() + (count - first), out + first);
+    read_.store(tail + count, std::memory_order_release);
+    return count;
+}
+
+bool read_wav_file(const std::string &path, PcmBuffer &out, std::string &error) {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+        error = "wav_open_failed";
+        return false;
+    }
+    const std::vector<unsigned char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    if (data.size() < 12 || std::memcmp(data.data(), "RIFF", 4) != 0 || std::memcmp(data.data() + 8, "WAVE", 4) != 0) {
+        error = "wav_invalid";
+        return false;
+    }
+
+    uint16_t format = 0;
+    uint16_t channels = 0;
+    uint16_t bits = 0;
+    uint32_t rate = 0;
+    const unsigned char *payload = nullptr;
+    size_t payload_size = 0;
+    size_t offset = 12;
+    while (offset + 8 <= data.size()) {
+        const unsigned char *chunk = data.data() + offset;
+        const size_t size = read_u32(chunk + 4);
+        const size_t available = std::min(size, data.size() - offset - 8);
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && available >= 16) {
+            format = read_u16(chunk + 8);
+            channels = read_u16(chunk + 10);
+            rate = read_u32(chunk + 12);
+            bits = read_u16(chunk + 22);
+            if (format == kFormatExtensible && available >= 26) {
+                format = read_u16(chunk + 32); // first two bytes of the subformat GUID
+            }
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            // Streaming writers (piper --output_raw piped through sox, ffmpeg to a pipe)
+            // leave the size at 0 or 0xFFFFFFFF; take what is there.
+            payload = chunk + 8;
+            payload_size = (size == 0 || size == 0xFFFFFFFFu) ? data.size() - offset - 8 : available;
+            break;
+        }
+        offset += 8 + size + (size & 1);
+    }
+
+    const bool supported = (format == kFormatPcm && (bits == 8 || bits == 16 || bits == 24 || bits == 32)) ||
+                           (format == kFormatFloat && bits == 32);
+    if (!supported || channels == 0 || rate == 0) {
+        error = "wav_unsupported_format";
+        return false;
+    }
+    if (!payload) {
+        error = "wav_missing_data";
+        return false;
+    }
+
+    const size_t frame_bytes = static_cast<size_t>(bits / 8) * channels;
+    const size_t frames = payload_size / frame_bytes;
+    out.sample_rate = static_cast<int32_t>(rate);
+    out.samples.resize(frames);
+    const float scale = 1.0f / static_cast<float>(channels);
+    for (size_t frame = 0; frame < frames; ++frame) {
+        const unsigned char *bytes = payload + frame * frame_bytes;
+        float sum = 0.0f;
+        for (uint16_t channel = 0; channel < channels; ++channel) {
+            sum += decode_sample(bytes + channel * (bits / 8), format, bits);
+        }
+        out.samples[frame] = sum * scale;
+    }
+    return true;
+}
+
+bool write_wav_file(const std::string &path, const float *samples, size_t count, int32_t sample_rate,
+                    std::string &error) {
+    const uint32_t data_bytes = static_cast<uint32_t>(count * 2);
+    std::vector<unsigned char> bytes;
+    bytes.reserve(44 + data_bytes);
+    bytes.insert(bytes.end(), {'R', 'I', 'F', 'F'});
+    put_u32(bytes, 36 + data_bytes);
+    bytes.insert(bytes.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    put_u32(bytes, 16);
+    put_u16(bytes, kFormatPcm);
+    put_u16(bytes, 1);
+    put_u32(bytes, static_cast<uint32_t>(sample_rate));
+    put_u32(bytes, static_cast<uint32_t>(sample_rate) * 2);
+    put_u16(bytes, 2);
+    put_u16(bytes, 16);
+    bytes.insert(bytes.end(), {'d', 'a', 't', 'a'});
+    put_u32(bytes, data_bytes);
+    for (size_t i = 0; i < count; ++i) {
+        const float clamped = std::clamp(samples[i], -1.0f, 1.0f);
+        const long value = std::lround(clamped * 32768.0f);
+        put_u16(bytes, static_cast<uint16_t>(static_cast<int16_t>(std::clamp(value, -32768L, 32767L))));
+    }
+
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!stream) {
+        error = "wav_write_failed";
+        return false;
+    }
+    return true;
+}
+
+void resample_linear(const float *samples, size_t count, int32_t from_rate, int32_t to_rate,
+                     std::vector<float> &out) {
+    if (count == 0 || from_rate <= 0 || to_rate <= 0 || from_rate == to_rate) {
+        out.assign(samples, samples + count);
+        return;
+    }
+    const double step = static_cast<double>(from_rate) / static_cast<double>(to_rate);
+    const size_t frames = static_cast<size_t>(std::floor(static_cast<double>(count - 1) / step)) + 1;
+    out.resize(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        const double position = static_cast<double>(i) * step;
+        const size_t index = static_cast<size_t>(position);
+        const float fraction = static_cast<float>(position - static_cast<double>(index));
+        const float next = index + 1 < count ? samples[index + 1] : samples[index];
+        out[i] = samples[index] + (next - samples[index]) * fraction;
+    }
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,375 @@
+#include "ChildProcess.hpp"
+
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+namespace local_agents::runtime {
+
+namespace {
+#ifdef _WIN32
+std::wstring widen(const std::string &text) {
+    if (text.empty()) {
+        return std::wstring();
+    }
+    const int length = MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), nullptr, 0);
+    std::wstring wide(static_cast<size_t>(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, text.data(), static_cast<int>(text.size()), wide.data(), length);
+    return wide;
+}
+
+// CommandLineToArgvW rules: quotes around every argument, backslashes doubled only where
+// they precede a quote.
+void append_quoted(std::wstring &command, const std::wstring &argument) {
+    command.push_back(L'"');
+    size_t backslashes = 0;
+    for (wchar_t c : argument) {
+        if (c == L'\\') {
+            ++backslashes;
+            continue;
+        }
+        if (c == L'"') {
+            command.append(backslashes * 2 + 1, L'\\');
+        } else {
+            command.append(backslashes, L'\\');
+        }
+        backslashes = 0;
+        command.push_back(c);
+    }
+    command.append(backslashes * 2, L'\\');
+    command.push_back(L'"');
+}
+
+void close_handle(void *&handle) {
+    if (handle) {
+        CloseHandle(static_cast<HANDLE>(handle));
+        handle = nullptr;
+    }
+}
+#else
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+void close_fd(int &fd) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+void set_cloexec(int fd) {
+    const int flags = fcntl(fd, F_GETFD);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+    }
+}
+#endif
+} // namespace
+
+ChildProcess::~ChildProcess() {
+    terminate();
+    close_handles();
+}
+
+#ifdef _WIN32
+
+bool ChildProcess::start(const std::vector<std::string> &argv, std::string &error) {
+    terminate();
+    close_handles();
+    if (argv.empty()) {
+        error = "missing_executable";
+        return false;
+    }
+
+    SECURITY_ATTRIBUTES attributes{};
+    attributes.nLength = sizeof(attributes);
+    attributes.bInheritHandle = TRUE;
+    HANDLE child_in = nullptr, child_out = nullptr, child_err = nullptr;
+    HANDLE parent_in = nullptr, parent_out = nullptr, parent_err = nullptr;
+    if (!CreatePipe(&child_in, &parent_in, &attributes, 0) || !CreatePipe(&parent_out, &child_out, &attributes, 0) ||
+        !CreatePipe(&parent_err, &child_err, &attributes, 0)) {
+        for (HANDLE handle : {child_in, parent_in, parent_out, child_out, parent_err, child_err}) {
+            if (handle) {
+                CloseHandle(handle);
+            }
+        }
+        error = "pipe_failed";
+        return false;
+    }
+    SetHandleInformation(parent_in, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(parent_out, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(parent_err, HANDLE_FLAG_INHERIT, 0);
+
+    std::wstring command;
+    for (const std::string &argument : argv) {
+        if (!command.empty()) {
+            command.push_back(L' ');
+        }
+        append_quoted(command, widen(argument));
+    }
+
+    STARTUPINFOW startup{};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = child_in;
+    startup.hStdOutput = child_out;
+    startup.hStdError = child_err;
+    PROCESS_INFORMATION info{};
+    const BOOL created = CreateProcessW(nullptr, command.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr,
+                                        nullptr, &startup, &info);
+    CloseHandle(child_in);
+    CloseHandle(child_out);
+    CloseHandle(child_err);
+    if (!created) {
+        CloseHandle(parent_in);
+        CloseHandle(parent_out);
+        CloseHandle(parent_err);
+        error = "spawn_failed";
+        return false;
+    }
+    CloseHandle(info.hThread);
+    process_ = info.hProcess;
+    stdin_ = parent_in;
+    stdout_ = parent_out;
+    stderr_ = parent_err;
+    started_ = true;
+    return true;
+}
+
+bool ChildProcess::write_all(const char *data, size_t size) {
+    while (size > 0 && stdin_) {
+        DWORD written = 0;
+        if (!WriteFile(static_cast<HANDLE>(stdin_), data, static_cast<DWORD>(size), &written, nullptr)) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return size == 0;
+}
+
+void ChildProcess::close_stdin() {
+    close_handle(stdin_);
+}
+
+int64_t ChildProcess::read_stdout(char *buffer, size_t size, int32_t timeout_ms) {
+    // Anonymous pipes cannot be waited on, so poll them.
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    for (;;) {
+        DWORD available = 0;
+        if (!stdout_ || !PeekNamedPipe(static_cast<HANDLE>(stdout_), nullptr, 0, nullptr, &available, nullptr)) {
+            return -1;
+        }
+        if (available > 0) {
+            DWORD read = 0;
+            const DWORD wanted = static_cast<DWORD>(size < available ? size : available);
+            if (!ReadFile(static_cast<HANDLE>(stdout_), buffer, wanted, &read, nullptr)) {
+                return -1;
+            }
+            return static_cast<int64_t>(read);
+        }
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return 0;
+        }
+        Sleep(1);
+    }
+}
+
+int64_t ChildProcess::read_stderr(char *buffer, size_t size) {
+    DWORD read = 0;
+    if (!stderr_ || !ReadFile(static_cast<HANDLE>(stderr_), buffer, static_cast<DWORD>(size), &read, nullptr) ||
+        read == 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(read);
+}
+
+int ChildProcess::terminate() {
+    if (!started_) {
+        return -1;
+    }
+    started_ = false;
+    HANDLE process = static_cast<HANDLE>(process_);
+    if (WaitForSingleObject(process, 0) == WAIT_TIMEOUT) {
+        TerminateProcess(process, 1);
+        WaitForSingleObject(process, INFINITE);
+        return -1;
+    }
+    DWORD code = 0;
+    return GetExitCodeProcess(process, &code) ? static_cast<int>(code) : -1;
+}
+
+void ChildProcess::close_handles() {
+    close_handle(stdin_);
+    close_handle(stdout_);
+    close_handle(stderr_);
+    close_handle(process_);
+}
+
+#else
+
+bool ChildProcess::start(const std::vector<std::string> &argv, std::string &error) {
+    terminate();
+    close_handles();
+    if (argv.empty()) {
+        error = "missing_executable";
+        return false;
+    }
+
+    int in_pair[2] = {-1, -1};
+    int out_pipe[2] = {-1, -1};
+    int err_pipe[2] = {-1, -1};
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, in_pair) != 0 || pipe(out_pipe) != 0 || pipe(err_pipe) != 0) {
+        for (int fd : {in_pair[0], in_pair[1], out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+        error = "pipe_failed";
+        return false;
+    }
+    // Close-on-exec everywhere so processes spawned concurrently (popen elsewhere in the
+    // runtime) do not inherit and hold open our pipes; dup2 clears it on the child's 0/1/2.
+    for (int fd : {in_pair[0], in_pair[1], out_pipe[0], out_pipe[1], err_pipe[0], err_pipe[1]}) {
+        set_cloexec(fd);
+    }
+#ifdef SO_NOSIGPIPE
+    const int enabled = 1;
+    setsockopt(in_pair[0], SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_pair[1], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], STDERR_FILENO);
+
+    std::vector<char *> arguments;
+    arguments.reserve(argv.size() + 1);
+    for (const std::string &argument : argv) {
+        arguments.push_back(const_cast<char *>(argument.c_str()));
+    }
+    arguments.push_back(nullptr);
+
+    pid_t pid = -1;
+    const int status = posix_spawn(&pid, argv[0].c_str(), &actions, nullptr, arguments.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(in_pair[1]);
+    ::close(out_pipe[1]);
+    ::close(err_pipe[1]);
+    if (status != 0) {
+        ::close(in_pair[0]);
+        ::close(out_pipe[0]);
+        ::close(err_pipe[0]);
+        error = "spawn_failed";
+        return false;
+    }
+    pid_ = pid;
+    stdin_ = in_pair[0];
+    stdout_ = out_pipe[0];
+    stderr_ = err_pipe[0];
+    started_ = true;
+    return true;
+}
+
+bool ChildProcess::write_all(const char *data, size_t size) {
+    while (size > 0 && stdin_ >= 0) {
+        const ssize_t written = ::send(stdin_, data, size, kSendFlags);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return size == 0;
+}
+
+void ChildProcess::close_stdin() {
+    close_fd(stdin_);
+}
+
+int64_t ChildProcess::read_stdout(char *buffer, size_t size, int32_t timeout_ms) {
+    if (stdout_ < 0) {
+        return -1;
+    }
+    pollfd entry{stdout_, POLLIN, 0};
+    const int ready = ::poll(&entry, 1, timeout_ms);
+    if (ready == 0 || (ready < 0 && errno == EINTR)) {
+        return 0;
+    }
+    if (ready < 0) {
+        return -1;
+    }
+    for (;;) {
+        const ssize_t read = ::read(stdout_, buffer, size);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        return read > 0 ? static_cast<int64_t>(read) : -1;
+    }
+}
+
+int64_t ChildProcess::read_stderr(char *buffer, size_t size) {
+    if (stderr_ < 0) {
+        return -1;
+    }
+    for (;;) {
+        const ssize_t read = ::read(stderr_, buffer, size);
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        return read > 0 ? static_cast<int64_t>(read) : -1;
+    }
+}
+
+int ChildProcess::terminate() {
+    if (!started_) {
+        return -1;
+    }
+    started_ = false;
+    int status = 0;
+    pid_t reaped = waitpid(pid_, &status, WNOHANG);
+    if (reaped == 0) {
+        kill(pid_, SIGKILL);
+        reaped = waitpid(pid_, &status, 0);
+        pid_ = -1;
+        return -1;
+    }
+    pid_ = -1;
+    return reaped > 0 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+void ChildProcess::close_handles() {
+    close_fd(stdin_);
+    close_fd(stdout_);
+    close_fd(stderr_);
+}
+
+#endif
+
+} // namespace local_agents::runtime
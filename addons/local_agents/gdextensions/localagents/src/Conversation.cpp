@@ -0,0 +1,256 @@
+#include "Conversation.hpp"
+
+#include <atomic>
+
+namespace local_agents::runtime {
+
+namespace {
+std::atomic<int64_t> next_conversation_id{1};
+
+int32_t estimate_tokens(const std::string &text) {
+    return static_cast<int32_t>((text.size() + 3) / 4);
+}
+} // namespace
+
+Conversation::Conversation() : id_(next_conversation_id.fetch_add(1)) {}
+
+Conversation::Entry Conversation::make_entry(const std::string &role, const std::string &content) {
+    Entry entry;
+    entry.role = role;
+    entry.content = content;
+    entry.rendered = role + ": " + content + "\n";
+    entry.token_count = estimate_tokens(entry.rendered);
+    return entry;
+}
+
+void Conversation::tokenize_entry(Entry &entry, const InferenceEngine &engine, bool add_bos, bool parse_special) {
+    const uint64_t epoch = engine.model_epoch();
+    if (epoch == 0 || entry.epoch == epoch || !entry.formatted) {
+        return;
+    }
+    std::vector<llama_token> tokens;
+    if (!engine.tokenize(entry.rendered, add_bos, tokens, parse_special)) {
+        return;
+    }
+    entry.tokens = std::move(tokens);
+    entry.epoch = epoch;
+    entry.token_count = static_cast<int32_t>(entry.tokens.size());
+}
+
+void Conversation::restyle_entry(Entry &entry, std::string rendered) {
+    entries_tokens_ -= entry.token_count;
+    entry.rendered = std::move(rendered);
+    entry.formatted = true;
+    entry.tokens.clear();
+    entry.epoch = 0;
+    entry.token_count = estimate_tokens(entry.rendered);
+    entries_tokens_ += entry.token_count;
+}
+
+std::vector<ChatMessage> Conversation::header_messages_locked() const {
+    std::string system = system_prompt_;
+    if (!summary_.content.empty()) {
+        system += system.empty() ? "" : "\n\n";
+        system += summary_.content;
+    }
+    if (system.empty()) {
+        return {};
+    }
+    return {{"system", system}};
+}
+
+void Conversation::append(const std::string &role, const std::string &content) {
+    Entry entry = make_entry(role, content);
+    std::scoped_lock lock(mutex_);
+    // A template renders it on the next turn; the plain line is already final.
+    entry.formatted = format_key_ == 0;
+    entries_tokens_ += entry.token_count;
+    entries_.push_back(std::move(entry));
+}
+
+void Conversation::clear() {
+    std::scoped_lock lock(mutex_);
+    entries_.clear();
+    entries_tokens_ = 0;
+    summary_ = Entry();
+    header_valid_ = false;
+}
+
+std::vector<ChatMessage> Conversation::messages() const {
+    std::scoped_lock lock(mutex_);
+    std::vector<ChatMessage> out;
+    out.reserve(entries_.size());
+    for (const Entry &entry : entries_) {
+        out.push_back({entry.role, entry.content});
+    }
+    return out;
+}
+
+void Conversation::set_summary(const std::string &summary) {
+    Entry entry = summary.empty() ? Entry() : make_entry("system", summary);
+    entry.formatted = true;
+    std::scoped_lock lock(mutex_);
+    summary_ = std::move(entry);
+    header_valid_ = false;
+    // A template renders the first message against the header (some fold the system prompt
+    // into the first user turn), so it is redone with it.
+    if (format_key_ != 0 && !entries_.empty()) {
+        entries_.front().formatted = false;
+    }
+}
+
+std::string Conversation::summary() const {
+    std::scoped_lock lock(mutex_);
+    return summary_.content;
+}
+
+void Conversation::set_max_tokens(int32_t max_tokens) {
+    std::scoped_lock lock(mutex_);
+    max_tokens_ = max_tokens > 0 ? max_tokens : 0;
+}
+
+int32_t Conversation::max_tokens() const {
+    std::scoped_lock lock(mutex_);
+    return max_tokens_;
+}
+
+int64_t Conversation::token_total() const {
+    std::scoped_lock lock(mutex_);
+    return entries_tokens_ + summary_.token_count;
+}
+
+void Conversation::tokenize_pending(const InferenceEngine &engine) {
+    std::scoped_lock lock(mutex_);
+    for (Entry &entry : entries_) {
+        entries_tokens_ -= entry.token_count;
+        tokenize_entry(entry, engine, false, format_key_ != 0);
+        entries_tokens_ += entry.token_count;
+    }
+    // The summary is budgeted as its plain line whatever the prompt format.
+    tokenize_entry(summary_, engine, false, false);
+}
+
+std::vector<ChatMessage> Conversation::trim() {
+    std::vector<ChatMessage> evicted;
+    std::scoped_lock lock(mutex_);
+    if (max_tokens_ <= 0) {
+        return evicted;
+    }
+    while (entries_.size() > 1 && entries_tokens_ + summary_.token_count > max_tokens_) {
+        Entry &oldest = entries_.front();
+        entries_tokens_ -= oldest.token_count;
+        evicted.push_back({std::move(oldest.role), std::move(oldest.content)});
+        entries_.pop_front();
+    }
+    // The new first message is rendered against the header under a template, as in set_summary.
+    if (!evicted.empty() && format_key_ != 0) {
+        entries_.front().formatted = false;
+    }
+    return evicted;
+}
+
+bool Conversation::render_prompt(const InferenceEngine &engine, const PromptFormat &format,
+                                 const std::string &system_prompt, const std::string &user_prompt,
+                                 std::string &text, std::vector<llama_token> &tokens) {
+    text.clear();
+    tokens.clear();
+    const bool templated = format.key != 0 && format.render;
+    std::scoped_lock lock(mutex_);
+    if (format.key != format_key_) {
+        format_key_ = format.key;
+        header_valid_ = false;
+        for (Entry &entry : entries_) {
+            entry.formatted = false;
+        }
+    }
+    if (system_prompt != system_prompt_) {
+        system_prompt_ = system_prompt;
+        header_valid_ = false;
+        if (templated && !entries_.empty()) {
+            entries_.front().formatted = false;
+        }
+    }
+
+    // A template renders whole message lists, so each new message's piece is what it adds to
+    // the render of everything before it. A template whose output is not prefix-stable fails
+    // the check and the turn is rendered some other way.
+    std::vector<ChatMessage> messages;
+    if (templated) {
+        messages = header_messages_locked();
+    }
+    if (!header_valid_) {
+        std::string rendered;
+        if (!templated) {
+            rendered = system_prompt_ + "\n";
+            if (!summary_.content.empty()) {
+                rendered += summary_.rendered;
+            }
+        } else if (!messages.empty() && !format.render(messages, false, rendered)) {
+            return false;
+        }
+        header_ = Entry();
+        header_.rendered = std::move(rendered);
+        header_.formatted = true;
+        header_valid_ = true;
+    }
+    text = header_.rendered;
+    for (Entry &entry : entries_) {
+        if (templated) {
+            messages.push_back({entry.role, entry.content});
+        }
+        if (!entry.formatted) {
+            std::string rendered;
+            if (!templated) {
+                rendered = entry.role + ": " + entry.content + "\n";
+            } else if (!format.render(messages, false, rendered) || rendered.compare(0, text.size(), text) != 0) {
+                return false;
+            } else {
+                rendered.erase(0, text.size());
+            }
+            restyle_entry(entry, std::move(rendered));
+        }
+        text += entry.rendered;
+    }
+    std::string tail;
+    if (templated) {
+        if (!user_prompt.empty()) {
+            messages.push_back({"user", user_prompt});
+        }
+        if (!format.render(messages, true, tail) || tail.compare(0, text.size(), text) != 0) {
+            return false;
+        }
+        tail.erase(0, text.size());
+    } else {
+        if (!user_prompt.empty()) {
+            tail = "user: " + user_prompt + "\n";
+        }
+        tail += "assistant:";
+    }
+
+    const uint64_t epoch = engine.model_epoch();
+    tokenize_entry(header_, engine, true, templated);
+    bool complete = epoch != 0 && header_.epoch == epoch;
+    if (complete) {
+        tokens = header_.tokens;
+    }
+    for (Entry &entry : entries_) {
+        entries_tokens_ -= entry.token_count;
+        tokenize_entry(entry, engine, false, templated);
+        entries_tokens_ += entry.token_count;
+        complete = complete && entry.epoch == epoch;
+        if (complete) {
+            tokens.insert(tokens.end(), entry.tokens.begin(), entry.tokens.end());
+        }
+    }
+    std::vector<llama_token> tail_tokens;
+    complete = complete && engine.tokenize(tail, false, tail_tokens, templated);
+    if (complete) {
+        tokens.insert(tokens.end(), tail_tokens.begin(), tail_tokens.end());
+    } else {
+        tokens.clear();
+    }
+    text += tail;
+    return true;
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,226 @@
+#include "GenerationCache.hpp"
+
+#include "RuntimeMetrics.hpp"
+
+#include <cstring>
+
+namespace local_agents::runtime {
+
+struct GenerationCache::Flight {
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    bool done = false;
+    GenerationResult result;
+};
+
+namespace {
+template <typename T>
+void append_raw(std::string &key, const T &value) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    key.append(bytes, sizeof(T));
+}
+
+void append_text(std::string &key, const std::string &text) {
+    append_raw(key, static_cast<uint64_t>(text.size()));
+    key += text;
+}
+} // namespace
+
+std::string canonical_generation_key(const GenerationRequest &request, uint64_t model_epoch,
+                                     uint64_t adapter_epoch) {
+    const SamplingOptions &s = request.sampling;
+    const bool greedy = s.temperature <= 0.0f;
+    // Continuing a context (reset off, no prefix matching) depends on whatever it held.
+    if ((!greedy && s.seed < 0) || (!request.reset_context && !request.cache_prompt) || model_epoch == 0) {
+        return std::string();
+    }
+
+    std::string key;
+    append_raw(key, model_epoch);
+    append_raw(key, adapter_epoch);
+    if (!request.prompt_tokens.empty() && request.prompt_epoch == model_epoch) {
+        key += 't';
+        append_raw(key, static_cast<uint64_t>(request.prompt_tokens.size()));
+        key.append(reinterpret_cast<const char *>(request.prompt_tokens.data()),
+                   request.prompt_tokens.size() * sizeof(llama_token));
+    } else {
+        key += 'p';
+        append_text(key, request.prompt);
+    }
+    // Greedy decoding ignores the seed and every sampler knob that only reshapes a draw.
+    append_raw(key, greedy);
+    if (!greedy) {
+        append_raw(key, s.top_k);
+        append_raw(key, s.top_p);
+        append_raw(key, s.min_p);
+        append_raw(key, s.typical_p);
+        append_raw(key, s.temperature);
+        append_raw(key, s.seed);
+        append_raw(key, s.mirostat);
+        append_raw(key, s.mirostat_m);
+        append_raw(key, s.mirostat_tau);
+        append_raw(key, s.mirostat_eta);
+    }
+    append_raw(key, s.repeat_penalty);
+    append_raw(key, s.frequency_penalty);
+    append_raw(key, s.presence_penalty);
+    append_raw(key, s.repeat_last_n);
+    append_raw(key, static_cast<uint64_t>(request.loras.size()));
+    for (const LoraSelection &lora : request.loras) {
+        append_text(key, lora.id);
+        append_raw(key, lora.scale);
+    }
+    append_raw(key, static_cast<uint64_t>(request.stop.size()));
+    for (const std::string &stop : request.stop) {
+        append_text(key, stop);
+    }
+    append_raw(key, request.max_tokens);
+    append_raw(key, request.parse_special);
+    append_text(key, request.grammar);
+    append_raw(key, request.grammar_lazy);
+    for (const std::string &pattern : request.grammar_trigger_patterns) {
+        append_text(key, pattern);
+    }
+    key += '|';
+    for (llama_token token : request.grammar_trigger_tokens) {
+        append_raw(key, token);
+    }
+    key += '|';
+    for (llama_token token : request.preserved_tokens) {
+        append_raw(key, token);
+    }
+    return key;
+}
+
+void GenerationCache::configure(size_t capacity, uint64_t ttl_ms) {
+    std::scoped_lock lock(mutex_);
+    capacity_ = capacity;
+    ttl_ms_ = ttl_ms;
+    while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+bool GenerationCache::enabled() const {
+    std::scoped_lock lock(mutex_);
+    return capacity_ > 0;
+}
+
+GenerationCache::Ticket GenerationCache::acquire(const std::string &key) {
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    Ticket ticket;
+    ticket.key = key;
+    std::scoped_lock lock(mutex_);
+    if (lookup_locked(key, ticket.result)) {
+        ticket.role = Role::Hit;
+        metrics.generation_cache_hits.add();
+        return ticket;
+    }
+    auto flying = flights_.find(key);
+    if (flying != flights_.end()) {
+        ticket.role = Role::Follower;
+        ticket.flight = flying->second;
+        metrics.generation_requests_coalesced.add();
+        return ticket;
+    }
+    ticket.role = Role::Leader;
+    ticket.flight = std::make_shared<Flight>();
+    flights_[key] = ticket.flight;
+    metrics.generation_cache_misses.add();
+    return ticket;
+}
+
+void GenerationCache::complete(Ticket &ticket, const GenerationResult &result) {
+    {
+        std::scoped_lock lock(mutex_);
+        auto flying = flights_.find(ticket.key);
+        if (flying != flights_.end() && flying->second == ticket.flight) {
+            flights_.erase(flying);
+        }
+        if (result.ok && result.warning.empty()) {
+            store_locked(ticket.key, result);
+        }
+    }
+    {
+        std::scoped_lock lock(ticket.flight->mutex);
+        ticket.flight->result = result;
+        ticket.flight->done = true;
+    }
+    ticket.flight->done_cv.notify_all();
+}
+
+GenerationResult GenerationCache::wait(const Ticket &ticket) {
+    std::unique_lock lock(ticket.flight->mutex);
+    ticket.flight->done_cv.wait(lock, [&] { return ticket.flight->done; });
+    return ticket.flight->result;
+}
+
+bool GenerationCache::lookup(const std::string &key, GenerationResult &out) {
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    std::scoped_lock lock(mutex_);
+    if (lookup_locked(key, out)) {
+        metrics.generation_cache_hits.add();
+        return true;
+    }
+    metrics.generation_cache_misses.add();
+    return false;
+}
+
+void GenerationCache::store(const std::string &key, const GenerationResult &result) {
+    // A warning means the text was cut short (e.g. a failed continuation decode).
+    if (!result.ok || !result.warning.empty()) {
+        return;
+    }
+    std::scoped_lock lock(mutex_);
+    store_locked(key, result);
+}
+
+void GenerationCache::clear() {
+    std::scoped_lock lock(mutex_);
+    entries_.clear();
+    index_.clear();
+}
+
+size_t GenerationCache::size() const {
+    std::scoped_lock lock(mutex_);
+    return entries_.size();
+}
+
+bool GenerationCache::lookup_locked(const std::string &key, GenerationResult &out) {
+    auto found = index_.find(key);
+    if (found == index_.end()) {
+        return false;
+    }
+    if (ttl_ms_ > 0 && Clock::now() >= found->second->expires) {
+        entries_.erase(found->second);
+        index_.erase(found);
+        return false;
+    }
+    entries_.splice(entries_.begin(), entries_, found->second);
+    out = found->second->result;
+    return true;
+}
+
+void GenerationCache::store_locked(const std::string &key, const GenerationResult &result) {
+    if (capacity_ == 0) {
+        return;
+    }
+    const Clock::time_point expires = Clock::now() + std::chrono::milliseconds(ttl_ms_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        found->second->result = result;
+        found->second->expires = expires;
+        entries_.splice(entries_.begin(), entries_, found->second);
+        return;
+    }
+    entries_.push_front({key, result, expires});
+    index_[key] = entries_.begin();
+    while (entries_.size() > capacity_) {
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+    }
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,74 @@
+#include "GenerationHandle.hpp"
+#include "RuntimeStringUtils.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+using local_agents::runtime::complete_utf8_length;
+
+GenerationHandle::GenerationHandle() = default;
+
+GenerationHandle::~GenerationHandle() = default;
+
+void GenerationHandle::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("step", "budget_usec"), &GenerationHandle::step);
+    ClassDB::bind_method(D_METHOD("poll"), &GenerationHandle::poll);
+    ClassDB::bind_method(D_METHOD("is_done"), &GenerationHandle::is_done);
+    ClassDB::bind_method(D_METHOD("cancel"), &GenerationHandle::cancel);
+    ClassDB::bind_method(D_METHOD("get_response"), &GenerationHandle::get_response);
+}
+
+bool GenerationHandle::step(int64_t budget_usec) {
+    if (finished_) {
+        return true;
+    }
+    AgentRuntime *runtime = AgentRuntime::get_singleton();
+    if (!runtime) {
+        response_["ok"] = false;
+        response_["error"] = "runtime_unavailable";
+        finished_ = true;
+        return true;
+    }
+    runtime->step_generation(*this, budget_usec > 0 ? static_cast<uint64_t>(budget_usec) : 0);
+    return finished_;
+}
+
+Dictionary GenerationHandle::poll() const {
+    Dictionary status;
+    status["done"] = finished_;
+    if (finished_) {
+        status["state"] = "done";
+        status["text"] = response_.get("text", String());
+        status["response"] = response_;
+        return status;
+    }
+    // Not finished implies a session: begin_generation() completes handles it cannot start.
+    const std::string &text = session_->text();
+    status["state"] = session_->prefilling() ? "prefill" : "decode";
+    status["prefill_progress"] = session_->prefill_progress();
+    status["completion_tokens"] = session_->completion_tokens();
+    status["text"] = String::utf8(text.data(), static_cast<int64_t>(complete_utf8_length(text)));
+    return status;
+}
+
+bool GenerationHandle::is_done() const {
+    return finished_;
+}
+
+void GenerationHandle::cancel() {
+    if (finished_) {
+        return;
+    }
+    session_->cancel();
+    if (AgentRuntime *runtime = AgentRuntime::get_singleton()) {
+        runtime->step_generation(*this, 0);
+    } else {
+        response_["ok"] = false;
+        response_["error"] = "cancelled";
+        finished_ = true;
+    }
+}
+
+Dictionary GenerationHandle::get_response() const {
+    return response_;
+}
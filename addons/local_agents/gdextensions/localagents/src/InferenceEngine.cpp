@@ -0,0 +1,1396 @@
+#include "InferenceEngine.hpp"
+
+#include "RuntimeMetrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+namespace local_agents::runtime {
+
+namespace {
+// llama.cpp's LLAMA_MAX_SEQ, which its public header does not export.
+constexpr int32_t kMaxSequences = 256;
+
+struct SamplerDeleter {
+    void operator()(llama_sampler *sampler) const {
+        if (sampler) {
+            llama_sampler_free(sampler);
+        }
+    }
+};
+
+struct LoadProgressState {
+    const std::function<bool(float)> *callback = nullptr;
+    bool cancelled = false;
+};
+
+ggml_type to_ggml_type(KvCacheType type) {
+    switch (type) {
+        case KvCacheType::Q8_0: return GGML_TYPE_Q8_0;
+        case KvCacheType::Q4_0: return GGML_TYPE_Q4_0;
+        case KvCacheType::F16:
+        default: return GGML_TYPE_F16;
+    }
+}
+
+// llama.cpp replaced the `flash_attn` bool with the tri-state `flash_attn_type` (-1 auto,
+// 0 off, 1 on); accept whichever the pinned checkout has.
+template <typename Params>
+auto set_flash_attn(Params &params, int32_t mode, int) -> decltype(params.flash_attn_type, void()) {
+    params.flash_attn_type = static_cast<decltype(params.flash_attn_type)>(mode);
+}
+
+template <typename Params>
+void set_flash_attn(Params &params, int32_t mode, long) {
+    if (mode >= 0) {
+        params.flash_attn = mode == 1;
+    }
+}
+
+// Newer llama.cpp splits the KV cache per sequence unless `kv_unified` is set; a unified
+// cache lets single-sequence requests keep the whole context. Older checkouts always share.
+template <typename Params>
+auto set_kv_unified(Params &params, bool unified, int) -> decltype(params.kv_unified, void()) {
+    params.kv_unified = unified;
+}
+
+template <typename Params>
+void set_kv_unified(Params &, bool, long) {}
+
+// Owns a llama_batch from llama_batch_init() for one multi-sequence decode.
+class SequenceBatch {
+public:
+    explicit SequenceBatch(int32_t capacity) : batch_(llama_batch_init(capacity, 0, 1)), capacity_(capacity) {}
+    ~SequenceBatch() { llama_batch_free(batch_); }
+
+    SequenceBatch(const SequenceBatch &) = delete;
+    SequenceBatch &operator=(const SequenceBatch &) = delete;
+
+    bool full() const { return batch_.n_tokens >= capacity_; }
+    bool empty() const { return batch_.n_tokens == 0; }
+    void clear() { batch_.n_tokens = 0; }
+
+    // Returns the token's index in the batch, which is where its logits land. Callers flush
+    // when full(); this never grows the batch.
+    int32_t add(llama_token token, llama_pos pos, llama_seq_id seq, bool logits) {
+        const int32_t i = batch_.n_tokens++;
+        batch_.token[i] = token;
+        batch_.pos[i] = pos;
+        batch_.n_seq_id[i] = 1;
+        batch_.seq_id[i][0] = seq;
+        batch_.logits[i] = logits;
+        return i;
+    }
+
+    const llama_batch &get() const { return batch_; }
+
+private:
+    llama_batch batch_;
+    int32_t capacity_;
+};
+
+bool same_loras(const std::vector<LoraSelection> &a, const std::vector<LoraSelection> &b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].id != b[i].id || a[i].scale != b[i].scale) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool is_preserved(const GenerationRequest &request, llama_token token) {
+    return std::find(request.preserved_tokens.begin(), request.preserved_tokens.end(), token) !=
+           request.preserved_tokens.end();
+}
+} // namespace
+
+llama_sampler *create_sampler(const SamplingOptions &options, const llama_model *model, llama_sampler *constraint) {
+    llama_sampler_chain_params chain_params = llama_sampler_chain_default_params();
+    chain_params.no_perf = true;
+
+    llama_sampler *chain = llama_sampler_chain_init(chain_params);
+    if (!chain) {
+        if (constraint) {
+            llama_sampler_free(constraint);
+        }
+        return nullptr;
+    }
+
+    auto append_sampler = [chain](llama_sampler *sampler) {
+        if (sampler) {
+            llama_sampler_chain_add(chain, sampler);
+        }
+    };
+
+    // Masks disallowed tokens before anything reshapes or draws from the distribution.
+    append_sampler(constraint);
+
+    bool use_distribution = false;
+    bool use_mirostat = false;
+
+    if (options.top_k > 0) {
+        append_sampler(llama_sampler_init_top_k(options.top_k));
+        use_distribution = true;
+    }
+
+    if (options.top_p > 0.0f) {
+        append_sampler(llama_sampler_init_top_p(options.top_p, 1));
+        use_distribution = true;
+    }
+
+    if (options.min_p > 0.0f) {
+        append_sampler(llama_sampler_init_min_p(options.min_p, 1));
+        use_distribution = true;
+    }
+
+    if (options.typical_p > 0.0f && options.typical_p < 1.0f) {
+        append_sampler(llama_sampler_init_typical(options.typical_p, 1));
+        use_distribution = true;
+    }
+
+    const float temperature = options.temperature;
+    if (temperature <= 0.0f) {
+        use_distribution = false;
+    } else if (temperature != 1.0f) {
+        append_sampler(llama_sampler_init_temp(temperature));
+        use_distribution = true;
+    } else {
+        use_distribution = true;
+    }
+
+    uint32_t seed = LLAMA_DEFAULT_SEED;
+    if (options.seed >= 0) {
+        seed = static_cast<uint32_t>(options.seed);
+    }
+
+    if (options.repeat_penalty != 1.0f || options.frequency_penalty != 0.0f || options.presence_penalty != 0.0f ||
+        options.repeat_last_n != 0) {
+        append_sampler(llama_sampler_init_penalties(
+            options.repeat_last_n, options.repeat_penalty, options.frequency_penalty, options.presence_penalty));
+    }
+
+    if (options.mirostat == 1 && model != nullptr) {
+        const llama_vocab *model_vocab = llama_model_get_vocab(model);
+        int32_t vocab_tokens = model_vocab ? llama_vocab_n_tokens(model_vocab) : 0;
+        append_sampler(llama_sampler_init_mirostat(
+            vocab_tokens, seed, options.mirostat_tau, options.mirostat_eta, options.mirostat_m));
+        use_mirostat = true;
+    } else if (options.mirostat == 2) {
+        append_sampler(llama_sampler_init_mirostat_v2(seed, options.mirostat_tau, options.mirostat_eta));
+        use_mirostat = true;
+    }
+
+    if (!use_mirostat) {
+        if (use_distribution) {
+            append_sampler(llama_sampler_init_dist(seed));
+        } else {
+            append_sampler(llama_sampler_init_greedy());
+        }
+    }
+
+    if (llama_sampler_chain_n(chain) == 0) {
+        append_sampler(llama_sampler_init_greedy());
+    }
+
+    return chain;
+}
+
+llama_sampler *create_grammar_sampler(const GenerationRequest &request, const llama_model *model, std::string &error) {
+    if (request.grammar.empty() || !model) {
+        return nullptr;
+    }
+    const llama_vocab *vocab = llama_model_get_vocab(model);
+    llama_sampler *grammar = nullptr;
+    if (request.grammar_lazy) {
+        std::vector<const char *> patterns;
+        patterns.reserve(request.grammar_trigger_patterns.size());
+        for (const std::string &pattern : request.grammar_trigger_patterns) {
+            patterns.push_back(pattern.c_str());
+        }
+        grammar = llama_sampler_init_grammar_lazy_patterns(vocab, request.grammar.c_str(), "root", patterns.data(),
+                                                           patterns.size(), request.grammar_trigger_tokens.data(),
+                                                           request.grammar_trigger_tokens.size());
+    } else {
+        grammar = llama_sampler_init_grammar(vocab, request.grammar.c_str(), "root");
+    }
+    if (!grammar) {
+        error = "grammar_init_failed";
+    }
+    return grammar;
+}
+
+bool tokenize_text(
+    const llama_vocab *vocab,
+    const std::string &text,
+    bool add_bos,
+    bool parse_special,
+    std::vector<llama_token> &out_tokens
+) {
+    out_tokens.clear();
+    if (!vocab) {
+        return false;
+    }
+
+    // Recent llama.cpp versions can return a negative required size when the output
+    // buffer is too small, including probing calls with a null buffer.
+    int32_t capacity = std::max<int32_t>(32, static_cast<int32_t>(text.size()) + (add_bos ? 2 : 1));
+    out_tokens.resize(static_cast<size_t>(capacity));
+
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        int32_t token_count = llama_tokenize(
+            vocab,
+            text.c_str(),
+            static_cast<int32_t>(text.length()),
+            out_tokens.data(),
+            capacity,
+            add_bos,
+            parse_special
+        );
+
+        if (token_count > 0) {
+            out_tokens.resize(static_cast<size_t>(token_count));
+            return true;
+        }
+
+        if (token_count < 0) {
+            capacity = -token_count;
+            if (capacity <= 0) {
+                return false;
+            }
+            out_tokens.resize(static_cast<size_t>(capacity));
+            continue;
+        }
+
+        return false;
+    }
+
+    return false;
+}
+
+bool apply_stop_sequences(std::string &text, const std::vector<std::string> &stops) {
+    if (stops.empty()) {
+        return false;
+    }
+    size_t earliest = std::string::npos;
+    for (const std::string &stop : stops) {
+        if (stop.empty()) {
+            continue;
+        }
+        size_t pos = text.find(stop);
+        if (pos != std::string::npos && (earliest == std::string::npos || pos < earliest)) {
+            earliest = pos;
+        }
+    }
+    if (earliest != std::string::npos) {
+        text.resize(earliest);
+        return true;
+    }
+    return false;
+}
+
+InferenceEngine::~InferenceEngine() {
+    unload();
+}
+
+MemoryPlan InferenceEngine::plan(const std::string &path, const ModelLoadOptions &options, ModelMetadata &metadata,
+                                 std::string &error) {
+    if (!read_model_metadata(path, metadata, error)) {
+        MemoryPlan failed;
+        failed.reason = error;
+        return failed;
+    }
+
+    const llama_model_params defaults = llama_model_default_params();
+    MemoryPlanRequest request;
+    request.budget_bytes = options.memory_budget_bytes;
+    request.context_size = options.context_size;
+    request.min_context_size = options.min_context_size;
+    request.max_context_size = options.max_context_size;
+    request.batch_size = options.batch_size;
+    request.ubatch_size = options.ubatch_size;
+    request.cache_type = options.cache_type;
+    request.flash_attn = options.flash_attn;
+    request.n_seq = options.n_seq;
+    request.n_contexts = std::max(options.n_contexts, 1);
+    request.n_gpu_layers = llama_supports_gpu_offload() ? options.n_gpu_layers.value_or(defaults.n_gpu_layers) : 0;
+    request.use_mmap = llama_supports_mmap() && options.use_mmap.value_or(defaults.use_mmap);
+    return plan_memory(metadata, request, query_system_memory());
+}
+
+// Holds one context of the pool for the duration of a request and hands it back (waking
+// a waiter) on every return path.
+class InferenceEngine::SlotLease {
+public:
+    SlotLease(InferenceEngine &engine, const std::string &affinity)
+        : engine_(engine), slot_(engine.acquire_slot(affinity)) {}
+    ~SlotLease() {
+        if (slot_) {
+            engine_.release_slot(slot_);
+        }
+    }
+
+    SlotLease(const SlotLease &) = delete;
+    SlotLease &operator=(const SlotLease &) = delete;
+
+    ContextSlot &operator*() const { return *slot_; }
+
+private:
+    InferenceEngine &engine_;
+    ContextSlot *slot_;
+};
+
+bool InferenceEngine::load(const std::string &path, const ModelLoadOptions &options, std::string &error) {
+    unload();
+
+    MemoryPlan memory_plan;
+    ModelMetadata metadata;
+    if (options.plan_memory) {
+        std::string plan_error;
+        memory_plan = plan(path, options, metadata, plan_error);
+        if (!plan_error.empty()) {
+            // Unreadable header: let llama.cpp report the real problem with the file.
+            memory_plan = MemoryPlan();
+            memory_plan.warnings.push_back("memory planning skipped: " + plan_error);
+        } else if (!memory_plan.ok) {
+            error = "memory_budget_exceeded: " + memory_plan.reason;
+            memory_plan_ = memory_plan;
+            return false;
+        }
+    }
+    const uint64_t resident_before = process_resident_bytes();
+
+    llama_backend_init();
+
+    llama_model_params model_params = llama_model_default_params();
+    if (options.n_gpu_layers) {
+        model_params.n_gpu_layers = *options.n_gpu_layers;
+    }
+    if (options.use_mmap) {
+        model_params.use_mmap = *options.use_mmap;
+    }
+    if (options.use_mlock) {
+        model_params.use_mlock = *options.use_mlock;
+    }
+
+    // Weight loading is most of the wall time; context creation and warm-up share the rest.
+    auto report = [&options](float progress) {
+        return !options.progress || options.progress(progress);
+    };
+    LoadProgressState progress_state{&options.progress};
+    if (options.progress) {
+        model_params.progress_callback = [](float progress, void *user_data) {
+            auto *state = static_cast<LoadProgressState *>(user_data);
+            state->cancelled = !(*state->callback)(progress * 0.9f);
+            return !state->cancelled;
+        };
+        model_params.progress_callback_user_data = &progress_state;
+    }
+
+    model_ = llama_model_load_from_file(path.c_str(), model_params);
+    if (!model_) {
+        error = progress_state.cancelled ? "load cancelled: " + path : "failed to load: " + path;
+        llama_backend_free();
+        return false;
+    }
+
+    llama_context_params ctx_params = llama_context_default_params();
+    if (memory_plan.ok) {
+        ctx_params.n_ctx = static_cast<uint32_t>(memory_plan.context_size);
+        ctx_params.n_batch = static_cast<uint32_t>(memory_plan.batch_size);
+        ctx_params.n_ubatch = static_cast<uint32_t>(memory_plan.ubatch_size);
+        ctx_params.type_k = to_ggml_type(memory_plan.type_k);
+        ctx_params.type_v = to_ggml_type(memory_plan.type_v);
+        set_flash_attn(ctx_params, memory_plan.flash_attn, 0);
+    } else {
+        int32_t model_ctx_train = llama_model_n_ctx_train(model_);
+        if (model_ctx_train > 0) {
+            ctx_params.n_ctx = model_ctx_train;
+        }
+        if (options.context_size > 0) {
+            ctx_params.n_ctx = options.context_size;
+        }
+        if (ctx_params.n_ctx <= 0) {
+            ctx_params.n_ctx = 4096;
+        }
+        ctx_params.n_batch = options.batch_size > 0 ? options.batch_size : ctx_params.n_ctx;
+        if (ctx_params.n_batch > ctx_params.n_ctx) {
+            ctx_params.n_batch = ctx_params.n_ctx;
+        }
+        if (options.ubatch_size > 0) {
+            ctx_params.n_ubatch = static_cast<uint32_t>(options.ubatch_size);
+        }
+        set_flash_attn(ctx_params, options.flash_attn, 0);
+    }
+    ctx_params.n_ubatch = std::min(ctx_params.n_ubatch, ctx_params.n_batch);
+    if (options.pooling) {
+        ctx_params.pooling_type = static_cast<enum llama_pooling_type>(*options.pooling);
+    }
+    ctx_params.embeddings = options.embeddings;
+    // generate_group() puts one token per sequence into each n_batch-sized step batch.
+    const int32_t n_seq_limit = std::min(static_cast<int32_t>(ctx_params.n_batch), kMaxSequences);
+    if (options.n_seq > n_seq_limit) {
+        memory_plan.warnings.push_back("n_seq " + std::to_string(options.n_seq) + " reduced to " +
+                                       std::to_string(n_seq_limit) + " (batch_size / llama.cpp limit)");
+    }
+    ctx_params.n_seq_max = static_cast<uint32_t>(std::clamp(options.n_seq, 1, n_seq_limit));
+    set_kv_unified(ctx_params, true, 0);
+
+    // Every context maps the same weights; only KV cache and compute buffers are per context.
+    const int32_t n_contexts = std::max(options.n_contexts, 1);
+    std::vector<std::unique_ptr<ContextSlot>> slots;
+    for (int32_t i = 0; i < n_contexts; ++i) {
+        auto slot = std::make_unique<ContextSlot>();
+        if (!slot->threads.configure(SharedThreadPool::partition(options.threading, n_contexts, i), error)) {
+            break;
+        }
+        ctx_params.n_threads = slot->threads.n_threads();
+        ctx_params.n_threads_batch = slot->threads.n_threads_batch();
+        slot->context = llama_init_from_model(model_, ctx_params);
+        if (!slot->context) {
+            error = n_contexts > 1 ? "failed to create context " + std::to_string(i) : "failed to create context";
+            break;
+        }
+        slot->threads.attach(slot->context);
+        slots.push_back(std::move(slot));
+    }
+    {
+        std::scoped_lock lock(slots_mutex_);
+        slots_ = std::move(slots);
+        threading_ = options.threading;
+        if (threads_held_) {
+            for (auto &slot : slots_) {
+                slot->threads.pause();
+            }
+        }
+    }
+    if (static_cast<int32_t>(slots_.size()) != n_contexts) {
+        unload();
+        return false;
+    }
+
+    static std::atomic<uint64_t> next_epoch{1};
+    model_path_ = path;
+    model_epoch_ = next_epoch.fetch_add(1);
+    metadata_ = std::move(metadata);
+    memory_plan_ = std::move(memory_plan);
+    const uint64_t resident_after = process_resident_bytes();
+    memory_actual_bytes_ = resident_after > resident_before ? resident_after - resident_before : 0;
+    context_size_ = static_cast<int32_t>(ctx_params.n_ctx);
+    batch_size_ = static_cast<int32_t>(ctx_params.n_batch);
+    n_seq_ = static_cast<int32_t>(ctx_params.n_seq_max);
+    embeddings_ = ctx_params.embeddings;
+
+    if (!report(options.warmup ? 0.95f : 1.0f)) {
+        error = "load cancelled: " + path;
+        unload();
+        return false;
+    }
+    if (options.warmup) {
+        std::string warmup_error;
+        if (!warm_up(warmup_error)) {
+            // A model that cannot decode two tokens will fail real requests the same way.
+            error = "warm-up failed: " + warmup_error;
+            unload();
+            return false;
+        }
+        report(1.0f);
+    }
+    update_kv_metrics();
+    return true;
+}
+
+bool InferenceEngine::warm_up(std::string &error) {
+    if (!is_loaded()) {
+        error = "model not loaded";
+        return false;
+    }
+    // Each context reserves its own compute graph and threadpool on first use.
+    for (auto &slot : slots_) {
+        if (!warm_up_slot(*slot, error)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InferenceEngine::warm_up_slot(ContextSlot &slot, std::string &error) {
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    std::vector<llama_token> tokens;
+    if (vocab) {
+        const llama_token bos = llama_vocab_bos(vocab);
+        const llama_token eos = llama_vocab_eos(vocab);
+        if (bos != LLAMA_TOKEN_NULL) {
+            tokens.push_back(bos);
+        }
+        if (eos != LLAMA_TOKEN_NULL) {
+            tokens.push_back(eos);
+        }
+    }
+    if (tokens.empty()) {
+        tokens.push_back(0);
+    }
+
+    llama_batch batch = llama_batch_get_one(tokens.data(), static_cast<int32_t>(tokens.size()));
+    const bool decoded = llama_decode(slot.context, batch) == 0;
+    llama_synchronize(slot.context);
+    reset_slot(slot);
+    llama_perf_context_reset(slot.context);
+    slot.threads.on_idle();
+    if (!decoded) {
+        error = "llama_decode failed";
+        return false;
+    }
+    return true;
+}
+
+void InferenceEngine::unload() {
+    const bool was_loaded = model_ != nullptr;
+    std::vector<std::unique_ptr<ContextSlot>> slots;
+    {
+        std::scoped_lock lock(slots_mutex_);
+        slots.swap(slots_);
+    }
+    for (auto &slot : slots) {
+        SharedThreadPool::detach(slot->context);
+        llama_clear_adapter_lora(slot->context);
+        llama_free(slot->context);
+        slot->threads.release();
+    }
+    slots.clear();
+    for (auto &[id, adapter] : loras_) {
+        llama_adapter_lora_free(adapter);
+    }
+    loras_.clear();
+    if (model_) {
+        llama_model_free(model_);
+        model_ = nullptr;
+    }
+    model_path_.clear();
+    model_epoch_ = 0;
+    metadata_ = ModelMetadata();
+    memory_plan_ = MemoryPlan();
+    memory_actual_bytes_ = 0;
+    context_size_ = 0;
+    batch_size_ = 0;
+    n_seq_ = 1;
+    embeddings_ = false;
+    update_kv_metrics();
+    if (was_loaded) {
+        llama_backend_free();
+    }
+}
+
+InferenceEngine::ContextSlot *InferenceEngine::acquire_slot(const std::string &affinity) {
+    std::unique_lock lock(slots_mutex_);
+    ContextSlot *chosen = nullptr;
+    slot_cv_.wait(lock, [&] {
+        // Preference: the conversation's own context, then one no conversation owns, then
+        // the least recently used.
+        ContextSlot *owned = nullptr;
+        ContextSlot *unowned = nullptr;
+        ContextSlot *oldest = nullptr;
+        for (auto &slot : slots_) {
+            if (slot->busy) {
+                continue;
+            }
+            if (!affinity.empty() && slot->affinity == affinity) {
+                owned = slot.get();
+                break;
+            }
+            if (!unowned && slot->affinity.empty()) {
+                unowned = slot.get();
+            }
+            if (!oldest || slot->last_used < oldest->last_used) {
+                oldest = slot.get();
+            }
+        }
+        chosen = owned ? owned : (unowned ? unowned : oldest);
+        return chosen != nullptr;
+    });
+    chosen->busy = true;
+    chosen->affinity = affinity;
+    chosen->last_used = ++slot_clock_;
+    return chosen;
+}
+
+void InferenceEngine::release_slot(ContextSlot *slot) {
+    {
+        std::scoped_lock lock(slots_mutex_);
+        slot->busy = false;
+    }
+    slot_cv_.notify_one();
+}
+
+void InferenceEngine::reset_slot(ContextSlot &slot) {
+    llama_memory_clear(llama_get_memory(slot.context), true);
+    slot.tokens.clear();
+    slot.kv_used.store(0);
+}
+
+GenerationResult InferenceEngine::generate(const GenerationRequest &request, std::chrono::steady_clock::time_point started) {
+    std::unique_ptr<GenerationSession> session = begin_generation(request, started);
+    session->step(0);
+    return session->result();
+}
+
+std::unique_ptr<GenerationSession> InferenceEngine::begin_generation(const GenerationRequest &request,
+                                                                     std::chrono::steady_clock::time_point started) {
+    std::unique_ptr<GenerationSession> session(new GenerationSession());
+    session->engine_ = this;
+    session->request_ = request;
+    session->started_ = started;
+    GenerationResult &result = session->result_;
+    auto fail = [&](const char *error) {
+        result.error = error;
+        session->done_ = true;
+        return std::move(session);
+    };
+    if (!is_loaded()) {
+        return fail("model_not_loaded");
+    }
+
+    std::string grammar_error;
+    llama_sampler *grammar = create_grammar_sampler(request, model_, grammar_error);
+    if (!grammar_error.empty()) {
+        return fail("grammar_init_failed");
+    }
+    session->sampler_.reset(create_sampler(request.sampling, model_, grammar));
+    if (!session->sampler_) {
+        return fail("sampler_init_failed");
+    }
+    llama_sampler_reset(session->sampler_.get());
+
+    const bool add_bos = true;
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    if (!vocab) {
+        return fail("vocab_unavailable");
+    }
+    if (!request.prompt_tokens.empty() && request.prompt_epoch == model_epoch_) {
+        session->tokens_ = request.prompt_tokens;
+    } else if (!tokenize_text(vocab, request.prompt, add_bos, request.parse_special, session->tokens_)) {
+        return fail("tokenization_failed");
+    }
+    session->prompt_size_ = session->tokens_.size();
+    session->epoch_ = model_epoch_;
+    // Without a conversation the session still needs a stable key to find its KV again
+    // between steps.
+    static std::atomic<uint64_t> next_session{1};
+    session->affinity_ = request.conversation_id.empty()
+                             ? "generation:" + std::to_string(next_session.fetch_add(1))
+                             : request.conversation_id;
+    return session;
+}
+
+void GenerationSession::step(uint64_t budget_us) {
+    if (done_) {
+        return;
+    }
+    InferenceEngine &engine = *engine_;
+    if (engine.model_epoch() != epoch_ || !engine.is_loaded()) {
+        fail("model_unloaded");
+        return;
+    }
+    const auto step_started = std::chrono::steady_clock::now();
+    InferenceEngine::SlotLease lease(engine, affinity_);
+    InferenceEngine::ContextSlot &slot = *lease;
+    llama_context *context = slot.context;
+    const llama_vocab *vocab = llama_model_get_vocab(engine.model_);
+
+    bool adapters_changed = false;
+    if (!engine.apply_loras(slot, request_.loras, adapters_changed, result_.error)) {
+        done_ = true;
+        return;
+    }
+
+    // Line the context's KV up with what this session has decoded so far. On the first step
+    // that follows the request's reset/cache_prompt policy; later steps normally find their
+    // own KV untouched, but another request may have borrowed the context in between.
+    const bool first_step = !started_stepping_;
+    started_stepping_ = true;
+    if (adapters_changed || (first_step && request_.reset_context && !request_.cache_prompt)) {
+        InferenceEngine::reset_slot(slot);
+        decoded_ = 0;
+    } else if (first_step && !request_.cache_prompt) {
+        // reset_context off: the prompt continues whatever the context already holds.
+        tokens_.insert(tokens_.begin(), slot.tokens.begin(), slot.tokens.end());
+        prompt_size_ = tokens_.size();
+        decoded_ = slot.tokens.size();
+        prompt_base_ = decoded_;
+    } else {
+        const size_t target = first_step ? tokens_.size() : decoded_;
+        size_t reused = 0;
+        const size_t limit = std::min(slot.tokens.size(), target);
+        while (reused < limit && slot.tokens[reused] == tokens_[reused]) {
+            ++reused;
+        }
+        // Logits are only fresh if the context's last decode was exactly our last token;
+        // otherwise decode at least one token again.
+        const bool intact = !first_step && reused == decoded_ && slot.tokens.size() == decoded_;
+        if (!intact && reused == target && reused > 0) {
+            --reused;
+        }
+        if (!intact) {
+            if (!llama_memory_seq_rm(llama_get_memory(context), 0, static_cast<llama_pos>(reused), -1)) {
+                // Memory that cannot drop a suffix (recurrent models) starts over.
+                InferenceEngine::reset_slot(slot);
+                reused = 0;
+            }
+            slot.tokens.resize(reused);
+            decoded_ = reused;
+        }
+        if (first_step) {
+            result_.cached_tokens = static_cast<int32_t>(reused);
+        }
+    }
+
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    const int32_t decode_batch_size = request_.batch_size > 0 ? request_.batch_size : 512;
+    auto out_of_budget = [&]() {
+        return budget_us > 0 && elapsed_micros(step_started) >= budget_us;
+    };
+    for (;;) {
+        if (decoded_ < prompt_size_ || (decoded_ < tokens_.size() && sampled_ < request_.max_tokens)) {
+            // Prompt chunks first, then the token sampled last, one llama_decode per unit.
+            const bool prompt = decoded_ < prompt_size_;
+            const size_t end = prompt ? prompt_size_ : tokens_.size();
+            const int32_t chunk =
+                static_cast<int32_t>(std::min<size_t>(static_cast<size_t>(decode_batch_size), end - decoded_));
+            const auto unit_started = std::chrono::steady_clock::now();
+            llama_batch batch = llama_batch_get_one(tokens_.data() + decoded_, chunk);
+            if (llama_decode(context, batch)) {
+                if (prompt) {
+                    InferenceEngine::reset_slot(slot);
+                    slot.threads.on_idle();
+                    fail("llama_decode_failed");
+                    return;
+                }
+                result_.warning = "llama_decode failed during continuation";
+                tokens_.resize(decoded_);
+                finish(slot);
+                return;
+            }
+            slot.tokens.insert(slot.tokens.end(), tokens_.begin() + decoded_, tokens_.begin() + decoded_ + chunk);
+            decoded_ += static_cast<size_t>(chunk);
+            if (!prompt) {
+                decode_us_ += elapsed_micros(unit_started);
+            }
+            if (prompt && decoded_ == prompt_size_ && result_.prompt_tokens == 0) {
+                metrics.prompt_tokens.add(prompt_size_ - prompt_base_);
+                result_.prompt_tokens = static_cast<int32_t>(prompt_size_ - prompt_base_);
+            }
+        } else if (sampled_ >= request_.max_tokens) {
+            finish(slot);
+            return;
+        } else {
+            const auto unit_started = std::chrono::steady_clock::now();
+            const llama_token token = llama_sampler_sample(sampler_.get(), context, -1);
+            if (sampled_++ == 0) {
+                ttft_us_ = elapsed_micros(started_);
+                metrics.ttft_us.record(ttft_us_);
+            }
+            decode_us_ += elapsed_micros(unit_started);
+            if (llama_vocab_is_eog(vocab, token)) {
+                finish(slot);
+                return;
+            }
+            ++result_.completion_tokens;
+            text_ += engine.token_to_string(token, is_preserved(request_, token));
+            if (apply_stop_sequences(text_, request_.stop)) {
+                finish(slot);
+                return;
+            }
+            tokens_.push_back(token);
+        }
+        if (out_of_budget()) {
+            break;
+        }
+    }
+    // Park the workers between frames; the KV stays put for the next step.
+    slot.threads.on_idle();
+    slot.kv_used.store(static_cast<int64_t>(slot.tokens.size()));
+}
+
+void GenerationSession::cancel() {
+    if (!done_) {
+        fail("cancelled");
+    }
+}
+
+float GenerationSession::prefill_progress() const {
+    const size_t total = prompt_size_ - prompt_base_;
+    const size_t done = std::min(decoded_, prompt_size_) - std::min(decoded_, prompt_base_);
+    return total > 0 ? static_cast<float>(done) / static_cast<float>(total) : 1.0f;
+}
+
+void GenerationSession::fail(const char *error) {
+    result_.ok = false;
+    result_.error = error;
+    done_ = true;
+}
+
+void GenerationSession::finish(InferenceEngine::ContextSlot &slot) {
+    slot.threads.on_idle();
+    slot.kv_used.store(static_cast<int64_t>(slot.tokens.size()));
+    const double tokens_per_second =
+        decode_us_ > 0 ? result_.completion_tokens * 1e6 / static_cast<double>(decode_us_) : 0.0;
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    metrics.completion_tokens.add(static_cast<uint64_t>(result_.completion_tokens));
+    if (result_.completion_tokens > 0) {
+        metrics.decode_tokens_per_second.set(tokens_per_second);
+    }
+    engine_->update_kv_metrics();
+
+    result_.ok = true;
+    result_.text = text_;
+    result_.ttft_ms = static_cast<double>(ttft_us_) / 1000.0;
+    result_.tokens_per_second = tokens_per_second;
+    done_ = true;
+}
+
+std::vector<GenerationResult> InferenceEngine::generate_batch(const std::vector<GenerationRequest> &requests,
+                                                              std::chrono::steady_clock::time_point started) {
+    std::vector<GenerationResult> results(requests.size());
+    if (!is_loaded()) {
+        for (GenerationResult &result : results) {
+            result.error = "model_not_loaded";
+        }
+        return results;
+    }
+    // The sequences of a group share one KV cache, so a group's prompts plus their
+    // max_tokens must fit the context; counted up front so a group never runs out mid-decode.
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    const size_t budget = static_cast<size_t>(std::max(context_size_, 0));
+    std::vector<size_t> cost(requests.size(), budget + 1);
+    std::vector<llama_token> counted;
+    for (size_t i = 0; i < requests.size(); ++i) {
+        const GenerationRequest &request = requests[i];
+        size_t prompt = 0;
+        if (!request.prompt_tokens.empty() && request.prompt_epoch == model_epoch_) {
+            prompt = request.prompt_tokens.size();
+        } else if (vocab && tokenize_text(vocab, request.prompt, true, request.parse_special, counted)) {
+            prompt = counted.size();
+        } else {
+            continue; // generate() reports the failure on its own
+        }
+        cost[i] = prompt + static_cast<size_t>(std::max(request.max_tokens, 0));
+    }
+
+    // Requests sharing an adapter set go through one context together, up to n_seq at a
+    // time and within the context budget; whatever cannot be grouped decodes alone.
+    std::vector<bool> taken(requests.size(), false);
+    for (size_t first = 0; first < requests.size(); ++first) {
+        if (taken[first]) {
+            continue;
+        }
+        std::vector<size_t> group{first};
+        taken[first] = true;
+        size_t used = cost[first];
+        for (size_t i = first + 1; i < requests.size() && static_cast<int32_t>(group.size()) < n_seq_ && used <= budget;
+             ++i) {
+            if (!taken[i] && cost[i] <= budget - used && same_loras(requests[i].loras, requests[first].loras)) {
+                group.push_back(i);
+                taken[i] = true;
+                used += cost[i];
+            }
+        }
+        if (group.size() == 1) {
+            results[first] = generate(requests[first], started);
+        } else {
+            generate_group(requests, group, started, results);
+        }
+    }
+    return results;
+}
+
+void InferenceEngine::generate_group(const std::vector<GenerationRequest> &requests, const std::vector<size_t> &group,
+                                     std::chrono::steady_clock::time_point started,
+                                     std::vector<GenerationResult> &results) {
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    if (!vocab) {
+        for (size_t index : group) {
+            results[index].error = "vocab_unavailable";
+        }
+        return;
+    }
+
+    struct Sequence {
+        size_t index = 0;
+        std::unique_ptr<llama_sampler, SamplerDeleter> sampler;
+        std::vector<llama_token> prompt;
+        llama_pos n_past = 0;
+        int32_t logits_at = -1;
+        llama_token next = LLAMA_TOKEN_NULL;
+        bool active = false;
+        std::string text;
+        int32_t completion_tokens = 0;
+        uint64_t ttft_us = 0;
+    };
+    std::vector<Sequence> sequences;
+    sequences.reserve(group.size());
+    for (size_t index : group) {
+        const GenerationRequest &request = requests[index];
+        Sequence sequence;
+        sequence.index = index;
+        std::string grammar_error;
+        llama_sampler *grammar = create_grammar_sampler(request, model_, grammar_error);
+        if (!grammar_error.empty()) {
+            results[index].error = grammar_error;
+            continue;
+        }
+        sequence.sampler.reset(create_sampler(request.sampling, model_, grammar));
+        if (!sequence.sampler) {
+            results[index].error = "sampler_init_failed";
+            continue;
+        }
+        llama_sampler_reset(sequence.sampler.get());
+        if (!request.prompt_tokens.empty() && request.prompt_epoch == model_epoch_) {
+            sequence.prompt = request.prompt_tokens;
+        } else if (!tokenize_text(vocab, request.prompt, true, request.parse_special, sequence.prompt) ||
+                   sequence.prompt.empty()) {
+            results[index].error = "tokenization_failed";
+            continue;
+        }
+        sequences.push_back(std::move(sequence));
+    }
+    if (sequences.empty()) {
+        return;
+    }
+    auto fail_all = [&](const std::string &error) {
+        for (const Sequence &sequence : sequences) {
+            results[sequence.index].error = error;
+        }
+    };
+
+    // No affinity: the batch wipes the KV, so it takes a context no conversation owns.
+    SlotLease lease(*this, std::string());
+    ContextSlot &slot = *lease;
+    llama_context *context = slot.context;
+    bool adapters_changed = false;
+    std::string error;
+    if (!apply_loras(slot, requests[sequences.front().index].loras, adapters_changed, error)) {
+        fail_all(error);
+        return;
+    }
+    reset_slot(slot);
+
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    // Samples the token whose logits `sequence` asked for and decides whether it goes on.
+    auto accept = [&](Sequence &sequence) {
+        const GenerationRequest &request = requests[sequence.index];
+        const llama_token token = llama_sampler_sample(sequence.sampler.get(), context, sequence.logits_at);
+        sequence.logits_at = -1;
+        sequence.active = false;
+        if (sequence.ttft_us == 0) {
+            sequence.ttft_us = elapsed_micros(started);
+            metrics.ttft_us.record(sequence.ttft_us);
+        }
+        if (llama_vocab_is_eog(vocab, token)) {
+            return;
+        }
+        ++sequence.completion_tokens;
+        sequence.text += token_to_string(token, is_preserved(request, token));
+        if (apply_stop_sequences(sequence.text, request.stop) || sequence.completion_tokens >= request.max_tokens) {
+            return;
+        }
+        sequence.next = token;
+        sequence.active = true;
+    };
+
+    SequenceBatch batch(std::max(batch_size_, 1));
+    auto flush = [&]() {
+        if (batch.empty()) {
+            return true;
+        }
+        if (llama_decode(context, batch.get())) {
+            return false;
+        }
+        batch.clear();
+        for (Sequence &sequence : sequences) {
+            if (sequence.logits_at >= 0) {
+                accept(sequence);
+            }
+        }
+        return true;
+    };
+
+    // One prefill for every prompt: sequences share each batch until it fills, and each
+    // samples its first token right after the chunk that holds its last prompt token.
+    for (size_t s = 0; s < sequences.size(); ++s) {
+        Sequence &sequence = sequences[s];
+        const bool samples = requests[sequence.index].max_tokens > 0;
+        for (size_t t = 0; t < sequence.prompt.size(); ++t) {
+            const bool last = t + 1 == sequence.prompt.size();
+            const int32_t at = batch.add(sequence.prompt[t], static_cast<llama_pos>(t), static_cast<llama_seq_id>(s),
+                                         last && samples);
+            if (last && samples) {
+                sequence.logits_at = at;
+            }
+            if (batch.full() && !flush()) {
+                reset_slot(slot);
+                slot.threads.on_idle();
+                fail_all("llama_decode_failed");
+                return;
+            }
+        }
+        sequence.n_past = static_cast<llama_pos>(sequence.prompt.size());
+        metrics.prompt_tokens.add(sequence.prompt.size());
+        results[sequence.index].prompt_tokens = static_cast<int32_t>(sequence.prompt.size());
+    }
+    if (!flush()) {
+        reset_slot(slot);
+        slot.threads.on_idle();
+        fail_all("llama_decode_failed");
+        return;
+    }
+
+    // Then one decode per step for all sequences still going, one token each.
+    const auto decode_started = std::chrono::steady_clock::now();
+    bool decode_failed = false;
+    for (;;) {
+        bool stepped = false;
+        for (size_t s = 0; s < sequences.size(); ++s) {
+            Sequence &sequence = sequences[s];
+            if (sequence.active) {
+                stepped = true;
+                sequence.logits_at = batch.add(sequence.next, sequence.n_past++, static_cast<llama_seq_id>(s), true);
+                // More sequences than batch slots: decode this part of the step now.
+                if (batch.full() && !flush()) {
+                    decode_failed = true;
+                    break;
+                }
+            }
+        }
+        if (decode_failed || !stepped) {
+            break;
+        }
+        if (!flush()) {
+            decode_failed = true;
+            break;
+        }
+    }
+
+    slot.threads.on_idle();
+    // Several interleaved sequences are no prefix a later request could reuse.
+    reset_slot(slot);
+    const uint64_t decode_us = elapsed_micros(decode_started);
+    int64_t completion_total = 0;
+    for (Sequence &sequence : sequences) {
+        GenerationResult &result = results[sequence.index];
+        // Sequences that already finished keep their text; the ones cut off fail.
+        if (decode_failed && sequence.active) {
+            result.error = "llama_decode_failed";
+        } else {
+            result.ok = true;
+        }
+        result.text = std::move(sequence.text);
+        result.completion_tokens = sequence.completion_tokens;
+        result.ttft_ms = static_cast<double>(sequence.ttft_us) / 1000.0;
+        result.tokens_per_second =
+            decode_us > 0 ? sequence.completion_tokens * 1e6 / static_cast<double>(decode_us) : 0.0;
+        completion_total += sequence.completion_tokens;
+    }
+    metrics.completion_tokens.add(static_cast<uint64_t>(completion_total));
+    if (completion_total > 0 && decode_us > 0) {
+        metrics.decode_tokens_per_second.set(completion_total * 1e6 / static_cast<double>(decode_us));
+    }
+    update_kv_metrics();
+}
+
+bool InferenceEngine::tokenize(const std::string &text, bool add_bos, std::vector<llama_token> &out,
+                               bool parse_special) const {
+    out.clear();
+    if (!model_) {
+        return false;
+    }
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    if (text.empty()) {
+        // llama_tokenize reports zero tokens as a failure; an empty prompt head is just BOS.
+        if (add_bos && vocab && llama_vocab_get_add_bos(vocab)) {
+            out.push_back(llama_vocab_bos(vocab));
+        }
+        return true;
+    }
+    return tokenize_text(vocab, text, add_bos, parse_special, out);
+}
+
+int32_t InferenceEngine::count_tokens(const std::string &text) const {
+    std::vector<llama_token> tokens;
+    if (!tokenize(text, false, tokens)) {
+        return -1;
+    }
+    return static_cast<int32_t>(tokens.size());
+}
+
+bool InferenceEngine::embed(const std::string &text, bool add_bos, bool normalize, std::vector<float> &out, std::string &error) {
+    out.clear();
+    if (!is_loaded()) {
+        error = "model not loaded";
+        return false;
+    }
+
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    if (!vocab) {
+        error = "vocab unavailable";
+        return false;
+    }
+
+    std::vector<llama_token> tokens;
+    if (!tokenize_text(vocab, text, add_bos, false, tokens)) {
+        error = "tokenization failed";
+        return false;
+    }
+
+    // No affinity: an embedding wipes the KV, so it takes a context no conversation owns.
+    SlotLease lease(*this, std::string());
+    ContextSlot &slot = *lease;
+    llama_context *context = slot.context;
+
+    // Embeddings always come from the base model so vectors stay comparable across agents.
+    bool adapters_changed = false;
+    if (!apply_loras(slot, {}, adapters_changed, error)) {
+        return false;
+    }
+
+    reset_slot(slot);
+
+    llama_batch batch = llama_batch_get_one(tokens.data(), static_cast<int32_t>(tokens.size()));
+    const bool decoded = llama_decode(context, batch) == 0;
+    slot.threads.on_idle();
+    if (!decoded) {
+        error = "llama_decode failed";
+        return false;
+    }
+
+    const float *embedding_ptr = nullptr;
+    switch (llama_pooling_type(context)) {
+        case LLAMA_POOLING_TYPE_NONE:
+            embedding_ptr = llama_get_embeddings(context);
+            if (!embedding_ptr) {
+                embedding_ptr = llama_get_embeddings_ith(context, static_cast<int32_t>(tokens.size()) - 1);
+            }
+            break;
+        default:
+            embedding_ptr = llama_get_embeddings_seq(context, 0);
+            break;
+    }
+
+    if (!embedding_ptr) {
+        error = "no embedding data";
+        return false;
+    }
+
+    const int dim = llama_model_n_embd(model_);
+    out.assign(embedding_ptr, embedding_ptr + dim);
+
+    if (normalize) {
+        double norm = 0.0;
+        for (float value : out) {
+            norm += static_cast<double>(value) * static_cast<double>(value);
+        }
+        norm = std::sqrt(std::max(norm, 1e-12));
+        if (norm > 0.0) {
+            for (float &value : out) {
+                value = static_cast<float>(value / norm);
+            }
+        }
+    }
+
+    // The embedding pass is not a prefix any generation can reuse.
+    reset_slot(slot);
+    update_kv_metrics();
+    return true;
+}
+
+bool InferenceEngine::load_lora(const std::string &id, const std::string &path, std::string &error) {
+    if (!is_loaded()) {
+        error = "model not loaded";
+        return false;
+    }
+    llama_adapter_lora *adapter = llama_adapter_lora_init(model_, path.c_str());
+    if (!adapter) {
+        error = "failed to load lora: " + path;
+        return false;
+    }
+    unload_lora(id);
+    loras_[id] = adapter;
+    return true;
+}
+
+bool InferenceEngine::unload_lora(const std::string &id) {
+    auto found = loras_.find(id);
+    if (found == loras_.end()) {
+        return false;
+    }
+    for (auto &slot : slots_) {
+        for (const LoraSelection &selection : slot->active_loras) {
+            if (selection.id == id) {
+                // The context must not reference an adapter after it is freed.
+                llama_clear_adapter_lora(slot->context);
+                slot->active_loras.clear();
+                reset_slot(*slot);
+                break;
+            }
+        }
+    }
+    llama_adapter_lora_free(found->second);
+    loras_.erase(found);
+    return true;
+}
+
+std::vector<std::string> InferenceEngine::lora_ids() const {
+    std::vector<std::string> ids;
+    ids.reserve(loras_.size());
+    for (const auto &[id, adapter] : loras_) {
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+bool InferenceEngine::apply_loras(ContextSlot &slot, const std::vector<LoraSelection> &loras, bool &changed,
+                                  std::string &error) {
+    changed = false;
+    const bool same = loras.size() == slot.active_loras.size() &&
+                      std::equal(loras.begin(), loras.end(), slot.active_loras.begin(),
+                                 [](const LoraSelection &a, const LoraSelection &b) {
+                                     return a.id == b.id && a.scale == b.scale;
+                                 });
+    if (same) {
+        return true;
+    }
+    // The registry only changes under exclusive access, so concurrent readers are safe.
+    for (const LoraSelection &selection : loras) {
+        if (loras_.find(selection.id) == loras_.end()) {
+            error = "unknown_lora: " + selection.id;
+            return false;
+        }
+    }
+
+    llama_clear_adapter_lora(slot.context);
+    slot.active_loras.clear();
+    changed = true;
+    for (const LoraSelection &selection : loras) {
+        if (llama_set_adapter_lora(slot.context, loras_.at(selection.id), selection.scale) != 0) {
+            error = "lora_apply_failed: " + selection.id;
+            llama_clear_adapter_lora(slot.context);
+            slot.active_loras.clear();
+            return false;
+        }
+        slot.active_loras.push_back(selection);
+    }
+    return true;
+}
+
+bool InferenceEngine::configure_threads(const ThreadingOptions &options, std::string &error) {
+    std::scoped_lock lock(slots_mutex_);
+    threading_ = options;
+    const int32_t parts = static_cast<int32_t>(slots_.size());
+    bool ok = true;
+    for (int32_t i = 0; i < parts; ++i) {
+        ContextSlot &slot = *slots_[static_cast<size_t>(i)];
+        const ThreadingOptions part = SharedThreadPool::partition(options, parts, i);
+        SharedThreadPool::detach(slot.context);
+        if (ok && slot.threads.configure(part, error)) {
+            slot.threads.attach(slot.context);
+            if (threads_held_) {
+                slot.threads.pause();
+            }
+            continue;
+        }
+        // Fall back to llama.cpp's own per-call threads rather than a dangling pool.
+        ok = false;
+        slot.threads.release();
+        llama_set_n_threads(slot.context, SharedThreadPool::resolve_thread_count(part.n_threads, part.reserved_threads),
+                            SharedThreadPool::resolve_thread_count(part.n_threads_batch, part.reserved_threads));
+    }
+    return ok;
+}
+
+void InferenceEngine::pause_threads() {
+    std::scoped_lock lock(slots_mutex_);
+    threads_held_ = true;
+    for (auto &slot : slots_) {
+        slot->threads.pause();
+    }
+}
+
+void InferenceEngine::resume_threads() {
+    std::scoped_lock lock(slots_mutex_);
+    threads_held_ = false;
+    for (auto &slot : slots_) {
+        slot->threads.resume();
+    }
+}
+
+ThreadPoolInfo InferenceEngine::thread_info() const {
+    std::scoped_lock lock(slots_mutex_);
+    ThreadPoolInfo info;
+    info.options = threading_;
+    info.paused = threads_held_;
+    info.n_contexts = static_cast<int32_t>(slots_.size());
+    for (const auto &slot : slots_) {
+        if (!slot->threads.is_configured()) {
+            continue;
+        }
+        ++info.n_pools;
+        info.n_threads = std::max(info.n_threads, slot->threads.n_threads());
+        info.n_threads_batch = std::max(info.n_threads_batch, slot->threads.n_threads_batch());
+    }
+    info.configured = info.n_pools > 0;
+    if (info.configured) {
+        info.paused = true;
+        for (const auto &slot : slots_) {
+            info.paused = info.paused && slot->threads.is_paused();
+        }
+    }
+    return info;
+}
+
+void InferenceEngine::update_kv_metrics() const {
+    RuntimeMetrics &metrics = RuntimeMetrics::get();
+    int64_t used = 0;
+    int64_t total = 0;
+    for (const auto &slot : slots_) {
+        used += slot->kv_used.load();
+        total += static_cast<int64_t>(llama_n_ctx(slot->context));
+    }
+    metrics.kv_cells_used.set(used);
+    metrics.kv_cells_total.set(total);
+}
+
+std::string InferenceEngine::render_prompt(const std::string &system_prompt,
+                                           const std::vector<ChatMessage> &history,
+                                           const std::string &user_prompt) {
+    std::ostringstream oss;
+    oss << system_prompt << "\n";
+    for (const ChatMessage &message : history) {
+        oss << message.role << ": " << message.content << "\n";
+    }
+    if (!user_prompt.empty()) {
+        oss << "user: " << user_prompt << "\n";
+    }
+    oss << "assistant:";
+    return oss.str();
+}
+
+std::string InferenceEngine::token_to_string(llama_token token, bool special) const {
+    std::string buffer;
+    buffer.resize(4096);
+    const llama_vocab *vocab = llama_model_get_vocab(model_);
+    if (!vocab) {
+        return std::string();
+    }
+    int written = llama_token_to_piece(vocab, token, buffer.data(), buffer.size(), 0, special);
+    if (written < 0) {
+        return std::string();
+    }
+    buffer.resize(written);
+    return buffer;
+}
+
+} // namespace local_agents::runtime
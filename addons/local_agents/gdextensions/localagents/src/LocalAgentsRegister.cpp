@@ -1,17 +1,23 @@
 #include <godot_cpp/godot.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
 #include <godot_cpp/variant/string_name.hpp>
 
 #include "AgentNode.hpp"
 #include "AgentRuntime.hpp"
+#include "AgentScheduler.hpp"
+#include "GenerationHandle.hpp"
 #include "NetworkGraph.hpp"
 #include "LAProcess.hpp"
+#include "SpeechListener.hpp"
+#include "SpeechStream.hpp"
 
 using namespace godot;
 
 namespace {
 AgentRuntime *g_agent_runtime_singleton = nullptr;
+AgentScheduler *g_agent_scheduler_singleton = nullptr;
 
 void initialize_local_agents(ModuleInitializationLevel p_level) {
     if (p_level != MODULE_INITIALIZATION_LEVEL_SCENE) {
@@ -20,13 +26,25 @@ void initialize_local_agents(ModuleInitializationLevel p_level) {
 
     ClassDB::register_class<AgentRuntime>();
     ClassDB::register_class<AgentNode>();
+    ClassDB::register_class<AgentScheduler>();
+    ClassDB::register_class<GenerationHandle>();
     ClassDB::register_class<NetworkGraph>();
     ClassDB::register_class<LAProcess>();
+    ClassDB::register_class<SpeechListener>();
+    ClassDB::register_class<SpeechStream>();
 
     if (!g_agent_runtime_singleton) {
         g_agent_runtime_singleton = memnew(AgentRuntime);
         g_agent_runtime_singleton->set_name("AgentRuntime");
         Engine::get_singleton()->register_singleton(StringName("AgentRuntime"), g_agent_runtime_singleton);
+        // Performance may not exist yet this early in scene init; register once the loop runs.
+        callable_mp(g_agent_runtime_singleton, &AgentRuntime::register_performance_monitors).call_deferred();
+    }
+    if (!g_agent_scheduler_singleton) {
+        g_agent_scheduler_singleton = memnew(AgentScheduler);
+        Engine::get_singleton()->register_singleton(StringName("AgentScheduler"), g_agent_scheduler_singleton);
+        // Same as above: the SceneTree to hook into only exists once the loop runs.
+        callable_mp(g_agent_scheduler_singleton, &AgentScheduler::attach_to_tree).call_deferred();
     }
 }
 
@@ -35,7 +53,13 @@ void terminate_local_agents(ModuleInitializationLevel p_level) {
         return;
     }
 
+    if (g_agent_scheduler_singleton) {
+        Engine::get_singleton()->unregister_singleton(StringName("AgentScheduler"));
+        memdelete(g_agent_scheduler_singleton);
+        g_agent_scheduler_singleton = nullptr;
+    }
     if (g_agent_runtime_singleton) {
+        g_agent_runtime_singleton->unregister_performance_monitors();
         Engine::get_singleton()->unregister_singleton(StringName("AgentRuntime"));
         memdelete(g_agent_runtime_singleton);
         g_agent_runtime_singleton = nullptr;
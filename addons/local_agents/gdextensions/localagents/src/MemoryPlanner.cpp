@@ -0,0 +1,322 @@
+#include "MemoryPlanner.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/sysctl.h>
+#include <unistd.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr uint64_t kMiB = 1024ull * 1024ull;
+constexpr uint64_t kGiB = 1024ull * kMiB;
+constexpr int32_t kContextPadding = 256;
+constexpr int32_t kSmallestContext = 256;
+constexpr int32_t kDefaultMaxBatch = 2048;
+
+int32_t pad_context(int32_t n_ctx) {
+    return ((n_ctx + kContextPadding - 1) / kContextPadding) * kContextPadding;
+}
+
+std::string format_mib(uint64_t bytes) {
+    std::ostringstream out;
+    out << (bytes + kMiB / 2) / kMiB << " MiB";
+    return out.str();
+}
+} // namespace
+
+const char *kv_cache_type_name(KvCacheType type) {
+    switch (type) {
+        case KvCacheType::Q8_0: return "q8_0";
+        case KvCacheType::Q4_0: return "q4_0";
+        case KvCacheType::F16:
+        default: return "f16";
+    }
+}
+
+bool parse_kv_cache_type(const std::string &name, KvCacheType &out) {
+    if (name == "f16") {
+        out = KvCacheType::F16;
+    } else if (name == "q8_0") {
+        out = KvCacheType::Q8_0;
+    } else if (name == "q4_0") {
+        out = KvCacheType::Q4_0;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double kv_cache_type_bytes(KvCacheType type) {
+    // Block formats: q8_0 stores 32 int8 + one f16 scale, q4_0 32 nibbles + one f16 scale.
+    switch (type) {
+        case KvCacheType::Q8_0: return 34.0 / 32.0;
+        case KvCacheType::Q4_0: return 18.0 / 32.0;
+        case KvCacheType::F16:
+        default: return 2.0;
+    }
+}
+
+SystemMemory query_system_memory() {
+    SystemMemory memory;
+#if defined(_WIN32)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status)) {
+        memory.total = status.ullTotalPhys;
+        memory.available = status.ullAvailPhys;
+    }
+#elif defined(__APPLE__)
+    uint64_t total = 0;
+    size_t length = sizeof(total);
+    if (sysctlbyname("hw.memsize", &total, &length, nullptr, 0) == 0) {
+        memory.total = total;
+    }
+    vm_statistics64_data_t stats;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+    if (host_statistics64(mach_host_self(), HOST_VM_INFO64, reinterpret_cast<host_info64_t>(&stats), &count) == KERN_SUCCESS) {
+        const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        memory.available = (static_cast<uint64_t>(stats.free_count) + stats.inactive_count + stats.purgeable_count) * page;
+    }
+#else
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    uint64_t value = 0;
+    std::string unit;
+    while (meminfo >> key >> value >> unit) {
+        if (key == "MemTotal:") {
+            memory.total = value * 1024ull;
+        } else if (key == "MemAvailable:") {
+            memory.available = value * 1024ull;
+        }
+    }
+#endif
+    return memory;
+}
+
+uint64_t process_resident_bytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return static_cast<uint64_t>(counters.WorkingSetSize);
+    }
+    return 0;
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+        return static_cast<uint64_t>(info.resident_size);
+    }
+    return 0;
+#else
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size_pages = 0;
+    uint64_t resident_pages = 0;
+    if (statm >> size_pages >> resident_pages) {
+        return resident_pages * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    }
+    return 0;
+#endif
+}
+
+MemoryEstimate estimate_memory(const ModelMetadata &model, int32_t context_size, int32_t ubatch_size,
+                               KvCacheType type_k, KvCacheType type_v, bool flash_attn, int32_t n_seq,
+                               int32_t n_gpu_layers, bool use_mmap) {
+    MemoryEstimate estimate;
+    const int32_t n_layer = std::max(model.n_layer, 1);
+    const int32_t offloaded = std::clamp(n_gpu_layers, 0, n_layer);
+    const double host_fraction = static_cast<double>(n_layer - offloaded) / static_cast<double>(n_layer);
+
+    estimate.weights = static_cast<uint64_t>(static_cast<double>(model.weights_bytes) * host_fraction);
+
+    const double bytes_per_cell_layer =
+        static_cast<double>(model.n_head_kv) * (model.n_embd_head_k * kv_cache_type_bytes(type_k) +
+                                                model.n_embd_head_v * kv_cache_type_bytes(type_v));
+    const double host_layers = static_cast<double>(n_layer - offloaded);
+    estimate.kv_cache = static_cast<uint64_t>(pad_context(context_size) * host_layers * bytes_per_cell_layer);
+
+    // ggml's allocator reuses intermediate buffers across layers, so the compute buffer is
+    // roughly one layer's activations for a micro-batch plus the logits. Without flash
+    // attention the KQ score matrix (ubatch x n_ctx x n_head, f32) dominates at long context.
+    const uint64_t ubatch = static_cast<uint64_t>(std::max(ubatch_size, 1));
+    uint64_t compute = ubatch * static_cast<uint64_t>(model.n_vocab) * 4ull;
+    compute += ubatch * (static_cast<uint64_t>(model.n_embd) * 4ull * 6ull + static_cast<uint64_t>(model.n_ff) * 4ull * 3ull);
+    if (flash_attn) {
+        compute += ubatch * static_cast<uint64_t>(model.n_head) * 256ull * 4ull;
+    } else {
+        compute += ubatch * static_cast<uint64_t>(pad_context(context_size)) * static_cast<uint64_t>(model.n_head) * 4ull * 2ull;
+    }
+    compute += static_cast<uint64_t>(std::max(n_seq, 1)) * static_cast<uint64_t>(model.n_vocab) * 4ull;
+    estimate.compute = static_cast<uint64_t>(static_cast<double>(compute) * (offloaded == n_layer ? 0.25 : 1.0));
+
+    estimate.total = estimate.weights + estimate.kv_cache + estimate.compute;
+    estimate.anonymous = estimate.kv_cache + estimate.compute + (use_mmap ? 0 : estimate.weights);
+    return estimate;
+}
+
+MemoryPlan plan_memory(const ModelMetadata &model, const MemoryPlanRequest &request, const SystemMemory &system) {
+    MemoryPlan plan;
+    plan.available_bytes = system.available;
+    plan.total_system_bytes = system.total;
+
+    // Keep a slice of free RAM for Godot itself, textures and the OS.
+    const uint64_t margin = system.available > 0 ? std::min<uint64_t>(system.available / 10, kGiB) : 0;
+    const uint64_t swap_limit = system.available > 0 ? system.available - margin : std::numeric_limits<uint64_t>::max();
+    const uint64_t resident_limit = request.budget_bytes > 0 ? request.budget_bytes : swap_limit;
+    plan.limit_bytes = std::min(resident_limit, swap_limit);
+
+    std::vector<int32_t> contexts;
+    if (request.context_size > 0) {
+        contexts.push_back(request.context_size);
+    } else {
+        int32_t top = request.max_context_size > 0 ? request.max_context_size : 8192;
+        if (model.n_ctx_train > 0) {
+            top = std::min(top, model.n_ctx_train);
+        }
+        for (int32_t n_ctx = top; n_ctx >= kSmallestContext; n_ctx /= 2) {
+            contexts.push_back(n_ctx);
+        }
+        if (contexts.empty()) {
+            contexts.push_back(std::max(top, 1));
+        }
+    }
+
+    std::vector<KvCacheType> preferred_types;
+    std::vector<KvCacheType> fallback_types;
+    KvCacheType forced = KvCacheType::F16;
+    if (!request.cache_type.empty() && request.cache_type != "auto" && parse_kv_cache_type(request.cache_type, forced)) {
+        if (forced != KvCacheType::F16 && request.flash_attn == 0) {
+            plan.reason = "quantized KV cache requires flash attention";
+            return plan;
+        }
+        preferred_types.push_back(forced);
+    } else {
+        preferred_types = {KvCacheType::F16, KvCacheType::Q8_0};
+        fallback_types = {KvCacheType::Q4_0};
+    }
+
+    std::vector<int32_t> ubatches;
+    if (request.ubatch_size > 0) {
+        ubatches.push_back(request.ubatch_size);
+    } else {
+        ubatches = {512, 256, 128};
+    }
+
+    struct Candidate {
+        int32_t n_ctx = 0;
+        KvCacheType type = KvCacheType::F16;
+        int32_t ubatch = 0;
+        int32_t flash_attn = -1;
+        MemoryEstimate estimate;
+    };
+
+    auto evaluate = [&](int32_t n_ctx, KvCacheType type, int32_t ubatch, Candidate &out) {
+        // llama.cpp only supports a quantized V cache with flash attention.
+        int32_t flash = request.flash_attn;
+        if (type != KvCacheType::F16) {
+            if (request.flash_attn == 0) {
+                return false;
+            }
+            flash = 1;
+        }
+        const int32_t batch = request.batch_size > 0 ? std::min(request.batch_size, n_ctx) : std::min(n_ctx, kDefaultMaxBatch);
+        out = {n_ctx, type, std::min(ubatch, batch), flash,
+               estimate_memory(model, n_ctx, std::min(ubatch, batch), type, type, flash == 1,
+                               request.n_seq, request.n_gpu_layers, request.use_mmap)};
+        // Contexts in a pool share the weights but not their KV cache or compute buffers.
+        const uint64_t contexts = static_cast<uint64_t>(std::max(request.n_contexts, 1));
+        MemoryEstimate &estimate = out.estimate;
+        estimate.kv_cache *= contexts;
+        estimate.compute *= contexts;
+        estimate.total = estimate.weights + estimate.kv_cache + estimate.compute;
+        estimate.anonymous = estimate.kv_cache + estimate.compute + (request.use_mmap ? 0 : estimate.weights);
+        return true;
+    };
+
+    auto search = [&](bool above_min, const std::vector<KvCacheType> &types, bool ignore_resident, Candidate &found) {
+        for (int32_t n_ctx : contexts) {
+            const bool is_above = request.context_size > 0 || n_ctx >= request.min_context_size;
+            if (is_above != above_min) {
+                continue;
+            }
+            for (KvCacheType type : types) {
+                for (int32_t ubatch : ubatches) {
+                    Candidate candidate;
+                    if (!evaluate(n_ctx, type, ubatch, candidate)) {
+                        continue;
+                    }
+                    const bool fits_swap = candidate.estimate.anonymous <= swap_limit;
+                    const bool fits_resident = candidate.estimate.total <= resident_limit;
+                    if (fits_swap && (fits_resident || ignore_resident)) {
+                        found = candidate;
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    };
+
+    std::vector<KvCacheType> all_types = preferred_types;
+    all_types.insert(all_types.end(), fallback_types.begin(), fallback_types.end());
+
+    Candidate chosen;
+    bool found = search(true, preferred_types, false, chosen) ||
+                 (!fallback_types.empty() && search(true, fallback_types, false, chosen)) ||
+                 search(false, all_types, false, chosen);
+    if (found && chosen.n_ctx < request.min_context_size && request.context_size <= 0) {
+        plan.warnings.push_back("context reduced below min_context_size to fit the memory budget");
+    }
+    if (!found && request.budget_bytes == 0) {
+        // No explicit budget: mmap'd weights that overflow free RAM thrash the page cache
+        // but do not swap, so accept the best plan whose anonymous memory still fits.
+        found = search(true, all_types, true, chosen) || search(false, all_types, true, chosen);
+        if (found) {
+            plan.warnings.push_back("model weights exceed free RAM; expect page-cache thrashing");
+        }
+    }
+
+    if (!found) {
+        // The smallest type llama.cpp accepts here; quantized ones drop out with flash_attn off.
+        Candidate smallest;
+        for (auto type = all_types.rbegin(); type != all_types.rend(); ++type) {
+            if (evaluate(contexts.back(), *type, ubatches.back(), smallest)) {
+                break;
+            }
+        }
+        plan.predicted = smallest.estimate;
+        std::ostringstream reason;
+        reason << "smallest configuration (n_ctx=" << smallest.n_ctx << ", kv=" << kv_cache_type_name(smallest.type)
+               << ") needs " << format_mib(smallest.estimate.total) << " resident / "
+               << format_mib(smallest.estimate.anonymous) << " anonymous, limit " << format_mib(plan.limit_bytes);
+        plan.reason = reason.str();
+        return plan;
+    }
+
+    plan.ok = true;
+    plan.context_size = chosen.n_ctx;
+    plan.batch_size = request.batch_size > 0 ? std::min(request.batch_size, chosen.n_ctx)
+                                             : std::min(chosen.n_ctx, kDefaultMaxBatch);
+    plan.ubatch_size = chosen.ubatch;
+    plan.type_k = chosen.type;
+    plan.type_v = chosen.type;
+    plan.flash_attn = chosen.flash_attn;
+    plan.predicted = chosen.estimate;
+    return plan;
+}
+
+} // namespace local_agents::runtime
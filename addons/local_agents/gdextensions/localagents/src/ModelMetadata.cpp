@@ -0,0 +1,118 @@
+#include "ModelMetadata.hpp"
+
+#include <gguf.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+
+namespace local_agents::runtime {
+
+namespace {
+// Scalar hyperparameters are u32 in most GGUFs, but a few architectures store per-layer
+// arrays (e.g. head_count_kv on hybrid models); take the largest entry so KV sizing is an
+// upper bound.
+int64_t read_integer(const gguf_context *ctx, const std::string &key, int64_t fallback) {
+    const int64_t id = gguf_find_key(ctx, key.c_str());
+    if (id < 0) {
+        return fallback;
+    }
+    switch (gguf_get_kv_type(ctx, id)) {
+        case GGUF_TYPE_UINT8: return gguf_get_val_u8(ctx, id);
+        case GGUF_TYPE_INT8: return gguf_get_val_i8(ctx, id);
+        case GGUF_TYPE_UINT16: return gguf_get_val_u16(ctx, id);
+        case GGUF_TYPE_INT16: return gguf_get_val_i16(ctx, id);
+        case GGUF_TYPE_UINT32: return gguf_get_val_u32(ctx, id);
+        case GGUF_TYPE_INT32: return gguf_get_val_i32(ctx, id);
+        case GGUF_TYPE_UINT64: return static_cast<int64_t>(gguf_get_val_u64(ctx, id));
+        case GGUF_TYPE_INT64: return gguf_get_val_i64(ctx, id);
+        case GGUF_TYPE_ARRAY: {
+            const size_t count = gguf_get_arr_n(ctx, id);
+            const void *data = gguf_get_arr_data(ctx, id);
+            int64_t best = fallback;
+            for (size_t i = 0; i < count && data; ++i) {
+                int64_t value = fallback;
+                switch (gguf_get_arr_type(ctx, id)) {
+                    case GGUF_TYPE_UINT32: value = static_cast<const uint32_t *>(data)[i]; break;
+                    case GGUF_TYPE_INT32: value = static_cast<const int32_t *>(data)[i]; break;
+                    default: return fallback;
+                }
+                best = i == 0 ? value : std::max(best, value);
+            }
+            return best;
+        }
+        default:
+            return fallback;
+    }
+}
+
+int32_t layer_of(const char *name) {
+    if (std::strncmp(name, "blk.", 4) != 0) {
+        return -1;
+    }
+    char *end = nullptr;
+    const long layer = std::strtol(name + 4, &end, 10);
+    return end != name + 4 ? static_cast<int32_t>(layer) : -1;
+}
+} // namespace
+
+bool read_model_metadata(const std::string &path, ModelMetadata &out, std::string &error) {
+    out = ModelMetadata();
+
+    gguf_init_params params;
+    params.no_alloc = true;
+    params.ctx = nullptr;
+    gguf_context *ctx = gguf_init_from_file(path.c_str(), params);
+    if (!ctx) {
+        error = "failed to read gguf header: " + path;
+        return false;
+    }
+
+    const int64_t arch_id = gguf_find_key(ctx, "general.architecture");
+    if (arch_id >= 0 && gguf_get_kv_type(ctx, arch_id) == GGUF_TYPE_STRING) {
+        out.architecture = gguf_get_val_str(ctx, arch_id);
+    }
+    const std::string prefix = out.architecture + ".";
+
+    out.n_layer = static_cast<int32_t>(read_integer(ctx, prefix + "block_count", 0));
+    out.n_embd = static_cast<int32_t>(read_integer(ctx, prefix + "embedding_length", 0));
+    out.n_ff = static_cast<int32_t>(read_integer(ctx, prefix + "feed_forward_length", 4 * out.n_embd));
+    out.n_head = static_cast<int32_t>(read_integer(ctx, prefix + "attention.head_count", 0));
+    out.n_head_kv = static_cast<int32_t>(read_integer(ctx, prefix + "attention.head_count_kv", out.n_head));
+    const int32_t head_dim = out.n_head > 0 ? out.n_embd / out.n_head : 0;
+    out.n_embd_head_k = static_cast<int32_t>(read_integer(ctx, prefix + "attention.key_length", head_dim));
+    out.n_embd_head_v = static_cast<int32_t>(read_integer(ctx, prefix + "attention.value_length", head_dim));
+    out.n_ctx_train = static_cast<int32_t>(read_integer(ctx, prefix + "context_length", 0));
+
+    const int64_t tokens_id = gguf_find_key(ctx, "tokenizer.ggml.tokens");
+    out.n_vocab = tokens_id >= 0 ? static_cast<int32_t>(gguf_get_arr_n(ctx, tokens_id))
+                                 : static_cast<int32_t>(read_integer(ctx, prefix + "vocab_size", 0));
+
+    out.data_offset = gguf_get_data_offset(ctx);
+    const int64_t n_tensors = gguf_get_n_tensors(ctx);
+    out.tensors.reserve(static_cast<size_t>(std::max<int64_t>(n_tensors, 0)));
+    for (int64_t i = 0; i < n_tensors; ++i) {
+        TensorExtent tensor;
+        const char *name = gguf_get_tensor_name(ctx, i);
+        tensor.name = name ? name : "";
+        tensor.offset = out.data_offset + gguf_get_tensor_offset(ctx, i);
+        tensor.size = gguf_get_tensor_size(ctx, i);
+        tensor.layer = name ? layer_of(name) : -1;
+        out.weights_bytes += tensor.size;
+        out.tensors.push_back(std::move(tensor));
+    }
+    gguf_free(ctx);
+
+    std::error_code ec;
+    const uintmax_t size = std::filesystem::file_size(std::filesystem::u8path(path), ec);
+    out.file_size = ec ? out.data_offset + out.weights_bytes : static_cast<uint64_t>(size);
+
+    if (out.n_layer <= 0 || out.n_embd <= 0 || out.n_head <= 0) {
+        error = "gguf is missing " + prefix + "block_count/embedding_length/attention.head_count";
+        return false;
+    }
+    return true;
+}
+
+} // namespace local_agents::runtime
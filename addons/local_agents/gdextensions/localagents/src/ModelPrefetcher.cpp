@@ -0,0 +1,398 @@
+#include "ModelPrefetcher.hpp"
+
+#include "MemoryPlanner.hpp"
+#include "ModelMetadata.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <map>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr uint64_t kTouchChunk = 8ull * 1024ull * 1024ull;
+// GGUF pads tensor data to its alignment; treat gaps this small as contiguous.
+constexpr uint64_t kMergeGap = 4096;
+
+int64_t now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+uint64_t page_size() {
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return static_cast<uint64_t>(info.dwPageSize);
+#else
+    const long size = sysconf(_SC_PAGESIZE);
+    return size > 0 ? static_cast<uint64_t>(size) : 4096ull;
+#endif
+}
+
+void advise_willneed(const uint8_t *address, uint64_t length) {
+#if defined(_WIN32)
+    (void)address;
+    (void)length;
+#else
+    madvise(const_cast<uint8_t *>(address), static_cast<size_t>(length), MADV_WILLNEED);
+#endif
+}
+
+bool lock_pages(const uint8_t *address, uint64_t length, std::string &error) {
+#if defined(_WIN32)
+    if (!VirtualLock(const_cast<uint8_t *>(address), static_cast<SIZE_T>(length))) {
+        error = "VirtualLock failed (error " + std::to_string(GetLastError()) + "); raise the working set size";
+        return false;
+    }
+#else
+    if (mlock(address, static_cast<size_t>(length)) != 0) {
+        error = std::string("mlock failed: ") + std::strerror(errno) + " (check RLIMIT_MEMLOCK)";
+        return false;
+    }
+#endif
+    return true;
+}
+
+void unlock_pages(const uint8_t *address, uint64_t length) {
+#if defined(_WIN32)
+    VirtualUnlock(const_cast<uint8_t *>(address), static_cast<SIZE_T>(length));
+#else
+    munlock(address, static_cast<size_t>(length));
+#endif
+}
+
+bool starts_with(const std::string &value, const char *prefix) {
+    return value.rfind(prefix, 0) == 0;
+}
+} // namespace
+
+const char *prefetch_state_name(PrefetchState state) {
+    switch (state) {
+        case PrefetchState::Running: return "running";
+        case PrefetchState::Done: return "done";
+        case PrefetchState::Cancelled: return "cancelled";
+        case PrefetchState::Failed: return "failed";
+        case PrefetchState::Idle:
+        default: return "idle";
+    }
+}
+
+ModelPrefetcher::~ModelPrefetcher() {
+    stop();
+}
+
+void ModelPrefetcher::start(const std::string &path, const PrefetchOptions &options) {
+    stop();
+    {
+        std::scoped_lock lock(mutex_);
+        path_ = path;
+        error_.clear();
+    }
+    cancel_.store(false);
+    bytes_total_.store(0);
+    bytes_done_.store(0);
+    locked_bytes_.store(0);
+    layers_total_.store(0);
+    layers_done_.store(0);
+    started_us_.store(now_us());
+    finished_us_.store(0);
+    state_.store(static_cast<int>(PrefetchState::Running));
+    thread_ = std::thread(&ModelPrefetcher::run, this, path, options);
+}
+
+void ModelPrefetcher::stop() {
+    cancel_.store(true);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::scoped_lock lock(mutex_);
+    for (const auto &[address, length] : locked_) {
+        unlock_pages(address, length);
+    }
+    locked_.clear();
+    locked_bytes_.store(0);
+    unmap_file_locked();
+    if (state_.load() == static_cast<int>(PrefetchState::Running)) {
+        state_.store(static_cast<int>(PrefetchState::Cancelled));
+    }
+}
+
+PrefetchStatus ModelPrefetcher::status() const {
+    PrefetchStatus status;
+    status.state = static_cast<PrefetchState>(state_.load());
+    status.bytes_total = bytes_total_.load();
+    status.bytes_done = bytes_done_.load();
+    status.locked_bytes = locked_bytes_.load();
+    status.layers_total = layers_total_.load();
+    status.layers_done = layers_done_.load();
+    const int64_t started = started_us_.load();
+    const int64_t finished = finished_us_.load();
+    if (started > 0) {
+        status.elapsed_ms = static_cast<double>((finished > 0 ? finished : now_us()) - started) / 1000.0;
+    }
+    std::scoped_lock lock(mutex_);
+    status.path = path_;
+    status.error = error_;
+    return status;
+}
+
+void ModelPrefetcher::set_state(PrefetchState state, const std::string &error) {
+    if (!error.empty()) {
+        std::scoped_lock lock(mutex_);
+        error_ = error;
+    }
+    finished_us_.store(now_us());
+    state_.store(static_cast<int>(state));
+}
+
+void ModelPrefetcher::run(std::string path, PrefetchOptions options) {
+    ModelMetadata metadata;
+    std::string error;
+    if (!read_model_metadata(path, metadata, error)) {
+        set_state(PrefetchState::Failed, error);
+        return;
+    }
+
+    // Prefetch order follows a forward pass; blocks keep their layer index, the token
+    // embeddings go first and the remaining globals (output norm/head) last.
+    std::map<int32_t, Group> groups;
+    for (const TensorExtent &tensor : metadata.tensors) {
+        int32_t order = tensor.layer;
+        if (order < 0) {
+            order = starts_with(tensor.name, "token_embd") ? -1 : metadata.n_layer;
+        }
+        Group &group = groups[order];
+        group.order = order;
+        group.ranges.push_back({tensor.offset, tensor.size});
+        group.bytes += tensor.size;
+    }
+    uint64_t total = 0;
+    for (auto &[order, group] : groups) {
+        std::sort(group.ranges.begin(), group.ranges.end(),
+                  [](const Range &a, const Range &b) { return a.offset < b.offset; });
+        std::vector<Range> merged;
+        for (const Range &range : group.ranges) {
+            if (!merged.empty() && range.offset <= merged.back().offset + merged.back().size + kMergeGap) {
+                const uint64_t end = std::max(merged.back().offset + merged.back().size, range.offset + range.size);
+                merged.back().size = end - merged.back().offset;
+            } else {
+                merged.push_back(range);
+            }
+        }
+        group.ranges = std::move(merged);
+        total += group.bytes;
+    }
+    bytes_total_.store(total);
+    layers_total_.store(static_cast<int32_t>(groups.size()));
+
+    uint64_t max_bytes = options.max_bytes;
+    if (max_bytes == 0) {
+        // Reading past free RAM would only evict what was just read.
+        const SystemMemory memory = query_system_memory();
+        if (memory.available > 0) {
+            max_bytes = memory.available - std::min<uint64_t>(memory.available / 10, 1ull << 30);
+        }
+    }
+
+    bool mapped = false;
+    {
+        std::scoped_lock lock(mutex_);
+        mapped = map_file_locked(path, error);
+        if (!mapped) {
+            unmap_file_locked();
+        }
+    }
+    if (!mapped) {
+        set_state(PrefetchState::Failed, error);
+        return;
+    }
+
+    const uint64_t page = page_size();
+    std::string warning;
+    volatile uint8_t sink = 0;
+    bool budget_hit = false;
+    for (const auto &[order, group] : groups) {
+        for (const Range &range : group.ranges) {
+            const uint64_t begin = (range.offset / page) * page;
+            const uint64_t end = std::min(range.offset + range.size, mapping_size_);
+            if (begin >= end) {
+                continue;
+            }
+            advise_willneed(mapping_ + begin, end - begin);
+            // WILLNEED only queues readahead; touching one byte per page makes the read
+            // synchronous here instead of on the inference thread.
+            for (uint64_t offset = begin; offset < end; offset += kTouchChunk) {
+                if (cancel_.load()) {
+                    set_state(PrefetchState::Cancelled);
+                    return;
+                }
+                const uint64_t chunk_end = std::min(offset + kTouchChunk, end);
+                for (uint64_t at = offset; at < chunk_end; at += page) {
+                    sink = static_cast<uint8_t>(sink + mapping_[at]);
+                }
+                const uint64_t read = chunk_end - std::max(offset, range.offset);
+                const uint64_t done = bytes_done_.fetch_add(read) + read;
+                if (max_bytes > 0 && done >= max_bytes) {
+                    budget_hit = true;
+                    break;
+                }
+            }
+            if (budget_hit) {
+                break;
+            }
+        }
+        if (budget_hit) {
+            warning = "stopped at the free-RAM limit; the rest of the model stays cold";
+            break;
+        }
+        layers_done_.fetch_add(1);
+    }
+
+    if (options.mlock_budget_bytes > 0) {
+        // Hottest first: the output head and norms run for every sampled token, then blocks
+        // from the first layer up; token embeddings are only gathered a row at a time.
+        std::vector<const Group *> hot;
+        for (const auto &[order, group] : groups) {
+            hot.push_back(&group);
+        }
+        const int32_t tail = metadata.n_layer;
+        std::stable_sort(hot.begin(), hot.end(), [tail](const Group *a, const Group *b) {
+            auto rank = [tail](const Group *group) {
+                return group->order == tail ? -2 : (group->order == -1 ? tail + 1 : group->order);
+            };
+            return rank(a) < rank(b);
+        });
+
+        std::scoped_lock lock(mutex_);
+        uint64_t locked = 0;
+        for (const Group *group : hot) {
+            if (locked + group->bytes > options.mlock_budget_bytes || cancel_.load()) {
+                break;
+            }
+            bool ok = true;
+            for (const Range &range : group->ranges) {
+                const uint64_t begin = (range.offset / page) * page;
+                const uint64_t end = std::min(range.offset + range.size, mapping_size_);
+                if (begin >= end) {
+                    continue;
+                }
+                std::string lock_error;
+                if (!lock_pages(mapping_ + begin, end - begin, lock_error)) {
+                    warning = lock_error;
+                    ok = false;
+                    break;
+                }
+                locked_.emplace_back(mapping_ + begin, end - begin);
+            }
+            if (!ok) {
+                break;
+            }
+            locked += group->bytes;
+            locked_bytes_.store(locked);
+        }
+        if (locked_.empty()) {
+            unmap_file_locked();
+        }
+    } else {
+        std::scoped_lock lock(mutex_);
+        unmap_file_locked();
+    }
+
+    set_state(PrefetchState::Done, warning);
+}
+
+bool ModelPrefetcher::map_file_locked(const std::string &path, std::string &error) {
+#if defined(_WIN32)
+    const int wide_size = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, nullptr, 0);
+    std::wstring wide(static_cast<size_t>(std::max(wide_size, 1)), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, path.c_str(), -1, wide.data(), wide_size);
+    HANDLE file = CreateFileW(wide.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        error = "failed to open " + path;
+        return false;
+    }
+    file_handle_ = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+        error = "failed to stat " + path;
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        error = "failed to map " + path;
+        return false;
+    }
+    mapping_handle_ = mapping;
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        error = "failed to map " + path;
+        return false;
+    }
+    mapping_ = static_cast<const uint8_t *>(view);
+    mapping_size_ = static_cast<uint64_t>(size.QuadPart);
+#else
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        error = "failed to open " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd_, &info) != 0 || info.st_size <= 0) {
+        error = "failed to stat " + path;
+        return false;
+    }
+    void *view = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd_, 0);
+    if (view == MAP_FAILED) {
+        error = "failed to map " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    mapping_ = static_cast<const uint8_t *>(view);
+    mapping_size_ = static_cast<uint64_t>(info.st_size);
+#endif
+    return true;
+}
+
+void ModelPrefetcher::unmap_file_locked() {
+#if defined(_WIN32)
+    if (mapping_) {
+        UnmapViewOfFile(mapping_);
+    }
+    if (mapping_handle_) {
+        CloseHandle(static_cast<HANDLE>(mapping_handle_));
+        mapping_handle_ = nullptr;
+    }
+    if (file_handle_) {
+        CloseHandle(static_cast<HANDLE>(file_handle_));
+        file_handle_ = nullptr;
+    }
+#else
+    if (mapping_) {
+        munmap(const_cast<uint8_t *>(mapping_), static_cast<size_t>(mapping_size_));
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+#endif
+    mapping_ = nullptr;
+    mapping_size_ = 0;
+}
+
+} // namespace local_agents::runtime
@@ -1,5 +1,7 @@
 #include "NetworkGraph.hpp"
 
+#include "RuntimeMetrics.hpp"
+
 #include <godot_cpp/classes/json.hpp>
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
@@ -13,6 +15,8 @@
 #include <numeric>
 
 using namespace godot;
+using local_agents::runtime::RuntimeMetrics;
+using local_agents::runtime::ScopedLatency;
 
 namespace {
 constexpr float kEpsilon = 1e-8f;
@@ -373,6 +377,7 @@ bool NetworkGraph::remove_node(int64_t node_id) {
 }
 
 Dictionary NetworkGraph::get_node(int64_t node_id) const {
+    ScopedLatency query_timer(RuntimeMetrics::get().graph_query_us);
     std::scoped_lock lock(mutex_);
     Dictionary result;
     if (!db_) {
@@ -402,6 +407,7 @@ Dictionary NetworkGraph::get_node(int64_t node_id) const {
 }
 
 TypedArray<Dictionary> NetworkGraph::list_nodes(const String &space, int64_t limit, int64_t offset) const {
+    ScopedLatency query_timer(RuntimeMetrics::get().graph_query_us);
     std::scoped_lock lock(mutex_);
     TypedArray<Dictionary> rows;
     if (!db_) {
@@ -444,6 +450,7 @@ LIMIT ?2 OFFSET ?3;
 
 TypedArray<Dictionary> NetworkGraph::list_nodes_by_metadata(const String &space, const String &key, const Variant &value,
                                                            int64_t limit, int64_t offset) const {
+    ScopedLatency query_timer(RuntimeMetrics::get().graph_query_us);
     std::scoped_lock lock(mutex_);
     TypedArray<Dictionary> rows;
     if (!db_) {
@@ -548,6 +555,7 @@ bool NetworkGraph::remove_edge(int64_t edge_id) {
 }
 
 TypedArray<Dictionary> NetworkGraph::get_edges(int64_t node_id, int64_t limit) const {
+    ScopedLatency query_timer(RuntimeMetrics::get().graph_query_us);
     std::scoped_lock lock(mutex_);
     TypedArray<Dictionary> rows;
     if (!db_) {
@@ -667,6 +675,7 @@ INSERT INTO embeddings(node_id, dim, norm, vector, metadata) VALUES(?1, ?2, ?3,
 }
 
 TypedArray<Dictionary> NetworkGraph::search_embeddings(const PackedFloat32Array &query, int64_t top_k, int64_t expand, const String &strategy) const {
+    ScopedLatency query_timer(RuntimeMetrics::get().graph_query_us);
     std::scoped_lock lock(mutex_);
     TypedArray<Dictionary> results;
     if (!db_ || query.is_empty() || embeddings_.empty()) {
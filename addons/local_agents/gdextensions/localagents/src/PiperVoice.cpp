@@ -0,0 +1,222 @@
+#include "PiperVoice.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr const char *kUtteranceDoneMarker = "Real-time factor";
+constexpr int32_t kPollMs = 20;
+
+// Voice configs carry {"audio": {"sample_rate": N, ...}}; "sample_rate" appears nowhere else
+// in them, so a key search is enough.
+int32_t read_sample_rate(const std::string &config_path, int32_t fallback) {
+    std::ifstream stream(config_path);
+    if (!stream) {
+        return fallback;
+    }
+    const std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    const size_t key = text.find("\"sample_rate\"");
+    if (key == std::string::npos) {
+        return fallback;
+    }
+    const size_t colon = text.find(':', key);
+    if (colon == std::string::npos) {
+        return fallback;
+    }
+    const long rate = std::strtol(text.c_str() + colon + 1, nullptr, 10);
+    return rate > 0 ? static_cast<int32_t>(rate) : fallback;
+}
+} // namespace
+
+PiperVoice::~PiperVoice() {
+    stop();
+}
+
+bool PiperVoice::start(const PiperVoiceOptions &options, std::string &error) {
+    std::scoped_lock lock(mutex_);
+    stop_locked();
+    options_ = options;
+    sample_rate_ = read_sample_rate(options.config.empty() ? options.model + ".json" : options.config, 22050);
+
+    std::vector<std::string> argv = {options.binary, "--model", options.model};
+    if (!options.config.empty()) {
+        argv.insert(argv.end(), {"--config", options.config});
+    }
+    if (!options.espeak_data.empty()) {
+        argv.insert(argv.end(), {"--espeak_data", options.espeak_data});
+    }
+    if (!options.tashkeel_model.empty()) {
+        argv.insert(argv.end(), {"--tashkeel_model", options.tashkeel_model});
+    }
+    if (options.speaker >= 0) {
+        argv.insert(argv.end(), {"--speaker", std::to_string(options.speaker)});
+    }
+    if (options.length_scale > 0.0f) {
+        argv.insert(argv.end(), {"--length_scale", std::to_string(options.length_scale)});
+    }
+    if (options.noise_scale > 0.0f) {
+        argv.insert(argv.end(), {"--noise_scale", std::to_string(options.noise_scale)});
+    }
+    if (options.noise_w > 0.0f) {
+        argv.insert(argv.end(), {"--noise_w", std::to_string(options.noise_w)});
+    }
+    argv.push_back("--output_raw");
+
+    {
+        std::scoped_lock status(status_mutex_);
+        utterances_done_ = 0;
+        exited_ = false;
+        last_log_.clear();
+    }
+    if (!process_.start(argv, error)) {
+        std::scoped_lock status(status_mutex_);
+        exited_ = true;
+        error = "piper_spawn_failed";
+        return false;
+    }
+    stderr_thread_ = std::thread(&PiperVoice::read_stderr, this);
+    return true;
+}
+
+void PiperVoice::stop() {
+    std::scoped_lock lock(mutex_);
+    stop_locked();
+}
+
+void PiperVoice::stop_locked() {
+    process_.terminate();
+    // The kill closes piper's end of stderr, so the reader sees end of stream.
+    if (stderr_thread_.joinable()) {
+        stderr_thread_.join();
+    }
+    std::scoped_lock status(status_mutex_);
+    exited_ = true;
+}
+
+bool PiperVoice::running() const {
+    std::scoped_lock status(status_mutex_);
+    return !exited_;
+}
+
+void PiperVoice::read_stderr() {
+    std::array<char, 1024> buffer{};
+    std::string line;
+    for (;;) {
+        const int64_t read = process_.read_stderr(buffer.data(), buffer.size());
+        if (read < 0) {
+            break;
+        }
+        for (int64_t i = 0; i < read; ++i) {
+            const char c = buffer[static_cast<size_t>(i)];
+            if (c != '\n') {
+                line.push_back(c);
+                continue;
+            }
+            std::scoped_lock status(status_mutex_);
+            if (line.find(kUtteranceDoneMarker) != std::string::npos) {
+                ++utterances_done_;
+            } else if (!line.empty() && line != "\r" && line.find("[info]") == std::string::npos &&
+                       line.find("[debug]") == std::string::npos) {
+                last_log_ = line; // reported if piper dies
+            }
+            line.clear();
+        }
+    }
+    std::scoped_lock status(status_mutex_);
+    exited_ = true;
+}
+
+bool PiperVoice::synthesize(const std::string &text, const PcmSink &sink, std::string &error) {
+    // Piper reads one utterance per line.
+    std::string line = text;
+    bool blank = true;
+    for (char &c : line) {
+        if (c == '\n' || c == '\r') {
+            c = ' ';
+        }
+        blank = blank && (c == ' ' || c == '\t');
+    }
+    if (blank) {
+        return true;
+    }
+    line.push_back('\n');
+
+    std::scoped_lock lock(mutex_);
+    uint64_t target = 0;
+    {
+        std::scoped_lock status(status_mutex_);
+        if (exited_) {
+            error = last_log_.empty() ? "piper_not_running" : "piper_exited: " + last_log_;
+            return false;
+        }
+        target = utterances_done_ + 1;
+    }
+    if (!process_.write_all(line.data(), line.size())) {
+        stop_locked();
+        error = "piper_write_failed";
+        return false;
+    }
+
+    std::array<char, 8192> bytes{};
+    size_t carry = 0; // a sample split across reads
+    std::vector<float> samples;
+    bool wanted = true;
+    auto last_activity = std::chrono::steady_clock::now();
+    for (;;) {
+        bool done = false;
+        {
+            std::scoped_lock status(status_mutex_);
+            done = utterances_done_ >= target;
+        }
+        // Once the marker is in, every byte of the utterance is already in the pipe: drain
+        // without waiting and stop at the first empty read.
+        const int64_t read = process_.read_stdout(bytes.data() + carry, bytes.size() - carry, done ? 0 : kPollMs);
+        if (read < 0) {
+            // End of stdout: piper exited. Once the reader has drained stderr we know whether
+            // it finished this line first.
+            stop_locked();
+            std::scoped_lock status(status_mutex_);
+            if (utterances_done_ >= target) {
+                return true;
+            }
+            error = last_log_.empty() ? "piper_exited" : "piper_exited: " + last_log_;
+            return false;
+        }
+        if (read == 0) {
+            if (done) {
+                return true;
+            }
+            if (std::chrono::steady_clock::now() - last_activity > std::chrono::milliseconds(options_.timeout_ms)) {
+                stop_locked();
+                error = "piper_timeout";
+                return false;
+            }
+            continue;
+        }
+        last_activity = std::chrono::steady_clock::now();
+
+        const size_t total = carry + static_cast<size_t>(read);
+        const size_t count = total / 2;
+        samples.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            const auto lo = static_cast<unsigned char>(bytes[2 * i]);
+            const auto hi = static_cast<unsigned char>(bytes[2 * i + 1]);
+            samples[i] = static_cast<float>(static_cast<int16_t>(lo | (hi << 8))) / 32768.0f;
+        }
+        carry = total & 1;
+        if (carry) {
+            bytes[0] = bytes[total - 1];
+        }
+        if (wanted && count > 0) {
+            wanted = sink(samples.data(), count);
+        }
+    }
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,218 @@
+#include "RuntimeMetrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace local_agents::runtime {
+
+namespace {
+int highest_bit(uint64_t value) {
+    int bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+}
+
+double micros_to_ms(double micros) {
+    return micros / 1000.0;
+}
+
+struct SampleDescriptor {
+    const char *name;
+    double (*read)(const RuntimeMetrics &);
+};
+
+const SampleDescriptor kSampleDescriptors[] = {
+    {"queue_depth", [](const RuntimeMetrics &m) { return static_cast<double>(m.queue_depth.get()); }},
+    {"in_flight", [](const RuntimeMetrics &m) { return static_cast<double>(m.in_flight.get()); }},
+    {"requests_total", [](const RuntimeMetrics &m) { return static_cast<double>(m.requests_total.get()); }},
+    {"request_errors", [](const RuntimeMetrics &m) { return static_cast<double>(m.request_errors.get()); }},
+    {"prompt_tokens_total", [](const RuntimeMetrics &m) { return static_cast<double>(m.prompt_tokens.get()); }},
+    {"completion_tokens_total", [](const RuntimeMetrics &m) { return static_cast<double>(m.completion_tokens.get()); }},
+    {"ttft_ms_p50", [](const RuntimeMetrics &m) { return micros_to_ms(m.ttft_us.percentile(50.0)); }},
+    {"ttft_ms_p99", [](const RuntimeMetrics &m) { return micros_to_ms(m.ttft_us.percentile(99.0)); }},
+    {"request_ms_p50", [](const RuntimeMetrics &m) { return micros_to_ms(m.request_us.percentile(50.0)); }},
+    {"request_ms_p99", [](const RuntimeMetrics &m) { return micros_to_ms(m.request_us.percentile(99.0)); }},
+    {"tokens_per_second", [](const RuntimeMetrics &m) { return m.decode_tokens_per_second.get(); }},
+    {"kv_cells_used", [](const RuntimeMetrics &m) { return static_cast<double>(m.kv_cells_used.get()); }},
+    {"kv_cells_total", [](const RuntimeMetrics &m) { return static_cast<double>(m.kv_cells_total.get()); }},
+    {"kv_occupancy", [](const RuntimeMetrics &m) {
+         const int64_t total = m.kv_cells_total.get();
+         return total > 0 ? static_cast<double>(m.kv_cells_used.get()) / static_cast<double>(total) : 0.0;
+     }},
+    {"embedding_requests", [](const RuntimeMetrics &m) { return static_cast<double>(m.embedding_requests.get()); }},
+    {"embedding_cache_hits", [](const RuntimeMetrics &m) { return static_cast<double>(m.embedding_cache_hits.get()); }},
+    {"embedding_cache_misses", [](const RuntimeMetrics &m) { return static_cast<double>(m.embedding_cache_misses.get()); }},
+    {"embedding_cache_hit_rate", [](const RuntimeMetrics &m) {
+         const double hits = static_cast<double>(m.embedding_cache_hits.get());
+         const double lookups = hits + static_cast<double>(m.embedding_cache_misses.get());
+         return lookups > 0.0 ? hits / lookups : 0.0;
+     }},
+    {"generation_cache_hits", [](const RuntimeMetrics &m) { return static_cast<double>(m.generation_cache_hits.get()); }},
+    {"generation_cache_misses", [](const RuntimeMetrics &m) { return static_cast<double>(m.generation_cache_misses.get()); }},
+    {"generation_requests_coalesced", [](const RuntimeMetrics &m) { return static_cast<double>(m.generation_requests_coalesced.get()); }},
+    {"generation_cache_hit_rate", [](const RuntimeMetrics &m) {
+         // Coalesced followers were served without a decode too.
+         const double saved = static_cast<double>(m.generation_cache_hits.get() + m.generation_requests_coalesced.get());
+         const double lookups = saved + static_cast<double>(m.generation_cache_misses.get());
+         return lookups > 0.0 ? saved / lookups : 0.0;
+     }},
+    {"graph_queries", [](const RuntimeMetrics &m) { return static_cast<double>(m.graph_query_us.count()); }},
+    {"graph_query_ms_p50", [](const RuntimeMetrics &m) { return micros_to_ms(m.graph_query_us.percentile(50.0)); }},
+    {"graph_query_ms_p99", [](const RuntimeMetrics &m) { return micros_to_ms(m.graph_query_us.percentile(99.0)); }},
+    {"transcriptions", [](const RuntimeMetrics &m) { return static_cast<double>(m.transcriptions.get()); }},
+    {"transcribe_ms_p50", [](const RuntimeMetrics &m) { return micros_to_ms(m.transcribe_us.percentile(50.0)); }},
+    {"transcribe_ms_p99", [](const RuntimeMetrics &m) { return micros_to_ms(m.transcribe_us.percentile(99.0)); }},
+    {"tts_cache_hits", [](const RuntimeMetrics &m) { return static_cast<double>(m.tts_cache_hits.get()); }},
+    {"tts_cache_misses", [](const RuntimeMetrics &m) { return static_cast<double>(m.tts_cache_misses.get()); }},
+};
+} // namespace
+
+int LatencyHistogram::bucket_index(uint64_t micros) {
+    if (micros < static_cast<uint64_t>(2 * kSubBucketCount)) {
+        return static_cast<int>(micros);
+    }
+    int exponent = highest_bit(micros) - kSubBucketBits;
+    if (exponent > kMaxExponent) {
+        return kBucketCount - 1;
+    }
+    return exponent * kSubBucketCount + static_cast<int>(micros >> exponent);
+}
+
+uint64_t LatencyHistogram::bucket_lower_bound(int index) {
+    if (index < 2 * kSubBucketCount) {
+        return static_cast<uint64_t>(std::max(index, 0));
+    }
+    const int exponent = index / kSubBucketCount - 1;
+    const uint64_t sub_bucket = static_cast<uint64_t>(index % kSubBucketCount + kSubBucketCount);
+    return sub_bucket << exponent;
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(int index) {
+    if (index < 2 * kSubBucketCount) {
+        return static_cast<uint64_t>(std::max(index, 0));
+    }
+    const int exponent = index / kSubBucketCount - 1;
+    const uint64_t sub_bucket = static_cast<uint64_t>(index % kSubBucketCount + kSubBucketCount);
+    return ((sub_bucket + 1) << exponent) - 1;
+}
+
+void LatencyHistogram::record(uint64_t micros) {
+    buckets_[static_cast<size_t>(bucket_index(micros))].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t previous = max_.load(std::memory_order_relaxed);
+    while (micros > previous && !max_.compare_exchange_weak(previous, micros, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset() {
+    for (std::atomic<uint64_t> &bucket : buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_.store(0, std::memory_order_relaxed);
+    max_.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean() const {
+    const uint64_t total = count();
+    if (total == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(sum_.load(std::memory_order_relaxed)) / static_cast<double>(total);
+}
+
+double LatencyHistogram::percentile(double p) const {
+    // Sum the buckets instead of trusting count_: concurrent writers may have bumped one
+    // but not yet the other, and the rank must be taken against what we actually scan.
+    uint64_t total = 0;
+    for (const std::atomic<uint64_t> &bucket : buckets_) {
+        total += bucket.load(std::memory_order_relaxed);
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    p = std::clamp(p, 0.0, 100.0);
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * static_cast<double>(total)));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t seen = 0;
+    for (int i = 0; i < kBucketCount; ++i) {
+        seen += buckets_[static_cast<size_t>(i)].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            const double lower = static_cast<double>(bucket_lower_bound(i));
+            const double upper = static_cast<double>(bucket_upper_bound(i));
+            return std::min((lower + upper) * 0.5, static_cast<double>(max()));
+        }
+    }
+    return static_cast<double>(max());
+}
+
+ScopedLatency::~ScopedLatency() {
+    histogram_.record(elapsed_micros(started_));
+}
+
+uint64_t elapsed_micros(std::chrono::steady_clock::time_point since) {
+    const auto elapsed = std::chrono::steady_clock::now() - since;
+    const int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    return micros > 0 ? static_cast<uint64_t>(micros) : 0;
+}
+
+RuntimeMetrics &RuntimeMetrics::get() {
+    static RuntimeMetrics metrics;
+    return metrics;
+}
+
+std::vector<RuntimeMetrics::Sample> RuntimeMetrics::samples() const {
+    std::vector<Sample> out;
+    out.reserve(std::size(kSampleDescriptors));
+    for (const SampleDescriptor &descriptor : kSampleDescriptors) {
+        out.push_back({descriptor.name, descriptor.read(*this)});
+    }
+    return out;
+}
+
+bool RuntimeMetrics::sample(const std::string &name, double &out) const {
+    for (const SampleDescriptor &descriptor : kSampleDescriptors) {
+        if (name == descriptor.name) {
+            out = descriptor.read(*this);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<const char *> RuntimeMetrics::sample_names() {
+    std::vector<const char *> names;
+    names.reserve(std::size(kSampleDescriptors));
+    for (const SampleDescriptor &descriptor : kSampleDescriptors) {
+        names.push_back(descriptor.name);
+    }
+    return names;
+}
+
+void RuntimeMetrics::reset() {
+    // Gauges describe live state (queue depth, in-flight, KV cells) and are left alone.
+    requests_total.reset();
+    request_errors.reset();
+    prompt_tokens.reset();
+    completion_tokens.reset();
+    ttft_us.reset();
+    request_us.reset();
+    decode_tokens_per_second.reset();
+    embedding_requests.reset();
+    embedding_cache_hits.reset();
+    embedding_cache_misses.reset();
+    generation_cache_hits.reset();
+    generation_cache_misses.reset();
+    generation_requests_coalesced.reset();
+    graph_query_us.reset();
+    transcriptions.reset();
+    transcribe_us.reset();
+    tts_cache_hits.reset();
+    tts_cache_misses.reset();
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,156 @@
+#include "ServerReply.hpp"
+
+#include <array>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr std::array<std::string_view, 9> kChatReplyFields = {
+    "id", "object", "created", "model", "choices", "usage", "error", "content", "output_text",
+};
+
+bool is_chat_reply_field(const std::string &key) {
+    for (std::string_view field : kChatReplyFields) {
+        if (key == field) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// SAX consumer that only looks at the first embedding array and the error message; every
+// other value is tokenized and dropped.
+class EmbeddingSax : public nlohmann::json_sax<ServerJson> {
+public:
+    explicit EmbeddingSax(std::vector<float> &out) : out_(out) {}
+
+    bool null() override { return value(); }
+    bool boolean(bool) override { return value(); }
+    bool number_integer(number_integer_t number) override { return number_value(static_cast<float>(number)); }
+    bool number_unsigned(number_unsigned_t number) override { return number_value(static_cast<float>(number)); }
+    bool number_float(number_float_t number, const string_t &) override {
+        return number_value(static_cast<float>(number));
+    }
+    bool string(string_t &text) override {
+        // {"error": {"message": "..."}} or {"error": "..."}
+        if ((path_.size() == 2 && path_[0].key == "error" && path_[1].key == "message") ||
+            (path_.size() == 1 && path_[0].key == "error")) {
+            error_message = text;
+        }
+        return value();
+    }
+    bool binary(binary_t &) override { return value(); }
+
+    bool start_object(std::size_t) override {
+        path_.push_back({false, std::string(), 0});
+        return true;
+    }
+    bool key(string_t &name) override {
+        path_.back().key = name;
+        return true;
+    }
+    bool end_object() override {
+        path_.pop_back();
+        return value();
+    }
+    bool start_array(std::size_t) override {
+        path_.push_back({true, std::string(), 0});
+        if (!done && in_embedding_array()) {
+            capturing_ = true;
+            out_.clear();
+        }
+        return true;
+    }
+    bool end_array() override {
+        if (capturing_ && in_embedding_array()) {
+            capturing_ = false;
+            done = true;
+        }
+        path_.pop_back();
+        return value();
+    }
+
+    bool parse_error(std::size_t, const std::string &, const nlohmann::detail::exception &) override {
+        failed = true;
+        return false;
+    }
+
+    bool done = false;
+    bool failed = false;
+    std::string error_message;
+
+private:
+    struct Level {
+        bool array;
+        std::string key; // current key when an object
+        size_t index;    // next element index when an array
+    };
+
+    // The innermost container is the array under `embedding` at the top level or inside the
+    // first element of `data`.
+    bool in_embedding_array() const {
+        if (path_.size() == 2) {
+            return path_[0].key == "embedding" && path_[1].array;
+        }
+        return path_.size() == 4 && path_[0].key == "data" && path_[1].array && path_[1].index == 0 &&
+               path_[2].key == "embedding";
+    }
+
+    bool value() {
+        if (!path_.empty() && path_.back().array) {
+            ++path_.back().index;
+        }
+        return true;
+    }
+
+    bool number_value(float number) {
+        if (capturing_ && in_embedding_array()) {
+            out_.push_back(number);
+        }
+        return value();
+    }
+
+    std::vector<float> &out_;
+    std::vector<Level> path_;
+    bool capturing_ = false;
+};
+} // namespace
+
+bool parse_chat_reply(std::string_view body, bool keep_all, ServerJson &out, std::string &error) {
+    std::string top_key;
+    ServerJson::parser_callback_t keep = [&](int depth, ServerJson::parse_event_t event, ServerJson &parsed) {
+        if (keep_all || event != ServerJson::parse_event_t::key) {
+            return true;
+        }
+        const std::string &key = parsed.get_ref<const std::string &>();
+        if (depth == 1) {
+            top_key = key;
+            return is_chat_reply_field(key);
+        }
+        // Keys of each choice object.
+        return !(depth == 3 && top_key == "choices" && key == "logprobs");
+    };
+    out = ServerJson::parse(body.begin(), body.end(), keep, false);
+    if (out.is_discarded() || !out.is_object()) {
+        error = "invalid_json_response";
+        return false;
+    }
+    return true;
+}
+
+bool parse_embedding_reply(std::string_view body, std::vector<float> &out, std::string &error) {
+    out.clear();
+    EmbeddingSax sax(out);
+    const bool parsed = ServerJson::sax_parse(body.begin(), body.end(), &sax);
+    if (!parsed || sax.failed) {
+        error = "invalid_json_response";
+        return false;
+    }
+    if (!sax.done || out.empty()) {
+        error = sax.error_message.empty() ? std::string("invalid_embedding_response") : sax.error_message;
+        return false;
+    }
+    return true;
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,284 @@
+#include "SharedThreadPool.hpp"
+
+#include <ggml.h>
+#include <ggml-cpu.h>
+#include <llama.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace local_agents::runtime {
+
+namespace {
+bool build_params(int32_t n_threads, const std::string &cpu_mask, const ThreadingOptions &options,
+                  ggml_threadpool_params &params, std::string &error) {
+    params = ggml_threadpool_params_default(n_threads);
+    params.prio = static_cast<enum ggml_sched_priority>(std::clamp(options.priority, 0, 3));
+    params.poll = static_cast<uint32_t>(std::clamp(options.poll, 0, 100));
+    params.strict_cpu = options.strict_cpu;
+    // Start parked: the first decode resumes the pool, and nothing spins before then.
+    params.paused = true;
+    if (!cpu_mask.empty() && !SharedThreadPool::parse_cpu_mask(cpu_mask, params.cpumask, GGML_MAX_N_THREADS, error)) {
+        return false;
+    }
+    return true;
+}
+
+// The index-th of `parts` contiguous runs of the CPUs set in `spec`, as a CPU list. Masks
+// that do not parse, or have fewer CPUs than parts, are returned as-is.
+std::string partition_mask(const std::string &spec, int32_t parts, int32_t index) {
+    if (spec.empty() || parts <= 1) {
+        return spec;
+    }
+    bool mask[GGML_MAX_N_THREADS];
+    std::string error;
+    if (!SharedThreadPool::parse_cpu_mask(spec, mask, GGML_MAX_N_THREADS, error)) {
+        return spec;
+    }
+    std::vector<int32_t> cpus;
+    for (int32_t cpu = 0; cpu < GGML_MAX_N_THREADS; ++cpu) {
+        if (mask[cpu]) {
+            cpus.push_back(cpu);
+        }
+    }
+    if (static_cast<int32_t>(cpus.size()) < parts) {
+        return spec;
+    }
+    const size_t begin = cpus.size() * static_cast<size_t>(index) / static_cast<size_t>(parts);
+    const size_t end = cpus.size() * static_cast<size_t>(index + 1) / static_cast<size_t>(parts);
+    std::string out;
+    for (size_t i = begin; i < end; ++i) {
+        out += (out.empty() ? "" : ",") + std::to_string(cpus[i]);
+    }
+    return out;
+}
+} // namespace
+
+SharedThreadPool::~SharedThreadPool() {
+    release();
+}
+
+int32_t SharedThreadPool::resolve_thread_count(int32_t requested, int32_t reserved) {
+    if (requested > 0) {
+        return requested;
+    }
+    const int32_t hardware = static_cast<int32_t>(std::thread::hardware_concurrency());
+    if (hardware <= 0) {
+        return 4;
+    }
+    return std::max(1, hardware - std::max(0, reserved));
+}
+
+ThreadingOptions SharedThreadPool::partition(const ThreadingOptions &options, int32_t parts, int32_t index) {
+    ThreadingOptions part = options;
+    if (parts <= 1) {
+        return part;
+    }
+    const int32_t n_threads = resolve_thread_count(options.n_threads, options.reserved_threads);
+    const int32_t n_threads_batch = options.n_threads_batch > 0 ? options.n_threads_batch
+                                                                : resolve_thread_count(0, options.reserved_threads);
+    part.n_threads = std::max(1, n_threads / parts);
+    part.n_threads_batch = std::max(1, n_threads_batch / parts);
+    part.cpu_mask = partition_mask(options.cpu_mask, parts, index);
+    part.cpu_mask_batch = partition_mask(options.cpu_mask_batch, parts, index);
+    return part;
+}
+
+bool SharedThreadPool::parse_cpu_mask(const std::string &spec, bool *mask, size_t size, std::string &error) {
+    std::fill(mask, mask + size, false);
+    if (spec.size() > 2 && spec[0] == '0' && (spec[1] == 'x' || spec[1] == 'X')) {
+        // Rightmost hex digit covers CPUs 0-3.
+        size_t cpu = 0;
+        for (size_t i = spec.size(); i-- > 2;) {
+            const char c = static_cast<char>(std::tolower(static_cast<unsigned char>(spec[i])));
+            int nibble = 0;
+            if (c >= '0' && c <= '9') {
+                nibble = c - '0';
+            } else if (c >= 'a' && c <= 'f') {
+                nibble = c - 'a' + 10;
+            } else {
+                error = "invalid cpu mask: " + spec;
+                return false;
+            }
+            for (int bit = 0; bit < 4; ++bit, ++cpu) {
+                if (cpu < size && (nibble & (1 << bit))) {
+                    mask[cpu] = true;
+                }
+            }
+        }
+        return true;
+    }
+
+    size_t start = 0;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) {
+            end = spec.size();
+        }
+        const std::string item = spec.substr(start, end - start);
+        if (!item.empty()) {
+            const size_t dash = item.find('-');
+            char *tail = nullptr;
+            const long first = std::strtol(item.c_str(), &tail, 10);
+            long last = first;
+            if (dash != std::string::npos) {
+                last = std::strtol(item.c_str() + dash + 1, &tail, 10);
+            }
+            if (tail == nullptr || *tail != '\0' || first < 0 || last < first || static_cast<size_t>(last) >= size) {
+                error = "invalid cpu range: " + item;
+                return false;
+            }
+            for (long cpu = first; cpu <= last; ++cpu) {
+                mask[cpu] = true;
+            }
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool SharedThreadPool::configure(const ThreadingOptions &options, std::string &error) {
+    std::scoped_lock lock(mutex_);
+    release_locked();
+
+    const int32_t n_threads = resolve_thread_count(options.n_threads, options.reserved_threads);
+    const int32_t n_threads_batch = options.n_threads_batch > 0 ? options.n_threads_batch
+                                                                : resolve_thread_count(0, options.reserved_threads);
+    const std::string &mask_batch = options.cpu_mask_batch.empty() ? options.cpu_mask : options.cpu_mask_batch;
+
+    ggml_threadpool_params params;
+    if (!build_params(n_threads, options.cpu_mask, options, params, error)) {
+        return false;
+    }
+    pool_ = ggml_threadpool_new(&params);
+    if (!pool_) {
+        error = "failed to create threadpool";
+        return false;
+    }
+
+    if (n_threads_batch == n_threads && mask_batch == options.cpu_mask) {
+        pool_batch_ = pool_;
+    } else {
+        ggml_threadpool_params batch_params;
+        if (!build_params(n_threads_batch, mask_batch, options, batch_params, error)) {
+            release_locked();
+            return false;
+        }
+        pool_batch_ = ggml_threadpool_new(&batch_params);
+        if (!pool_batch_) {
+            error = "failed to create batch threadpool";
+            release_locked();
+            return false;
+        }
+    }
+
+    options_ = options;
+    n_threads_ = n_threads;
+    n_threads_batch_ = n_threads_batch;
+    paused_ = true;
+    return true;
+}
+
+void SharedThreadPool::release() {
+    std::scoped_lock lock(mutex_);
+    release_locked();
+}
+
+void SharedThreadPool::release_locked() {
+    if (pool_batch_ && pool_batch_ != pool_) {
+        ggml_threadpool_free(pool_batch_);
+    }
+    if (pool_) {
+        ggml_threadpool_free(pool_);
+    }
+    pool_ = nullptr;
+    pool_batch_ = nullptr;
+    n_threads_ = 0;
+    n_threads_batch_ = 0;
+    paused_ = false;
+}
+
+bool SharedThreadPool::is_configured() const {
+    std::scoped_lock lock(mutex_);
+    return pool_ != nullptr;
+}
+
+void SharedThreadPool::attach(llama_context *context) const {
+    std::scoped_lock lock(mutex_);
+    if (!context || !pool_) {
+        return;
+    }
+    llama_attach_threadpool(context, pool_, pool_batch_);
+    llama_set_n_threads(context, n_threads_, n_threads_batch_);
+}
+
+void SharedThreadPool::detach(llama_context *context) {
+    if (context) {
+        llama_detach_threadpool(context);
+    }
+}
+
+void SharedThreadPool::pause() {
+    std::scoped_lock lock(mutex_);
+    held_ = true;
+    pause_locked();
+}
+
+void SharedThreadPool::pause_locked() {
+    if (!pool_ || paused_) {
+        return;
+    }
+    ggml_threadpool_pause(pool_);
+    if (pool_batch_ != pool_) {
+        ggml_threadpool_pause(pool_batch_);
+    }
+    paused_ = true;
+}
+
+void SharedThreadPool::resume() {
+    std::scoped_lock lock(mutex_);
+    held_ = false;
+    if (!pool_) {
+        return;
+    }
+    // Resuming a running pool is a no-op in ggml, so a stale paused_ is harmless here.
+    ggml_threadpool_resume(pool_);
+    if (pool_batch_ != pool_) {
+        ggml_threadpool_resume(pool_batch_);
+    }
+    paused_ = false;
+}
+
+void SharedThreadPool::on_idle() {
+    std::scoped_lock lock(mutex_);
+    // The decode that just finished resumed the pool on its own (ggml kicks paused pools).
+    paused_ = false;
+    if (options_.pause_when_idle || held_) {
+        pause_locked();
+    }
+}
+
+bool SharedThreadPool::is_paused() const {
+    std::scoped_lock lock(mutex_);
+    return paused_;
+}
+
+int32_t SharedThreadPool::n_threads() const {
+    std::scoped_lock lock(mutex_);
+    return n_threads_;
+}
+
+int32_t SharedThreadPool::n_threads_batch() const {
+    std::scoped_lock lock(mutex_);
+    return n_threads_batch_;
+}
+
+ThreadingOptions SharedThreadPool::options() const {
+    std::scoped_lock lock(mutex_);
+    return options_;
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,176 @@
+#include "SpeechEngine.hpp"
+
+#include "AudioPcm.hpp"
+#include "SharedThreadPool.hpp"
+
+#include <chrono>
+#include <utility>
+
+#ifdef LOCAL_AGENTS_WITH_WHISPER
+#include <whisper.h>
+#endif
+
+namespace local_agents::runtime {
+
+namespace {
+#ifdef LOCAL_AGENTS_WITH_WHISPER
+bool abort_requested(void *data) {
+    return static_cast<const std::atomic<bool> *>(data)->load(std::memory_order_relaxed);
+}
+
+void quiet_log(enum ggml_log_level, const char *, void *) {}
+#endif
+} // namespace
+
+SpeechEngine::~SpeechEngine() {
+    cancel();
+    std::scoped_lock lock(mutex_);
+    unload_locked();
+}
+
+bool SpeechEngine::available() {
+#ifdef LOCAL_AGENTS_WITH_WHISPER
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool SpeechEngine::load(const std::string &path, const SpeechModelOptions &options, std::string &error) {
+#ifdef LOCAL_AGENTS_WITH_WHISPER
+    std::scoped_lock lock(mutex_);
+    if (context_ && path_ == path) {
+        return true;
+    }
+    unload_locked();
+
+    // whisper prints every tensor while loading; llama.cpp's log stays as configured.
+    whisper_log_set(quiet_log, nullptr);
+    whisper_context_params params = whisper_context_default_params();
+    params.use_gpu = options.use_gpu;
+    params.flash_attn = options.flash_attn;
+    params.gpu_device = options.gpu_device;
+    context_ = whisper_init_from_file_with_params(path.c_str(), params);
+    if (!context_) {
+        error = "speech_model_load_failed";
+        return false;
+    }
+    path_ = path;
+    return true;
+#else
+    (void)path;
+    (void)options;
+    error = "whisper_not_linked";
+    return false;
+#endif
+}
+
+void SpeechEngine::unload() {
+    cancel();
+    std::scoped_lock lock(mutex_);
+    unload_locked();
+}
+
+void SpeechEngine::unload_locked() {
+#ifdef LOCAL_AGENTS_WITH_WHISPER
+    if (context_) {
+        whisper_free(context_);
+    }
+#endif
+    context_ = nullptr;
+    path_.clear();
+}
+
+bool SpeechEngine::is_loaded() const {
+    std::scoped_lock lock(mutex_);
+    return context_ != nullptr;
+}
+
+std::string SpeechEngine::model_path() const {
+    std::scoped_lock lock(mutex_);
+    return path_;
+}
+
+void SpeechEngine::cancel() {
+    cancelled_.store(true, std::memory_order_relaxed);
+}
+
+bool SpeechEngine::transcribe(const float *samples, size_t count, int32_t sample_rate, const TranscribeOptions &options,
+                              TranscribeResult &result, std::string &error) {
+#ifdef LOCAL_AGENTS_WITH_WHISPER
+    if (!samples || count == 0 || sample_rate <= 0) {
+        error = "missing_audio";
+        return false;
+    }
+    std::vector<float> resampled;
+    if (sample_rate != kSampleRate) {
+        resample_linear(samples, count, sample_rate, kSampleRate, resampled);
+        samples = resampled.data();
+        count = resampled.size();
+    }
+
+    std::scoped_lock lock(mutex_);
+    if (!context_) {
+        error = "speech_model_not_loaded";
+        return false;
+    }
+    cancelled_.store(false, std::memory_order_relaxed);
+
+    whisper_full_params params = whisper_full_default_params(
+        options.beam_size > 1 ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+    params.n_threads = SharedThreadPool::resolve_thread_count(options.n_threads, 2);
+    params.translate = options.translate;
+    params.language = options.language.empty() ? "en" : options.language.c_str();
+    params.detect_language = false;
+    params.no_timestamps = !options.timestamps;
+    params.single_segment = options.single_segment;
+    params.temperature = options.temperature;
+    params.initial_prompt = options.initial_prompt.empty() ? nullptr : options.initial_prompt.c_str();
+    if (options.beam_size > 1) {
+        params.beam_search.beam_size = options.beam_size;
+    }
+    params.print_progress = false;
+    params.print_realtime = false;
+    params.print_special = false;
+    params.print_timestamps = false;
+    params.abort_callback = abort_requested;
+    params.abort_callback_user_data = &cancelled_;
+
+    const auto started = std::chrono::steady_clock::now();
+    const int status = whisper_full(context_, params, samples, static_cast<int>(count));
+    if (status != 0) {
+        error = cancelled_.load(std::memory_order_relaxed) ? "cancelled" : "whisper_failed";
+        return false;
+    }
+
+    result = TranscribeResult();
+    const int segments = whisper_full_n_segments(context_);
+    result.segments.reserve(static_cast<size_t>(segments));
+    for (int i = 0; i < segments; ++i) {
+        TranscriptSegment segment;
+        segment.text = whisper_full_get_segment_text(context_, i);
+        // whisper timestamps count 10 ms frames.
+        segment.start_ms = whisper_full_get_segment_t0(context_, i) * 10;
+        segment.end_ms = whisper_full_get_segment_t1(context_, i) * 10;
+        result.text += segment.text;
+        result.segments.push_back(std::move(segment));
+    }
+    const int language = whisper_full_lang_id(context_);
+    if (language >= 0) {
+        result.language = whisper_lang_str(language);
+    }
+    result.audio_ms = static_cast<double>(count) * 1000.0 / kSampleRate;
+    result.encode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return true;
+#else
+    (void)samples;
+    (void)count;
+    (void)sample_rate;
+    (void)options;
+    (void)result;
+    error = "whisper_not_linked";
+    return false;
+#endif
+}
+
+} // namespace local_agents::runtime
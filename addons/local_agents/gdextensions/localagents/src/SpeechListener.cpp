@@ -0,0 +1,122 @@
+#include "SpeechListener.hpp"
+
+#include "AgentRuntime.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+
+using namespace godot;
+
+void SpeechListener::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("push_pcm", "pcm"), &SpeechListener::push_pcm);
+    ClassDB::bind_method(D_METHOD("push_frames", "frames"), &SpeechListener::push_frames);
+    ClassDB::bind_method(D_METHOD("capture", "effect"), &SpeechListener::capture);
+    ClassDB::bind_method(D_METHOD("flush"), &SpeechListener::flush);
+    ClassDB::bind_method(D_METHOD("reset"), &SpeechListener::reset);
+    ClassDB::bind_method(D_METHOD("is_speaking"), &SpeechListener::is_speaking);
+    ClassDB::bind_method(D_METHOD("get_sample_rate"), &SpeechListener::get_sample_rate);
+    ClassDB::bind_method(D_METHOD("get_noise_floor_db"), &SpeechListener::get_noise_floor_db);
+    ClassDB::bind_method(D_METHOD("get_stats"), &SpeechListener::get_stats);
+
+    ADD_SIGNAL(MethodInfo("speech_started"));
+    ADD_SIGNAL(MethodInfo("speech_ended"));
+    ADD_SIGNAL(MethodInfo("utterance_transcribed", PropertyInfo(Variant::DICTIONARY, "result")));
+}
+
+int64_t SpeechListener::push_pcm(const PackedFloat32Array &pcm) {
+    return process(pcm.ptr(), static_cast<size_t>(pcm.size()));
+}
+
+int64_t SpeechListener::push_frames(const PackedVector2Array &frames) {
+    const Vector2 *in = frames.ptr();
+    mono_.resize(static_cast<size_t>(frames.size()));
+    for (size_t i = 0; i < mono_.size(); ++i) {
+        mono_[i] = 0.5f * (in[i].x + in[i].y);
+    }
+    return process(mono_.data(), mono_.size());
+}
+
+int64_t SpeechListener::capture(const Ref<AudioEffectCapture> &effect) {
+    if (effect.is_null()) {
+        return 0;
+    }
+    const int32_t available = effect->get_frames_available();
+    if (available <= 0) {
+        return 0;
+    }
+    return push_frames(effect->get_buffer(available));
+}
+
+int64_t SpeechListener::process(const float *samples, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    const bool was_speaking = vad_.in_speech();
+    vad_.push(samples, count, finished_);
+    const bool speaking = vad_.in_speech();
+    // A short utterance can open and close inside one block; it still gets both signals.
+    if (!was_speaking && (speaking || !finished_.empty())) {
+        emit_signal("speech_started");
+    }
+    if (!speaking && (was_speaking || !finished_.empty())) {
+        emit_signal("speech_ended");
+    }
+    return dispatch();
+}
+
+int64_t SpeechListener::flush() {
+    const bool was_speaking = vad_.in_speech();
+    vad_.flush(finished_);
+    if (was_speaking) {
+        emit_signal("speech_ended");
+    }
+    return dispatch();
+}
+
+void SpeechListener::reset() {
+    vad_.reset(vad_.sample_rate(), vad_options_);
+    finished_.clear();
+}
+
+int64_t SpeechListener::dispatch() {
+    if (finished_.empty()) {
+        return 0;
+    }
+    AgentRuntime *runtime = AgentRuntime::get_singleton();
+    int64_t queued = 0;
+    for (local_agents::runtime::VoicedSegment &segment : finished_) {
+        const double rate = static_cast<double>(vad_.sample_rate());
+        const double start = static_cast<double>(segment.start_sample) / rate;
+        const double end = static_cast<double>(segment.end_sample) / rate;
+        if (runtime && runtime->queue_utterance(get_instance_id(), std::move(segment.samples), vad_.sample_rate(),
+                                                start, end, transcribe_options_) != 0) {
+            ++queued;
+        }
+    }
+    finished_.clear();
+    utterances_ += queued;
+    return queued;
+}
+
+bool SpeechListener::is_speaking() const {
+    return vad_.in_speech();
+}
+
+int32_t SpeechListener::get_sample_rate() const {
+    return vad_.sample_rate();
+}
+
+double SpeechListener::get_noise_floor_db() const {
+    return vad_.noise_floor_db();
+}
+
+Dictionary SpeechListener::get_stats() const {
+    const double rate = static_cast<double>(vad_.sample_rate());
+    const double heard = static_cast<double>(vad_.samples_seen()) / rate;
+    const double voiced = static_cast<double>(vad_.samples_voiced()) / rate;
+    Dictionary stats;
+    stats["seconds_heard"] = heard;
+    stats["seconds_voiced"] = voiced;
+    stats["voiced_ratio"] = heard > 0.0 ? voiced / heard : 0.0;
+    stats["utterances"] = utterances_;
+    return stats;
+}
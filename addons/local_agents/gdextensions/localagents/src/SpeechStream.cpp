@@ -0,0 +1,99 @@
+#include "SpeechStream.hpp"
+
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/packed_vector2_array.hpp>
+
+#include <algorithm>
+#include <vector>
+
+using namespace godot;
+
+namespace {
+constexpr size_t kDefaultRingSamples = 1u << 18; // ~12 s at 22.05 kHz
+}
+
+void SpeechStream::State::finish(const std::string &failure) {
+    if (!failure.empty()) {
+        std::scoped_lock lock(error_mutex);
+        error = failure;
+    }
+    producing.store(false, std::memory_order_release);
+}
+
+SpeechStream::SpeechStream() : state_(std::make_shared<State>(kDefaultRingSamples)) {}
+
+SpeechStream::~SpeechStream() {
+    // A stream nobody holds any more stops its synthesis at the next chunk.
+    state_->cancelled.store(true);
+}
+
+void SpeechStream::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("get_sample_rate"), &SpeechStream::get_sample_rate);
+    ClassDB::bind_method(D_METHOD("get_frames_available"), &SpeechStream::get_frames_available);
+    ClassDB::bind_method(D_METHOD("read", "max_frames"), &SpeechStream::read, DEFVAL(-1));
+    ClassDB::bind_method(D_METHOD("fill", "playback"), &SpeechStream::fill);
+    ClassDB::bind_method(D_METHOD("is_synthesizing"), &SpeechStream::is_synthesizing);
+    ClassDB::bind_method(D_METHOD("is_finished"), &SpeechStream::is_finished);
+    ClassDB::bind_method(D_METHOD("get_error"), &SpeechStream::get_error);
+    ClassDB::bind_method(D_METHOD("cancel"), &SpeechStream::cancel);
+}
+
+int32_t SpeechStream::get_sample_rate() const {
+    return state_->sample_rate.load();
+}
+
+int64_t SpeechStream::get_frames_available() const {
+    return static_cast<int64_t>(state_->ring.size());
+}
+
+PackedFloat32Array SpeechStream::read(int64_t max_frames) {
+    size_t wanted = state_->ring.size();
+    if (max_frames >= 0) {
+        wanted = std::min(wanted, static_cast<size_t>(max_frames));
+    }
+    PackedFloat32Array samples;
+    samples.resize(static_cast<int64_t>(wanted));
+    const size_t got = state_->ring.read(samples.ptrw(), wanted);
+    if (got < wanted) {
+        samples.resize(static_cast<int64_t>(got));
+    }
+    return samples;
+}
+
+int64_t SpeechStream::fill(const Ref<AudioStreamGeneratorPlayback> &playback) {
+    if (playback.is_null()) {
+        return 0;
+    }
+    const size_t room = static_cast<size_t>(std::max<int64_t>(0, playback->get_frames_available()));
+    const size_t wanted = std::min(room, state_->ring.size());
+    if (wanted == 0) {
+        return 0;
+    }
+    std::vector<float> mono(wanted);
+    const size_t got = state_->ring.read(mono.data(), wanted);
+    PackedVector2Array frames;
+    frames.resize(static_cast<int64_t>(got));
+    Vector2 *out = frames.ptrw();
+    for (size_t i = 0; i < got; ++i) {
+        out[i] = Vector2(mono[i], mono[i]);
+    }
+    playback->push_buffer(frames);
+    return static_cast<int64_t>(got);
+}
+
+bool SpeechStream::is_synthesizing() const {
+    return state_->producing.load(std::memory_order_acquire);
+}
+
+bool SpeechStream::is_finished() const {
+    return !state_->producing.load(std::memory_order_acquire) && state_->ring.size() == 0;
+}
+
+String SpeechStream::get_error() const {
+    std::scoped_lock lock(state_->error_mutex);
+    return String::utf8(state_->error.c_str());
+}
+
+void SpeechStream::cancel() {
+    state_->cancelled.store(true);
+}
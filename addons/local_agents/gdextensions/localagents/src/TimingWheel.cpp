@@ -0,0 +1,131 @@
+#include "TimingWheel.hpp"
+
+#include <algorithm>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr uint64_t kMaxDelta = (1ull << 32) - 1; // four 8-bit levels
+}
+
+TimingWheel::TimingWheel(uint64_t seed) : rng_(seed ? seed : 1) {}
+
+uint64_t TimingWheel::next_random() {
+    // xorshift64: cheap, and deterministic for a given seed, which keeps tests repeatable.
+    rng_ ^= rng_ << 13;
+    rng_ ^= rng_ >> 7;
+    rng_ ^= rng_ << 17;
+    return rng_;
+}
+
+uint64_t TimingWheel::next_interval(const Timer &timer) {
+    if (timer.jitter == 0) {
+        return timer.period;
+    }
+    const uint64_t spread = next_random() % (2 * timer.jitter + 1);
+    const int64_t interval = static_cast<int64_t>(timer.period) + static_cast<int64_t>(spread) -
+                             static_cast<int64_t>(timer.jitter);
+    return static_cast<uint64_t>(std::max<int64_t>(1, interval));
+}
+
+void TimingWheel::place(uint64_t id, uint64_t due) {
+    // A timer lives on the lowest level whose span still reaches its due time, in the slot
+    // that level's digit of `due` selects; it moves down when time reaches that slot.
+    const uint64_t delta = due > now_ ? due - now_ : 0;
+    for (int level = 0; level < kLevels; ++level) {
+        const int shift = kBits * (level + 1);
+        if (level == kLevels - 1 || delta < (1ull << shift)) {
+            const uint64_t slot = (due >> (kBits * level)) & kMask;
+            wheel_[level][slot].push_back({id, due});
+            return;
+        }
+    }
+}
+
+void TimingWheel::schedule(uint64_t id, uint64_t period_ms, uint64_t jitter_ms) {
+    Timer &timer = timers_[id];
+    timer.period = std::clamp<uint64_t>(period_ms, 1, kMaxDelta / 2);
+    timer.jitter = std::min(jitter_ms, timer.period);
+    // Random phase within one period; an older slot entry for this id is now stale.
+    timer.due = now_ + 1 + next_random() % timer.period;
+    place(id, timer.due);
+}
+
+void TimingWheel::cancel(uint64_t id) {
+    // Slot and backlog entries are dropped lazily when they no longer match a timer.
+    timers_.erase(id);
+}
+
+void TimingWheel::deliver(uint64_t id, Timer &timer, size_t max_due, size_t base, std::vector<uint64_t> &out) {
+    if (timer.backlogged || timer.delivered_at == target_) {
+        return;
+    }
+    if (max_due == 0 || out.size() - base < max_due) {
+        timer.delivered_at = target_;
+        out.push_back(id);
+    } else {
+        timer.backlogged = true;
+        backlog_.push_back(id);
+    }
+}
+
+void TimingWheel::step(size_t max_due, size_t base, std::vector<uint64_t> &out) {
+    ++now_;
+    // Cascade from the top so timers fall through every level they have reached.
+    for (int level = kLevels - 1; level > 0; --level) {
+        const uint64_t span = 1ull << (kBits * level);
+        if (now_ % span != 0) {
+            continue;
+        }
+        std::vector<Slotted> moving;
+        moving.swap(wheel_[level][(now_ >> (kBits * level)) & kMask]);
+        for (const Slotted &entry : moving) {
+            place(entry.id, entry.due);
+        }
+    }
+
+    std::vector<Slotted> firing;
+    firing.swap(wheel_[0][now_ & kMask]);
+    for (const Slotted &entry : firing) {
+        auto found = timers_.find(entry.id);
+        if (found == timers_.end() || found->second.due != entry.due) {
+            continue;
+        }
+        Timer &timer = found->second;
+        // Next due counts from this one, not from delivery, so capped frames do not drift.
+        // Periods that would fall due again within the same advance() (a long frame or a
+        // stall) are skipped: an agent ticks at most once per frame and keeps its phase.
+        timer.due = entry.due + next_interval(timer);
+        if (timer.due <= target_) {
+            timer.due += ((target_ - timer.due) / timer.period + 1) * timer.period;
+        }
+        place(entry.id, timer.due);
+        deliver(entry.id, timer, max_due, base, out);
+    }
+}
+
+void TimingWheel::advance(uint64_t elapsed_ms, size_t max_due, std::vector<uint64_t> &out) {
+    const size_t base = out.size();
+    target_ = now_ + elapsed_ms;
+    while (!backlog_.empty() && (max_due == 0 || out.size() - base < max_due)) {
+        const uint64_t id = backlog_.front();
+        backlog_.pop_front();
+        auto found = timers_.find(id);
+        if (found == timers_.end() || !found->second.backlogged) {
+            continue;
+        }
+        found->second.backlogged = false;
+        found->second.delivered_at = target_;
+        out.push_back(id);
+    }
+    for (uint64_t i = 0; i < elapsed_ms; ++i) {
+        const uint64_t next = now_ + 1;
+        if ((next & kMask) != 0 && wheel_[0][next & kMask].empty()) {
+            now_ = next; // nothing due and no cascade boundary
+            continue;
+        }
+        step(max_due, base, out);
+    }
+}
+
+} // namespace local_agents::runtime
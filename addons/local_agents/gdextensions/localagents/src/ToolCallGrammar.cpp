@@ -0,0 +1,297 @@
+#include "ToolCallGrammar.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr const char *kCallStart = "<start_function_call>";
+constexpr const char *kCallEnd = "<end_function_call>";
+constexpr const char *kEscape = "<escape>";
+
+bool is_text_type(const std::string &type) {
+    return type != "integer" && type != "number" && type != "boolean";
+}
+
+std::string gbnf_literal(const std::string &text) {
+    std::string out = "\"";
+    for (const char c : text) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+std::string json_quote(const std::string &text) {
+    std::string out = "\"";
+    for (const char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out + "\"";
+}
+
+std::string text_value(const std::string &value, bool escape_strings) {
+    return escape_strings ? std::string(kEscape) + value + kEscape : json_quote(value);
+}
+
+std::string value_rule(const ToolParameter &parameter, bool escape_strings) {
+    if (!parameter.choices.empty()) {
+        std::string alternatives;
+        for (const std::string &choice : parameter.choices) {
+            alternatives += alternatives.empty() ? "" : " | ";
+            alternatives += gbnf_literal(is_text_type(parameter.type) ? text_value(choice, escape_strings) : choice);
+        }
+        return "(" + alternatives + ")";
+    }
+    if (parameter.type == "integer" || parameter.type == "number" || parameter.type == "boolean") {
+        return parameter.type;
+    }
+    return "string";
+}
+
+std::string parameter_rule(const ToolParameter &parameter, bool escape_strings) {
+    const std::string key = escape_strings ? parameter.name + ":" : json_quote(parameter.name) + ":";
+    return gbnf_literal(key) + (escape_strings ? " " : " ws ") + value_rule(parameter, escape_strings);
+}
+
+bool starts_with_at(const std::string &text, size_t pos, const char *prefix) {
+    return text.compare(pos, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+void skip_spaces(const std::string &text, size_t &pos) {
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\n' || text[pos] == '\t' || text[pos] == '\r')) {
+        ++pos;
+    }
+}
+
+std::string trimmed(const std::string &text, size_t begin, size_t end) {
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+void append_utf8(std::string &out, uint32_t code) {
+    if (code < 0x80) {
+        out += static_cast<char>(code);
+    } else if (code < 0x800) {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+// `pos` is on the opening quote; leaves it past the closing one.
+bool read_json_string(const std::string &text, size_t &pos, std::string &out) {
+    out.clear();
+    for (++pos; pos < text.size(); ++pos) {
+        const char c = text[pos];
+        if (c == '"') {
+            ++pos;
+            return true;
+        }
+        if (c != '\\' || pos + 1 >= text.size()) {
+            out += c;
+            continue;
+        }
+        const char escaped = text[++pos];
+        switch (escaped) {
+        case 'n':
+            out += '\n';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 'b':
+            out += '\b';
+            break;
+        case 'f':
+            out += '\f';
+            break;
+        case 'u':
+            if (pos + 4 < text.size()) {
+                append_utf8(out, static_cast<uint32_t>(std::strtoul(text.substr(pos + 1, 4).c_str(), nullptr, 16)));
+                pos += 4;
+            }
+            break;
+        default:
+            out += escaped;
+        }
+    }
+    return false;
+}
+} // namespace
+
+std::string function_call_grammar(const std::vector<ToolSpec> &tools, bool escape_strings) {
+    std::string root;
+    std::string rules;
+    for (size_t t = 0; t < tools.size(); ++t) {
+        const ToolSpec &tool = tools[t];
+        const std::string rule = "tool-" + std::to_string(t);
+        root += root.empty() ? "" : " | ";
+        root += rule;
+
+        std::vector<std::string> required;
+        std::vector<std::string> optional;
+        for (const ToolParameter &parameter : tool.parameters) {
+            (parameter.required ? required : optional).push_back(parameter_rule(parameter, escape_strings));
+        }
+        const std::string comma = escape_strings ? "\",\"" : "\",\" ws";
+        std::string args;
+        for (const std::string &parameter : required) {
+            args += args.empty() ? "" : " " + comma + " ";
+            args += "(" + parameter + ")";
+        }
+        if (!optional.empty()) {
+            // Optional arguments may come in any order after the required ones.
+            const std::string any = rule + "-opt";
+            std::string alternatives;
+            for (const std::string &parameter : optional) {
+                alternatives += alternatives.empty() ? "" : " | ";
+                alternatives += "(" + parameter + ")";
+            }
+            rules += any + " ::= " + alternatives + "\n";
+            args += args.empty() ? "(" + any + " (" + comma + " " + any + ")*)?"
+                                 : " (" + comma + " " + any + ")*";
+        }
+        rules += rule + " ::= " + gbnf_literal(tool.name + "{") + (args.empty() ? "" : " " + args) + " \"}\"\n";
+    }
+
+    std::string grammar = "root ::= " + gbnf_literal(std::string(kCallStart) + "call:") + " (" + root + ") " +
+                          gbnf_literal(kCallEnd) + "\n";
+    grammar += rules;
+    grammar += escape_strings ? "string ::= \"<escape>\" [^<]* \"<escape>\"\n"
+                              : "string ::= \"\\\"\" ([^\"\\\\\\n] | \"\\\\\" [^\\n])* \"\\\"\"\n";
+    grammar += "integer ::= \"-\"? [0-9]+\n";
+    grammar += "number ::= \"-\"? [0-9]+ (\".\" [0-9]+)?\n";
+    grammar += "boolean ::= \"true\" | \"false\"\n";
+    grammar += "ws ::= \" \"?\n";
+    return grammar;
+}
+
+bool parse_function_call(const std::string &text, const std::vector<ToolSpec> &tools, ToolCall &call,
+                         std::string &error) {
+    call = ToolCall();
+    error = "no_tool_call";
+    const size_t start = text.find(kCallStart);
+    size_t pos = text.find("call:", start == std::string::npos ? 0 : start);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos += 5;
+    const size_t brace = text.find('{', pos);
+    if (brace == std::string::npos) {
+        return false;
+    }
+    call.name = trimmed(text, pos, brace);
+    const auto tool = std::find_if(tools.begin(), tools.end(), [&](const ToolSpec &spec) { return spec.name == call.name; });
+    if (tool == tools.end()) {
+        error = "unknown_tool";
+        return false;
+    }
+
+    pos = brace + 1;
+    while (true) {
+        skip_spaces(text, pos);
+        if (pos >= text.size()) {
+            return false;
+        }
+        if (text[pos] == '}') {
+            break;
+        }
+        ToolArgument argument;
+        if (text[pos] == '"') {
+            if (!read_json_string(text, pos, argument.name)) {
+                return false;
+            }
+        } else {
+            const size_t colon = text.find(':', pos);
+            if (colon == std::string::npos) {
+                return false;
+            }
+            argument.name = trimmed(text, pos, colon);
+            pos = colon;
+        }
+        skip_spaces(text, pos);
+        if (pos >= text.size() || text[pos] != ':') {
+            return false;
+        }
+        ++pos;
+        skip_spaces(text, pos);
+        if (starts_with_at(text, pos, kEscape)) {
+            pos += std::char_traits<char>::length(kEscape);
+            const size_t close = text.find(kEscape, pos);
+            if (close == std::string::npos) {
+                return false;
+            }
+            argument.value = text.substr(pos, close - pos);
+            pos = close + std::char_traits<char>::length(kEscape);
+        } else if (pos < text.size() && text[pos] == '"') {
+            if (!read_json_string(text, pos, argument.value)) {
+                return false;
+            }
+        } else {
+            const size_t end = text.find_first_of(",}", pos);
+            if (end == std::string::npos) {
+                return false;
+            }
+            argument.value = trimmed(text, pos, end);
+            pos = end;
+        }
+        for (const ToolParameter &parameter : tool->parameters) {
+            if (parameter.name == argument.name) {
+                argument.type = parameter.type;
+            }
+        }
+        call.arguments.push_back(std::move(argument));
+        skip_spaces(text, pos);
+        if (pos < text.size() && text[pos] == ',') {
+            ++pos;
+        }
+    }
+
+    for (const ToolParameter &parameter : tool->parameters) {
+        const bool present = std::any_of(call.arguments.begin(), call.arguments.end(),
+                                         [&](const ToolArgument &argument) { return argument.name == parameter.name; });
+        if (parameter.required && !present) {
+            error = "missing_argument";
+            return false;
+        }
+    }
+    error.clear();
+    return true;
+}
+
+} // namespace local_agents::runtime
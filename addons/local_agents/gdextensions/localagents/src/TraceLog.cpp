@@ -0,0 +1,361 @@
+#include "TraceLog.hpp"
+
+#include <cstring>
+#include <iterator>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr char kMagic[8] = {'L', 'A', 'T', 'R', 'A', 'C', 'E', '\0'};
+constexpr uint32_t kVersion = 1;
+
+enum RecordFlags : uint8_t {
+    kFlagOk = 1 << 0,
+    kFlagAddBos = 1 << 1,
+    kFlagNormalize = 1 << 2,
+    kFlagResetContext = 1 << 3,
+    kFlagCachePrompt = 1 << 4,
+    kFlagParseSpecial = 1 << 5,
+};
+
+// Fixed-width little-endian fields regardless of the host, so traces move between machines.
+class ByteWriter {
+public:
+    void u8(uint8_t value) { bytes_.push_back(static_cast<char>(value)); }
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            u8(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            u8(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+    void i32(int32_t value) { u32(static_cast<uint32_t>(value)); }
+    void i64(int64_t value) { u64(static_cast<uint64_t>(value)); }
+    void f32(float value) {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        u32(bits);
+    }
+    void str(const std::string &value) {
+        u32(static_cast<uint32_t>(value.size()));
+        bytes_.append(value);
+    }
+
+    const std::string &bytes() const { return bytes_; }
+
+private:
+    std::string bytes_;
+};
+
+class ByteReader {
+public:
+    ByteReader(const char *data, size_t size) : data_(data), size_(size) {}
+
+    bool u8(uint8_t &out) {
+        if (pos_ + 1 > size_) {
+            return false;
+        }
+        out = static_cast<uint8_t>(data_[pos_++]);
+        return true;
+    }
+    bool u32(uint32_t &out) {
+        out = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint8_t byte = 0;
+            if (!u8(byte)) {
+                return false;
+            }
+            out |= static_cast<uint32_t>(byte) << (8 * i);
+        }
+        return true;
+    }
+    bool u64(uint64_t &out) {
+        out = 0;
+        for (int i = 0; i < 8; ++i) {
+            uint8_t byte = 0;
+            if (!u8(byte)) {
+                return false;
+            }
+            out |= static_cast<uint64_t>(byte) << (8 * i);
+        }
+        return true;
+    }
+    bool i32(int32_t &out) {
+        uint32_t bits = 0;
+        const bool ok = u32(bits);
+        out = static_cast<int32_t>(bits);
+        return ok;
+    }
+    bool i64(int64_t &out) {
+        uint64_t bits = 0;
+        const bool ok = u64(bits);
+        out = static_cast<int64_t>(bits);
+        return ok;
+    }
+    bool f32(float &out) {
+        uint32_t bits = 0;
+        if (!u32(bits)) {
+            return false;
+        }
+        std::memcpy(&out, &bits, sizeof(out));
+        return true;
+    }
+    bool str(std::string &out) {
+        uint32_t length = 0;
+        if (!u32(length) || pos_ + length > size_) {
+            return false;
+        }
+        out.assign(data_ + pos_, length);
+        pos_ += length;
+        return true;
+    }
+
+private:
+    const char *data_;
+    size_t size_;
+    size_t pos_ = 0;
+};
+
+void encode_record(const TraceRecord &record, ByteWriter &out) {
+    const GenerationRequest &request = record.request;
+    const SamplingOptions &sampling = request.sampling;
+    uint8_t flags = 0;
+    flags |= record.ok ? kFlagOk : 0;
+    flags |= record.add_bos ? kFlagAddBos : 0;
+    flags |= record.normalize ? kFlagNormalize : 0;
+    flags |= request.reset_context ? kFlagResetContext : 0;
+    flags |= request.cache_prompt ? kFlagCachePrompt : 0;
+    flags |= request.parse_special ? kFlagParseSpecial : 0;
+
+    out.u8(static_cast<uint8_t>(record.kind));
+    out.u8(flags);
+    out.u64(record.start_us);
+    out.u64(record.duration_us);
+    out.u64(record.prompt_hash);
+    out.str(request.prompt);
+    out.i32(record.prompt_tokens);
+    out.i32(record.completion_tokens);
+    out.u64(record.ttft_us);
+    out.u64(record.output_hash);
+
+    out.i32(request.max_tokens);
+    out.i32(request.batch_size);
+    out.i32(sampling.top_k);
+    out.f32(sampling.top_p);
+    out.f32(sampling.min_p);
+    out.f32(sampling.typical_p);
+    out.f32(sampling.temperature);
+    out.i64(sampling.seed);
+    out.f32(sampling.repeat_penalty);
+    out.f32(sampling.frequency_penalty);
+    out.f32(sampling.presence_penalty);
+    out.i32(sampling.repeat_last_n);
+    out.i32(sampling.mirostat);
+    out.i32(sampling.mirostat_m);
+    out.f32(sampling.mirostat_tau);
+    out.f32(sampling.mirostat_eta);
+
+    out.u32(static_cast<uint32_t>(request.stop.size()));
+    for (const std::string &stop : request.stop) {
+        out.str(stop);
+    }
+    out.u32(static_cast<uint32_t>(request.loras.size()));
+    for (const LoraSelection &lora : request.loras) {
+        out.str(lora.id);
+        out.f32(lora.scale);
+    }
+    out.str(request.conversation_id);
+}
+
+bool decode_record(ByteReader &in, TraceRecord &record) {
+    GenerationRequest &request = record.request;
+    SamplingOptions &sampling = request.sampling;
+    uint8_t kind = 0;
+    uint8_t flags = 0;
+    bool ok = in.u8(kind) && in.u8(flags) && in.u64(record.start_us) && in.u64(record.duration_us) &&
+              in.u64(record.prompt_hash) && in.str(request.prompt) && in.i32(record.prompt_tokens) &&
+              in.i32(record.completion_tokens) && in.u64(record.ttft_us) && in.u64(record.output_hash) &&
+              in.i32(request.max_tokens) && in.i32(request.batch_size) && in.i32(sampling.top_k) &&
+              in.f32(sampling.top_p) && in.f32(sampling.min_p) && in.f32(sampling.typical_p) &&
+              in.f32(sampling.temperature) && in.i64(sampling.seed) && in.f32(sampling.repeat_penalty) &&
+              in.f32(sampling.frequency_penalty) && in.f32(sampling.presence_penalty) &&
+              in.i32(sampling.repeat_last_n) && in.i32(sampling.mirostat) && in.i32(sampling.mirostat_m) &&
+              in.f32(sampling.mirostat_tau) && in.f32(sampling.mirostat_eta);
+    if (!ok) {
+        return false;
+    }
+    record.kind = static_cast<TraceKind>(kind);
+    record.ok = (flags & kFlagOk) != 0;
+    record.add_bos = (flags & kFlagAddBos) != 0;
+    record.normalize = (flags & kFlagNormalize) != 0;
+    request.reset_context = (flags & kFlagResetContext) != 0;
+    request.cache_prompt = (flags & kFlagCachePrompt) != 0;
+    request.parse_special = (flags & kFlagParseSpecial) != 0;
+
+    uint32_t count = 0;
+    if (!in.u32(count)) {
+        return false;
+    }
+    request.stop.resize(count);
+    for (std::string &stop : request.stop) {
+        if (!in.str(stop)) {
+            return false;
+        }
+    }
+    if (!in.u32(count)) {
+        return false;
+    }
+    request.loras.resize(count);
+    for (LoraSelection &lora : request.loras) {
+        if (!in.str(lora.id) || !in.f32(lora.scale)) {
+            return false;
+        }
+    }
+    return in.str(request.conversation_id);
+}
+} // namespace
+
+uint64_t trace_hash(const void *data, size_t size) {
+    // FNV-1a: stable across platforms and runs, which std::hash is not.
+    uint64_t hash = 1469598103934665603ull;
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t trace_hash(const std::string &text) {
+    return trace_hash(text.data(), text.size());
+}
+
+bool trace_is_deterministic(const TraceRecord &record) {
+    if (record.kind == TraceKind::Embed) {
+        return true;
+    }
+    return record.request.sampling.temperature <= 0.0f && record.request.sampling.mirostat == 0;
+}
+
+TraceWriter::~TraceWriter() {
+    close();
+}
+
+bool TraceWriter::open(const std::string &path, bool record_prompts, std::string &error) {
+    std::scoped_lock lock(mutex_);
+    if (file_.is_open()) {
+        file_.close();
+    }
+    file_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file_) {
+        error = "cannot write trace: " + path;
+        open_.store(false);
+        return false;
+    }
+    ByteWriter header;
+    header.u32(kVersion);
+    file_.write(kMagic, sizeof(kMagic));
+    file_.write(header.bytes().data(), static_cast<std::streamsize>(header.bytes().size()));
+    path_ = path;
+    opened_ = std::chrono::steady_clock::now();
+    record_prompts_ = record_prompts;
+    records_ = 0;
+    open_.store(true);
+    return true;
+}
+
+uint64_t TraceWriter::close() {
+    std::scoped_lock lock(mutex_);
+    open_.store(false);
+    if (file_.is_open()) {
+        file_.close();
+    }
+    return records_;
+}
+
+bool TraceWriter::is_open() const {
+    return open_.load();
+}
+
+std::string TraceWriter::path() const {
+    std::scoped_lock lock(mutex_);
+    return path_;
+}
+
+uint64_t TraceWriter::offset_us(std::chrono::steady_clock::time_point at) const {
+    std::scoped_lock lock(mutex_);
+    if (at <= opened_) {
+        return 0;
+    }
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(at - opened_).count());
+}
+
+void TraceWriter::append(TraceRecord record) {
+    record.prompt_hash = trace_hash(record.request.prompt);
+    // Encoding happens outside the lock; only the write is serialized.
+    bool keep_prompt = true;
+    {
+        std::scoped_lock lock(mutex_);
+        keep_prompt = record_prompts_;
+    }
+    if (!keep_prompt) {
+        record.request.prompt.clear();
+    }
+    ByteWriter payload;
+    encode_record(record, payload);
+    ByteWriter frame;
+    frame.u32(static_cast<uint32_t>(payload.bytes().size()));
+
+    std::scoped_lock lock(mutex_);
+    if (!file_.is_open()) {
+        return;
+    }
+    file_.write(frame.bytes().data(), static_cast<std::streamsize>(frame.bytes().size()));
+    file_.write(payload.bytes().data(), static_cast<std::streamsize>(payload.bytes().size()));
+    ++records_;
+}
+
+bool read_trace(const std::string &path, std::vector<TraceRecord> &out, std::string &error) {
+    out.clear();
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) {
+        error = "cannot read trace: " + path;
+        return false;
+    }
+    const std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (bytes.size() < sizeof(kMagic) + 4 || std::memcmp(bytes.data(), kMagic, sizeof(kMagic)) != 0) {
+        error = "not a trace file: " + path;
+        return false;
+    }
+    ByteReader header(bytes.data() + sizeof(kMagic), 4);
+    uint32_t version = 0;
+    header.u32(version);
+    if (version != kVersion) {
+        error = "unsupported trace version " + std::to_string(version);
+        return false;
+    }
+
+    size_t pos = sizeof(kMagic) + 4;
+    while (pos < bytes.size()) {
+        ByteReader frame(bytes.data() + pos, bytes.size() - pos);
+        uint32_t length = 0;
+        if (!frame.u32(length) || pos + 4 + length > bytes.size()) {
+            // A trace cut off mid-record (crash, kill) still replays up to that point.
+            break;
+        }
+        ByteReader payload(bytes.data() + pos + 4, length);
+        TraceRecord record;
+        if (!decode_record(payload, record)) {
+            error = "corrupt trace record at byte " + std::to_string(pos);
+            return false;
+        }
+        out.push_back(std::move(record));
+        pos += 4 + length;
+    }
+    return true;
+}
+
+} // namespace local_agents::runtime
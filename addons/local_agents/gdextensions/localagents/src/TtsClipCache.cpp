@@ -0,0 +1,452 @@
+#include "TtsClipCache.hpp"
+
+#include "TraceLog.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr char kMagic[4] = {'L', 'A', 'T', 'C'};
+constexpr uint32_t kVersion = 1;
+constexpr size_t kHeaderBytes = 20; // magic, version, sample rate, sample count, key size
+constexpr const char *kExtension = ".lapcm";
+constexpr const char *kTempSuffix = ".tmp";
+constexpr size_t kBlockSamples = 1024;
+constexpr auto kStaleTempAge = std::chrono::minutes(10);
+
+constexpr std::array<int16_t, 89> kStepTable = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+    544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+    9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+constexpr std::array<int8_t, 16> kIndexTable = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+size_t block_bytes(size_t samples) {
+    // Header (first sample exact, step index, pad) then the rest two per byte.
+    return 4 + samples / 2;
+}
+
+int16_t to_int16(float sample) {
+    const long value = std::lround(std::clamp(sample, -1.0f, 1.0f) * 32768.0f);
+    return static_cast<int16_t>(std::clamp(value, -32768L, 32767L));
+}
+
+// One ADPCM step shared by the encoder and decoder, so both track the same predictor.
+void apply_nibble(uint8_t nibble, int32_t &predictor, int32_t &index) {
+    const int32_t step = kStepTable[static_cast<size_t>(index)];
+    int32_t delta = step >> 3;
+    if (nibble & 4) {
+        delta += step;
+    }
+    if (nibble & 2) {
+        delta += step >> 1;
+    }
+    if (nibble & 1) {
+        delta += step >> 2;
+    }
+    predictor = std::clamp(predictor + ((nibble & 8) ? -delta : delta), -32768, 32767);
+    index = std::clamp(index + kIndexTable[nibble], 0, 88);
+}
+
+uint8_t encode_nibble(int32_t sample, int32_t &predictor, int32_t &index) {
+    int32_t diff = sample - predictor;
+    uint8_t nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    int32_t step = kStepTable[static_cast<size_t>(index)];
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 2;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        nibble |= 1;
+    }
+    apply_nibble(nibble, predictor, index);
+    return nibble;
+}
+
+void put_u32(std::vector<uint8_t> &bytes, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) {
+        bytes.push_back(static_cast<uint8_t>((value >> shift) & 0xFF));
+    }
+}
+
+uint32_t read_u32(const uint8_t *bytes) {
+    return static_cast<uint32_t>(bytes[0]) | (static_cast<uint32_t>(bytes[1]) << 8) |
+           (static_cast<uint32_t>(bytes[2]) << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+std::string clip_name(const std::string &key) {
+    static constexpr char kHex[] = "0123456789abcdef";
+    const uint64_t hash = trace_hash(key);
+    std::string name(16, '0');
+    for (int i = 0; i < 16; ++i) {
+        name[static_cast<size_t>(15 - i)] = kHex[(hash >> (4 * i)) & 0xF];
+    }
+    return name;
+}
+
+bool ends_with(const std::string &text, const std::string &suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+} // namespace
+
+std::string normalize_tts_text(const std::string &text) {
+    std::string out;
+    out.reserve(text.size());
+    bool space = false;
+    for (char c : text) {
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v') {
+            space = !out.empty();
+            continue;
+        }
+        if (space) {
+            out.push_back(' ');
+            space = false;
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+std::string tts_clip_key(const PiperVoiceOptions &voice, const std::string &normalized_text) {
+    std::error_code ec;
+    const uint64_t model_size = std::filesystem::file_size(voice.model, ec);
+    const auto model_time = std::filesystem::last_write_time(voice.model, ec);
+    std::string key;
+    key.reserve(voice.model.size() + voice.config.size() + normalized_text.size() + 96);
+    key += voice.model;
+    key += '\n';
+    key += std::to_string(ec ? 0 : model_size);
+    key += ':';
+    key += std::to_string(ec ? 0 : static_cast<long long>(model_time.time_since_epoch().count()));
+    key += '\n';
+    key += voice.config;
+    key += '\n';
+    key += std::to_string(voice.speaker) + ' ' + std::to_string(voice.length_scale) + ' ' +
+           std::to_string(voice.noise_scale) + ' ' + std::to_string(voice.noise_w);
+    key += '\n';
+    key += normalized_text;
+    return key;
+}
+
+std::vector<uint8_t> encode_adpcm(const float *samples, size_t count) {
+    std::vector<uint8_t> bytes;
+    bytes.reserve((count / kBlockSamples + 1) * block_bytes(kBlockSamples));
+    for (size_t start = 0; start < count; start += kBlockSamples) {
+        const size_t n = std::min(kBlockSamples, count - start);
+        int32_t predictor = to_int16(samples[start]);
+        int32_t index = 0;
+        // Start each block at the step size that fits its opening difference, so a block
+        // that opens mid-word does not spend its first samples ramping up.
+        if (n > 1) {
+            const int32_t diff = std::abs(to_int16(samples[start + 1]) - predictor);
+            while (index < 88 && kStepTable[static_cast<size_t>(index)] < diff) {
+                ++index;
+            }
+        }
+        bytes.push_back(static_cast<uint8_t>(predictor & 0xFF));
+        bytes.push_back(static_cast<uint8_t>((predictor >> 8) & 0xFF));
+        bytes.push_back(static_cast<uint8_t>(index));
+        bytes.push_back(0);
+        for (size_t i = 1; i < n; i += 2) {
+            const uint8_t low = encode_nibble(to_int16(samples[start + i]), predictor, index);
+            const uint8_t high = i + 1 < n ? encode_nibble(to_int16(samples[start + i + 1]), predictor, index) : 0;
+            bytes.push_back(static_cast<uint8_t>(low | (high << 4)));
+        }
+    }
+    return bytes;
+}
+
+bool decode_adpcm(const uint8_t *bytes, size_t size, size_t sample_count, std::vector<float> &out) {
+    out.resize(sample_count);
+    size_t offset = 0;
+    for (size_t start = 0; start < sample_count; start += kBlockSamples) {
+        const size_t n = std::min(kBlockSamples, sample_count - start);
+        if (offset + block_bytes(n) > size) {
+            return false;
+        }
+        const uint8_t *block = bytes + offset;
+        int32_t predictor = static_cast<int16_t>(block[0] | (block[1] << 8));
+        int32_t index = std::min<int32_t>(block[2], 88);
+        out[start] = static_cast<float>(predictor) / 32768.0f;
+        const uint8_t *nibbles = block + 4;
+        for (size_t i = 1; i < n; ++i) {
+            const uint8_t byte = nibbles[(i - 1) / 2];
+            apply_nibble((i & 1) ? (byte & 0x0F) : (byte >> 4), predictor, index);
+            out[start + i] = static_cast<float>(predictor) / 32768.0f;
+        }
+        offset += block_bytes(n);
+    }
+    return true;
+}
+
+void TtsClipCache::configure(const std::filesystem::path &directory, uint64_t max_bytes) {
+    std::scoped_lock lock(mutex_);
+    if (directory != directory_) {
+        directory_ = directory;
+        indexed_ = false;
+        entries_.clear();
+        index_.clear();
+        total_bytes_ = 0;
+    }
+    max_bytes_ = max_bytes;
+    if (indexed_) {
+        evict_locked();
+    }
+}
+
+bool TtsClipCache::enabled() const {
+    std::scoped_lock lock(mutex_);
+    return max_bytes_ > 0 && !directory_.empty();
+}
+
+std::filesystem::path TtsClipCache::path_for(const std::string &name) const {
+    return directory_ / (name + kExtension);
+}
+
+bool TtsClipCache::ensure_index_locked() {
+    if (max_bytes_ == 0 || directory_.empty()) {
+        return false;
+    }
+    if (indexed_) {
+        return true;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+    struct Found {
+        std::string name;
+        uint64_t bytes;
+        std::filesystem::file_time_type time;
+    };
+    std::vector<Found> found;
+    const auto now = std::filesystem::file_time_type::clock::now();
+    for (std::filesystem::directory_iterator it(directory_, ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string file = it->path().filename().string();
+        const auto time = it->last_write_time(ec);
+        if (ec) {
+            ec.clear();
+            continue;
+        }
+        if (ends_with(file, kTempSuffix)) {
+            // Left by a writer that died before its rename; a live one finishes in well
+            // under this.
+            if (now - time > kStaleTempAge) {
+                std::filesystem::remove(it->path(), ec);
+                ec.clear();
+            }
+            continue;
+        }
+        if (!ends_with(file, kExtension)) {
+            continue;
+        }
+        const uint64_t bytes = it->file_size(ec);
+        if (ec) {
+            ec.clear();
+            continue;
+        }
+        found.push_back({file.substr(0, file.size() - std::strlen(kExtension)), bytes, time});
+    }
+    std::sort(found.begin(), found.end(), [](const Found &a, const Found &b) { return a.time > b.time; });
+    for (Found &clip : found) {
+        entries_.push_back({std::move(clip.name), clip.bytes});
+        index_[entries_.back().name] = std::prev(entries_.end());
+        total_bytes_ += clip.bytes;
+    }
+    indexed_ = true;
+    evict_locked();
+    return true;
+}
+
+void TtsClipCache::touch_locked(std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found) {
+    entries_.splice(entries_.begin(), entries_, found->second);
+    // Persist recency for the next run's index.
+    std::error_code ec;
+    std::filesystem::last_write_time(path_for(found->first), std::filesystem::file_time_type::clock::now(), ec);
+}
+
+void TtsClipCache::erase_locked(std::unordered_map<std::string, std::list<Entry>::iterator>::iterator found) {
+    std::error_code ec;
+    std::filesystem::remove(path_for(found->first), ec);
+    total_bytes_ -= found->second->bytes;
+    entries_.erase(found->second);
+    index_.erase(found);
+}
+
+void TtsClipCache::evict_locked() {
+    while (total_bytes_ > max_bytes_ && !entries_.empty()) {
+        erase_locked(index_.find(entries_.back().name));
+    }
+}
+
+bool TtsClipCache::lookup(const std::string &key, std::vector<float> &samples, int32_t &sample_rate) {
+    const std::string name = clip_name(key);
+    std::filesystem::path path;
+    {
+        std::scoped_lock lock(mutex_);
+        if (!ensure_index_locked() || index_.find(name) == index_.end()) {
+            return false;
+        }
+        path = path_for(name);
+    }
+
+    std::vector<uint8_t> data;
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (stream) {
+        data.resize(static_cast<size_t>(std::max<std::streamoff>(0, stream.tellg())));
+        stream.seekg(0);
+        stream.read(reinterpret_cast<char *>(data.data()), static_cast<std::streamsize>(data.size()));
+        data.resize(static_cast<size_t>(std::max<std::streamsize>(0, stream.gcount())));
+    }
+    bool valid = data.size() >= kHeaderBytes && std::memcmp(data.data(), kMagic, 4) == 0 &&
+                 read_u32(data.data() + 4) == kVersion;
+    uint32_t key_size = 0;
+    if (valid) {
+        key_size = read_u32(data.data() + 16);
+        valid = data.size() >= kHeaderBytes + key_size;
+    }
+    // A different key under the same name is a hash collision: a miss, not a corrupt file.
+    if (valid && (key_size != key.size() || std::memcmp(data.data() + kHeaderBytes, key.data(), key_size) != 0)) {
+        return false;
+    }
+    const size_t payload = kHeaderBytes + key_size;
+    valid = valid && decode_adpcm(data.data() + payload, data.size() - payload, read_u32(data.data() + 12), samples);
+    if (valid) {
+        sample_rate = static_cast<int32_t>(read_u32(data.data() + 8));
+    }
+
+    std::scoped_lock lock(mutex_);
+    auto found = index_.find(name);
+    if (found == index_.end()) {
+        return valid; // evicted while we read; the bytes we have are still good
+    }
+    if (!valid) {
+        erase_locked(found);
+        return false;
+    }
+    touch_locked(found);
+    return true;
+}
+
+bool TtsClipCache::contains(const std::string &key) {
+    std::scoped_lock lock(mutex_);
+    return ensure_index_locked() && index_.find(clip_name(key)) != index_.end();
+}
+
+bool TtsClipCache::store(const std::string &key, const float *samples, size_t count, int32_t sample_rate,
+                         std::string &error) {
+    std::vector<uint8_t> bytes;
+    bytes.insert(bytes.end(), kMagic, kMagic + 4);
+    put_u32(bytes, kVersion);
+    put_u32(bytes, static_cast<uint32_t>(sample_rate));
+    put_u32(bytes, static_cast<uint32_t>(count));
+    put_u32(bytes, static_cast<uint32_t>(key.size()));
+    bytes.insert(bytes.end(), key.begin(), key.end());
+    const std::vector<uint8_t> encoded = encode_adpcm(samples, count);
+    bytes.insert(bytes.end(), encoded.begin(), encoded.end());
+
+    const std::string name = clip_name(key);
+    std::filesystem::path target;
+    std::filesystem::path temp;
+    {
+        std::scoped_lock lock(mutex_);
+        if (!ensure_index_locked()) {
+            error = "tts_cache_disabled";
+            return false;
+        }
+        if (bytes.size() > max_bytes_) {
+            error = "tts_clip_too_large";
+            return false;
+        }
+        target = path_for(name);
+        // Unique across threads and, through the clock, across processes sharing the
+        // directory.
+        const auto ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+        temp = directory_ / (name + '.' + std::to_string(ticks) + '-' + std::to_string(++temp_counter_) + kTempSuffix);
+    }
+
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        out.close();
+        if (!out) {
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            error = "tts_cache_write_failed";
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, target, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+        error = "tts_cache_rename_failed";
+        return false;
+    }
+
+    std::scoped_lock lock(mutex_);
+    if (target != path_for(name)) {
+        return true; // reconfigured meanwhile; the file is in the old directory
+    }
+    auto found = index_.find(name);
+    if (found != index_.end()) {
+        total_bytes_ -= found->second->bytes;
+        entries_.erase(found->second);
+        index_.erase(found);
+    }
+    entries_.push_front({name, bytes.size()});
+    index_[name] = entries_.begin();
+    total_bytes_ += bytes.size();
+    evict_locked();
+    return true;
+}
+
+void TtsClipCache::clear() {
+    std::scoped_lock lock(mutex_);
+    if (!ensure_index_locked()) {
+        return;
+    }
+    while (!entries_.empty()) {
+        erase_locked(index_.find(entries_.front().name));
+    }
+}
+
+size_t TtsClipCache::entry_count() {
+    std::scoped_lock lock(mutex_);
+    ensure_index_locked();
+    return entries_.size();
+}
+
+uint64_t TtsClipCache::total_bytes() {
+    std::scoped_lock lock(mutex_);
+    ensure_index_locked();
+    return total_bytes_;
+}
+
+uint64_t TtsClipCache::max_bytes() const {
+    std::scoped_lock lock(mutex_);
+    return max_bytes_;
+}
+
+std::filesystem::path TtsClipCache::directory() const {
+    std::scoped_lock lock(mutex_);
+    return directory_;
+}
+
+} // namespace local_agents::runtime
@@ -0,0 +1,169 @@
+#include "VoiceActivity.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace local_agents::runtime {
+
+namespace {
+constexpr int32_t kTailMs = 100; // silence kept after the last voiced frame
+// Noise floor tracking: quick to fall (a pause reveals the true floor), slow to rise while
+// idle, slower still during speech so a fan switching on mid-sentence ends it eventually.
+constexpr float kFloorFall = 0.3f;
+constexpr float kFloorRise = 0.05f;
+constexpr float kFloorRiseInSpeech = 0.001f;
+
+size_t ms_to_samples(int32_t ms, int32_t rate) {
+    return static_cast<size_t>(std::max<int64_t>(0, static_cast<int64_t>(ms) * rate / 1000));
+}
+} // namespace
+
+void VoiceActivityDetector::reset(int32_t sample_rate, const VadOptions &options) {
+    options_ = options;
+    sample_rate_ = std::max(1, sample_rate);
+    frame_samples_ = std::max<size_t>(1, ms_to_samples(std::max(1, options.frame_ms), sample_rate_));
+    const auto frames = [this](int32_t ms) {
+        return (ms_to_samples(ms, sample_rate_) + frame_samples_ - 1) / frame_samples_;
+    };
+    onset_frames_ = std::max<size_t>(1, frames(options.onset_ms));
+    hangover_frames_ = std::max<size_t>(1, frames(options.hangover_ms));
+    preroll_samples_ = ms_to_samples(options.preroll_ms, sample_rate_);
+    tail_samples_ = std::min(ms_to_samples(kTailMs, sample_rate_), hangover_frames_ * frame_samples_);
+    min_samples_ = ms_to_samples(options.min_utterance_ms, sample_rate_);
+    max_samples_ = std::max(frame_samples_, ms_to_samples(options.max_utterance_ms, sample_rate_));
+
+    partial_.clear();
+    history_.clear();
+    current_ = VoicedSegment();
+    in_speech_ = false;
+    floor_ready_ = false;
+    noise_floor_db_ = -90.0f;
+    voiced_run_ = 0;
+    silent_run_ = 0;
+    utterance_voiced_frames_ = 0;
+    continued_ = false;
+    position_ = 0;
+    frame_end_ = 0;
+    samples_voiced_ = 0;
+}
+
+void VoiceActivityDetector::push(const float *samples, size_t count, std::vector<VoicedSegment> &finished) {
+    position_ += static_cast<int64_t>(count);
+    if (!partial_.empty()) {
+        const size_t take = std::min(count, frame_samples_ - partial_.size());
+        partial_.insert(partial_.end(), samples, samples + take);
+        samples += take;
+        count -= take;
+        if (partial_.size() < frame_samples_) {
+            return;
+        }
+        process_frame(partial_.data(), finished);
+        partial_.clear();
+    }
+    while (count >= frame_samples_) {
+        process_frame(samples, finished);
+        samples += frame_samples_;
+        count -= frame_samples_;
+    }
+    partial_.assign(samples, samples + count);
+}
+
+void VoiceActivityDetector::flush(std::vector<VoicedSegment> &finished) {
+    if (in_speech_) {
+        current_.samples.insert(current_.samples.end(), partial_.begin(), partial_.end());
+        frame_end_ += static_cast<int64_t>(partial_.size());
+        const size_t silent = std::min(silent_run_ * frame_samples_ + partial_.size(), current_.samples.size());
+        close_utterance(current_.samples.size() - silent + std::min(silent, tail_samples_), finished);
+    } else {
+        frame_end_ += static_cast<int64_t>(partial_.size());
+    }
+    partial_.clear();
+    history_.clear();
+    voiced_run_ = 0;
+}
+
+void VoiceActivityDetector::process_frame(const float *frame, std::vector<VoicedSegment> &finished) {
+    double energy = 0.0;
+    size_t crossings = 0;
+    for (size_t i = 0; i < frame_samples_; ++i) {
+        energy += static_cast<double>(frame[i]) * frame[i];
+        if (i > 0 && (frame[i] >= 0.0f) != (frame[i - 1] >= 0.0f)) {
+            ++crossings;
+        }
+    }
+    const float energy_db = static_cast<float>(10.0 * std::log10(energy / static_cast<double>(frame_samples_) + 1e-10));
+    const float zcr = frame_samples_ > 1 ? static_cast<float>(crossings) / static_cast<float>(frame_samples_ - 1) : 0.0f;
+    if (!floor_ready_) {
+        noise_floor_db_ = energy_db;
+        floor_ready_ = true;
+    }
+    const float above = energy_db - noise_floor_db_;
+    bool voiced = energy_db >= options_.min_energy_db && above >= options_.threshold_db;
+    if (voiced && zcr > options_.max_zcr && above < 2.0f * options_.threshold_db) {
+        voiced = false;
+    }
+    if (!voiced || in_speech_) {
+        const float rate = energy_db < noise_floor_db_ ? kFloorFall : (in_speech_ ? kFloorRiseInSpeech : kFloorRise);
+        noise_floor_db_ += rate * (energy_db - noise_floor_db_);
+    }
+    frame_end_ += static_cast<int64_t>(frame_samples_);
+
+    if (!in_speech_) {
+        history_.insert(history_.end(), frame, frame + frame_samples_);
+        voiced_run_ = voiced ? voiced_run_ + 1 : 0;
+        if (voiced_run_ >= onset_frames_) {
+            const size_t keep = std::min(history_.size(), preroll_samples_ + voiced_run_ * frame_samples_);
+            current_ = VoicedSegment();
+            current_.samples.assign(history_.end() - static_cast<std::ptrdiff_t>(keep), history_.end());
+            current_.start_sample = frame_end_ - static_cast<int64_t>(keep);
+            history_.clear();
+            in_speech_ = true;
+            silent_run_ = 0;
+            utterance_voiced_frames_ = voiced_run_;
+            return;
+        }
+        // Trimmed in bulk so idle frames cost an append, not a shift.
+        const size_t limit = preroll_samples_ + onset_frames_ * frame_samples_;
+        if (history_.size() > 2 * limit) {
+            history_.erase(history_.begin(), history_.end() - static_cast<std::ptrdiff_t>(limit));
+        }
+        return;
+    }
+
+    current_.samples.insert(current_.samples.end(), frame, frame + frame_samples_);
+    silent_run_ = voiced ? 0 : silent_run_ + 1;
+    utterance_voiced_frames_ += voiced ? 1 : 0;
+    if (silent_run_ >= hangover_frames_) {
+        const size_t silent = silent_run_ * frame_samples_;
+        close_utterance(current_.samples.size() - silent + tail_samples_, finished);
+        return;
+    }
+    if (current_.samples.size() >= max_samples_) {
+        // Cut mid-speech: the next utterance starts right here, with no pre-roll to repeat.
+        close_utterance(current_.samples.size(), finished);
+        current_.start_sample = frame_end_;
+        in_speech_ = true;
+        continued_ = true;
+    }
+}
+
+void VoiceActivityDetector::close_utterance(size_t keep, std::vector<VoicedSegment> &finished) {
+    keep = std::min(keep, current_.samples.size());
+    current_.samples.resize(keep);
+    current_.end_sample = current_.start_sample + static_cast<int64_t>(keep);
+    in_speech_ = false;
+    voiced_run_ = 0;
+    silent_run_ = 0;
+    // The rest of a cut utterance is kept however short: it is the end of real speech.
+    const bool long_enough = continued_ ? utterance_voiced_frames_ > 0
+                                        : utterance_voiced_frames_ * frame_samples_ >= min_samples_;
+    utterance_voiced_frames_ = 0;
+    continued_ = false;
+    if (long_enough && keep > 0) {
+        samples_voiced_ += static_cast<int64_t>(keep);
+        finished.push_back(std::move(current_));
+    }
+    current_ = VoicedSegment();
+}
+
+} // namespace local_agents::runtime
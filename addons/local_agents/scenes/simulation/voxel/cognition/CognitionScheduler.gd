@@ -7,10 +7,13 @@ extends Node
 ## trace for the auto-finetune loop. It is deliberately the only place that talks to the model server
 ## so the global concurrency/rate caps are honoured no matter how many creatures escalate at once.
 ##
-## Two backends resolve an escalation into one LAActionRegistry action:
-##   1. Real FunctionGemma — an async HTTP POST to a running llama.cpp llama-server. Signal-based; it
+## Three backends resolve an escalation into one LAActionRegistry action:
+##   1. Native FunctionGemma — AgentRuntime.resolve_tool_call() on the model already loaded in process,
+##      decoded under a grammar that only admits one declared action, so there is no HTTP round trip or
+##      JSON to re-parse. Runs on the WorkerThreadPool. Used when `native` is set and a model is loaded.
+##   2. Server FunctionGemma — an async HTTP POST to a running llama.cpp llama-server. Signal-based; it
 ##      never blocks the frame. Used when a `server_url` is configured and we are inside the tree.
-##   2. Heuristic teacher — a synchronous rule-of-thumb resolved from the signature+context, but its
+##   3. Heuristic teacher — a synchronous rule-of-thumb resolved from the signature+context, but its
 ##      callback is DEFERRED so it too never blocks. This is the offline fallback AND the "teacher"
 ##      that keeps generating training traces when no model is loaded.
 ##
@@ -31,6 +34,7 @@ const ACTIVITY_PRUNE_AT: int = 256         # prune expired activity entries once
 
 # --- configuration (set via setup) ---
 var _enabled: bool = true
+var _native: bool = false
 var _server_url: String = ""
 var _model: String = DEFAULT_MODEL
 var _trace_path: String = DEFAULT_TRACE_PATH
@@ -57,6 +61,7 @@ var _activity: Dictionary = {}
 ## Configure the scheduler. Robust to a missing/empty server_url (falls back to the teacher).
 func setup(options: Dictionary = {}) -> void:
 	_enabled = bool(options.get("enabled", true))
+	_native = bool(options.get("native", false))
 	_server_url = String(options.get("server_url", "")).strip_edges()
 	if _server_url.ends_with("/"):
 		_server_url = _server_url.substr(0, _server_url.length() - 1)
@@ -101,6 +106,8 @@ func request(creature, cognition, sig: Dictionary, innate_action: String) -> boo
 		"http": null,
 	}
 
+	if _enabled and _native and _dispatch_native(job):
+		return true
 	if _enabled and _server_url != "" and is_inside_tree():
 		if _dispatch_llm(job):
 			return true
@@ -162,6 +169,32 @@ func _on_llm_completed(result: int, response_code: int, _headers: PackedStringAr
 	_finish(job, action, "llm")
 
 
+# --- native FunctionGemma backend -----------------------------------------------------------------
+
+func _dispatch_native(job: Dictionary) -> bool:
+	if not Engine.has_singleton("AgentRuntime"):
+		return false
+	var runtime: Object = Engine.get_singleton("AgentRuntime")
+	if runtime == null or not runtime.has_method("resolve_tool_call") or not bool(runtime.call("is_model_loaded")):
+		return false
+	# The prompt is built here so the worker never reads the job while this thread writes task_id.
+	var prompt: String = LAFunctionGemmaClient.context_prompt(job["sig"], job["context"])
+	var task_id: int = WorkerThreadPool.add_task(_resolve_native.bind(job, prompt, runtime), false, "FunctionGemma escalation")
+	# Godot keeps a finished task's record until it is waited on; _finish collects it.
+	job["task_id"] = task_id
+	_llm_calls += 1
+	return true
+
+
+# Worker thread: the job only rides along to _finish, which runs back on the main thread.
+func _resolve_native(job: Dictionary, prompt: String, runtime: Object) -> void:
+	var result: Dictionary = runtime.call(
+		"resolve_tool_call", LAActionRegistry.tool_specs(), prompt, LAFunctionGemmaClient.native_options()
+	)
+	var action: String = String(result.get("name", "")) if bool(result.get("ok", false)) else ""
+	call_deferred("_finish", job, action, "llm")
+
+
 # --- heuristic teacher backend --------------------------------------------------------------------
 
 func _resolve_teacher(job: Dictionary) -> void:
@@ -195,6 +228,10 @@ func _teacher_action(sig: Dictionary, context: Dictionary) -> String:
 # --- shared resolution / feedback -----------------------------------------------------------------
 
 func _finish(job: Dictionary, action: String, source: String) -> void:
+	if job.has("task_id"):
+		# Native job: deferring this call was its task's last step, so the wait is momentary and frees the record.
+		WorkerThreadPool.wait_for_task_completion(int(job["task_id"]))
+		job.erase("task_id")
 	_in_flight = maxi(0, _in_flight - 1)
 	# Resolved: drop the exact in-flight mark but keep a lingering "thinking" glow so a fast (single-frame)
 	# consult is still visible for a moment after it lands.
@@ -79,6 +79,17 @@ static func build_request(model_name: String, sig: Dictionary, context: Dictiona
 	}
 
 
+## Options for AgentRuntime.resolve_tool_call(), the in-process counterpart of build_request(): the
+## same system prompt, temperature and token cap. The runtime forces the call itself, so there is no
+## tool_choice, and the reply comes back as {ok, name, arguments} rather than a completion to parse.
+static func native_options() -> Dictionary:
+	return {
+		"system_prompt": developer_prompt(),
+		"temperature": 0.3,
+		"max_tokens": 64,
+	}
+
+
 ## Extract the chosen function name from a parsed chat-completions response. Returns "" when the
 ## response contains no valid, known action. Prefers the structured `tool_calls`; falls back to
 ## scanning assistant content for a known action name (for non-jinja / inline-call servers).
@@ -162,11 +162,14 @@ func setup(_terrain, _actors_root: Node3D) -> void:
 		add_child(_cognition_sched)
 		if _cognition_sched.has_method("setup"):
 			# Point the slow brain at a running FunctionGemma llama-server if one is configured
-			# (env FUNCTIONGEMMA_URL); otherwise it uses the built-in heuristic teacher fallback.
+			# (env FUNCTIONGEMMA_URL), or at the model loaded in process (env FUNCTIONGEMMA_NATIVE=1);
+			# otherwise it uses the built-in heuristic teacher fallback.
 			var opts: Dictionary = {}
 			var url: String = OS.get_environment("FUNCTIONGEMMA_URL")
 			if url != "":
 				opts["server_url"] = url
+			if OS.get_environment("FUNCTIONGEMMA_NATIVE") == "1":
+				opts["native"] = true
 			_cognition_sched.setup(opts)
 
 
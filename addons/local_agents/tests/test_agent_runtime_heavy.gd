@@ -2,6 +2,7 @@
 extends RefCounted
 
 const TestModelHelper := preload("res://addons/local_agents/tests/test_model_helper.gd")
+const FunctionGemmaClient: GDScript = preload("res://addons/local_agents/scenes/simulation/voxel/cognition/FunctionGemmaClient.gd")
 
 func run_test(_tree: SceneTree) -> bool:
     if not Engine.has_singleton("AgentRuntime"):
@@ -30,6 +31,7 @@ func run_test(_tree: SceneTree) -> bool:
         "embedding": true,
         "max_tokens": 16,
         "n_gpu_layers": 0,
+        "n_seq": 2,
     })
     var loaded := bool(runtime.call("load_model", resolved_path, load_options))
     if not loaded:
@@ -83,14 +85,105 @@ func run_test(_tree: SceneTree) -> bool:
         var parsed: Dictionary = json_response.get("json", {})
         ok = ok and String(parsed.get("status", "")).strip_edges() != ""
 
+    var batch_requests: Array = []
+    for word in ["yes", "no"]:
+        batch_requests.append({
+            "prompt": "Reply with exactly one word: %s." % word,
+            "options": {"max_tokens": model_helper.max_tokens_for_tests(8), "temperature": 0.0},
+        })
+    var batch_responses: Array = runtime.call("generate_many", batch_requests)
+    ok = ok and _assert(batch_responses.size() == 2, "generate_many returned %d responses" % batch_responses.size())
+    for batch_response in batch_responses:
+        ok = ok and _assert(bool(batch_response.get("ok", false)), "Batched generation failed: %s" % JSON.stringify(batch_response))
+
+    var hits_before: int = int(runtime.call("get_runtime_metrics").get("generation_cache_hits", 0))
+    var repeated: Dictionary = runtime.call("generate", batch_requests[0])
+    var hits_after: int = int(runtime.call("get_runtime_metrics").get("generation_cache_hits", 0))
+    ok = ok and _assert(bool(repeated.get("cached", false)), "Repeated greedy request was not served from the generation cache")
+    ok = ok and _assert(hits_after == hits_before + 1, "generation_cache_hits did not advance (%d -> %d)" % [hits_before, hits_after])
+
+    # Cache keys name adapters by id, so unloading one must retire the results it produced.
+    var lora_path := OS.get_environment("LOCAL_AGENTS_TEST_LORA").strip_edges()
+    if lora_path != "" and FileAccess.file_exists(_normalize_path(lora_path)):
+        var lora_request: Dictionary = {
+            "prompt": "Reply with exactly one word: yes.",
+            "options": {"max_tokens": model_helper.max_tokens_for_tests(8), "temperature": 0.0, "lora": "heavy_test"},
+        }
+        ok = ok and _assert(bool(runtime.call("load_lora", _normalize_path(lora_path), "heavy_test")), "load_lora failed for %s" % lora_path)
+        var with_lora: Dictionary = runtime.call("generate", lora_request)
+        ok = ok and _assert(bool(with_lora.get("ok", false)), "Generation with a LoRA failed: %s" % JSON.stringify(with_lora))
+        runtime.call("unload_lora", "heavy_test")
+        var after_unload: Dictionary = runtime.call("generate", lora_request)
+        ok = ok and _assert(not bool(after_unload.get("ok", false)) and not bool(after_unload.get("cached", false)),
+            "Request naming an unloaded LoRA was answered from the cache: %s" % JSON.stringify(after_unload))
+        ok = ok and _assert(String(after_unload.get("error", "")).begins_with("unknown_lora"), "Unloaded LoRA did not report unknown_lora: %s" % JSON.stringify(after_unload))
+
+    var tool_specs: Array = [{
+        "type": "function",
+        "function": {"name": "rest", "description": "Lie down and recover energy.", "parameters": {"type": "object", "properties": {}}},
+    }]
+    var chat_body: Dictionary = FunctionGemmaClient.build_request("local", {"e": 1, "h": 2}, {"species": "deer"}, tool_specs)
+    chat_body["backend"] = "inprocess"
+    var chat: Dictionary = runtime.call("generate", chat_body)
+    var completion: Dictionary = chat.get("response", {})
+    ok = ok and _assert(bool(chat.get("ok", false)), "In-process chat completion failed: %s" % JSON.stringify(chat))
+    ok = ok and _assert(String(chat.get("provider", "")) == "inprocess", "In-process response has the wrong provider")
+    ok = ok and _assert(Array(completion.get("choices", [])).size() == 1 and completion.has("usage"), "In-process body lacks choices/usage")
+
+    var tool_options: Dictionary = FunctionGemmaClient.native_options()
+    tool_options["temperature"] = 0.0
+    var call: Dictionary = runtime.call("resolve_tool_call", tool_specs, FunctionGemmaClient.context_prompt({"e": 1, "h": 2}, {"species": "deer"}), tool_options)
+    ok = ok and _assert(bool(call.get("ok", false)) and String(call.get("name", "")) == "rest", "resolve_tool_call did not pick the only tool: %s" % JSON.stringify(call))
+
+    var handle: RefCounted = runtime.call("begin_generation", {
+        "prompt": "Count from one to five.",
+        "options": {"max_tokens": model_helper.max_tokens_for_tests(16), "temperature": 0.0, "batch_size": 8},
+    })
+    var steps: int = 0
+    # A 1 usec budget stops after every unit of work, so even one token takes several steps.
+    while not bool(handle.call("step", 1)) and steps < 100000:
+        steps += 1
+    var status: Dictionary = handle.call("poll")
+    var stepped: Dictionary = handle.call("get_response")
+    ok = ok and _assert(bool(status.get("done", false)), "GenerationHandle did not finish")
+    ok = ok and _assert(bool(stepped.get("ok", false)), "Stepped generation failed: %s" % JSON.stringify(stepped))
+    ok = ok and _assert(steps > 0, "GenerationHandle finished in one step despite a 1us budget")
+
     if not ok:
         push_error("Heavy generation response invalid: %s | json=%s" % [JSON.stringify(response), JSON.stringify(json_response)])
 
+    # More sequences than batch slots: each decode step must split across several batches.
+    runtime.call("unload_model")
+    var narrow_options = model_helper.apply_runtime_overrides({
+        "context_size": 256,
+        "batch_size": 4,
+        "n_seq": 8,
+        "n_gpu_layers": 0,
+    })
+    if _assert(bool(runtime.call("load_model", resolved_path, narrow_options)), "Failed to reload with n_seq > batch_size"):
+        var narrow_requests: Array = []
+        for i in range(6):
+            narrow_requests.append({
+                "prompt": "Say %d." % i,
+                "options": {"max_tokens": model_helper.max_tokens_for_tests(4), "temperature": 0.0},
+            })
+        var narrow_responses: Array = runtime.call("generate_many", narrow_requests)
+        ok = ok and _assert(narrow_responses.size() == narrow_requests.size(), "generate_many with n_seq > batch_size returned %d responses" % narrow_responses.size())
+        for narrow_response in narrow_responses:
+            ok = ok and _assert(bool(narrow_response.get("ok", false)), "Generation with n_seq > batch_size failed: %s" % JSON.stringify(narrow_response))
+    else:
+        ok = false
+
     runtime.call("unload_model")
     if ok:
         print("Local Agents heavy runtime test passed")
     return ok
 
+func _assert(condition: bool, message: String) -> bool:
+    if not condition:
+        push_error(message)
+    return condition
+
 func _normalize_path(path: String) -> String:
     if path.begins_with("res://") or path.begins_with("user://"):
         return ProjectSettings.globalize_path(path)
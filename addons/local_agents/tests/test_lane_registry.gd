@@ -11,6 +11,7 @@ const DETERMINISTIC_TESTS: Array[String] = [
 	"res://addons/local_agents/tests/test_agent_utilities.gd",
 	"res://addons/local_agents/tests/test_synth_dsp.gd",
 	"res://addons/local_agents/tests/test_audio_music.gd",
+	"res://addons/local_agents/tests/test_runtime_metrics.gd",
 ]
 
 const INTEGRATION_TESTS: Array[String] = []
@@ -41,6 +41,16 @@ func run_test(tree: SceneTree) -> bool:
     var text := String(result.get("text", "")).strip_edges()
     ok = ok and text.length() > 0
 
+    # Replies are decoded natively: only the envelope's fields by default, everything with raw.
+    var runtime := Engine.get_singleton("AgentRuntime")
+    var trimmed: Dictionary = runtime.call("generate", {"prompt": "Reply with one word.", "options": server_options})
+    var raw_options: Dictionary = server_options.duplicate()
+    raw_options["raw"] = true
+    var full: Dictionary = runtime.call("generate", {"prompt": "Reply with one word.", "options": raw_options})
+    ok = ok and bool(trimmed.get("ok", false)) and not Dictionary(trimmed.get("response", {})).has("timings")
+    ok = ok and typeof(trimmed.get("usage", null)) == TYPE_DICTIONARY
+    ok = ok and bool(full.get("ok", false)) and String(full.get("raw", "")).length() > 0
+
     var stopped: Dictionary = agent.stop_managed_llama_server()
     ok = ok and bool(stopped.get("ok", false))
 
@@ -0,0 +1,71 @@
+@tool
+extends RefCounted
+
+const ExtensionLoader: GDScript = preload("res://addons/local_agents/runtime/LocalAgentsExtensionLoader.gd")
+const TEST_DIR: String = "user://tests"
+const EXPECTED_KEYS: Array[String] = [
+    "queue_depth",
+    "in_flight",
+    "ttft_ms_p50",
+    "ttft_ms_p99",
+    "tokens_per_second",
+    "kv_occupancy",
+    "embedding_cache_hits",
+    "generation_cache_hits",
+    "graph_query_ms_p50",
+    "transcribe_ms_p99",
+    "tts_cache_hits",
+]
+
+func run_test(_tree: SceneTree) -> bool:
+    if not ExtensionLoader.ensure_initialized():
+        push_error("Runtime metrics test requires the extension: %s" % ExtensionLoader.get_error())
+        return false
+    var runtime: Object = Engine.get_singleton("AgentRuntime")
+    if runtime == null:
+        push_error("AgentRuntime singleton missing.")
+        return false
+
+    var ok: bool = true
+    runtime.call("reset_runtime_metrics")
+    var metrics: Dictionary = runtime.call("get_runtime_metrics")
+    for key in EXPECTED_KEYS:
+        ok = ok and _assert(metrics.has(key), "Runtime metrics missing key %s" % key)
+    ok = ok and _assert(int(metrics.get("requests_total", -1)) == 0, "reset_runtime_metrics did not clear counters")
+    ok = ok and _assert(int(metrics.get("queue_depth", -1)) == 0, "Idle runtime reports queued requests")
+
+    runtime.call("register_performance_monitors")
+    ok = ok and _assert(Performance.has_custom_monitor("LocalAgents/queue_depth"), "Performance monitor not registered")
+    ok = ok and _assert(Performance.has_custom_monitor("LocalAgents/ttft_ms_p99"), "TTFT monitor not registered")
+
+    DirAccess.make_dir_recursive_absolute(ProjectSettings.globalize_path(TEST_DIR))
+    var db_path: String = ProjectSettings.globalize_path(TEST_DIR.path_join("metrics_graph_%d.sqlite3" % Time.get_ticks_msec()))
+    var graph: NetworkGraph = NetworkGraph.new()
+    if graph.open(db_path):
+        var node_id: int = graph.upsert_node("metrics", "probe", {})
+        var queries_before: int = int(runtime.call("get_runtime_metrics").get("graph_queries", -1))
+        for i in range(8):
+            graph.get_node(node_id)
+        graph.close()
+        metrics = runtime.call("get_runtime_metrics")
+        var sampled: int = int(metrics.get("graph_queries", -1)) - queries_before
+        ok = ok and _assert(sampled == 8, "Expected 8 sampled graph queries, got %d" % sampled)
+    DirAccess.remove_absolute(db_path)
+
+    var trace_path: String = ProjectSettings.globalize_path(TEST_DIR.path_join("trace_%d.latrace" % Time.get_ticks_msec()))
+    ok = ok and _assert(bool(runtime.call("start_trace", trace_path)), "start_trace failed")
+    ok = ok and _assert(bool(runtime.call("is_tracing")), "Runtime not tracing after start_trace")
+    var trace_summary: Dictionary = runtime.call("stop_trace")
+    ok = ok and _assert(not bool(runtime.call("is_tracing")), "Runtime still tracing after stop_trace")
+    ok = ok and _assert(int(trace_summary.get("records", -1)) == 0, "Idle trace recorded requests")
+    ok = ok and _assert(FileAccess.file_exists(trace_path), "Trace file not written")
+    DirAccess.remove_absolute(trace_path)
+
+    if ok:
+        print("Local Agents runtime metrics test passed")
+    return ok
+
+func _assert(condition: bool, message: String) -> bool:
+    if not condition:
+        push_error(message)
+    return condition
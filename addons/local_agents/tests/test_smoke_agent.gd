@@ -40,6 +40,53 @@ func run_test(tree: SceneTree) -> bool:
     history = agent.get("history")
     ok = ok and _assert(history is Array and history.is_empty(), "History clear failed")
 
+    var evicted: Array = []
+    agent_node.connect("history_evicted", func(messages: Array) -> void: evicted.append_array(messages))
+    agent_node.set("max_history_tokens", 32)
+    for i in range(12):
+        agent_node.call("add_message", "user", "message number %d with some padding text" % i)
+    var window: Array = agent_node.call("get_history")
+    ok = ok and _assert(int(agent_node.call("get_history_tokens")) <= 32, "History window exceeded max_history_tokens")
+    ok = ok and _assert(not evicted.is_empty(), "history_evicted not emitted")
+    ok = ok and _assert(window.size() + evicted.size() == 12, "Evicted and kept messages do not add up")
+    agent_node.call("clear_history")
+
+    var scheduler: Object = Engine.get_singleton("AgentScheduler")
+    var ticks: Array = [0]
+    var count_tick: Callable = func(action: String, _params: Dictionary) -> void:
+        if action == "tick":
+            ticks[0] += 1
+    agent_node.connect("action_requested", count_tick)
+    agent_node.set("tick_interval", 0.05)
+    agent_node.set("tick_enabled", true)
+    ok = ok and _assert(bool(scheduler.call("is_registered", agent_node)), "Ticking AgentNode not registered with AgentScheduler")
+    for i in range(20):
+        scheduler.call("advance", 0.01)
+    ok = ok and _assert(ticks[0] >= 3, "AgentScheduler ticked %d times in 0.2s at a 0.05s interval" % ticks[0])
+    agent_node.set("tick_enabled", false)
+    ok = ok and _assert(not bool(scheduler.call("is_registered", agent_node)), "Disabled AgentNode still scheduled")
+
+    var actions: Array = []
+    var record_action: Callable = func(action: String, params: Dictionary) -> void:
+        if action != "tick":
+            actions.append(params)
+    agent_node.connect("action_requested", record_action)
+    agent_node.set("max_actions_per_tick", 2)
+    agent_node.set("tick_enabled", true)
+    agent_node.call("enqueue_action", "wave", {})
+    agent_node.call("enqueue_action", "flee", {}, {"priority": 5})
+    agent_node.call("enqueue_action", "move", {"to": "door"}, {"coalesce_key": "move"})
+    agent_node.call("enqueue_action", "move", {"to": "well"}, {"coalesce_key": "move"})
+    ok = ok and _assert(actions.is_empty(), "enqueue_action emitted before the next tick")
+    scheduler.call("advance", 0.06)
+    ok = ok and _assert(actions.size() == 2, "Tick drained %d actions, expected max_actions_per_tick" % actions.size())
+    ok = ok and _assert(actions.size() == 2 and actions[0].get("name") == "flee" and actions[1].get("name") == "wave", "Queued actions out of priority order")
+    scheduler.call("advance", 0.06)
+    ok = ok and _assert(actions.size() == 3 and actions[2].get("to") == "well", "Coalesced action missing or stale")
+    ok = ok and _assert(int(agent_node.call("get_pending_action_count")) == 0, "Action queue not empty")
+    agent_node.disconnect("action_requested", record_action)
+    agent_node.set("tick_enabled", false)
+
     agent.queue_free()
     manager.queue_free()
 
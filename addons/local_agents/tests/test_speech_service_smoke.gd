@@ -23,6 +23,27 @@ func run_test(_tree: SceneTree) -> bool:
     ok = ok and not bool(transcribe_result.get("ok", false))
     ok = ok and String(transcribe_result.get("error", "")) in ["missing_input_path", "runtime_missing"]
 
+    if Engine.has_singleton("AgentRuntime"):
+        var runtime: Object = Engine.get_singleton("AgentRuntime")
+        if runtime != null and runtime.has_method("transcribe_pcm"):
+            var job_id: int = int(runtime.call("transcribe_pcm", PackedFloat32Array(), 16000, {}))
+            ok = ok and job_id == 0
+        if runtime != null and runtime.has_method("begin_speech"):
+            var stream: Object = runtime.call("begin_speech", {"text": "hello", "voice_path": ""})
+            ok = ok and stream != null and bool(stream.call("is_finished"))
+            ok = ok and String(stream.call("get_error")) == "missing_voice_path"
+        if runtime != null and runtime.has_method("create_speech_listener"):
+            var listener: Object = runtime.call("create_speech_listener", {"sample_rate": 16000})
+            var silence := PackedFloat32Array()
+            silence.resize(16000)
+            ok = ok and int(listener.call("push_pcm", silence)) == 0
+            ok = ok and not bool(listener.call("is_speaking"))
+            ok = ok and is_equal_approx(float(listener.call("get_stats").get("seconds_heard", 0.0)), 1.0)
+        if runtime != null and runtime.has_method("prewarm_speech"):
+            var prewarm: Dictionary = runtime.call("prewarm_speech", ["hello"], {"voice_path": ""})
+            ok = ok and not bool(prewarm.get("ok", true))
+            ok = ok and String(prewarm.get("error", "")) == "missing_voice_path"
+
     var report: Dictionary = RuntimePaths.voice_asset_report("definitely-missing-voice-id")
     ok = ok and not bool(report.get("ok", false))
     ok = ok and String(report.get("error", "")) == "voice_missing"